@@ -45,6 +45,16 @@ protected:
   
   /** Event processing must be specified in derived class */
   virtual void process() = 0;
+  /** Process a block of loop iterations: `events` holds the events of each
+    * iteration in turn, one per device. By default the iterations are passed
+    * to `process` one at a time. */
+  virtual void processBatch(const std::vector<const Storage::Event*>& events);
+
+private:
+  /** Const copy of the events of a block, re-used from block to block */
+  std::vector<const Storage::Event*> m_batch;
+  /** Analyzers which must run before this one on each event */
+  std::vector<const Analyzer*> m_dependencies;
 
 public:
   /** Constructor for an analyzer which doesn't use device information */
@@ -67,9 +77,39 @@ public:
   void execute(const std::vector<const Storage::Event*>& events);
   /** Single device event execution */
   void execute(const Storage::Event& event);
+  /** Execution on a block of loop iterations, with the events of each
+    * iteration in turn (one per device) */
+  void executeBatch(const std::vector<Storage::Event*>& events);
+  /** Block execution with const events */
+  void executeBatch(const std::vector<const Storage::Event*>& events);
 
   /** Post processing */
   virtual void finalize();
+
+  /** Make a new analyzer with the same devices and configuration, but none
+    * of the accumulated data, to run on another thread of a parallel loop.
+    * Caller takes ownership. Throws if the analyzer can't run in parallel. */
+  virtual Analyzer* clone() const;
+  /** Accumulate the data of `other`, a clone of this analyzer, as though its
+    * events were processed after those of this analyzer. The base method adds
+    * up the histograms in `m_histograms`. */
+  virtual void merge(const Analyzer& other);
+
+  /** True if the analyzer only reads the events and devices, and writes only
+    * its own members, so that it can run alongside other such analyzers on
+    * the same event. The base analyzer makes no such promise. */
+  virtual bool isReadOnly() const { return false; }
+  /** Require `analyzer` to finish each event before this one runs on it */
+  void addDependency(const Analyzer& analyzer);
+  const std::vector<const Analyzer*>& getDependencies() const {
+    return m_dependencies; }
+
+  /** Append the mean and RMS of the accumulated distributions, used by
+    * loopers to stop once they are stable. The base method gives those of the
+    * 1D histograms in `m_histograms` which have entries. */
+  virtual void getMoments(
+      std::vector<double>& means,
+      std::vector<double>& sigmas) const;
 };
 
 }
@@ -0,0 +1,57 @@
+#ifndef ANA_CLUSTERPATTERNS_H
+#define ANA_CLUSTERPATTERNS_H
+
+#include <string>
+
+#include "storage/clusterdictionary.h"
+#include "analyzers/analyzer.h"
+
+namespace Analyzers {
+
+/**
+  * Gather the shapes of the clusters on all planes of all devices into a
+  * cluster dictionary, over a calibration run. The dictionary's patterns are
+  * built from the most frequent shapes when the analyzer is finalized.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class ClusterPatterns : public Analyzer {
+private:
+  ClusterPatterns(const ClusterPatterns&);
+  ClusterPatterns& operator=(const ClusterPatterns&);
+
+  /** Shapes seen so far, and the patterns once finalized */
+  Storage::ClusterDictionary m_dictionary;
+
+  /** Base virtual method defined, gives code to run at each loop */
+  void process();
+
+public:
+  /** Keep up to this many patterns */
+  size_t m_maxPatterns;
+  /** Only keep shapes seen at least this many times */
+  ULong64_t m_minCount;
+
+  /** Only needs the clusters, not the devices */
+  ClusterPatterns(size_t ndevices=1) :
+      Analyzer(ndevices),
+      m_maxPatterns(256),
+      m_minCount(10) {}
+  ~ClusterPatterns() {}
+
+  /** Build the patterns from the shapes seen */
+  void finalize();
+
+  Analyzer* clone() const;
+  /** Only adds to its own dictionary */
+  bool isReadOnly() const { return true; }
+  /** Add the shapes seen by the clone */
+  void merge(const Analyzer& other);
+
+  const Storage::ClusterDictionary& getDictionary() const {
+    return m_dictionary; }
+};
+
+}
+
+#endif  // ANA_CLUSTERPATTERNS_H
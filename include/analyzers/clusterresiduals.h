@@ -9,6 +9,7 @@
 
 #include "analyzers/analyzer.h"
 
+namespace Storage { class Event; }
 namespace Mechanics { class Device; }
 
 namespace Analyzers {
@@ -37,8 +38,20 @@ private:
   /** Constructor calls this to initialize memory */
   void initialize();
 
+  /** Residuals of the events so far in a block, for each histogram. They
+    * are filled all at once at the end of the block. */
+  std::vector<std::vector<double> > m_bufferX;
+  std::vector<std::vector<double> > m_bufferY;
+
+  /** Add the residuals of the events of one loop iteration to the buffers */
+  void collect(const Storage::Event* const* events);
+  /** Fill the histograms with the buffered residuals, and clear them */
+  void flush();
+
   /** Base virtual method defined, gives code to run at each loop */
   void process();
+  /** Collect the residuals of the whole block, then fill each histogram */
+  void processBatch(const std::vector<const Storage::Event*>& events);
 
 public:
   /** Automatically calls the correct base constuctor */
@@ -46,6 +59,10 @@ public:
   ClusterResiduals(const T& t) : Analyzer(t) { initialize(); }
   ~ClusterResiduals() {}
 
+  Analyzer* clone() const { return new ClusterResiduals(m_devices); }
+  /** Fills only its own residual histograms */
+  bool isReadOnly() const { return true; }
+
   void setOutput(TDirectory* dir, const std::string& name="ClusterResiduals") {
     // Just adds the default name
     Analyzer::setOutput(dir, name);
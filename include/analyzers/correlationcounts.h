@@ -0,0 +1,110 @@
+#ifndef ANA_CORRELATIONCOUNTS
+#define ANA_CORRELATIONCOUNTS
+
+#include <vector>
+#include <string>
+
+#include <TH2D.h>
+
+namespace Analyzers {
+
+/**
+  * Integer counts of a 2D correlation between pixel coordinates, filled by
+  * index arithmetic instead of `TH2::Fill`. Pixels are grouped `rebin` at a
+  * time on both axes. Optionally only a band of bins along the expected
+  * correlation is kept for each x bin, so that memory grows with the number
+  * of columns rather than its square.
+  *
+  * Entries outside the range go to the under/overflow bins as `TH2::Fill`
+  * would put them. Entries in range but outside the band go to the y
+  * under/overflow bin of their x bin, below or above the band, so that the
+  * histogram still accounts for every entry.
+  *
+  * A ROOT histogram is made from the counts once they are complete.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class CorrelationCounts {
+private:
+  /** Number of pixels on each axis, and of bins after rebinning */
+  unsigned m_npixX;
+  unsigned m_npixY;
+  unsigned m_rebin;
+  unsigned m_nbinsX;
+  unsigned m_nbinsY;
+  /** Number of y bins kept for each x bin, and the first of them */
+  unsigned m_width;
+  std::vector<unsigned> m_first;
+  /** Counts of the kept bins, `m_width` for each x bin in turn */
+  std::vector<unsigned> m_counts;
+  /** Entries below and above the band (or y range) of each x bin */
+  std::vector<unsigned> m_below;
+  std::vector<unsigned> m_above;
+  /** Entries below and above the x range, by ROOT y bin (0 is underflow) */
+  std::vector<unsigned> m_underX;
+  std::vector<unsigned> m_overX;
+
+  /** Count an entry whose `x` is outside the range */
+  void fillOutsideX(double x, double y);
+
+public:
+  /** Counts for `npixX` by `npixY` pixels, grouped `rebin` at a time */
+  CorrelationCounts(unsigned npixX, unsigned npixY, unsigned rebin=1);
+
+  /** Keep only the y bins within `halfWidth` of `centers[ix]` for each x bin
+    * `ix`. Centers are in units of (rebinned) y bins. Must be set before
+    * filling. */
+  void setBand(const std::vector<double>& centers, unsigned halfWidth);
+
+  /** Count one entry at pixel coordinates `x`, `y` */
+  void fill(double x, double y) {
+    // Comparing as double first keeps the casts in range, and sends NaN to
+    // the overflow as ROOT does
+    if (!(x >= 0 && x < m_npixX)) {
+      fillOutsideX(x, y);
+      return;
+    }
+    const unsigned ix = static_cast<unsigned>(x) / m_rebin;
+    if (y < 0) {
+      m_below[ix] += 1;
+      return;
+    }
+    if (!(y < m_npixY)) {
+      m_above[ix] += 1;
+      return;
+    }
+    const unsigned iy = static_cast<unsigned>(y) / m_rebin;
+    if (iy < m_first[ix])
+      m_below[ix] += 1;
+    else if (iy - m_first[ix] >= m_width)
+      m_above[ix] += 1;
+    else
+      m_counts[ix*m_width + iy-m_first[ix]] += 1;
+  }
+
+  /** Add the counts of `other`, which must have the same binning */
+  void add(const CorrelationCounts& other);
+  /** Clear the counts, keeping the binning and band */
+  void reset();
+  /** True if nothing was counted, in or out of the kept bins */
+  bool isEmpty() const;
+
+  /** Count in the bin `ix`, `iy` (rebinned, from 0), 0 if not kept */
+  unsigned getCount(unsigned ix, unsigned iy) const;
+  /** Number of entries outside the range or band */
+  unsigned long long getNumOutside() const;
+  unsigned getNumBinsX() const { return m_nbinsX; }
+  unsigned getNumBinsY() const { return m_nbinsY; }
+  unsigned getRebin() const { return m_rebin; }
+  /** Number of bins actually stored */
+  size_t getNumStored() const { return m_counts.size(); }
+
+  /** Make a new histogram of the counts, in pixel units, with errors from
+    * the counts. Entries outside the range or band are in the under/overflow
+    * bins. Caller takes ownership. */
+  TH2D* makeHistogram(const std::string& name, const std::string& title) const;
+};
+
+}
+
+#endif  // ANA_CORRELATIONCOUNTS
@@ -8,8 +8,9 @@
 #include <TH2D.h>
 
 #include "analyzers/analyzer.h"
+#include "analyzers/correlationcounts.h"
 
-namespace Mechanics { class Device; }
+namespace Mechanics { class Device; class Sensor; }
 
 namespace Analyzers {
 
@@ -18,6 +19,13 @@ namespace Analyzers {
   * difference of all clusters on adjeacent planes in the reference device,
   * or to the nearest reference plane in the DUTs.
   *
+  * The pairs are counted in compact integer counters (see
+  * `CorrelationCounts`), optionally rebinned and restricted to a band around
+  * the correlation expected from the current alignment. The histograms are
+  * made from the counts when the analyzer is finalized: unlike the other
+  * analyzers, `getCorrelationX` and `getCorrelationY` throw until then, so
+  * read the counts (`getCountsX`, `getCountsY`) while looping.
+  *
   * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
   */
 class Correlations : public Analyzer {
@@ -30,8 +38,23 @@ private:
   /** For each plane, gives the global index (device + plane) of the plane
     * relative to which it will be correlated */
   std::vector<size_t> m_irelative;
+  /** All sensors in their global order */
+  std::vector<const Mechanics::Sensor*> m_sensors;
+
+  /** Pixels grouped in each bin, and the half width of the band of bins
+    * kept around the expected correlation (0 keeps all bins) */
+  unsigned m_rebin;
+  unsigned m_halfWidth;
+
+  // Counts for each plane, one for each axis
+  std::vector<CorrelationCounts> m_countsX;
+  std::vector<CorrelationCounts> m_countsY;
 
-  // Keep track of each plane's histograms, one for each content type
+  /** Where the histograms go once they are made */
+  TDirectory* m_output;
+
+  // Keep track of each plane's histograms, one for each content type. Only
+  // filled at finalize.
   std::vector<TH2D*> m_hCorrelationsX;
   std::vector<TH2D*> m_hCorrelationsY;
 
@@ -40,6 +63,8 @@ private:
 
   /** Constructor calls this to initialize memory */
   void initialize();
+  /** Make the counters with the current binning */
+  void initializeCounts();
 
   /** Base virtual method defined, gives code to run at each loop */
   void process();
@@ -47,15 +72,37 @@ private:
 public:
   /** Automatically calls the correct base constuctor */
   template <class T>
-  Correlations(const T& t) : Analyzer(t) { initialize(); }
+  Correlations(const T& t) :
+      Analyzer(t),
+      m_rebin(1),
+      m_halfWidth(0),
+      m_output(0) {
+    initialize();
+  }
   /** Memory managed by base class */
   ~Correlations() {}
 
-  void setOutput(TDirectory* dir, const std::string& name="Correlations") {
-    // Just adds the default name
-    Analyzer::setOutput(dir, name);
-  }
+  Analyzer* clone() const;
+  /** Only fills its own correlation counts */
+  bool isReadOnly() const { return true; }
+
+  /** Group `rebin` pixels per bin and, if `halfWidth` is above 0, keep only
+    * the bins within `halfWidth` (rebinned) of the correlation expected from
+    * the device alignment. The band must be wide enough to cover the
+    * misalignment being sought. Call before any event is processed. */
+  void setBinning(unsigned rebin, unsigned halfWidth);
+
+  /** Remembers the output, the histograms are made at finalize */
+  void setOutput(TDirectory* dir, const std::string& name="Correlations");
+  /** Make the histograms from the counts */
+  void finalize();
+  /** Add up the counts of a clone */
+  void merge(const Analyzer& other);
+
+  const CorrelationCounts& getCountsX(size_t idevice, size_t isensor) const;
+  const CorrelationCounts& getCountsY(size_t idevice, size_t isensor) const;
 
+  /** Histograms of the correlations, throw before finalize */
   TH2D& getCorrelationX(size_t idevice, size_t isensor) const;
   TH2D& getCorrelationY(size_t idevice, size_t isensor) const;
 };
@@ -0,0 +1,99 @@
+#ifndef ANA_NOISESCAN_H
+#define ANA_NOISESCAN_H
+
+#include <vector>
+#include <string>
+
+#include <Rtypes.h>
+#include <TDirectory.h>
+#include <TH2D.h>
+
+#include "analyzers/analyzer.h"
+
+namespace Mechanics { class Device; }
+
+namespace Analyzers {
+
+/**
+  * Count the hits in each pixel of every sensor over a run. The rate of hits
+  * per event gives the noise profile of the sensors, and pixels firing above
+  * `m_maxRate` are flagged for masking.
+  *
+  * Counters are kept in one flat array per sensor, in the pixel order of
+  * `Mechanics::Sensor::getPixelIndex`. The histograms are only made from
+  * them when finalizing, so that clones don't carry their own.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class NoiseScan : public Analyzer {
+private:
+  NoiseScan(const NoiseScan&);
+  NoiseScan& operator=(const NoiseScan&);
+
+  /** Number of events counted */
+  ULong64_t m_nevents;
+  /** Hit count of each pixel, for each sensor in the global order (devices
+    * then sensors) */
+  std::vector<std::vector<unsigned> > m_counts;
+
+  /** Where the histograms go once they are made */
+  TDirectory* m_output;
+
+  /** Map of the hit rate in each pixel, for each sensor. Only filled at
+    * finalize. */
+  std::vector<TH2D*> m_hOccupancy;
+
+  /** Find the global id of the sensor of a given device */
+  size_t toGlobal(size_t idevice, size_t isensor) const;
+
+  /** Constructor calls this to initialize memory */
+  void initialize();
+
+  /** Base virtual method defined, gives code to run at each loop */
+  void process();
+
+public:
+  /** Pixels with more hits per event than this are masked */
+  double m_maxRate;
+
+  /** Automatically calls the correct base constuctor */
+  template <class T>
+  NoiseScan(const T& t) :
+      Analyzer(t),
+      m_nevents(0),
+      m_output(0),
+      m_maxRate(0.01) {
+    initialize();
+  }
+  /** Memory managed by base class */
+  ~NoiseScan() {}
+
+  /** Remembers the output, the histograms are made at finalize */
+  void setOutput(TDirectory* dir, const std::string& name="NoiseScan");
+
+  /** Make the occupancy maps from the counters */
+  void finalize();
+
+  Analyzer* clone() const;
+  /** Counts hits into its own pixel counters only */
+  bool isReadOnly() const { return true; }
+  /** Add up the counters of the clone */
+  void merge(const Analyzer& other);
+
+  /** Number of events counted so far */
+  ULong64_t getNumEvents() const { return m_nevents; }
+  /** Compute the hit rate of each pixel in a sensor and flag those above
+    * `m_maxRate`. Pixel order is given by `Sensor::getPixelIndex`. */
+  void getNoise(
+      size_t idevice,
+      size_t isensor,
+      std::vector<double>& profile,
+      std::vector<bool>& mask) const;
+
+  /** Map of the hit rates, only available after finalize */
+  TH2D& getOccupancy(size_t idevice, size_t isensor) const;
+};
+
+}
+
+#endif  // ANA_NOISESCAN_H
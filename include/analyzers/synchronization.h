@@ -25,9 +25,9 @@ class Synchronization : public Analyzer {
 private:
   const static size_t s_maxStats = 1000;
 
-  /** Time difference between consecutive triggers for device 1 */
+  /** Time stamps of the processed events for device 1 */
   std::vector<ULong64_t> m_times1;
-  /** Time difference between consecutive triggers for device 2 */
+  /** Time stamps of the processed events for device 2 */
   std::vector<ULong64_t> m_times2;
   /** Which device 1 events to write out */
   std::vector<bool> m_write1;
@@ -57,6 +57,10 @@ private:
   /** Base virtual method defined, gives code to run at each loop */
   void process();
 
+  /** Compute the clock ratio and spacing statistics from the first time
+    * stamps, up to the first desynchronized event */
+  void computeStats();
+
 public:
   /** Ratio of device 2 time to device 1 time */
   double m_ratio;
@@ -98,6 +102,12 @@ public:
   /** Process the time staps for synchronization status */
   void finalize();
 
+  Analyzer* clone() const;
+  /** Collects the time stamps into its own lists only */
+  bool isReadOnly() const { return true; }
+  /** Append the time stamps of the clone */
+  void merge(const Analyzer& other);
+
   /** Returns whether or not `ievent` should be written from device 1 */
   bool writeStatus1(size_t ievent) const { return m_write1[ievent]; }
   /** Returns whether or not `ievent` should be written from device 2 */
@@ -7,6 +7,8 @@
 
 #include "analyzers/analyzer.h"
 
+class TH1D;
+
 namespace Mechanics { class Device; }
 namespace Mechanics { class Sensor; }
 
@@ -28,6 +30,8 @@ public:
   struct Cluster {
     /** Pointer to the sensor which aligns this cluster */
     const Mechanics::Sensor* sensor;
+    /** Index of that sensor in its device */
+    const size_t isensor;
     /** Cluster location in local pixel coordinates */
     const double pixX;
     const double pixY;
@@ -36,11 +40,13 @@ public:
     /** Initialization of members on construction */
     Cluster(
         const Mechanics::Sensor& sensor, 
+        size_t isensor,
         double pixX,
         double pixY,
         double pixErrX,
         double pixErrY) :
         sensor(&sensor),
+        isensor(isensor),
         pixX(pixX),
         pixY(pixY),
         pixErrX(pixErrX),
@@ -69,6 +75,9 @@ private:
   std::list<Cluster> m_clusters;
   /** Keep track of cluster index for last added */
   size_t m_icluster;
+  /** Distribution of the reference tracks' chi^2, tells when enough tracks
+    * were collected */
+  TH1D* m_hChi2;
 
   /** Number of planes in the reference device */
   size_t m_numRefPlanes;
@@ -87,12 +96,19 @@ public:
   TrackChi2(const T& t) :
       Analyzer(t),
       m_icluster(0),
+      m_hChi2(0),
       m_numRefPlanes(0),
       m_numDUTPlanes(0) {
     initialize();
   }
   ~TrackChi2() {}
 
+  Analyzer* clone() const { return new TrackChi2(m_devices); }
+  /** Fills only its own chi^2 histogram and track and cluster lists */
+  bool isReadOnly() const { return true; }
+  /** Append the tracks and clusters of the clone */
+  void merge(const Analyzer& other);
+
   void setOutput(TDirectory* dir, const std::string& name="TrackChi2") {
     // Just adds the default name
     Analyzer::setOutput(dir, name);
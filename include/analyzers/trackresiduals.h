@@ -10,6 +10,7 @@
 
 #include "analyzers/analyzer.h"
 
+namespace Storage { class Event; }
 namespace Mechanics { class Device; }
 
 namespace Analyzers {
@@ -35,8 +36,20 @@ private:
   /** Constructor calls this to initialize memory */
   void initialize();
 
+  /** Residuals of the events so far in a block, for each histogram. They
+    * are filled all at once at the end of the block. */
+  std::vector<std::vector<double> > m_bufferX;
+  std::vector<std::vector<double> > m_bufferY;
+
+  /** Add the residuals of the events of one loop iteration to the buffers */
+  void collect(const Storage::Event* const* events);
+  /** Fill the histograms with the buffered residuals, and clear them */
+  void flush();
+
   /** Base virtual method defined, gives code to run at each loop */
   void process();
+  /** Collect the residuals of the whole block, then fill each histogram */
+  void processBatch(const std::vector<const Storage::Event*>& events);
 
 public:
   /** Automatically calls the correct base constuctor */
@@ -44,6 +57,10 @@ public:
   TrackResiduals(const T& t) : Analyzer(t) { initialize(); }
   ~TrackResiduals() {}
 
+  Analyzer* clone() const { return new TrackResiduals(m_devices); }
+  /** Track residuals go to this analyzer's histograms only */
+  bool isReadOnly() const { return true; }
+
   void setOutput(TDirectory* dir, const std::string& name="TrackResiduals") {
     // Just adds the default name
     Analyzer::setOutput(dir, name);
@@ -0,0 +1,99 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <memory>
+
+namespace Utils {
+
+/**
+  * Monotonic scratch memory for the temporaries of one event. Allocations
+  * bump a pointer in the current block and are never freed individually:
+  * `reset` releases everything at once, when the event is done.
+  *
+  * A reset after an event which needed more than one block merges them into
+  * a single block of the total size. Once the blocks cover the largest event
+  * seen, processing makes no more heap calls.
+  *
+  * Not thread safe: each thread works in its own arena. A copy starts empty,
+  * since the contents are only scratch.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class Arena {
+private:
+  Arena& operator=(const Arena&);
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+    Block(size_t size) : data(new char[size]), size(size) {}
+  };
+
+  /** Size of the first block */
+  const size_t m_blockSize;
+  std::vector<Block> m_blocks;
+  /** Block being filled, and the number of bytes used in it */
+  size_t m_iblock;
+  size_t m_offset;
+
+public:
+  Arena(size_t blockSize = 1<<16);
+  Arena(const Arena& copy);
+
+  /** Get `bytes` of memory aligned to `align` (a power of 2), valid until
+    * the next `reset` */
+  void* allocate(size_t bytes, size_t align);
+  /** Release all the memory given out, keeping it for the next event */
+  void reset();
+
+  /** Total size of the blocks held */
+  size_t getCapacity() const;
+  size_t getNumBlocks() const { return m_blocks.size(); }
+};
+
+/**
+  * Standard allocator taking its memory from an `Arena`, so that standard
+  * containers can hold an event's temporaries. Deallocation does nothing,
+  * the memory comes back when the arena is reset. Containers using it must
+  * not outlive that reset.
+  */
+template <class T>
+class ArenaAllocator {
+private:
+  Arena* m_arena;
+
+public:
+  typedef T value_type;
+
+  /** Not explicit, so that a container can be given the arena itself */
+  ArenaAllocator(Arena& arena) : m_arena(&arena) {}
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U>& other) :
+      m_arena(other.getArena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(m_arena->allocate(n*sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  Arena* getArena() const { return m_arena; }
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.getArena() == b.getArena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.getArena() != b.getArena();
+}
+
+/** Vector whose memory comes from an arena */
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+}
+
+#endif  // ARENA_H
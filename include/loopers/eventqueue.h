@@ -0,0 +1,63 @@
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace Loopers {
+
+/**
+  * Bounded first-in first-out queue of event handles (indices in a pool of
+  * events), passing events between the threads of a pipeline. Any number of
+  * threads can push and pop. Once closed, pushes are refused and pops only
+  * drain the handles left in the queue.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class EventQueue {
+private:
+  // Disable copy and assignment operators
+  EventQueue(const EventQueue&);
+  EventQueue& operator=(const EventQueue&);
+
+  /** Ring buffer of the handles in the queue */
+  std::vector<size_t> m_handles;
+  /** Position of the first handle in the ring buffer */
+  size_t m_first;
+  /** Number of handles in the queue */
+  size_t m_size;
+  /** Remember if the queue is closed */
+  bool m_closed;
+
+  std::mutex m_mutex;
+  std::condition_variable m_notEmpty;
+  std::condition_variable m_notFull;
+
+public:
+  /** Queue holding up to `capacity` handles */
+  EventQueue(size_t capacity);
+  ~EventQueue() {}
+
+  /** Add a handle at the back, waiting for space if the queue is full.
+    * Returns false if the queue is closed. */
+  bool push(size_t handle);
+  /** Take the handle at the front, waiting for one if the queue is empty.
+    * Returns false once the queue is closed and empty. */
+  bool pop(size_t& handle);
+  /** Add all `handles` at the back at once, waiting for space for them all.
+    * Returns false if the queue is closed. */
+  bool push(const std::vector<size_t>& handles);
+  /** Take up to `max` handles from the front into `handles`, waiting for at
+    * least one if the queue is empty. Returns false once the queue is closed
+    * and empty. */
+  bool pop(std::vector<size_t>& handles, size_t max);
+  /** Refuse further handles and wake up all waiting threads */
+  void close();
+
+  size_t getCapacity() const { return m_handles.size(); }
+};
+
+}
+
+#endif  // EVENTQUEUE_H
@@ -7,12 +7,14 @@
 #include <Math/IFunction.h>
 #include <Math/Minimizer.h>
 
+#include "mechanics/geometry.h"
 #include "processors/tracking.h"
 #include "analyzers/trackchi2.h"
 #include "loopers/looper.h"
 
 namespace Storage { class StorageI; }
 namespace Mechanics { class Device; }
+namespace Utils { class ThreadPool; }
 
 namespace Loopers {
 
@@ -57,11 +59,14 @@ public:
     std::vector<Analyzers::TrackChi2::Track> m_tracks;
     // Pre-compute the dimensionality of the minimization
     unsigned m_ndim;
+    // The sensor alignment values minimized, in order
+    std::vector<Mechanics::Geometry::Parameter> m_parameters;
 
     // Compute the parameters for the set of cluster of the given track,
-    // considering device alignment
+    // placed with the given geometry, or with their sensors if it is null
     void computeTrackPars(
         const Analyzers::TrackChi2::Track& track,
+        const Mechanics::Geometry* geometry,
         LoopAlignTracks::TrackPars& pars) const;
 
     double DoEval(const double* x) const;
@@ -69,6 +74,11 @@ public:
   public:
     const ROOT::Math::Minimizer* m_minimizer;
 
+    /** Chi^2 of the tracks with the alignment values `x`. Works on its own
+      * geometry snapshot rather than the device, so many points can be
+      * evaluated at once from different threads. */
+    double evaluate(const double* x) const;
+
     Chi2Minimizer(
         Mechanics::Device& device,
         int flags,
@@ -79,10 +89,39 @@ public:
     inline unsigned int NDim() const { return m_ndim; }
   };
 
+  /** Adds a gradient to the chi^2 function, by central finite differences
+    * whose points are evaluated in parallel on a thread pool */
+  class Chi2Gradient : public ROOT::Math::IGradientFunctionMultiDim {
+  private:
+    const Chi2Minimizer& m_function;
+    // Finite difference step of each parameter
+    std::vector<double> m_steps;
+    Utils::ThreadPool* m_pool;
+
+    double DoEval(const double* x) const { return m_function(x); }
+    double DoDerivative(const double* x, unsigned int icoord) const;
+
+  public:
+    Chi2Gradient(
+        const Chi2Minimizer& function,
+        const std::vector<double>& steps,
+        Utils::ThreadPool& pool);
+
+    /** All derivatives at once, with the 2 points of each spread over the
+      * threads */
+    void Gradient(const double* x, double* grad) const;
+
+    ROOT::Math::IBaseFunctionMultiDim* Clone() const;
+    inline unsigned int NDim() const { return m_function.NDim(); }
+  };
+
 private:
   /** Analyzer computes track residuals for each event. */
   Analyzers::TrackChi2 m_trackChi2;
 
+  /** Add the tracking after the processors given by the user */
+  void preLoop();
+
 public:
   /** Tracking processor to generate the tracks for alignment */
   Processors::Tracking m_tracking;
@@ -90,6 +129,11 @@ public:
   double m_translationScale;
   double m_rotationScale;
   double m_tolerance;
+  /** Compute the chi^2 gradient on this many threads, instead of leaving
+    * the derivatives to the minimizer */
+  unsigned m_gradientThreads;
+  /** Finite difference step of the gradient, relative to the scales */
+  double m_gradientStep;
 
   LoopAlignTracks(
       const std::vector<Storage::StorageI*>& inputs,
@@ -99,9 +143,6 @@ public:
       Mechanics::Device& device);
   ~LoopAlignTracks() {}
 
-  /** Override default execute behaviour */
-  void execute();
-
   /** Compute and apply alignment as post-processing step */
   void finalize();
 };
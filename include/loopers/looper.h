@@ -11,6 +11,7 @@ namespace Storage { class Event; }
 namespace Mechanics { class Device; }
 namespace Processors { class Processor; }
 namespace Analyzers { class Analyzer; }
+namespace Utils { class ThreadPool; }
 
 namespace Loopers {
 
@@ -33,6 +34,42 @@ private:
   /** Called once event range is calculated */
   virtual void preLoop() {}
 
+  /** Runs the analyzers of one level on an event, on the thread pool */
+  class LevelTask;
+  /** Sort the analyzers into `m_analyzerLevels` */
+  void scheduleAnalyzers();
+
+  /** Reads the events of each input, one input per part */
+  class ReadTask;
+
+  /** Inputs, processors and analyzers used by one thread of a parallel loop,
+    * and the range of loop iterations it has yet to claim */
+  struct Worker;
+  /** Run the loop iterations of worker `iworker`, claiming them in chunks
+    * from its own range, then stealing from the other workers. Stops early
+    * once any worker has failed. */
+  void runWorker(const std::vector<Worker*>& workers, size_t iworker);
+  /** Give worker `ithief` the back half of the largest unclaimed range of
+    * the other workers. Returns false if no iterations are left. */
+  bool stealRange(const std::vector<Worker*>& workers, size_t ithief);
+  /** Run the loop iterations from `m_start` over `m_nprocess` events, on the
+    * parallel loop if requested */
+  void loopRange();
+  /** Run the loop in blocks of `m_sampleSize` iterations spread across the
+    * range, until the analyzers' moments are stable */
+  void loopSampled();
+  /** True if the analyzers' moments are within `m_sampleTolerance` of those
+    * of the previous call, which are kept in `means` and `sigmas` */
+  bool isStable(std::vector<double>& means, std::vector<double>& sigmas) const;
+
+  /** Run iterations `first` up to `last` of a worker in blocks of
+    * `m_batchSize` iterations */
+  void runBatches(
+      Worker& worker,
+      const std::vector<Analyzers::Analyzer*>& analyzers,
+      ULong64_t first,
+      ULong64_t last);
+
 protected:
   /** List of inputs from which to read events */
   const std::vector<Storage::StorageI*> m_inputs;
@@ -54,14 +91,68 @@ protected:
   TStopwatch m_timer;
   /** Keep track of last updated time for instantaneous bandwidth */
   double m_lastTime;
+  /** Event at the last progress update, for the instantaneous bandwidth */
+  ULong64_t m_lastEvent;
 
   /** List of processors to execute at each loop. Not owned by this. */
   std::vector<Processors::Processor*> m_processors;
+  /** Index of the input on whose event each processor runs, or -1 if it
+    * runs on the events of all inputs */
+  std::vector<int> m_processorInputs;
   /** List of analyzers to execute at each loop. Not owned by this. */
   std::vector<Analyzers::Analyzer*> m_analyzers;
+  /** Indices of the analyzers which can run together, level by level. An
+    * analyzer comes after its dependencies, and one which isn't read-only
+    * runs alone after all those added before it. */
+  std::vector<std::vector<size_t> > m_analyzerLevels;
+  /** Runs the analyzers of a level while a loop is running, or 0 */
+  Utils::ThreadPool* m_analyzerPool;
+  /** Reads the inputs concurrently while a loop is running, or 0 */
+  Utils::ThreadPool* m_inputPool;
+
+  /** Point `events` to event `ievent` of each input, reading the inputs
+    * together on the input pool if one is running. Returns false if any of
+    * the events is invalid. */
+  bool readInputs(
+      const std::vector<Storage::StorageI*>& inputs,
+      ULong64_t ievent,
+      std::vector<Storage::Event*>& events);
 
   /** Print a progress bar and bandwidth */
   void printProgress();
+  /** Print the progress of a loop run by other threads, once `ndone`
+    * iterations are done, if a print interval passed since `lastPrinted` */
+  void printProgress(ULong64_t ndone, ULong64_t& lastPrinted);
+
+  /** Split the loop iterations into one contiguous block per thread, run
+    * them in parallel, and merge the analyzers back in event order. Threads
+    * which run out of iterations steal from the others, so that uneven
+    * event costs don't leave threads idle. Used instead of the sequential
+    * loop when `m_nthreads` or `m_batchSize` is above 1. */
+  virtual void loopParallel();
+
+  /** Run the processors, then the analyzers, on the events read from the
+    * inputs. Processors are given in the order of `m_processorInputs`. */
+  void run(
+      const std::vector<Processors::Processor*>& processors,
+      const std::vector<Analyzers::Analyzer*>& analyzers,
+      const std::vector<Storage::Event*>& events);
+  /** Run the analyzers on the events of one iteration, level by level on
+    * the analyzer thread pool if one is running */
+  void runAnalyzers(
+      const std::vector<Analyzers::Analyzer*>& analyzers,
+      const std::vector<Storage::Event*>& events);
+  /** Run the processors, then the analyzers, on a block of iterations:
+    * `events` holds the events of the inputs for each iteration in turn */
+  void runBatch(
+      const std::vector<Processors::Processor*>& processors,
+      const std::vector<Analyzers::Analyzer*>& analyzers,
+      const std::vector<Storage::Event*>& events);
+
+  /** Derived loopers which do more than run the processors and analyzers in
+    * `execute` (e.g. write events in order) must return false, and then
+    * always loop sequentially */
+  virtual bool isParallel() const { return true; }
 
 public:
   /** First event index to process */
@@ -74,6 +165,32 @@ public:
   unsigned m_printInterval;
   /** Draw outputs or not (not always applicable) */
   bool m_draw;
+  /** Split the events between this many threads, each with its own inputs,
+    * processors and analyzers. Analyzers must support `clone` and `merge`. */
+  unsigned m_nthreads;
+  /** Run the read-only analyzers of an event concurrently on this many
+    * threads, respecting their dependencies. Not used when the events are
+    * split between threads. */
+  unsigned m_analyzerThreads;
+  /** Read the inputs of an iteration, or of a block of iterations, on this
+    * many threads. Only helps with several inputs, each in its own file. */
+  unsigned m_inputThreads;
+  /** Threads claim events in chunks lasting about this many seconds, sized
+    * from the cost of the events they processed so far */
+  double m_chunkTime;
+  /** Read and run blocks of this many loop iterations at once, so that the
+    * processors and analyzers can share their work across the block. Only
+    * used by the parallel loop, which then also runs with one thread. */
+  unsigned m_batchSize;
+  /** Sample the loop in contiguous blocks of this many iterations, taken
+    * across the whole range: each new block falls between those already
+    * read. 0 reads the range in order. */
+  ULong64_t m_sampleSize;
+  /** When sampling, stop once the mean and RMS of each analyzer histogram
+    * move by less than this fraction of the RMS for `m_sampleStable`
+    * successive blocks. 0 reads all the blocks. */
+  double m_sampleTolerance;
+  unsigned m_sampleStable;
 
   /** Constructor for multi device looper without device information */
   Looper(const std::vector<Storage::StorageI*>& inputs);
@@ -87,6 +204,11 @@ public:
   Looper(Storage::StorageI& input, Mechanics::Device& device);
   virtual ~Looper() {}
   
+  /** Restrict the loop to shard `ishard` out of `nshards`: one contiguous
+    * part of the event range, such that the shards cover it once, in order.
+    * Call after setting the event range. */
+  void setShard(unsigned ishard, unsigned nshards);
+
   /** Loop over the largest common set of events in the inputs */
   virtual void loop();
   /** Execute processors and analyzers */
@@ -96,7 +218,10 @@ public:
 
   /** Add a processor to execute at each loop iteration */
   void addProcessor(Processors::Processor& processor);
-  /** Add an analyzer to execute at each loop iteration */
+  /** Add a processor to execute only on the event of input `iinput` */
+  void addProcessor(Processors::Processor& processor, size_t iinput);
+  /** Add an analyzer to execute at each loop iteration, after those it
+    * depends on */
   void addAnalyzer(Analyzers::Analyzer& analyzer);
 };
 
@@ -0,0 +1,44 @@
+#ifndef LOOPNOISESCAN_H
+#define LOOPNOISESCAN_H
+
+#include <vector>
+
+#include "analyzers/noisescan.h"
+#include "loopers/looper.h"
+
+namespace Storage { class StorageI; }
+namespace Mechanics { class Device; }
+
+namespace Loopers {
+
+/**
+  * Loop over all events in a series of inputs and count the hits in each
+  * pixel with the noise scan analyzer. Use the result to set the noise
+  * profile and mask of the sensors.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class LoopNoiseScan : public Looper {
+private:
+  /** Analyzer counting the pixel hits */
+  Analyzers::NoiseScan m_noiseScan;
+
+public:
+  LoopNoiseScan(
+      const std::vector<Storage::StorageI*>& inputs,
+      const std::vector<Mechanics::Device*>& devices);
+  LoopNoiseScan(
+      Storage::StorageI& input,
+      Mechanics::Device& device);
+  ~LoopNoiseScan() {}
+
+  /** Set the sensor noise profiles and masks as post-processing step */
+  void finalize();
+
+  /** Provide access to noise scan object for configuring */
+  Analyzers::NoiseScan& getAnalyzer() { return m_noiseScan; }
+};
+
+}
+
+#endif  // LOOPNOISESCAN_H
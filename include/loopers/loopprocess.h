@@ -1,12 +1,17 @@
 #ifndef LOOPPROCESS_H
 #define LOOPPROCESS_H
 
+#include <Rtypes.h>
+
 #include "loopers/looper.h"
 
 namespace Storage { class StorageI; }
 namespace Storage { class StorageO; }
+namespace Storage { class TrackNtuple; }
+namespace Storage { class Event; }
 namespace Processors { class Clustering; }
 namespace Processors { class Aligning; }
+namespace Processors { class Processor; }
 
 namespace Loopers {
 
@@ -16,22 +21,57 @@ namespace Loopers {
   * so the output will contain these objects. Also applies alignment if
   * requested.
   *
+  * The output must be written in event order, so with more than one thread
+  * the events aren't split between threads. Instead, reading, each processor
+  * and writing run as stages of a pipeline, each on its own threads, so that
+  * they overlap. Processors are replicated on `m_nthreads` threads each.
+  * Events move between the stages in blocks of up to `m_batchSize`, which
+  * each processor runs through `executeBatch`.
+  *
   * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
   */
 class LoopProcess : public Looper {
 private:
   /** Output file where to store the processed events */
   Storage::StorageO& m_output;
+  /** Optional flat ntuple with the processed tracks. Not owned by this. */
+  Storage::TrackNtuple* m_ntuple;
+
+  /** Pool of events in flight and the queues passing them between stages */
+  struct Pipeline;
+  /** Read events into free pool entries and pass them to the first stage */
+  void readEvents(Pipeline& pipeline);
+  /** Run processor `istage` on the events of its queue */
+  void processEvents(
+      Pipeline& pipeline,
+      size_t istage,
+      Processors::Processor& processor);
+  /** Analyze and write the processed events in order, and free them */
+  void writeEvents(Pipeline& pipeline);
+
+  /** Run the loop as a pipeline */
+  void loopParallel();
+
+  /** Store a processed event in the outputs */
+  void store(Storage::Event& event, ULong64_t ievent);
 
 public:
+  /** Number of events in flight in a pipelined loop (0 picks 4 blocks of
+    * `m_batchSize` per thread) */
+  unsigned m_poolSize;
+
   LoopProcess(Storage::StorageI& input, Storage::StorageO& output);
   ~LoopProcess() {}
 
   /** Execute writes to the output */
   void execute();
+
+  /** Also write the tracks of each processed event to a flat ntuple. It is
+    * filled along with the output, so on the writer thread in event order
+    * when the loop is a pipeline. */
+  void setNtuple(Storage::TrackNtuple& ntuple) { m_ntuple = &ntuple; }
 };
 
 }
 
 #endif  // LOOPPROCESS_H
-
@@ -27,6 +27,8 @@ private:
   Analyzers::Synchronization m_synchronization;
 
   void preLoop();
+  /** The storing pass writes events in order, so run on a single thread */
+  bool isParallel() const { return false; }
 
 public:
   LoopSynchronize(
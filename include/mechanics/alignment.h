@@ -28,6 +28,10 @@ private:
   void calculate();
 
 protected:
+  /** Called whenever the alignment changes, after the rotation matrix is
+    * recalculated. Derived classes update what they cache from it. */
+  virtual void alignmentChanged() {}
+
   /** The alignment information (offsets and rotations) */
   double m_alignment[6];
   /** The rotation matrix */
@@ -42,6 +46,12 @@ public:
   void rotate(double& x, double& y, double& z) const;
   void unrotate(double& x, double& y, double& z) const;
 
+  /** Affine map from the local plane (z = 0) of this object to global space,
+    * going through the `parent` alignment if one is given. Columns 0 and 1
+    * of `map` are the global directions of the local x and y axes, column 2
+    * the global position of the local origin. */
+  void fuse(const Alignment* parent, double map[3][3]) const;
+
   /** Set the alignment from an array of 6 values whose indices are specified
     * by the `AlignAxis` enum */
   void setAlignment(const double* values);
@@ -31,6 +31,9 @@ private:
   /** Update the list of active sensors from the mask */
   void updateSensors();
 
+  /** The sensors' global maps include this device's alignment */
+  virtual void alignmentChanged();
+
 public:
   /** Name of this device, propagates to plots and results */
   std::string m_name;
@@ -44,6 +47,9 @@ public:
   std::string m_timeUnit;
   /** Path of file where this device can store alignment information */
   std::string m_alignmentFile;
+  /** Path of binary file where this device can store its sensors' noise
+    * profiles and masks */
+  std::string m_noiseMaskFile;
 
   /** Clock tick of first event in read out */
   ULong64_t m_timeStart;
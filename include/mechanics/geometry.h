@@ -0,0 +1,88 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <vector>
+
+#include "mechanics/alignment.h"
+
+namespace Mechanics {
+
+class Device;
+
+/**
+  * Read-only copy of the transformations of a device's sensors, taken at
+  * construction. A snapshot doesn't refer back to the device, so it can be
+  * shared between threads, and many snapshots of the same device can exist
+  * at once with different alignments, e.g. one per point of a minimizer's
+  * finite differences.
+  *
+  * The transformations give the same results as those of the sensors.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class Geometry {
+public:
+  /** Alignment value of one sensor which overrides the device's */
+  struct Parameter {
+    size_t isensor;
+    Alignment::AlignAxis axis;
+    Parameter(size_t isensor, Alignment::AlignAxis axis) :
+        isensor(isensor), axis(axis) {}
+  };
+
+private:
+  /** Everything needed to transform the pixels of one sensor */
+  struct Plane {
+    /** Fused sensor and device map, as in `Sensor` */
+    double toGlobal[3][3];
+    double colPitch;
+    double rowPitch;
+    /** Position of the sensor center in the local frame */
+    double centerX;
+    double centerY;
+  };
+
+  std::vector<Plane> m_planes;
+
+  /** Fill the plane of sensor `isensor` from the alignment `sensor` */
+  void setPlane(
+      const Device& device,
+      size_t isensor,
+      const Alignment& sensor);
+
+public:
+  /** Snapshot of the device as it is currently aligned */
+  Geometry(const Device& device);
+  /** Snapshot of the device with the alignment values `values` replacing
+    * those described by `parameters`, in the same order */
+  Geometry(
+      const Device& device,
+      const std::vector<Parameter>& parameters,
+      const double* values);
+
+  size_t getNumPlanes() const { return m_planes.size(); }
+
+  /** Transform a pixel coordinate of sensor `isensor` to a global
+    * coordinate, as `Sensor::pixelToSpace` */
+  void pixelToSpace(
+      size_t isensor,
+      double col,
+      double row,
+      double& x,
+      double& y,
+      double& z) const;
+
+  /** Compute the size of the pixel errors of sensor `isensor` in global
+    * coordinates, as `Sensor::pixelErrToSpace` */
+  void pixelErrToSpace(
+      size_t isensor,
+      double colErr,
+      double rowErr,
+      double& xe,
+      double& ye,
+      double& ze) const;
+};
+
+}
+
+#endif  // GEOMETRY_H
@@ -7,6 +7,7 @@
 namespace Mechanics {
 
 class Device;
+class Sensor;
 
 /** Build a device from the information given in a file */
 Device* parseDevice(const std::string& filePath);
@@ -17,6 +18,19 @@ void parseAlignment(Device& device);
 /** Write out a device's alignment */
 void writeAlignment(const Device& device);
 
+/** Load a sensor's charge calibration from its binary calibration file */
+void parseCalibration(Sensor& sensor);
+
+/** Write out a sensor's charge calibration to its binary calibration file */
+void writeCalibration(const Sensor& sensor);
+
+/** Set the noise profiles and masks of a device's sensors from its binary
+  * noise mask file */
+void parseNoiseMask(Device& device);
+
+/** Write out the noise profiles and masks of a device's sensors */
+void writeNoiseMask(const Device& device);
+
 /**
   * Container of devices parsed. Useful when setting up a multi-device run.
   * Provies nammed and indexed access to the devices.
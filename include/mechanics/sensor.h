@@ -18,12 +18,23 @@ class Device;
   * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
   */
 class Sensor : public Alignment {
+private:
+  /** Affine map from the sensor plane to global space, combining the sensor
+    * and device alignments. Columns 0 and 1 are the global directions of the
+    * local x and y axes, column 2 the global position of the sensor center. */
+  double m_toGlobal[3][3];
+
 protected:  // accessed by Device
   /** Pointer to the device to which this sensor belongs (optional) */
   Device* m_device;
   /** No assignment */
   Sensor& operator=(const Sensor&);
 
+  /** Recompute `m_toGlobal` from the sensor and device alignments. The device
+    * calls it when its own alignment changes. */
+  void fuseAlignment();
+  virtual void alignmentChanged() { fuseAlignment(); }
+
 public:
   /** Name propagates to plots and infomration about this sensor */
   std::string m_name;
@@ -37,13 +48,31 @@ public:
   double m_colPitch;
   /** The accumulated number of radiation lengths from the beam origin */
   double m_xox0;
-
-  /** Vector of noisy hit rate for each pixel. Pixel order is given by 
-    * `getPixelIndex` */
+  /** Inclusive region of interest in pixel columns and rows. Hits outside of
+    * it are dropped on read. Open by default. */
+  int m_roiMinCol;
+  int m_roiMaxCol;
+  int m_roiMinRow;
+  int m_roiMaxRow;
+  /** Inclusive window of hit timing values kept on read. Open by default. */
+  int m_minTiming;
+  int m_maxTiming;
+
+  /** Vector of noisy hit rate (hits per event) for each pixel. Pixel order
+    * is given by `getPixelIndex` */
   std::vector<double> m_noiseProfile;
   /** Vector indicating which pixels are masked (true if masked). Pixel order
     * is given by `getPixelIndex`. */
   std::vector<bool> m_noiseMask;
+  /** Charge calibration: `m_calibrationTerms` polynomial coefficients for
+    * each pixel, lowest order first, giving the charge of a raw hit value.
+    * Pixel order is given by `getPixelIndex`. Empty if the sensor isn't
+    * calibrated. */
+  std::vector<float> m_calibration;
+  /** Number of coefficients of the calibration of each pixel */
+  unsigned m_calibrationTerms;
+  /** Path of the binary calibration table of this sensor */
+  std::string m_calibrationFile;
   
   Sensor();
   Sensor(const Sensor& copy);
@@ -61,6 +90,27 @@ public:
       double& y,
       double& z) const;
 
+  /** Transform `n` pixel coordinates at once, with the same results as one
+    * by one. The points go through the fused sensor and device map in a loop
+    * free of dependencies, which the compiler can vectorize. The output
+    * arrays must not overlap the inputs. */
+  void pixelToSpace(
+      size_t n,
+      const double* cols,
+      const double* rows,
+      double* xs,
+      double* ys,
+      double* zs) const;
+  /** Transform `n` pixel coordinates in single precision, with the same
+    * map as the double version, for processing in float */
+  void pixelToSpace(
+      size_t n,
+      const float* cols,
+      const float* rows,
+      float* xs,
+      float* ys,
+      float* zs) const;
+
   /** Compute the size of the pixel errors in global coordinates */
   void pixelErrToSpace(
       double colErr,
@@ -69,6 +119,28 @@ public:
       double& ye,
       double& ze) const;
 
+  /** Compute the size of `n` pixel errors in global coordinates at once */
+  void pixelErrToSpace(
+      size_t n,
+      const double* colErrs,
+      const double* rowErrs,
+      double* xes,
+      double* yes,
+      double* zes) const;
+  /** Single precision version of the above */
+  void pixelErrToSpace(
+      size_t n,
+      const float* colErrs,
+      const float* rowErrs,
+      float* xes,
+      float* yes,
+      float* zes) const;
+
+  /** Get the affine map taking pixel coordinates to global space: a pixel
+    * (col, row) is at `x = map[0][0]*col + map[0][1]*row + map[0][2]`, and
+    * likewise for y and z. Its first two columns also scale the errors. */
+  void getPixelMap(double (*map)[3]) const;
+
   /** Transform a global coordinate to a pixel coordinate. Projects along the
     * z-axis, after applying the rotation. */
   void spaceToPixel(
@@ -86,9 +158,9 @@ public:
   /** Return the masked value of a pixel. throws and exception if no mask has
     * been provided */
   bool getPixelMask(unsigned row, unsigned col) const;
-  /** Return the noise rate of a pixel. throws and exception if no mask has
-    * been provided */
-  bool getPixelNoise(unsigned row, unsigned col) const;
+  /** Return the noise rate of a pixel. throws and exception if no noise
+    * profile has been provided */
+  double getPixelNoise(unsigned row, unsigned col) const;
 
   /** Compute and return the normal unit vector. */
   void getNormal(double& x, double&y, double& z) const;
@@ -4,7 +4,10 @@
 #include "processors/processor.h"
 
 namespace Storage { class Event; }
+namespace Storage { class Plane; }
 namespace Mechanics { class Device; }
+namespace Mechanics { class Sensor; }
+namespace Utils { class ThreadPool; }
 
 namespace Processors {
 
@@ -14,7 +17,22 @@ namespace Processors {
   * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
   */
 class Aligning : public Processor {
+private:
+  /** Aligns the planes of an event, or of a block of events, on a thread
+    * pool */
+  class PlaneTask;
+
+  /** Transform a plane's objects with blocks of scalar type `T` */
+  template <typename T>
+  void transformPlane(
+      const Storage::Plane& plane,
+      const Mechanics::Sensor& sensor);
+
 protected:
+  /** Apply the sensor's transformation to the objects in its plane */
+  void processPlane(
+      const Storage::Plane& plane,
+      const Mechanics::Sensor& sensor);
   /** Processing is done device-by-device, so make single device method */
   void processEvent(
       Storage::Event& event,
@@ -22,15 +40,37 @@ protected:
 
   /** Base virtual method called at each loop iteration */
   virtual void process();
+  /** Go through a block sensor by sensor, so that each sensor's
+    * transformation is applied to the plane of every event in a row */
+  virtual void processBatch(const std::vector<Storage::Event*>& events);
 
 public:
+  /** Align the planes of an event in parallel on this pool (0 aligns them in
+    * turn). Not owned by this. */
+  Utils::ThreadPool* m_pool;
+  /** Transform in float rather than double. The positions are stored in
+    * double either way. */
+  bool m_singlePrecision;
+
   /** Enable multi-device initialization */
   Aligning(const std::vector<Mechanics::Device*>& devices) :
-      Processor(devices) {}
+      Processor(devices),
+      m_pool(0),
+      m_singlePrecision(false) {}
   /** Enable single-device initialization */
   Aligning(Mechanics::Device& device) :
-      Processor(device) {}
+      Processor(device),
+      m_pool(0),
+      m_singlePrecision(false) {}
   virtual ~Aligning() {}
+
+  virtual Processor* clone() const { return new Aligning(*this); }
+
+  /** Align the event of a single device without going through `execute`.
+    * With `NPLANES` above 0, the number of planes is a compile time constant
+    * (instantiated for 6 planes). Used by `Chain`. */
+  template <size_t NPLANES>
+  void processFixed(Storage::Event& event);
 };
 
 }
@@ -0,0 +1,83 @@
+#ifndef PROC_CHAIN_H
+#define PROC_CHAIN_H
+
+#include <vector>
+#include <tuple>
+#include <type_traits>
+
+#include "processors/processor.h"
+
+namespace Storage { class Event; }
+
+namespace Processors {
+
+/**
+  * Processors of fixed types, run one after the other on the event of a
+  * single device. A looper calls the chain once per event, and the chain
+  * calls each stage's `processFixed` directly, rather than each stage's
+  * virtual `process` with its own copy of the event list. This saves one
+  * virtual call and event list per stage, nothing more: the stage bodies are
+  * compiled in their own translation units, so they are not inlined into
+  * the chain.
+  *
+  * With `NPLANES` above 0, the number of planes is a compile time constant
+  * in the loops over planes of every stage; scratch space is still sized at
+  * run time. The stages are instantiated for 0 (any number) and 6 planes,
+  * the standard telescope.
+  *
+  * The chain holds copies of the processors given on construction, so
+  * configure them first. For example, the standard processing chain is
+  * `Chain<6, Clustering, Aligning, Tracking>`.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+template <size_t NPLANES, class... Stages>
+class Chain : public Processor {
+  static_assert(NPLANES == 0 || NPLANES == 6,
+      "Chain: stages are instantiated for 0 or 6 planes only");
+
+private:
+  /** Copies of the processors, in the order they run */
+  std::tuple<Stages...> m_stages;
+
+  /** Run stage `I` and those after it on `event` */
+  template <size_t I>
+  typename std::enable_if<(I < sizeof...(Stages))>::type runStages(
+      Storage::Event& event) {
+    std::get<I>(m_stages).template processFixed<NPLANES>(event);
+    runStages<I+1>(event);
+  }
+  /** Ends the recursion past the last stage */
+  template <size_t I>
+  typename std::enable_if<(I == sizeof...(Stages))>::type runStages(
+      Storage::Event&) {}
+
+protected:
+  /** Base virtual method called at each loop iteration */
+  virtual void process() { runStages<0>(*m_events[0]); }
+  /** Each event of a block is its own iteration */
+  virtual void processBatch(const std::vector<Storage::Event*>& events) {
+    for (std::vector<Storage::Event*>::const_iterator it = events.begin();
+        it != events.end(); ++it)
+      runStages<0>(**it);
+  }
+
+public:
+  /** Copy the configured processors into the chain */
+  Chain(const Stages&... stages) :
+      Processor(1),  // single device processor
+      m_stages(stages...) {}
+  virtual ~Chain() {}
+
+  virtual Processor* clone() const { return new Chain(*this); }
+
+  /** Stage `I` of the chain, to configure it after construction */
+  template <size_t I>
+  typename std::tuple_element<I, std::tuple<Stages...> >::type& getStage() {
+    return std::get<I>(m_stages);
+  }
+};
+
+}
+
+#endif  // PROC_CHAIN_H
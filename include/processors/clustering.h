@@ -1,13 +1,16 @@
 #ifndef PROC_CLUSTERING_H
 #define PROC_CLUSTERING_H
 
-#include <list>
+#include <vector>
 
+#include "arena.h"
 #include "processors/processor.h"
 
 namespace Storage { class Hit; }
 namespace Storage { class Cluster; }
 namespace Storage { class Event; }
+namespace Storage { class Plane; }
+namespace Utils { class ThreadPool; }
 
 namespace Processors {
 
@@ -19,20 +22,61 @@ namespace Processors {
   * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
   */
 class Clustering : public Processor {
+private:
+  /** Groups the hits of each plane of an event on a thread pool */
+  class PlaneTask;
+  /** Grid cell of a hit, used to find its neighbours */
+  struct CellHit;
+
+  /** Scratch memory of each plane's grouping (planes can be grouped on
+    * different threads), then one for the event. Reset at each event. */
+  std::vector<Utils::Arena> m_arenas;
+
+  /** Join the hits in cells `begin1` to `end1` of `cells` (all in one grid
+    * cell) to their neighbours in the grid cell at `cellX`, `cellY` */
+  void joinCells(
+      const Storage::Plane& plane,
+      const Utils::ArenaVector<CellHit>& cells,
+      size_t begin1,
+      size_t end1,
+      int cellX,
+      int cellY,
+      Utils::ArenaVector<size_t>& parents) const;
+
+  /** Cluster values computed with sums of scalar type `T` */
+  template <typename T>
+  void computeCluster(
+      Storage::Cluster& cluster,
+      Storage::Hit* const* clustered,
+      size_t nhits);
+
 protected:
-  /** Algorithm builds a list of hits belonging to the same cluster as the
-    * provided seed. It is called from `process` and can be extended to
-    * implement a different clustering algorithm */
-  virtual void clusterSeed(
-      Storage::Hit& seed,
-      std::list<Storage::Hit*>& hits,
-      std::list<Storage::Hit*>& clustered);
+  /** Hits of a plane split by cluster, in the arena of the plane. The hits
+    * of group `i` run from `starts[i]` up to `starts[i+1]` in `hits`. */
+  struct HitGroups {
+    Utils::ArenaVector<Storage::Hit*> hits;
+    Utils::ArenaVector<size_t> starts;
+    HitGroups(Utils::Arena& arena) : hits(arena), starts(arena) {}
+    size_t getNumGroups() const { return starts.empty() ? 0 : starts.size()-1; }
+  };
+
   /** Algorithm buidls the `Cluster` object, and computes its pixel values from
-    * the given list of clustered hits. Can be extended to achieve different 
+    * the given `nhits` clustered hits. Can be extended to achieve different 
     * mean and uncertainties for the clusters. */
   virtual void buildCluster(
       Storage::Cluster& cluster,
-      std::list<Storage::Hit*>& clustered);
+      Storage::Hit* const* clustered,
+      size_t nhits);
+
+  /** Split the hits of a plane into the groups of hits of its clusters, in
+    * the order the clusters are to be made. Hits are bucketed on a grid of
+    * the clustering distance and neighbours joined with a union-find, so the
+    * time grows about linearly with the number of hits. Temporaries are
+    * taken from `arena`. */
+  void groupHits(
+      const Storage::Plane& plane,
+      Utils::Arena& arena,
+      HitGroups& groups);
 
   /** Processing is done device-by-device, so make single device method */
   virtual void processEvent(Storage::Event& event);
@@ -45,8 +89,13 @@ public:
   unsigned m_maxRows;
   /** Maximal number of columns between two hits to cluster */
   unsigned m_maxCols;
-  /** Weight the cluster center and RMS by its hit values */
+  /** Weight the cluster center and RMS by its hit charges */
   bool m_weighted;
+  /** Group the hits of the planes of an event in parallel on this pool (0
+    * groups them in turn). Not owned by this. */
+  Utils::ThreadPool* m_pool;
+  /** Compute the cluster centers and errors in float rather than double */
+  bool m_singlePrecision;
 
   /** Clustering doesn't require device information, so construct only with
     * the expected number of devices (events) */
@@ -54,14 +103,27 @@ public:
       Processor(ndevices),
       m_maxRows(1),
       m_maxCols(1),
-      m_weighted(false) {}
+      m_weighted(false),
+      m_pool(0),
+      m_singlePrecision(false) {}
   /** Keep the default constructor around, to make single device clustering */
   Clustering()  :
       Processor(1),
       m_maxRows(1),
       m_maxCols(1),
-      m_weighted(false) {}
+      m_weighted(false),
+      m_pool(0),
+      m_singlePrecision(false) {}
   virtual ~Clustering() {}
+
+  /** Derived algorithms should return a copy of their own type */
+  virtual Processor* clone() const { return new Clustering(*this); }
+
+  /** Cluster a single event without going through `execute`. With `NPLANES`
+    * above 0, the number of planes is a compile time constant (instantiated
+    * for 6 planes). Used by `Chain`, which calls it non-virtually. */
+  template <size_t NPLANES>
+  void processFixed(Storage::Event& event);
 };
 
 }
@@ -0,0 +1,100 @@
+#ifndef PROC_KALMANTRACKING_H
+#define PROC_KALMANTRACKING_H
+
+#include <vector>
+
+#include "arena.h"
+#include "processors/processor.h"
+
+namespace Storage { class Event; }
+namespace Mechanics { class Device; }
+
+namespace Processors {
+
+/**
+  * Finds tracks by following them from plane to plane with a Kalman filter.
+  * Each candidate carries a straight line state (position and slope in x and
+  * y) with its covariance. Going to the next plane, the state is propagated
+  * and the multiple scattering in the material crossed is added to the slope
+  * covariance. A cluster is a candidate if it is within `m_gate` sigma of the
+  * prediction, given the predicted covariance and the cluster's errors.
+  *
+  * Candidates and the clusters they gate are joined from the lowest chi^2
+  * up, each at most once: a candidate takes the closest cluster which a
+  * closer candidate hasn't taken. Clusters which no candidate gates seed new
+  * candidates.
+  *
+  * The filtered state after the last cluster is the track, so there is no
+  * fit once the clusters are found, and no smoothing: the state is that at
+  * the last cluster, moved back to z = 0 without the scattering in between.
+  * A seed's slope has the prior variance `m_slopeSigma`^2, which stays in
+  * the track's slope and covariance. Without material and with a loose
+  * prior, it is the same straight line fit as `Tracking::buildTrack`.
+  *
+  * The material is taken from the sensors' `m_xox0`, which accumulate the
+  * radiation lengths along the beam. The material between a sensor and the
+  * next is lumped at the first of the two.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class KalmanTracking : public Processor {
+public:
+  /** Straight line state along one axis: position and slope at a given z,
+    * with their covariance */
+  struct AxisState {
+    double pos;
+    double slope;
+    double covPos;
+    double covPosSlope;
+    double covSlope;
+    AxisState() :
+        pos(0), slope(0), covPos(0), covPosSlope(0), covSlope(0) {}
+
+    /** Move the state by `dz` along the line */
+    void propagate(double dz);
+    /** Add the measurement `meas` of the position, with variance `var`.
+      * Returns the chi^2 of the measurement against the prediction. */
+    double update(double meas, double var);
+  };
+
+protected:
+  /** Scratch memory for the track candidates of an event */
+  Utils::Arena m_arena;
+
+  /** Build the tracks of one event, on the device's sensors */
+  void processEvent(Storage::Event& event, const Mechanics::Device& device);
+
+  /** Base virtual method called at each loop iteration */
+  virtual void process();
+
+public:
+  /** Search window, in sigma of the predicted residual */
+  double m_gate;
+  /** Minimum number of clusters to make a track. Below 3 is ignored. */
+  size_t m_minClusters;
+  /** Beam momentum in GeV/c, for the scattering angles */
+  double m_momentum;
+  /** Spread of the track slopes, which constrains the slope of a candidate
+    * until it has two clusters. It is a prior of the fit, so it also pulls
+    * the track slopes towards 0 and reduces their errors. */
+  double m_slopeSigma;
+
+  KalmanTracking(Mechanics::Device& device) :
+      Processor(device),
+      m_gate(5),
+      m_minClusters(3),
+      m_momentum(120),
+      m_slopeSigma(0.01) {}
+  virtual ~KalmanTracking() {}
+
+  virtual Processor* clone() const { return new KalmanTracking(*this); }
+
+  /** RMS of the projected scattering angle of a singly charged particle of
+    * `momentum` (GeV/c, at the speed of light) crossing `xox0` radiation
+    * lengths, from the Highland formula. 0 without material. */
+  static double highland(double xox0, double momentum);
+};
+
+}
+
+#endif  // PROC_KALMANTRACKING_H
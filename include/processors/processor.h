@@ -37,6 +37,11 @@ protected:
   
   /** Event processing must be specified in derived class */
   virtual void process() = 0;
+  /** Process a block of loop iterations: `events` holds the events of each
+    * iteration in turn, one per device. By default the iterations are passed
+    * to `process` one at a time. Derived classes can instead share the setup
+    * and work across the whole block. */
+  virtual void processBatch(const std::vector<Storage::Event*>& events);
 
 public:
   /** Constructor for an analyzer which doesn't need devices, only events */
@@ -51,6 +56,13 @@ public:
   void execute(const std::vector<Storage::Event*>& events);
   /** Single device event execution */
   void execute(Storage::Event& event);
+  /** Execution on a block of loop iterations, with the events of each
+    * iteration in turn (one per device) */
+  void executeBatch(const std::vector<Storage::Event*>& events);
+
+  /** Make a copy of this processor, with the same configuration and devices,
+    * for another thread of a parallel loop. Caller takes ownership. */
+  virtual Processor* clone() const = 0;
 };
 
 }
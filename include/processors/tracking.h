@@ -1,8 +1,10 @@
 #ifndef PROC_TRACKING_H
 #define PROC_TRACKING_H
 
-#include <list>
+#include <vector>
+#include <string>
 
+#include "arena.h"
 #include "processors/processor.h"
 
 namespace Storage { class Hit; }
@@ -25,6 +27,11 @@ protected:
     * is iplane1*nplanes + iplane2 (yields scale from plane1 to plane2) */
   std::vector<double> m_transitionsX;
   std::vector<double> m_transitionsY;
+  /** Scratch memory for the track candidates of an event */
+  Utils::Arena m_arena;
+
+  /** Build the tracks of one event */
+  void processEvent(Storage::Event& event);
 
   /** Base virtual method called at each loop iteration */
   virtual void process();
@@ -34,6 +41,8 @@ public:
   double m_radius;
   /** Minimum number of clusters to make a track. Below 3 is ignored. */
   size_t m_minClusters;
+  /** Fit the tracks in float rather than double */
+  bool m_singlePrecision;
 
   /** Tracking requires no device information, and can be done for one device
     * at a time only */
@@ -43,17 +52,37 @@ public:
       m_transitionsX(m_nplanes*m_nplanes, 1),
       m_transitionsY(m_nplanes*m_nplanes, 1),
       m_radius(5),
-      m_minClusters(3) {}
+      m_minClusters(3),
+      m_singlePrecision(false) {}
   virtual ~Tracking() {}
 
+  virtual Processor* clone() const { return new Tracking(*this); }
+
+  /** Track a single event without going through `execute`. With `NPLANES`
+    * above 0, the number of planes is a compile time constant (instantiated
+    * for 6 planes). Used by `Chain`. */
+  template <size_t NPLANES>
+  void processFixed(Storage::Event& event);
+
   void setTransitionX(size_t from, size_t to, double scale);
   void setTransitionY(size_t from, size_t to, double scale);
 
+  /** Write the transfer scales to a text file, so that they can be measured
+    * once and used by many processing jobs */
+  void writeTransitions(const std::string& filePath) const;
+  /** Set the transfer scales from a file written by `writeTransitions` */
+  void readTransitions(const std::string& filePath);
+
   /** Algorithm builds the `Track` object, by performing a straight line
-    * fit to the clusters in the track. */
+    * fit to the `nclusters` clusters in the track. The fit is computed in
+    * the scalar type `T` (float or double), with its inputs taken from
+    * `scratch`. */
+  template <typename T>
   static void buildTrack(
       Storage::Track& track,
-      const std::list<Storage::Cluster*>& clusters);
+      Storage::Cluster* const* clusters,
+      size_t nclusters,
+      Utils::Arena& scratch);
 };
 
 }
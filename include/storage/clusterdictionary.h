@@ -0,0 +1,102 @@
+#ifndef CLUSTERDICTIONARY_H
+#define CLUSTERDICTIONARY_H
+
+#include <vector>
+#include <map>
+
+#include <Rtypes.h>
+#include <TDirectory.h>
+
+// Side of the box, in pixels, in which a cluster's shape must fit to be
+// encoded as a pattern (its hits then fit in the bits of a 64-bit word)
+#define PATTERN_SIZE 8
+
+// Name of the tree holding the dictionary in a file
+#define PATTERNS_TREE_NAME "ClusterPatterns"
+
+namespace Storage {
+
+class Cluster;
+
+/**
+  * Dictionary of the cluster shapes (patterns) seen in a calibration run,
+  * with the centroid and error of each. A cluster matching a pattern is then
+  * described by its anchor pixel (lowest column and row of its hits) and the
+  * pattern's index. This only compacts the storage: clustering still computes
+  * each centroid, and reading looks it up in the pattern, then places it
+  * with the plane's alignment.
+  *
+  * Shapes are gathered with `addCluster` and the most frequent ones kept by
+  * `build`. The centroid offset and errors of a pattern are averages over
+  * the calibration clusters of that shape: they are exact for unweighted
+  * clustering, and an approximation if the hits were weighted.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class ClusterDictionary {
+public:
+  struct Pattern {
+    /** Bit `dy*PATTERN_SIZE+dx` is set for a hit at (dx, dy) from the
+      * anchor */
+    ULong64_t shape;
+    /** Centroid relative to the anchor pixel, and cluster errors, in pixels */
+    double offsetX;
+    double offsetY;
+    double errX;
+    double errY;
+    /** Number of calibration clusters with this shape */
+    ULong64_t count;
+    Pattern() :
+        shape(0), offsetX(0), offsetY(0), errX(0), errY(0), count(0) {}
+  };
+
+private:
+  /** Sums over the calibration clusters of each shape seen so far */
+  std::map<ULong64_t, Pattern> m_candidates;
+  /** Patterns kept by `build`, most frequent first */
+  std::vector<Pattern> m_patterns;
+  /** Index of the pattern of each kept shape */
+  std::map<ULong64_t, Int_t> m_index;
+
+  /** Fill `m_index` from `m_patterns` */
+  void indexPatterns();
+
+public:
+  ClusterDictionary() {}
+
+  /** Get the anchor and shape of `cluster`. Returns false if it has no hits
+    * or doesn't fit in a pattern. */
+  static bool encode(
+      const Cluster& cluster,
+      Int_t& anchorX,
+      Int_t& anchorY,
+      ULong64_t& shape);
+
+  /** Count the shape of `cluster`, if it fits in a pattern */
+  void addCluster(const Cluster& cluster);
+  /** Add the counts of another dictionary's calibration */
+  void add(const ClusterDictionary& other);
+  /** Keep the (up to) `maxPatterns` most frequent shapes seen at least
+    * `minCount` times as the patterns, replacing any previous ones */
+  void build(size_t maxPatterns, ULong64_t minCount=1);
+
+  /** Index of the pattern with `shape`, -1 if there is none */
+  Int_t findPattern(ULong64_t shape) const;
+  const Pattern& getPattern(size_t n) const;
+  size_t getNumPatterns() const { return m_patterns.size(); }
+  /** Number of distinct shapes seen in calibration */
+  size_t getNumCandidates() const { return m_candidates.size(); }
+
+  /** True if both dictionaries hold the same patterns */
+  bool isSame(const ClusterDictionary& other) const;
+
+  /** Store the patterns in a tree in `dir` */
+  void write(TDirectory& dir) const;
+  /** Replace the patterns with those stored in `dir`. Returns false, and
+    * leaves the dictionary untouched, if `dir` has none. */
+  bool read(TDirectory& dir);
+};
+
+}
+
+#endif  // CLUSTERDICTIONARY_H
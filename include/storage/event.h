@@ -70,6 +70,11 @@ public:
   /** Print hit information to standard output */
   void print();
 
+  /** Delete the hits, clusters and tracks and clear the values, so that the
+    * event can be filled again. Only for events not owned by a `StorageIO`,
+    * which re-uses its own event. */
+  void reset();
+
   /** Make a new hit for plane `nplane` owned by this event */
   Hit& newHit(size_t nplane);
   /** Make a new cluster for plane `nplane` owned by this event */
@@ -29,6 +29,9 @@ protected:
   double m_posZ;
   /** Value of hit pixel (e.g. time over threashold) */
   double m_value;
+  /** Charge of the hit from the calibration of its value. Equals the value
+    * unless a calibration is applied. */
+  double m_charge;
   /** Timming of hit pixel (e.g. level 1 accept) */
   double m_timing;
   /** Flag to determine if this hit is masked */
@@ -52,6 +55,7 @@ public:
   inline double getPosY() const { return m_posY; }
   inline double getPosZ() const { return m_posZ; }
   inline double getValue() const { return m_value; }
+  inline double getCharge() const { return m_charge; }
   inline double getTiming() const { return m_timing; }
   inline bool getMasked() const { return m_masked; }
   inline Cluster* fetchCluster() const { return m_cluster; }
@@ -60,7 +64,9 @@ public:
   void setCluster(Cluster& cluster);
   inline void setPix(int x, int y) { m_pixX = x; m_pixY = y; }
   inline void setPos(double x, double y, double z) { m_posX = x; m_posY = y; m_posZ = z; }
-  inline void setValue(double value) { m_value = value; }
+  /** Set the raw value, and the charge to the same until calibrated */
+  inline void setValue(double value) { m_value = value; m_charge = value; }
+  inline void setCharge(double charge) { m_charge = charge; }
   inline void setTiming(double timing) { m_timing = timing; }
   inline void setMasked(bool isMaksed) { m_masked = isMaksed; }
 
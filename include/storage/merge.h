@@ -0,0 +1,26 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <string>
+#include <vector>
+
+namespace Storage {
+
+/**
+  * Concatenate judith files, e.g. the outputs of a run processed in shards,
+  * into one file. Events are written in the order of the inputs, which must
+  * be given in event order. All inputs must have the same planes and trees,
+  * with the same branches.
+  *
+  * By default, each event is read and written back. With `fast`, the trees
+  * are copied basket by basket without decoding the events, which is much
+  * faster but requires the inputs to be written with the same settings.
+  */
+void mergeFiles(
+    const std::vector<std::string>& inputPaths,
+    const std::string& outputPath,
+    bool fast=false);
+
+}
+
+#endif  // MERGE_H
@@ -23,6 +23,13 @@ protected:
   std::vector<Hit*> m_hits;
   /** List of clusters in this plane for an event */
   std::vector<Cluster*> m_clusters;
+  /** The hits are known to be in row-major order, and indexed by row */
+  bool m_sorted;
+  /** Row of the first entry in `m_rowOffsets` */
+  int m_firstRow;
+  /** Index of the first hit of each row starting at `m_firstRow`, followed
+    * by the number of hits */
+  std::vector<size_t> m_rowOffsets;
 
   /** Only constructed by an `Event` object */
   Plane(size_t nplane);
@@ -36,6 +43,15 @@ public:
   /** Print hit information to standard output */
   void print();
 
+  /** Check that the hits are in row-major order (by row, then column) and
+    * if so, index the first hit of each row. Returns false, leaving the plane
+    * without index, otherwise. Adding a hit drops the index. */
+  bool indexRows();
+  /** Get the range of hits, from `first` up to `last` excluded, in `row`.
+    * The range is empty for rows without hits. Needs the row index. */
+  void getRowRange(int row, size_t& first, size_t& last) const;
+  inline bool isSorted() const { return m_sorted; }
+
   Hit& getHit(size_t n) const;
   Cluster& getCluster(size_t n) const;
 
@@ -0,0 +1,130 @@
+#ifndef STORAGEDS_H
+#define STORAGEDS_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <typeinfo>
+
+#include <Rtypes.h>
+#include <ROOT/RDataSource.hxx>
+#include <ROOT/RDataFrame.hxx>
+
+namespace Storage {
+
+class StorageI;
+class Cluster;
+class Track;
+
+/**
+  * Data source exposing the events of a judith file to `ROOT::RDataFrame`.
+  * Each event is a row, with the columns:
+  *
+  *   - `TimeStamp`, `FrameNumber`, `TriggerOffset`, `TriggerInfo` and
+  *     `Invalid` from the event information;
+  *   - `PlaneN_ClusterX` for each cluster variable `X` of plane `N`, as a
+  *     vector with one entry per cluster. `PlaneN_ClusterInTrack` gives the
+  *     index of the cluster's track, or -1;
+  *   - `Track_X` for each track variable `X`, as a vector with one entry per
+  *     track.
+  *
+  * Only the trees and branches backing the columns used by the data frame
+  * are read. Each slot has its own `StorageI`, so that slots can run on
+  * separate threads with ROOT's implicit multi-threading.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class StorageDS : public ROOT::RDF::RDataSource {
+private:
+  // Disable copy and assignment operators
+  StorageDS(const StorageDS&);
+  StorageDS& operator=(const StorageDS&);
+
+  /** Description of a column and of where its values come from */
+  struct Column {
+    std::string name;
+    std::string typeName;
+    const std::type_info* type;
+    /** `StorageIO::ContentFlags` of the tree holding the values */
+    int tree;
+    /** Name of the branch holding the values */
+    std::string branch;
+    /** Plane of a cluster column */
+    size_t plane;
+    /** Getter of a cluster or track column (0 for other columns) */
+    double (Cluster::*clusterValue)() const;
+    double (Track::*trackValue)() const;
+    Column() :
+        type(0), tree(0), plane(0), clusterValue(0), trackValue(0) {}
+  };
+
+  /** Values of the columns for the event currently loaded in a slot */
+  struct Slot {
+    StorageI* input;
+    ULong64_t timeStamp;
+    ULong64_t frameNumber;
+    Int_t triggerOffset;
+    Int_t triggerInfo;
+    bool invalid;
+    /** Vector values of each column (unused for scalar columns) */
+    std::vector<std::vector<double> > doubles;
+    std::vector<std::vector<int> > ints;
+    /** Address of the value of each column, handed out to the readers */
+    std::vector<void*> values;
+    Slot() :
+        input(0), timeStamp(0), frameNumber(0),
+        triggerOffset(0), triggerInfo(0), invalid(false) {}
+  };
+
+  /** Path of the file to read */
+  const std::string m_filePath;
+  /** Number of events in the file */
+  ULong64_t m_numEvents;
+  /** All available columns */
+  std::vector<Column> m_columns;
+  /** Names of the available columns, in the order of `m_columns` */
+  std::vector<std::string> m_columnNames;
+  /** Flags the columns for which readers were requested */
+  std::vector<bool> m_requested;
+  /** One slot for each processing slot of the data frame */
+  std::vector<Slot> m_slots;
+  /** Remember if the entry ranges have been handed out */
+  bool m_rangesDone;
+
+  /** Add a column to the list of available columns */
+  void addColumn(const Column& column);
+  /** Find the index of a column by name, throws if it doesn't exist */
+  size_t findColumn(std::string_view name) const;
+  /** Delete the inputs of all slots */
+  void closeInputs();
+
+protected:
+  Record_t GetColumnReadersImpl(
+      std::string_view name,
+      const std::type_info& type);
+
+public:
+  /** Open the file to find its planes and columns */
+  StorageDS(const std::string& filePath);
+  ~StorageDS();
+
+  void SetNSlots(unsigned int nSlots);
+  const std::vector<std::string>& GetColumnNames() const;
+  bool HasColumn(std::string_view name) const;
+  std::string GetTypeName(std::string_view name) const;
+  /** Split the events evenly between the slots */
+  std::vector<std::pair<ULong64_t, ULong64_t> > GetEntryRanges();
+  /** Read event `entry` into the columns of slot `slot` */
+  bool SetEntry(unsigned int slot, ULong64_t entry);
+  /** Open one input for each slot, reading only the requested columns */
+  void Initialise();
+  void Finalise();
+  std::string GetLabel() { return "Judith"; }
+};
+
+/** Build a data frame reading the judith file at `filePath` */
+ROOT::RDataFrame makeDataFrame(const std::string& filePath);
+
+}
+
+#endif // STORAGEDS_H
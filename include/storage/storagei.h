@@ -4,6 +4,9 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <limits>
+
+#include <Rtypes.h>
 
 #include "storage/storageio.h"
 
@@ -15,6 +18,88 @@ private:
   StorageI(const StorageI&);
   StorageI& operator=(const StorageI&);
 
+public:
+  /** Inclusive bounds on the pixel coordinates and timing of the hits read
+    * from a plane. Hits outside are dropped before any object is built. The
+    * default window accepts everything. */
+  struct HitWindow {
+    Int_t minPixX;
+    Int_t maxPixX;
+    Int_t minPixY;
+    Int_t maxPixY;
+    Int_t minTiming;
+    Int_t maxTiming;
+    HitWindow() :
+        minPixX(std::numeric_limits<Int_t>::min()),
+        maxPixX(std::numeric_limits<Int_t>::max()),
+        minPixY(std::numeric_limits<Int_t>::min()),
+        maxPixY(std::numeric_limits<Int_t>::max()),
+        minTiming(std::numeric_limits<Int_t>::min()),
+        maxTiming(std::numeric_limits<Int_t>::max()) {}
+    /** True if the window can't reject any hit */
+    bool isOpen() const;
+  };
+
+private:
+  /** Charge calibration of a plane. Holds `nterms` polynomial coefficients
+    * for each pixel, lowest order first, those of pixel (x, y) starting at
+    * `(y*ncols+x)*nterms`. */
+  struct Calibration {
+    const float* table;
+    Int_t ncols;
+    Int_t nrows;
+    Int_t nterms;
+    Calibration() : table(0), ncols(0), nrows(0), nterms(0) {}
+  };
+
+  /** Affine map of a plane from pixel to global coordinates (see
+    * `Mechanics::Sensor::getPixelMap`) */
+  struct PixelMap {
+    double map[3][3];
+    bool set;
+    PixelMap() : set(false) {}
+  };
+
+  /** Path of the file being read, and mask of the planes not read from it,
+    * kept to open duplicates of this input */
+  const std::string m_filePath;
+  std::vector<bool> m_planeMask;
+
+  /** Window applied to the hits of each plane, empty if none is set */
+  std::vector<HitWindow> m_hitWindows;
+  /** Indices of the current plane's hits which pass the windows and noise
+    * masks, in their original order */
+  std::vector<Int_t> m_hitSelection;
+  /** Non-zero for each selected hit of the current plane which lies in a
+    * masked pixel */
+  std::vector<Int_t> m_hitMasked;
+  /** Calibration of each plane, empty if no plane is calibrated */
+  std::vector<Calibration> m_calibrations;
+  /** Calibrated charge of each selected hit on the current plane */
+  std::vector<float> m_hitCharges;
+  /** Map from pixel to global coordinates of each plane, to place clusters
+    * stored by pattern. Empty if no plane has one. */
+  std::vector<PixelMap> m_pixelMaps;
+
+  /** Put the hits of each plane in row-major order when reading */
+  bool m_sortHits;
+  /** The file is flagged as already holding its hits in order */
+  bool m_fileSorted;
+  /** Sort keys of the selected hits, and buffers for the radix sort passes */
+  std::vector<ULong64_t> m_sortKeys;
+  std::vector<ULong64_t> m_sortKeysTemp;
+  std::vector<Int_t> m_sortSelection;
+
+  /** Fill `m_hitSelection` from the hit arrays of plane `nplane` and return
+    * the number of hits selected */
+  Int_t selectHits(size_t nplane);
+  /** Order the `nselected` hits of `m_hitSelection` by row, then column */
+  void sortHits(Int_t nselected);
+  /** Fill `m_hitMasked` for the `nselected` hits of plane `nplane` */
+  void maskHits(size_t nplane, Int_t nselected);
+  /** Fill `m_hitCharges` for the `nselected` hits of plane `nplane` */
+  void calibrateHits(size_t nplane, Int_t nselected);
+
 public:
   StorageI(
       const std::string& filePath,
@@ -29,6 +114,43 @@ public:
 
   /** Generate the `Event` object filled from entry `n` */
   Event& readEvent(Long64_t n);
+  /** Fill `event`, which must be empty and have this input's planes, from
+    * entry `n`. Lets many events read from this input be kept at once. */
+  void readEvent(Long64_t n, Event& event);
+
+  /** Open another input on the same file, reading the same planes and
+    * branches, with the same windows, calibrations and noise masks. Each
+    * thread of a parallel loop reads from its own duplicate. The caller takes
+    * ownership. */
+  StorageI* duplicate() const;
+
+  /** Read the hits of each plane in row-major order (by row, then column)
+    * and index the planes by row. Hits of the same pixel keep their order.
+    * Files flagged as sorted (see `StorageO`) are only indexed. */
+  void setSortHits(bool sort);
+  bool getSortHits() const { return m_sortHits; }
+  /** True if the file is flagged as holding its hits in row-major order */
+  bool isFileSorted() const { return m_fileSorted; }
+
+  /** Only read the hits of plane `nplane` which fall inside `window` */
+  void setHitWindow(size_t nplane, const HitWindow& window);
+
+  /** Set the charge of the hits of plane `nplane` from their raw values,
+    * with the polynomial of their pixel in `table` (see `Calibration`). The
+    * raw values are kept as the hit values. The table isn't copied and must
+    * outlive this object. */
+  void setCalibration(
+      size_t nplane,
+      const float* table,
+      Int_t ncols,
+      Int_t nrows,
+      Int_t nterms);
+
+  /** Files storing clusters by pattern don't hold their positions: rebuild
+    * them for plane `nplane` from the cluster pixel values with `map` (see
+    * `Mechanics::Sensor::getPixelMap`). Without a map, such clusters are read
+    * at the origin, and need `Processors::Aligning` to be placed. */
+  void setPixelMap(size_t nplane, const double (*map)[3]);
 };
 
 }
@@ -11,6 +11,8 @@
 #include <TTree.h>
 #include <TBranch.h>
 
+#include "storage/clusterdictionary.h"
+
 // NOTE: these sizes are used to initialize arrays of track, cluster and
 // hit information. BUT these arrays are generated ONLY ONCE and re-used
 // to load events. Vectors could have been used in the ROOT file format, but
@@ -19,6 +21,10 @@
 #define MAX_CLUSTERS 10000
 #define MAX_HITS 10000
 
+// Name of the object flagging a file in which the hits of every plane are
+// stored in row-major pixel order
+#define HITS_SORTED_NAME "HitsSorted"
+
 namespace Storage {
 
 class Hit;
@@ -73,14 +79,18 @@ public:
     REMOVE
   };
 
-  /** Struct allows user to pass a noise mask for each plane as a 1D vector
-    * specifying how it is partitionned */
+  /** Noise mask of a plane, packed into a dense bitmap with one bit per
+    * pixel. The bit of pixel (col, row) is `row*ncols+col`, matching
+    * `Mechanics::Sensor::getPixelIndex`. Empty if the plane isn't masked. */
   struct NoiseMask {
-    std::vector<bool> mask;
+    std::vector<ULong64_t> words;
     size_t nrows;
     size_t ncols;
     NoiseMask() : nrows(0), ncols(0) {}
-    inline bool at(size_t nrow, size_t ncol) { return mask[nrow*ncols+ncol]; }
+    inline bool at(size_t col, size_t row) const {
+      const size_t bit = row*ncols+col;
+      return (words[bit>>6] >> (bit&63)) & 1;
+    }
   };
 
 protected:
@@ -96,8 +106,15 @@ protected:
   MaskMode m_maskMode;
   /** Number of events */
   Long64_t m_numEvents;
-  /** Vector of NoiseMask objects for each plane. The objects are realtively
-    * small and the vector won't be copied. */
+  /** Patterns of the clusters in the file, empty unless the clusters are
+    * stored by pattern */
+  ClusterDictionary m_clusterPatterns;
+  /** The cluster trees give the pixel values as an anchor and a pattern
+    * (with the others listed apart), rather than in full, and no positions */
+  bool m_clustersPatterned;
+  /** Vector of NoiseMask objects for each plane, empty if no plane is
+    * masked. The objects are realtively small and the vector won't be
+    * copied. */
   std::vector<NoiseMask> m_noiseMasks;
 
   // Cache objects so they aren't re-allocated at each iteration
@@ -136,6 +153,7 @@ protected:
   Double_t hitPosZ[MAX_HITS];
   Int_t    hitValue[MAX_HITS];
   Int_t    hitTiming[MAX_HITS];
+  Float_t  hitCharge[MAX_HITS];
   Int_t    hitInCluster[MAX_HITS];
 
   Int_t    numClusters;
@@ -152,6 +170,16 @@ protected:
   Double_t clusterValue[MAX_CLUSTERS];
   Double_t clusterTiming[MAX_CLUSTERS];
   Int_t    clusterInTrack[MAX_CLUSTERS];
+  // Pixel values of patterned clusters: the pattern index (-1 if none) and
+  // anchor, and the values of the clusters without pattern in turn
+  Int_t    clusterPattern[MAX_CLUSTERS];
+  Int_t    clusterAnchorX[MAX_CLUSTERS];
+  Int_t    clusterAnchorY[MAX_CLUSTERS];
+  Int_t    numOthers;
+  Double_t otherPixX[MAX_CLUSTERS];
+  Double_t otherPixY[MAX_CLUSTERS];
+  Double_t otherPixErrX[MAX_CLUSTERS];
+  Double_t otherPixErrY[MAX_CLUSTERS];
 
   ULong64_t timeStamp;
   ULong64_t frameNumber;
@@ -208,6 +236,26 @@ public:
   FileMode getFileMode() const { return m_fileMode; }
   MaskMode getMaskMode() const { return m_maskMode; }
   int getTreeMask() const { return m_treeMask; }
+  /** True if the clusters are stored by pattern */
+  bool isClustersPatterned() const { return m_clustersPatterned; }
+  /** Patterns of the stored clusters (empty if not patterned) */
+  const ClusterDictionary& getClusterPatterns() const {
+    return m_clusterPatterns; }
+  /** Get the `ContentFlags` of the trees which are actually read or
+    * written (the inverse of the tree mask, less trees missing in a file) */
+  int getContent() const;
+
+  /** Set the strategy for dealing with hits in masked pixels */
+  void setMaskMode(MaskMode mode) { m_maskMode = mode; }
+  /** Mask the pixels of plane `nplane` flagged in `mask`, which has one
+    * entry per pixel in the order of `Mechanics::Sensor::getPixelIndex` */
+  void setNoiseMask(
+      size_t nplane,
+      const std::vector<bool>& mask,
+      size_t ncols,
+      size_t nrows);
+  /** Get the packed noise mask of plane `nplane` (empty if none is set) */
+  const NoiseMask& getNoiseMask(size_t nplane) const;
 
   friend class Event;  // Access to cache
 };
@@ -15,6 +15,16 @@ private:
   StorageO(const StorageIO&);
   StorageO& operator=(const StorageIO&);
 
+  /** All the planes written so far were in row-major order, so the file can
+    * be flagged as sorted for the readers */
+  bool m_hitsSorted;
+  /** Largest difference, in pixels, between a cluster's values and those of
+    * its pattern for it to be stored by pattern */
+  double m_patternTolerance;
+
+  /** Set the pattern arrays of cluster `ncluster` of the current plane */
+  void setPattern(const Cluster& cluster, Int_t ncluster);
+
 public:
   StorageO(
       const std::string& filePath,
@@ -24,12 +34,22 @@ public:
       const std::set<std::string>* hitsBranchesOff=0,
       const std::set<std::string>* clustersBranchesOff=0,
       const std::set<std::string>* tracksBranchesOff=0,
-      const std::set<std::string>* eventInfoBranchesOff=0);
-  // Write to the file
+      const std::set<std::string>* eventInfoBranchesOff=0,
+      // Store the clusters matching these patterns as an anchor and pattern,
+      // and no cluster positions (see `StorageI::setPixelMap`), unless the
+      // "Pattern" clusters branch is off
+      const ClusterDictionary* clusterPatterns=0);
+  // Write to the file, and flag it as sorted if all its planes were
   virtual ~StorageO();
 
   /** Write the `Event` object to the file */
   void writeEvent(Event& event);
+
+  /** Store a cluster by pattern only if its center and errors are within
+    * `tolerance` pixels of the pattern's. Read back, they can differ from
+    * the clustered values by up to this (1e-6 pixel by default). */
+  void setPatternTolerance(double tolerance) { m_patternTolerance = tolerance; }
+  double getPatternTolerance() const { return m_patternTolerance; }
 };
 
 }
@@ -0,0 +1,96 @@
+#ifndef TRACKNTUPLE_H
+#define TRACKNTUPLE_H
+
+#include <string>
+#include <vector>
+
+#include <Rtypes.h>
+#include <TFile.h>
+#include <TTree.h>
+
+namespace Storage {
+
+class Event;
+class Track;
+class Cluster;
+
+/**
+  * Flat output with one entry per track, for analyses which don't need to
+  * rebuild the event's objects. Each entry holds the track parameters and,
+  * for each plane, the track's cluster on that plane along with its residual
+  * to the track.
+  *
+  * Per-plane values are fixed size arrays indexed by the plane number. Planes
+  * without a cluster have a size of 0, and their other values are 0.
+  *
+  * The ntuple is filled from one thread: `LoopProcess` fills it on the thread
+  * which writes the output, in event order.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class TrackNtuple {
+private:
+  // Disable copy and assignment operators
+  TrackNtuple(const TrackNtuple&);
+  TrackNtuple& operator=(const TrackNtuple&);
+
+  /** File in which the ntuple is written */
+  TFile m_file;
+  /** Tree with one entry per track */
+  TTree* m_tree;
+  /** Number of planes for which cluster information is stored */
+  const size_t m_numPlanes;
+
+  /** Find the cluster of a track on each plane (0 if none) */
+  void findClusters(
+      const Track& track,
+      std::vector<const Cluster*>& clusters) const;
+
+  // Variables in which a track is stored before filling the tree
+
+  ULong64_t event;
+  ULong64_t timeStamp;
+  Int_t     trackIndex;
+  Int_t     numTracks;
+  Double_t  originX;
+  Double_t  originY;
+  Double_t  originErrX;
+  Double_t  originErrY;
+  Double_t  slopeX;
+  Double_t  slopeY;
+  Double_t  slopeErrX;
+  Double_t  slopeErrY;
+  Double_t  covarianceX;
+  Double_t  covarianceY;
+  Double_t  chi2;
+  Int_t     numClusters;
+
+  std::vector<Double_t> clusterPixX;
+  std::vector<Double_t> clusterPixY;
+  std::vector<Double_t> clusterPosX;
+  std::vector<Double_t> clusterPosY;
+  std::vector<Double_t> clusterPosZ;
+  std::vector<Double_t> clusterValue;
+  std::vector<Int_t>    clusterSize;
+  std::vector<Double_t> residualX;
+  std::vector<Double_t> residualY;
+
+  /** List of cluster found for each plane, re-used for each track */
+  std::vector<const Cluster*> m_clusters;
+
+public:
+  TrackNtuple(const std::string& filePath, size_t numPlanes);
+  /** Write to the file */
+  ~TrackNtuple();
+
+  /** Add one entry for each track in `event`, the `ievent`th event of the
+    * input */
+  void fill(const Event& event, ULong64_t ievent);
+
+  Long64_t getNumEntries() const { return m_tree->GetEntries(); }
+  size_t getNumPlanes() const { return m_numPlanes; }
+};
+
+}
+
+#endif // TRACKNTUPLE_H
@@ -0,0 +1,78 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace Utils {
+
+/**
+  * Fixed set of threads which run the independent parts of a single job, for
+  * work which is split within one event (e.g. by plane). The calling thread
+  * takes part in the job, and `run` returns once all parts are done.
+  *
+  * One job runs at a time: a pool shared by many threads runs their jobs one
+  * after the other.
+  *
+  * @author Garrin McGoldrick (garrin.mcgoldrick@cern.ch)
+  */
+class ThreadPool {
+public:
+  /** Work split into parts indexed from 0, which can run in any order */
+  class Task {
+  public:
+    virtual ~Task() {}
+    /** Run part `i` of the task */
+    virtual void run(size_t i) = 0;
+  };
+
+private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  /** Threads other than the caller's */
+  std::vector<std::thread> m_threads;
+  /** Serializes the callers of `run` */
+  std::mutex m_runMutex;
+
+  /** Guards the job description and wakes the threads for a new job */
+  std::mutex m_mutex;
+  std::condition_variable m_start;
+  std::condition_variable m_done;
+  /** Incremented at each job, so threads know when a new one is posted */
+  unsigned long m_generation;
+  bool m_stop;
+
+  /** The current job: its task (0 when there is none), number of parts,
+    * next part to claim and number of threads still working on it */
+  Task* m_task;
+  size_t m_nparts;
+  std::atomic<size_t> m_next;
+  unsigned m_nbusy;
+  /** Message of the first exception thrown by a part */
+  std::string m_error;
+
+  /** Claim and run parts of the current job until none are left */
+  void work(Task& task, size_t nparts);
+  /** Loop of the pool threads, waiting for jobs */
+  void wait();
+
+public:
+  /** Pool using `nthreads` threads in total, including the caller of `run` */
+  ThreadPool(unsigned nthreads);
+  ~ThreadPool();
+
+  /** Run parts 0 to `nparts`-1 of `task` and wait for them to finish. An
+    * exception in a part is re-thrown here once all parts are done. */
+  void run(Task& task, size_t nparts);
+
+  unsigned getNumThreads() const { return m_threads.size()+1; }
+};
+
+}
+
+#endif  // THREADPOOL_H
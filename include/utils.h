@@ -24,17 +24,20 @@ void fitGausBg(
     bool display=false,
     double fitRange=5);
 
+/** Weighted straight line fit of `y` against `x`, with the sums computed in
+  * the scalar type `T` (instantiated for double and float) */
+template <typename T>
 void linearFit(
     const unsigned n,
-    const double* x,
-    const double* y,
-    const double* ye,
-    double& p0,
-    double& p1,
-    double& p0e,
-    double& p1e,
-    double& cov,
-    double& chi2);
+    const T* x,
+    const T* y,
+    const T* ye,
+    T& p0,
+    T& p1,
+    T& p0e,
+    T& p1e,
+    T& cov,
+    T& chi2);
 
 void linePlaneIntercept(
     double p0x,
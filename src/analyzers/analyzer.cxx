@@ -100,11 +100,67 @@ void Analyzer::execute(const Storage::Event& event) {
   process();
 }
 
+void Analyzer::executeBatch(const std::vector<Storage::Event*>& events) {
+  m_batch.assign(events.begin(), events.end());
+  executeBatch(m_batch);
+}
+
+void Analyzer::executeBatch(const std::vector<const Storage::Event*>& events) {
+  // Each iteration in the block has one event for each device
+  if (events.size() % m_ndevices)
+    throw std::runtime_error("Analyzer::executeBatch: incorrect number of events passed");
+  if (events.empty()) return;
+  processBatch(events);
+}
+
+void Analyzer::processBatch(const std::vector<const Storage::Event*>& events) {
+  for (size_t ibatch = 0; ibatch < events.size(); ibatch += m_ndevices) {
+    for (size_t i = 0; i < m_ndevices; i++)
+      m_events[i] = events[ibatch+i];
+    process();
+  }
+}
+
 void Analyzer::finalize() {
   if (m_finalized)
     throw std::runtime_error("Analyzer::finalize: analyzer already finalized");
   m_finalized = true;
 }
 
+Analyzer* Analyzer::clone() const {
+  throw std::runtime_error(
+      "Analyzer::clone: analyzer doesn't support parallel loops");
 }
 
+void Analyzer::merge(const Analyzer& other) {
+  if (m_finalized || other.m_finalized)
+    throw std::runtime_error("Analyzer::merge: can't merge finalized analyzers");
+  if (other.m_histograms.size() != m_histograms.size())
+    throw std::runtime_error("Analyzer::merge: histograms don't match");
+
+  // Clones book their histograms in the same order, so pair them up by position
+  std::list<TH1*>::const_iterator jt = other.m_histograms.begin();
+  for (std::list<TH1*>::iterator it = m_histograms.begin();
+      it != m_histograms.end(); ++it, ++jt)
+    (*it)->Add(*jt);
+}
+
+void Analyzer::addDependency(const Analyzer& analyzer) {
+  if (&analyzer == this)
+    throw std::runtime_error("Analyzer::addDependency: can't depend on itself");
+  m_dependencies.push_back(&analyzer);
+}
+
+void Analyzer::getMoments(
+    std::vector<double>& means,
+    std::vector<double>& sigmas) const {
+  for (std::list<TH1*>::const_iterator it = m_histograms.begin();
+      it != m_histograms.end(); ++it) {
+    // Multi-dimensional histograms (e.g. correlations) aren't summarized
+    if ((*it)->GetDimension() != 1 || (*it)->GetEntries() == 0) continue;
+    means.push_back((*it)->GetMean());
+    sigmas.push_back((*it)->GetRMS());
+  }
+}
+
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "storage/event.h"
+#include "storage/plane.h"
+#include "storage/cluster.h"
+#include "storage/clusterdictionary.h"
+#include "analyzers/clusterpatterns.h"
+
+namespace Analyzers {
+
+void ClusterPatterns::process() {
+  for (size_t idevice = 0; idevice < m_ndevices; idevice++) {
+    const Storage::Event& event = *m_events[idevice];
+    for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++) {
+      const Storage::Plane& plane = event.getPlane(iplane);
+      for (size_t icluster = 0; icluster < plane.getNumClusters(); icluster++)
+        m_dictionary.addCluster(plane.getCluster(icluster));
+    }
+  }
+}
+
+void ClusterPatterns::finalize() {
+  Analyzer::finalize();
+  m_dictionary.build(m_maxPatterns, m_minCount);
+}
+
+Analyzer* ClusterPatterns::clone() const {
+  ClusterPatterns* patterns = new ClusterPatterns(m_ndevices);
+  patterns->m_maxPatterns = m_maxPatterns;
+  patterns->m_minCount = m_minCount;
+  return patterns;
+}
+
+void ClusterPatterns::merge(const Analyzer& other) {
+  Analyzer::merge(other);
+  const ClusterPatterns& patterns = dynamic_cast<const ClusterPatterns&>(other);
+  m_dictionary.add(patterns.m_dictionary);
+}
+
+}
@@ -97,17 +97,20 @@ void ClusterResiduals::initialize() {
       }  // reference sensor loop
     }  // device sensor loop
   }  // device loop
+
+  m_bufferX.resize(m_hResidualsX.size());
+  m_bufferY.resize(m_hResidualsY.size());
 }
 
-void ClusterResiduals::process() {
+void ClusterResiduals::collect(const Storage::Event* const* events) {
   // Keep track of the reference event (with all reference planes)
   assert(m_ndevices > 0 && "ensures > 0 events");
-  const Storage::Event& refEvent = *m_events[0];
+  const Storage::Event& refEvent = *events[0];
 
   size_t iglobal = 0;
 
-  for (size_t ievent = 0; ievent < m_events.size(); ievent++) {
-    const Storage::Event& event = *m_events[ievent];
+  for (size_t ievent = 0; ievent < m_ndevices; ievent++) {
+    const Storage::Event& event = *events[ievent];
 
     for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++) {
       const Storage::Plane& plane = event.getPlane(iplane);
@@ -138,8 +141,8 @@ void ClusterResiduals::process() {
 
           if (!nearest) continue;
 
-          m_hResidualsX[iglobal]->Fill(cluster.getPosX() - nearest->getPosX());
-          m_hResidualsY[iglobal]->Fill(cluster.getPosY() - nearest->getPosY());
+          m_bufferX[iglobal].push_back(cluster.getPosX() - nearest->getPosX());
+          m_bufferY[iglobal].push_back(cluster.getPosY() - nearest->getPosY());
         }
 
         iglobal += 1;
@@ -148,6 +151,28 @@ void ClusterResiduals::process() {
   }
 }
 
+void ClusterResiduals::flush() {
+  for (size_t i = 0; i < m_bufferX.size(); i++) {
+    if (!m_bufferX[i].empty())
+      m_hResidualsX[i]->FillN(m_bufferX[i].size(), &m_bufferX[i][0], 0);
+    if (!m_bufferY[i].empty())
+      m_hResidualsY[i]->FillN(m_bufferY[i].size(), &m_bufferY[i][0], 0);
+    m_bufferX[i].clear();
+    m_bufferY[i].clear();
+  }
+}
+
+void ClusterResiduals::process() {
+  collect(&m_events[0]);
+  flush();
+}
+
+void ClusterResiduals::processBatch(const std::vector<const Storage::Event*>& events) {
+  for (size_t ibatch = 0; ibatch < events.size(); ibatch += m_ndevices)
+    collect(&events[ibatch]);
+  flush();
+}
+
 size_t ClusterResiduals::toGlobal(
     size_t idevice, 
     size_t isensor, 
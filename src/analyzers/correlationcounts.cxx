@@ -0,0 +1,174 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include <TH2D.h>
+
+#include "analyzers/correlationcounts.h"
+
+namespace Analyzers {
+
+CorrelationCounts::CorrelationCounts(
+    unsigned npixX,
+    unsigned npixY,
+    unsigned rebin) :
+    m_npixX(npixX),
+    m_npixY(npixY),
+    m_rebin(rebin),
+    m_nbinsX(0),
+    m_nbinsY(0),
+    m_width(0),
+    m_first(),
+    m_counts(),
+    m_below(),
+    m_above(),
+    m_underX(),
+    m_overX() {
+  if (m_rebin == 0)
+    throw std::runtime_error(
+        "CorrelationCounts::CorrelationCounts: rebin must be above 0");
+  // Partial groups at the end get their own bin
+  m_nbinsX = (m_npixX + m_rebin-1) / m_rebin;
+  m_nbinsY = (m_npixY + m_rebin-1) / m_rebin;
+  // Without a band, every y bin is kept for each x bin
+  m_width = m_nbinsY;
+  m_first.assign(m_nbinsX, 0);
+  m_counts.assign((size_t)m_nbinsX * m_width, 0);
+  m_below.assign(m_nbinsX, 0);
+  m_above.assign(m_nbinsX, 0);
+  m_underX.assign(m_nbinsY+2, 0);
+  m_overX.assign(m_nbinsY+2, 0);
+}
+
+void CorrelationCounts::fillOutsideX(double x, double y) {
+  // ROOT bin along y, without a band to apply
+  unsigned biny = 0;
+  if (!(y < 0))
+    biny = (y < m_npixY) ? static_cast<unsigned>(y)/m_rebin + 1 : m_nbinsY+1;
+  if (x < 0)
+    m_underX[biny] += 1;
+  else
+    m_overX[biny] += 1;
+}
+
+void CorrelationCounts::setBand(
+    const std::vector<double>& centers,
+    unsigned halfWidth) {
+  if (centers.size() != m_nbinsX)
+    throw std::runtime_error(
+        "CorrelationCounts::setBand: need one center per x bin");
+  if (!isEmpty())
+    throw std::runtime_error("CorrelationCounts::setBand: already filled");
+
+  // A band as wide as the axis keeps everything
+  if (2*halfWidth+1 >= m_nbinsY) return;
+  m_width = 2*halfWidth+1;
+
+  for (unsigned ix = 0; ix < m_nbinsX; ix++) {
+    // Slide the band to stay within the axis, so it always has full width
+    const double low = std::floor(centers[ix]) - (double)halfWidth;
+    if (!(low > 0))
+      m_first[ix] = 0;  // also for a NaN center
+    else if (low > m_nbinsY - m_width)
+      m_first[ix] = m_nbinsY - m_width;
+    else
+      m_first[ix] = static_cast<unsigned>(low);
+  }
+
+  m_counts.assign((size_t)m_nbinsX * m_width, 0);
+}
+
+void CorrelationCounts::add(const CorrelationCounts& other) {
+  if (other.m_npixX != m_npixX || other.m_npixY != m_npixY ||
+      other.m_rebin != m_rebin || other.m_width != m_width ||
+      other.m_first != m_first)
+    throw std::runtime_error("CorrelationCounts::add: binning doesn't match");
+  for (size_t i = 0; i < m_counts.size(); i++)
+    m_counts[i] += other.m_counts[i];
+  for (unsigned ix = 0; ix < m_nbinsX; ix++) {
+    m_below[ix] += other.m_below[ix];
+    m_above[ix] += other.m_above[ix];
+  }
+  for (unsigned biny = 0; biny < m_nbinsY+2; biny++) {
+    m_underX[biny] += other.m_underX[biny];
+    m_overX[biny] += other.m_overX[biny];
+  }
+}
+
+void CorrelationCounts::reset() {
+  m_counts.assign(m_counts.size(), 0);
+  m_below.assign(m_below.size(), 0);
+  m_above.assign(m_above.size(), 0);
+  m_underX.assign(m_underX.size(), 0);
+  m_overX.assign(m_overX.size(), 0);
+}
+
+bool CorrelationCounts::isEmpty() const {
+  if (getNumOutside() != 0) return false;
+  for (size_t i = 0; i < m_counts.size(); i++)
+    if (m_counts[i] != 0) return false;
+  return true;
+}
+
+unsigned long long CorrelationCounts::getNumOutside() const {
+  unsigned long long outside = 0;
+  for (unsigned ix = 0; ix < m_nbinsX; ix++) {
+    outside += m_below[ix];
+    outside += m_above[ix];
+  }
+  for (unsigned biny = 0; biny < m_nbinsY+2; biny++) {
+    outside += m_underX[biny];
+    outside += m_overX[biny];
+  }
+  return outside;
+}
+
+unsigned CorrelationCounts::getCount(unsigned ix, unsigned iy) const {
+  if (ix >= m_nbinsX || iy >= m_nbinsY)
+    throw std::runtime_error("CorrelationCounts::getCount: bin out of range");
+  const unsigned iband = iy - m_first[ix];
+  if (iband >= m_width) return 0;
+  return m_counts[ix*m_width + iband];
+}
+
+TH2D* CorrelationCounts::makeHistogram(
+    const std::string& name,
+    const std::string& title) const {
+  TH2D* hist = new TH2D(
+      name.c_str(), title.c_str(),
+      m_nbinsX, 0, m_nbinsX*m_rebin,
+      m_nbinsY, 0, m_nbinsY*m_rebin);
+
+  double entries = 0;
+  for (unsigned ix = 0; ix < m_nbinsX; ix++) {
+    for (unsigned iband = 0; iband < m_width; iband++) {
+      const unsigned count = m_counts[ix*m_width + iband];
+      if (count == 0) continue;
+      // ROOT bins start at 1
+      hist->SetBinContent(ix+1, m_first[ix]+iband+1, count);
+      entries += count;
+    }
+  }
+
+  // Under/overflow along y of each x bin, then along x
+  for (unsigned ix = 0; ix < m_nbinsX; ix++) {
+    if (m_below[ix]) hist->SetBinContent(ix+1, 0, m_below[ix]);
+    if (m_above[ix]) hist->SetBinContent(ix+1, m_nbinsY+1, m_above[ix]);
+  }
+  for (unsigned biny = 0; biny < m_nbinsY+2; biny++) {
+    if (m_underX[biny]) hist->SetBinContent(0, biny, m_underX[biny]);
+    if (m_overX[biny]) hist->SetBinContent(m_nbinsX+1, biny, m_overX[biny]);
+  }
+  entries += getNumOutside();
+
+  // With unit weights, the sum of squared weights is the content itself,
+  // which is what `Sumw2` takes on an already filled histogram
+  hist->Sumw2();
+  hist->SetEntries(entries);
+
+  return hist;
+}
+
+}
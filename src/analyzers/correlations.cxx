@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <cassert>
 #include <string>
+#include <vector>
 
 #include <TDirectory.h>
 #include <TH1D.h>
@@ -12,6 +13,7 @@
 #include "storage/cluster.h"
 #include "mechanics/device.h"
 #include "mechanics/sensor.h"
+#include "analyzers/correlationcounts.h"
 #include "analyzers/correlations.h"
 
 namespace Analyzers {
@@ -27,7 +29,7 @@ void Correlations::initialize() {
   // Each plane gets the index of another plane to which it will correlate
   m_irelative.assign(nsensors, 0);
   // Also keep a list of all sensors in their global order
-  std::vector<const Mechanics::Sensor*> sensors(nsensors, 0);
+  m_sensors.assign(nsensors, 0);
 
   // Get the reference device which is used throughout
   assert(!m_devices.empty());
@@ -40,7 +42,7 @@ void Correlations::initialize() {
   for (iglobal = 0; iglobal < ref.getNumSensors(); iglobal++) {
     // First reference aligns to itself, the rest align to the prior plane
     m_irelative[iglobal] = (iglobal==0) ? 0 : iglobal-1;
-    sensors[iglobal] = &ref[iglobal];
+    m_sensors[iglobal] = &ref[iglobal];
   }
 
   // iglobal has counted all reference planes, can now start on DUTs
@@ -50,6 +52,7 @@ void Correlations::initialize() {
     const Mechanics::Device& dut = *m_devices[idevice];
     // Loop over DUT device planes
     for (size_t idut = 0; idut < dut.getNumSensors(); idut++) {
+      m_sensors[iglobal] = &dut[idut];
       // Loop over reference device planes to find the nearest
       for (size_t iref = 0; iref < ref.getNumSensors(); iref++) {
         // Stop once the DUT plane has been surpassed in z (unless its the
@@ -57,7 +60,6 @@ void Correlations::initialize() {
         if (ref[iref].getOffZ() > dut[idut].getOffZ() && iref > 0) break;
         // Keep moving the align-to index to the nearest ref sensor
         m_irelative[iglobal] = iref;
-        sensors[iglobal] = &dut[iglobal];
       }
       // Move onto the next global DUT sensor for which to find a reference
       iglobal += 1;
@@ -66,48 +68,58 @@ void Correlations::initialize() {
 
   assert(iglobal == nsensors && "Should have iterated all sensors once");
 
-  // Generate the histograms for each sensor
-  for (iglobal = 0; iglobal < nsensors; iglobal++) {
-    const Mechanics::Sensor& sensor = *sensors[iglobal];
-    const Mechanics::Sensor& relative = *sensors[m_irelative[iglobal]];
-
-    // Sensors need not have devices, but they are retrieved from a device
-    // in this class, so this is just a sanity check
-    assert(sensor.getDevice());
-
-    const Mechanics::Device& device = *sensor.getDevice();
+  initializeCounts();
+}
 
-    m_hCorrelationsX.push_back(new TH2D(
-        ("CorrX_" + device.m_name + "_" + sensor.m_name).c_str(),
-        ("CorrX_" + device.m_name + "_" + sensor.m_name).c_str(),
-        sensor.m_ncols, 0, sensor.m_ncols,
-        relative.m_ncols, 0, relative.m_ncols));
-    m_hCorrelationsX.back()->GetXaxis()->SetTitle(
-        (sensor.m_name+" col").c_str());
-    m_hCorrelationsX.back()->GetYaxis()->SetTitle(
-        (relative.m_name+" col").c_str());
-    m_hCorrelationsX.back()->GetZaxis()->SetTitle("Triggers");
-    // Error propagation for each bin
-    m_hCorrelationsX.back()->Sumw2();
-    // No stats pannel for 2D histogram
-    m_hCorrelationsX.back()->SetStats(false);
-    // Base class keeps track of all histograms
-    m_histograms.push_back(m_hCorrelationsX.back());
+void Correlations::initializeCounts() {
+  m_countsX.clear();
+  m_countsY.clear();
+
+  for (size_t iglobal = 0; iglobal < m_sensors.size(); iglobal++) {
+    const Mechanics::Sensor& sensor = *m_sensors[iglobal];
+    const Mechanics::Sensor& relative = *m_sensors[m_irelative[iglobal]];
+
+    m_countsX.push_back(CorrelationCounts(
+        sensor.m_ncols, relative.m_ncols, m_rebin));
+    m_countsY.push_back(CorrelationCounts(
+        sensor.m_nrows, relative.m_nrows, m_rebin));
+
+    if (m_halfWidth == 0) continue;
+
+    // Where the center of each bin lands on the relative plane, with the
+    // other axis at the center of the sensor
+    std::vector<double> centersX(m_countsX.back().getNumBinsX());
+    for (size_t ix = 0; ix < centersX.size(); ix++) {
+      double x = 0, y = 0, z = 0, col = 0, row = 0;
+      sensor.pixelToSpace(
+          (ix+0.5)*m_rebin, sensor.m_nrows/2., x, y, z);
+      relative.spaceToPixel(x, y, z, col, row);
+      centersX[ix] = col / m_rebin;
+    }
+    m_countsX.back().setBand(centersX, m_halfWidth);
+
+    std::vector<double> centersY(m_countsY.back().getNumBinsX());
+    for (size_t iy = 0; iy < centersY.size(); iy++) {
+      double x = 0, y = 0, z = 0, col = 0, row = 0;
+      sensor.pixelToSpace(
+          sensor.m_ncols/2., (iy+0.5)*m_rebin, x, y, z);
+      relative.spaceToPixel(x, y, z, col, row);
+      centersY[iy] = row / m_rebin;
+    }
+    m_countsY.back().setBand(centersY, m_halfWidth);
+  }
+}
 
-    m_hCorrelationsY.push_back(new TH2D(
-        ("CorrY_" + device.m_name + "_" + sensor.m_name).c_str(),
-        ("CorrY_" + device.m_name + "_" + sensor.m_name).c_str(),
-        sensor.m_nrows, 0, sensor.m_nrows,
-        relative.m_nrows, 0, relative.m_nrows));
-    m_hCorrelationsY.back()->GetXaxis()->SetTitle(
-        (sensor.m_name+" row").c_str());
-    m_hCorrelationsY.back()->GetYaxis()->SetTitle(
-        (relative.m_name+" row").c_str());
-    m_hCorrelationsY.back()->GetZaxis()->SetTitle("Triggers");
-    m_hCorrelationsY.back()->Sumw2();
-    m_hCorrelationsY.back()->SetStats(false);
-    m_histograms.push_back(m_hCorrelationsY.back());
+void Correlations::setBinning(unsigned rebin, unsigned halfWidth) {
+  if (m_finalized)
+    throw std::runtime_error("Correlations::setBinning: already finalized");
+  for (size_t i = 0; i < m_countsX.size(); i++) {
+    if (!m_countsX[i].isEmpty() || !m_countsY[i].isEmpty())
+      throw std::runtime_error("Correlations::setBinning: already filled");
   }
+  m_rebin = rebin;
+  m_halfWidth = halfWidth;
+  initializeCounts();
 }
 
 void Correlations::process() {
@@ -124,14 +136,16 @@ void Correlations::process() {
       // Get the plane from the reference device to which to align
       assert(m_irelative[iglobal] < refEvent.getNumPlanes());
       const Storage::Plane& refPlane = refEvent.getPlane(m_irelative[iglobal]);
+      CorrelationCounts& countsX = m_countsX[iglobal];
+      CorrelationCounts& countsY = m_countsY[iglobal];
 
       // Fill the histograms
       for (size_t icluster = 0; icluster < plane.getNumClusters(); icluster++) {
         const Storage::Cluster& cluster = plane.getCluster(icluster);
         for (size_t iref = 0; iref < refPlane.getNumClusters(); iref++) {
           const Storage::Cluster& refCluster = refPlane.getCluster(iref);
-          m_hCorrelationsX[iglobal]->Fill(cluster.getPixX(), refCluster.getPixX());
-          m_hCorrelationsY[iglobal]->Fill(cluster.getPixY(), refCluster.getPixY());
+          countsX.fill(cluster.getPixX(), refCluster.getPixX());
+          countsY.fill(cluster.getPixY(), refCluster.getPixY());
         }  // ref clusters
       }  // plane clusters
 
@@ -150,11 +164,90 @@ size_t Correlations::toGlobal(size_t idevice, size_t isensor) const {
   return iglobal;
 }
 
+Analyzer* Correlations::clone() const {
+  Correlations* copy = new Correlations(m_devices);
+  copy->setBinning(m_rebin, m_halfWidth);
+  return copy;
+}
+
+void Correlations::setOutput(TDirectory* dir, const std::string& name) {
+  // Makes the named directory, if any, which then receives the histograms
+  Analyzer::setOutput(dir, name);
+  m_output = (dir && !name.empty()) ? dir->GetDirectory(name.c_str()) : dir;
+}
+
+void Correlations::finalize() {
+  Analyzer::finalize();
+
+  for (size_t iglobal = 0; iglobal < m_sensors.size(); iglobal++) {
+    const Mechanics::Sensor& sensor = *m_sensors[iglobal];
+    const Mechanics::Sensor& relative = *m_sensors[m_irelative[iglobal]];
+
+    // Sensors need not have devices, but they are retrieved from a device
+    // in this class, so this is just a sanity check
+    assert(sensor.getDevice());
+
+    const Mechanics::Device& device = *sensor.getDevice();
+    const std::string suffix = device.m_name + "_" + sensor.m_name;
+
+    m_hCorrelationsX.push_back(m_countsX[iglobal].makeHistogram(
+        "CorrX_" + suffix, "CorrX_" + suffix));
+    m_hCorrelationsX.back()->GetXaxis()->SetTitle(
+        (sensor.m_name+" col").c_str());
+    m_hCorrelationsX.back()->GetYaxis()->SetTitle(
+        (relative.m_name+" col").c_str());
+    m_hCorrelationsX.back()->GetZaxis()->SetTitle("Triggers");
+    // No stats pannel for 2D histogram
+    m_hCorrelationsX.back()->SetStats(false);
+    m_hCorrelationsX.back()->SetDirectory(m_output);
+    // Base class keeps track of all histograms
+    m_histograms.push_back(m_hCorrelationsX.back());
+
+    m_hCorrelationsY.push_back(m_countsY[iglobal].makeHistogram(
+        "CorrY_" + suffix, "CorrY_" + suffix));
+    m_hCorrelationsY.back()->GetXaxis()->SetTitle(
+        (sensor.m_name+" row").c_str());
+    m_hCorrelationsY.back()->GetYaxis()->SetTitle(
+        (relative.m_name+" row").c_str());
+    m_hCorrelationsY.back()->GetZaxis()->SetTitle("Triggers");
+    m_hCorrelationsY.back()->SetStats(false);
+    m_hCorrelationsY.back()->SetDirectory(m_output);
+    m_histograms.push_back(m_hCorrelationsY.back());
+  }
+}
+
+void Correlations::merge(const Analyzer& other) {
+  Analyzer::merge(other);
+  const Correlations& clone = dynamic_cast<const Correlations&>(other);
+  for (size_t i = 0; i < m_countsX.size(); i++) {
+    m_countsX[i].add(clone.m_countsX[i]);
+    m_countsY[i].add(clone.m_countsY[i]);
+  }
+}
+
+const CorrelationCounts& Correlations::getCountsX(
+    size_t idevice,
+    size_t isensor) const {
+  return m_countsX[toGlobal(idevice, isensor)];
+}
+
+const CorrelationCounts& Correlations::getCountsY(
+    size_t idevice,
+    size_t isensor) const {
+  return m_countsY[toGlobal(idevice, isensor)];
+}
+
 TH2D& Correlations::getCorrelationX(size_t idevice, size_t isensor) const {
+  if (!m_finalized)
+    throw std::runtime_error(
+        "Correlations::getCorrelationX: histograms are made at finalize");
   return *m_hCorrelationsX[toGlobal(idevice, isensor)];
 }
 
 TH2D& Correlations::getCorrelationY(size_t idevice, size_t isensor) const {
+  if (!m_finalized)
+    throw std::runtime_error(
+        "Correlations::getCorrelationY: histograms are made at finalize");
   return *m_hCorrelationsY[toGlobal(idevice, isensor)];
 }
 
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <stdexcept>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include <TDirectory.h>
+#include <TH2D.h>
+
+#include "storage/event.h"
+#include "storage/plane.h"
+#include "storage/hit.h"
+#include "mechanics/device.h"
+#include "mechanics/sensor.h"
+#include "analyzers/noisescan.h"
+
+namespace Analyzers {
+
+void NoiseScan::initialize() {
+  if (m_devices.empty())
+    throw std::runtime_error("NoiseScan::initialize: needs device information");
+
+  for (size_t idevice = 0; idevice < m_devices.size(); idevice++) {
+    const Mechanics::Device& device = *m_devices[idevice];
+    for (size_t isensor = 0; isensor < device.getNumSensors(); isensor++) {
+      const Mechanics::Sensor& sensor = device[isensor];
+
+      // One counter per pixel, contiguous for the whole sensor
+      m_counts.push_back(std::vector<unsigned>(
+          (size_t)sensor.m_ncols * sensor.m_nrows, 0));
+    }
+  }
+}
+
+void NoiseScan::process() {
+  size_t iglobal = 0;  // global index from all devices
+  for (size_t idevice = 0; idevice < m_devices.size(); idevice++) {
+    const Storage::Event& event = *m_events[idevice];
+    const Mechanics::Device& device = *m_devices[idevice];
+
+    if (event.getNumPlanes() != device.getNumSensors())
+      throw std::runtime_error(
+          "NoiseScan::process: event and device planes don't match");
+
+    for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++) {
+      const Storage::Plane& plane = event.getPlane(iplane);
+      const unsigned ncols = device[iplane].m_ncols;
+      const unsigned nrows = device[iplane].m_nrows;
+      unsigned* counts = &m_counts[iglobal][0];
+
+      for (size_t ihit = 0; ihit < plane.getNumHits(); ihit++) {
+        const Storage::Hit& hit = plane.getHit(ihit);
+        // Negative values wrap around and fail the bound checks
+        const unsigned col = hit.getPixX();
+        const unsigned row = hit.getPixY();
+        if (col < ncols && row < nrows) counts[row*ncols+col] += 1;
+      }
+
+      iglobal += 1;  // next global plane
+    }
+  }
+
+  m_nevents += 1;
+}
+
+void NoiseScan::setOutput(TDirectory* dir, const std::string& name) {
+  // Makes the named directory, if any, which then receives the histograms
+  Analyzer::setOutput(dir, name);
+  m_output = (dir && !name.empty()) ? dir->GetDirectory(name.c_str()) : dir;
+}
+
+void NoiseScan::finalize() {
+  Analyzer::finalize();
+
+  // Normalize by the number of events (leave empty if none were counted)
+  const double norm = m_nevents ? 1./m_nevents : 0;
+
+  size_t iglobal = 0;
+  for (size_t idevice = 0; idevice < m_devices.size(); idevice++) {
+    const Mechanics::Device& device = *m_devices[idevice];
+    for (size_t isensor = 0; isensor < device.getNumSensors(); isensor++) {
+      const Mechanics::Sensor& sensor = device[isensor];
+      const unsigned ncols = sensor.m_ncols;
+      const unsigned nrows = sensor.m_nrows;
+      const std::vector<unsigned>& counts = m_counts[iglobal];
+
+      TH2D* hist = new TH2D(
+          ("Occupancy_" + device.m_name + "_" + sensor.m_name).c_str(),
+          ("Occupancy_" + device.m_name + "_" + sensor.m_name).c_str(),
+          ncols, 0, ncols,
+          nrows, 0, nrows);
+      hist->GetXaxis()->SetTitle((sensor.m_name+" col").c_str());
+      hist->GetYaxis()->SetTitle((sensor.m_name+" row").c_str());
+      hist->GetZaxis()->SetTitle("Hits / event");
+      hist->SetStats(false);
+      hist->SetDirectory(m_output);
+      // Base class keeps track of all histograms
+      m_hOccupancy.push_back(hist);
+      m_histograms.push_back(hist);
+
+      for (unsigned row = 0; row < nrows; row++)
+        for (unsigned col = 0; col < ncols; col++)
+          hist->SetBinContent(col+1, row+1, counts[row*ncols+col]*norm);
+      iglobal += 1;
+    }
+  }
+}
+
+Analyzer* NoiseScan::clone() const {
+  NoiseScan* scan = new NoiseScan(m_devices);
+  scan->m_maxRate = m_maxRate;
+  return scan;
+}
+
+void NoiseScan::merge(const Analyzer& other) {
+  Analyzer::merge(other);
+  const NoiseScan& scan = dynamic_cast<const NoiseScan&>(other);
+
+  for (size_t iglobal = 0; iglobal < m_counts.size(); iglobal++) {
+    std::vector<unsigned>& counts = m_counts[iglobal];
+    const std::vector<unsigned>& add = scan.m_counts[iglobal];
+    for (size_t ipix = 0; ipix < counts.size(); ipix++)
+      counts[ipix] += add[ipix];
+  }
+
+  m_nevents += scan.m_nevents;
+}
+
+void NoiseScan::getNoise(
+    size_t idevice,
+    size_t isensor,
+    std::vector<double>& profile,
+    std::vector<bool>& mask) const {
+  if (m_nevents == 0)
+    throw std::runtime_error("NoiseScan::getNoise: no events were counted");
+
+  const std::vector<unsigned>& counts = m_counts[toGlobal(idevice, isensor)];
+  const double norm = 1./m_nevents;
+
+  profile.resize(counts.size());
+  mask.resize(counts.size());
+  for (size_t ipix = 0; ipix < counts.size(); ipix++) {
+    profile[ipix] = counts[ipix]*norm;
+    mask[ipix] = profile[ipix] > m_maxRate;
+  }
+}
+
+size_t NoiseScan::toGlobal(size_t idevice, size_t isensor) const {
+  if (idevice >= m_devices.size() ||
+      isensor >= m_devices[idevice]->getNumSensors())
+    throw std::runtime_error("NoiseScan::toGlobal: sensor out of range");
+  size_t iglobal = 0;
+  for (size_t id = 0; id < idevice; id++)
+    iglobal += m_devices[id]->getNumSensors();
+  iglobal += isensor;
+  return iglobal;
+}
+
+TH2D& NoiseScan::getOccupancy(size_t idevice, size_t isensor) const {
+  if (!m_finalized)
+    throw std::runtime_error(
+        "NoiseScan::getOccupancy: histograms are made at finalize");
+  return *m_hOccupancy[toGlobal(idevice, isensor)];
+}
+
+}
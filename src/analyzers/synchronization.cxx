@@ -25,10 +25,8 @@
 namespace Analyzers {
 
 void Synchronization::reserve(size_t nevents) {
-  m_times1.assign(nevents, 0);
-  m_times2.assign(nevents, 0);
-  m_write1.assign(nevents, false);
-  m_write2.assign(nevents, false);
+  m_times1.reserve(nevents);
+  m_times2.reserve(nevents);
   m_preSpacings.reserve(s_maxStats);
   m_preDiffs.reserve(s_maxStats);
   m_reserved = true;
@@ -42,61 +40,83 @@ void Synchronization::process() {
   const Storage::Event& event2 = *m_events[1];
 
   // Collect the time stamps, so that the synchronization routine can be run
-  // on all of them in memory at once
-  m_times1[m_nprocessed] = event1.getTimeStamp();
-  m_times2[m_nprocessed] = event2.getTimeStamp();
+  // on all of them in memory at once. Statistics are computed from them when
+  // finalizing, so that they don't depend on how the events were split
+  // between threads.
+  m_times1.push_back(event1.getTimeStamp());
+  m_times2.push_back(event2.getTimeStamp());
 
   m_nprocessed += 1;
+}
 
+void Synchronization::computeStats() {
   // The following code tries to compute some statistics on trigger spacing and
   // agreement between the two devices for synchronized events.
 
   // Note: want to know the number of *differences* counted, which is one less
-  // than the number of events processed
-  const size_t n = m_nprocessed-1;
-
-  // Need at least 1 difference computed, don't keep computing if an event
-  // has been seen as desychronized, and stop once enough stats have been
-  // accumulated
-  if (n > s_maxStats || m_desynchronized || n == 0) return;
-
-  // The spacing from the last event to this one, for both devices
-  const double delta1 = m_times1[n] - m_times1[n-1];
-  const double delta2 = m_times2[n] - m_times2[n-1];
-
-  // Update the mean ratio of the two device clocks
-  const double ratio = delta2 / delta1;
-  m_ratioMean += (ratio - m_ratioMean) / n;
-
-  // Update the variance of the agreement between the two clocks
-  const double diff = delta2 - delta1 * m_ratioMean;
-  m_diffVariance += diff*diff;
-
-  // Check if this event ratio is far from the mean, if enough ratios have been
-  // processed to get a good estimate of the mean
-  if (n >= m_minStats) {
-    const double scale = std::sqrt(m_diffVariance/(double)(n-1));
-    if (std::fabs(diff/scale) >= m_threshold) {
-      m_desynchronized = true;
-      // Up-update the mean and variance, this event is bad
-      m_ratioMean = (n*m_ratioMean - ratio) / (n-1);
-      m_diffVariance -= diff*diff;
-      return;
+  // than the number of events processed. Stop once enough stats have been
+  // accumulated, or an event has been seen as desynchronized.
+  for (size_t n = 1; n < m_nprocessed && n <= s_maxStats; n++) {
+    // The spacing from the last event to this one, for both devices
+    const double delta1 = m_times1[n] - m_times1[n-1];
+    const double delta2 = m_times2[n] - m_times2[n-1];
+
+    // Update the mean ratio of the two device clocks
+    const double ratio = delta2 / delta1;
+    m_ratioMean += (ratio - m_ratioMean) / n;
+
+    // Update the variance of the agreement between the two clocks
+    const double diff = delta2 - delta1 * m_ratioMean;
+    m_diffVariance += diff*diff;
+
+    // Check if this event ratio is far from the mean, if enough ratios have
+    // been processed to get a good estimate of the mean
+    if (n >= m_minStats) {
+      const double scale = std::sqrt(m_diffVariance/(double)(n-1));
+      if (std::fabs(diff/scale) >= m_threshold) {
+        m_desynchronized = true;
+        // Up-update the mean and variance, this event is bad
+        m_ratioMean = (n*m_ratioMean - ratio) / (n-1);
+        m_diffVariance -= diff*diff;
+        break;
+      }
     }
+
+    // Keep track of the inter-trigger spacings
+    m_preSpacings.push_back(std::fabs(delta1));
+    // Keep track of the inter-trigger spacing differences
+    m_preDiffs.push_back(std::fabs(diff));
+
+    // And the number of differences collected
+    m_ndiffs = n;
   }
+}
 
-  // Keep track of the inter-trigger spacings
-  m_preSpacings.push_back(std::fabs(delta1));
-  // Keep track of the inter-trigger spacing differences
-  m_preDiffs.push_back(std::fabs(diff));
+Analyzer* Synchronization::clone() const {
+  Synchronization* sync = new Synchronization();
+  sync->m_reserved = m_reserved;
+  sync->m_ratio = m_ratio;
+  sync->m_scale = m_scale;
+  sync->m_threshold = m_threshold;
+  sync->m_minStats = m_minStats;
+  sync->m_nconsecutive = m_nconsecutive;
+  return sync;
+}
+
+void Synchronization::merge(const Analyzer& other) {
+  Analyzer::merge(other);
+  const Synchronization& sync = dynamic_cast<const Synchronization&>(other);
 
-  // And the number of differences collected
-  m_ndiffs = n;
+  m_times1.insert(m_times1.end(), sync.m_times1.begin(), sync.m_times1.end());
+  m_times2.insert(m_times2.end(), sync.m_times2.begin(), sync.m_times2.end());
+  m_nprocessed += sync.m_nprocessed;
 }
 
 void Synchronization::finalize() {
   Analyzer::finalize();
 
+  computeStats();
+
   // Finalize the ratio and scale computations, if not provided
   if (m_ratio == 0) m_ratio = m_ratioMean;
   if (m_scale == 0) m_scale = std::sqrt(m_diffVariance/(double)(m_ndiffs-1));
@@ -7,6 +7,8 @@
 #include <list>
 #include <cmath>
 
+#include <TH1D.h>
+
 #include "storage/event.h"
 #include "storage/plane.h"
 #include "storage/cluster.h"
@@ -25,6 +27,11 @@ void TrackChi2::initialize() {
   m_numRefPlanes = m_devices[0]->getNumSensors();
   if (m_devices.size() > 1)
     m_numDUTPlanes = m_devices[1]->getNumSensors();
+
+  m_hChi2 = new TH1D("TrackChi2", "TrackChi2", 100, 0, 10);
+  m_hChi2->GetXaxis()->SetTitle("Track #chi^{2} / DOF");
+  m_hChi2->GetYaxis()->SetTitle("Tracks");
+  m_histograms.push_back(m_hChi2);
 }
 
 void TrackChi2::process() {
@@ -35,6 +42,7 @@ void TrackChi2::process() {
   // Make alignment track objects from reference tracks
   for (size_t itrack = 0; itrack < refEvent.getNumTracks(); itrack++) {
     const Storage::Track& track = refEvent.getTrack(itrack);
+    m_hChi2->Fill(track.getChi2());
 
     // Setup a new track, spanning clusters starting at icluster (size of the
     // cluster list)
@@ -49,6 +57,7 @@ void TrackChi2::process() {
 
       m_clusters.push_back(Cluster(
           m_devices[0]->getSensorConst(iplane),  // constituents are in ref
+          iplane,
           cluster.getPixX(),
           cluster.getPixY(),
           cluster.getPixErrX(),
@@ -90,6 +99,7 @@ void TrackChi2::process() {
       // Add it to the list of clusters
       m_clusters.push_back(Cluster(
           m_devices[1]->getSensorConst(iplane),
+          iplane,
           best->getPixX(),
           best->getPixY(),
           best->getPixErrX(),
@@ -101,5 +111,22 @@ void TrackChi2::process() {
   }
 }
 
+void TrackChi2::merge(const Analyzer& other) {
+  Analyzer::merge(other);
+  const TrackChi2& chi2 = dynamic_cast<const TrackChi2&>(other);
+
+  // The clone's tracks index its own clusters, which now follow this list
+  for (std::list<Track>::const_iterator it = chi2.m_tracks.begin();
+      it != chi2.m_tracks.end(); ++it) {
+    m_tracks.push_back(*it);
+    m_tracks.back().m_istart += m_icluster;
+  }
+
+  m_clusters.insert(
+      m_clusters.end(),
+      chi2.m_clusters.begin(),
+      chi2.m_clusters.end());
+  m_icluster += chi2.m_icluster;
 }
 
+}
@@ -63,12 +63,15 @@ void TrackResiduals::initialize() {
       m_histograms.push_back(m_hResidualsY.back());
     }  // device sensor loop
   }  // device loop
+
+  m_bufferX.resize(m_hResidualsX.size());
+  m_bufferY.resize(m_hResidualsY.size());
 }
 
-void TrackResiduals::process() {
+void TrackResiduals::collect(const Storage::Event* const* events) {
   // Keep track of the reference event (with all reference planes)
   assert(m_ndevices > 0 && "ensures > 0 events");
-  const Storage::Event& refEvent = *m_events[0];
+  const Storage::Event& refEvent = *events[0];
 
   // Extrapolate each track to each plane to get residuals
   for (size_t itrack = 0; itrack < refEvent.getNumTracks(); itrack++) {
@@ -91,16 +94,16 @@ void TrackResiduals::process() {
       const double ty = track.getOriginY() + track.getSlopeY() * cluster.getPosZ();
 
       // Compare the the cluster
-      m_hResidualsX[iplane]->Fill(tx - cluster.getPosX());
-      m_hResidualsY[iplane]->Fill(ty - cluster.getPosY());
+      m_bufferX[iplane].push_back(tx - cluster.getPosX());
+      m_bufferY[iplane].push_back(ty - cluster.getPosY());
     }
 
     // NOTE: reference residuals are exclusively to clusters in the track
 
     // Iterate through the reamaining devices (DUTs)
     size_t iglobal = -1;
-    for (size_t ievent = 1; ievent < m_events.size(); ievent++) {
-      const Storage::Event& event = *m_events[ievent];
+    for (size_t ievent = 1; ievent < m_ndevices; ievent++) {
+      const Storage::Event& event = *events[ievent];
       for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++) {
         const Storage::Plane& plane = event.getPlane(iplane);
         iglobal += 1;
@@ -129,13 +132,35 @@ void TrackResiduals::process() {
         // Compute and store its residual
         const double tx = track.getOriginX() + track.getSlopeX() * best->getPosZ();
         const double ty = track.getOriginY() + track.getSlopeY() * best->getPosZ();
-        m_hResidualsX[iplane]->Fill(tx - best->getPosX());
-        m_hResidualsY[iplane]->Fill(ty - best->getPosY());
+        m_bufferX[iplane].push_back(tx - best->getPosX());
+        m_bufferY[iplane].push_back(ty - best->getPosY());
       }
     }
   }
 }
 
+void TrackResiduals::flush() {
+  for (size_t i = 0; i < m_bufferX.size(); i++) {
+    if (!m_bufferX[i].empty())
+      m_hResidualsX[i]->FillN(m_bufferX[i].size(), &m_bufferX[i][0], 0);
+    if (!m_bufferY[i].empty())
+      m_hResidualsY[i]->FillN(m_bufferY[i].size(), &m_bufferY[i][0], 0);
+    m_bufferX[i].clear();
+    m_bufferY[i].clear();
+  }
+}
+
+void TrackResiduals::process() {
+  collect(&m_events[0]);
+  flush();
+}
+
+void TrackResiduals::processBatch(const std::vector<const Storage::Event*>& events) {
+  for (size_t ibatch = 0; ibatch < events.size(); ibatch += m_ndevices)
+    collect(&events[ibatch]);
+  flush();
+}
+
 size_t TrackResiduals::toGlobal(size_t idevice, size_t isensor) const {
   assert(!m_devices.empty());
   // Simple counting of sensor up to the correct device. Infrequently called,
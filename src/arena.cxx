@@ -0,0 +1,74 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "arena.h"
+
+namespace Utils {
+
+Arena::Arena(size_t blockSize) :
+    m_blockSize(blockSize),
+    m_blocks(),
+    m_iblock(0),
+    m_offset(0) {
+  if (m_blockSize == 0)
+    throw std::runtime_error("Arena::Arena: block size must be above 0");
+}
+
+Arena::Arena(const Arena& copy) :
+    m_blockSize(copy.m_blockSize),
+    m_blocks(),  // don't copy the scratch memory
+    m_iblock(0),
+    m_offset(0) {}
+
+void* Arena::allocate(size_t bytes, size_t align) {
+  if (align == 0 || (align & (align-1)))
+    throw std::runtime_error("Arena::allocate: alignment not a power of 2");
+
+  while (true) {
+    // Try to fit the request in the current block, then in the next ones
+    // (held from previous events), and finally in a new block
+    if (m_iblock < m_blocks.size()) {
+      const Block& block = m_blocks[m_iblock];
+      const uintptr_t start = reinterpret_cast<uintptr_t>(block.data.get());
+      const uintptr_t aligned =
+          (start + m_offset + align-1) & ~(uintptr_t)(align-1);
+      if (aligned + bytes <= start + block.size) {
+        m_offset = aligned + bytes - start;
+        return reinterpret_cast<void*>(aligned);
+      }
+      m_iblock += 1;
+      m_offset = 0;
+      continue;
+    }
+
+    // Blocks double in size, so there are few of them even on a cold start
+    size_t size = m_blocks.empty() ? m_blockSize : 2*m_blocks.back().size;
+    if (size < bytes + align) size = bytes + align;
+    m_blocks.push_back(Block(size));
+    m_iblock = m_blocks.size()-1;
+    m_offset = 0;
+  }
+}
+
+void Arena::reset() {
+  // Merge the blocks so the next event of this size fits in the first one
+  if (m_blocks.size() > 1) {
+    const size_t capacity = getCapacity();
+    m_blocks.clear();
+    m_blocks.push_back(Block(capacity));
+  }
+  m_iblock = 0;
+  m_offset = 0;
+}
+
+size_t Arena::getCapacity() const {
+  size_t capacity = 0;
+  for (size_t i = 0; i < m_blocks.size(); i++)
+    capacity += m_blocks[i].size;
+  return capacity;
+}
+
+}
@@ -5,24 +5,36 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
 
 #include <TApplication.h>
+#include <TROOT.h>
+#include <TFile.h>
 
 #include "options.h"
 #include "rootstyle.h"
+#include "threadpool.h"
 #include "storage/storagei.h"
 #include "storage/storageo.h"
+#include "storage/trackntuple.h"
+#include "storage/merge.h"
+#include "storage/clusterdictionary.h"
 #include "mechanics/device.h"
 #include "mechanics/mechparsers.h"
 #include "processors/clustering.h"
 #include "processors/tracking.h"
+#include "processors/kalmantracking.h"
 #include "processors/aligning.h"
+#include "processors/chain.h"
 #include "loopers/looper.h"
 #include "loopers/loopprocess.h"
 #include "loopers/loopaligncorr.h"
 #include "loopers/looptransfers.h"
 #include "loopers/loopaligntracks.h"
 #include "loopers/loopsynchronize.h"
+#include "loopers/loopnoisescan.h"
+#include "analyzers/clusterpatterns.h"
+#include "analyzers/correlations.h"
 
 void printHelp() {
   printf("usage: judith <command> [<args>]\n");
@@ -32,19 +44,37 @@ void printHelp() {
   printf("  %2s %-15s %s\n", "-i", "--input", "Path to input file(s)");
   printf("  %2s %-15s %s\n", "-o", "--output", "Path to output file");
   printf("  %2s %-15s %s\n", "-s", "--settings", "Path to settings file (default: configs/settings.cfg)");
-  printf("  %2s %-15s %s\n", "-r", "--results", "Path to results file");
+  printf("  %2s %-15s %s\n", "-r", "--results", "Path to results file (align-corr, align-tracks: plane correlations)");
+  printf("  %2s %-15s %s\n", "", "--ntuple", "Path to flat track ntuple (process only)");
+  printf("  %2s %-15s %s\n", "", "--transfers", "Path to tracking transfer scales");
+  printf("  %2s %-15s %s\n", "", "--patterns", "Path to cluster patterns (stores processed clusters by pattern)");
   printf("  %2s %-15s %s\n", "-d", "--device", "Path to device configuration(s)");
   printf("  %2s %-15s %s\n", "-f", "--first", "Number of first event to process");
   printf("  %2s %-15s %s\n", "-n", "--events", "Process up to this many events past first");
   printf("  %2s %-15s %s\n", "-k", "--skip", "Skip this many events at each loop iteration");
   printf("  %2s %-15s %s\n", "", "--progress", "Display progress at this interval (0 is off)");
+  printf("  %2s %-15s %s\n", "", "--threads", "Run a loop on this many threads (per stage when processing)");
+  printf("  %2s %-15s %s\n", "", "--plane-threads", "Split the work of each event between planes on this many threads (process only)");
+  printf("  %2s %-15s %s\n", "", "--analyzer-threads", "Run the analyzers of each event on this many threads");
+  printf("  %2s %-15s %s\n", "", "--input-threads", "Read the input files of each event on this many threads");
+  printf("  %2s %-15s %s\n", "", "--batch", "Run a loop in blocks of this many events");
+  printf("  %2s %-15s %s\n", "", "--sample", "Calibrate on blocks of this many events spread across the input");
+  printf("  %2s %-15s %s\n", "", "--sample-tolerance", "Stop sampling once distributions move by less than this (in RMS)");
+  printf("  %2s %-15s %s\n", "", "--shard", "Process only shard i/N of the events (process only)");
+  printf("  %2s %-15s %s\n", "", "--chain", "Process with a compiled clustering, aligning and tracking chain");
+  printf("  %2s %-15s %s\n", "", "--sort-hits", "Read the hits of each plane in row-major order");
+  printf("  %2s %-15s %s\n", "", "--fast", "Merge by copying baskets without decoding events");
   printf("  %2s %-15s %s\n", "", "--draw", "Give visual feedback when availalbe (e.g. fits)");
 
   printf("\nCommands:\n");
   printf("  %-15s %s\n", "process", "Generate clusters and tracks from the given input");
+  printf("  %-15s %s\n", "transfers", "Measure the tracking transfer scales of the input");
+  printf("  %-15s %s\n", "patterns", "Build the dictionary of cluster patterns of the input");
+  printf("  %-15s %s\n", "merge", "Concatenate processed shards, given in event order");
   printf("  %-15s %s\n", "align-corr", "Align the sensors by plane correlations");
   printf("  %-15s %s\n", "align-tracks", "Align the sensors using track residuals");
   printf("  %-15s %s\n", "sync", "Synchronize two device inputs");
+  printf("  %-15s %s\n", "noise-scan", "Mask the noisy pixels of the device");
   std::cout << std::endl;
 }
 
@@ -115,6 +145,78 @@ void maskPlanes(const Options& options, Mechanics::Devices& devices) {
   }
 }
 
+// Set sensor regions of interest and timing windows from configuration. The
+// plane index is taken from the full list of sensors, so this must be called
+// before masking planes.
+void setWindows(const Options& options, Mechanics::Devices& devices) {
+  // Values are: device name, plane, min col, max col, min row, max row
+  const Options::Values& rois = options.getValues("roi");
+  if (rois.size() % 6)
+    throw std::runtime_error("setWindows: roi takes 6 values");
+  for (size_t ival = 0; ival < rois.size(); ival += 6) {
+    Mechanics::Sensor& sensor =
+        devices[rois[ival]].getSensor(strToInt(rois[ival+1]));
+    sensor.m_roiMinCol = strToInt(rois[ival+2]);
+    sensor.m_roiMaxCol = strToInt(rois[ival+3]);
+    sensor.m_roiMinRow = strToInt(rois[ival+4]);
+    sensor.m_roiMaxRow = strToInt(rois[ival+5]);
+  }
+
+  // Values are: device name, plane, min timing, max timing
+  const Options::Values& timings = options.getValues("timing-window");
+  if (timings.size() % 4)
+    throw std::runtime_error("setWindows: timing-window takes 4 values");
+  for (size_t ival = 0; ival < timings.size(); ival += 4) {
+    Mechanics::Sensor& sensor =
+        devices[timings[ival]].getSensor(strToInt(timings[ival+1]));
+    sensor.m_minTiming = strToInt(timings[ival+2]);
+    sensor.m_maxTiming = strToInt(timings[ival+3]);
+  }
+}
+
+// Pass the sensor windows, calibrations, noise masks and pixel maps of a device
+// to the input reading its data, and have it sort its hits if requested
+void configureInput(
+    const Options& options,
+    const Mechanics::Device& device,
+    Storage::StorageI& input,
+    bool noiseMasks=true) {
+  input.setSortHits(options.evalBoolArg("sort-hits"));
+
+  for (size_t i = 0; i < device.getNumSensors(); i++) {
+    if (noiseMasks && !device[i].m_noiseMask.empty())
+      input.setNoiseMask(
+          i,
+          device[i].m_noiseMask,
+          device[i].m_ncols,
+          device[i].m_nrows);
+
+    if (!device[i].m_calibration.empty())
+      input.setCalibration(
+          i,
+          &device[i].m_calibration[0],
+          device[i].m_ncols,
+          device[i].m_nrows,
+          device[i].m_calibrationTerms);
+
+    Storage::StorageI::HitWindow window;
+    window.minPixX = device[i].m_roiMinCol;
+    window.maxPixX = device[i].m_roiMaxCol;
+    window.minPixY = device[i].m_roiMinRow;
+    window.maxPixY = device[i].m_roiMaxRow;
+    window.minTiming = device[i].m_minTiming;
+    window.maxTiming = device[i].m_maxTiming;
+    if (!window.isOpen()) input.setHitWindow(i, window);
+
+    // Clusters stored by pattern are placed from their pixel values
+    if (input.isClustersPatterned()) {
+      double map[3][3];
+      device[i].getPixelMap(map);
+      input.setPixelMap(i, map);
+    }
+  }
+}
+
 // Configure a looper with generic configuration options
 void configureLooper(const Options& options, Loopers::Looper& looper) {
   // Configure a base `Looper` object from standard options
@@ -126,9 +228,78 @@ void configureLooper(const Options& options, Loopers::Looper& looper) {
     looper.m_nstep = strToInt(options.getValue("skip"));
   if (options.hasArg("progress"))
     looper.m_printInterval = strToInt(options.getValue("progress"));
+  if (options.hasArg("threads"))
+    looper.m_nthreads = strToInt(options.getValue("threads"));
+  if (options.hasArg("analyzer-threads"))
+    looper.m_analyzerThreads = strToInt(options.getValue("analyzer-threads"));
+  if (options.hasArg("input-threads"))
+    looper.m_inputThreads = strToInt(options.getValue("input-threads"));
+  if (options.hasArg("batch"))
+    looper.m_batchSize = strToInt(options.getValue("batch"));
   looper.m_draw = options.evalBoolArg("draw");
 }
 
+// Sample the events of calibration loopers, which need only enough events for
+// their distributions to settle
+void configureSampling(const Options& options, Loopers::Looper& looper) {
+  if (options.hasArg("sample"))
+    looper.m_sampleSize = strToInt(options.getValue("sample"));
+  if (options.hasArg("sample-tolerance"))
+    looper.m_sampleTolerance = strToFloat(options.getValue("sample-tolerance"));
+}
+
+// Configure a clustering processor from the processing options
+void configureClustering(
+    const Options& options,
+    Processors::Clustering& clustering) {
+  if (options.hasArg("process-clusters-nrows"))
+    clustering.m_maxRows = strToInt(options.getValue("process-clusters-nrows"));
+  if (options.hasArg("process-clusters-ncols"))
+    clustering.m_maxRows = strToInt(options.getValue("process-clusters-ncols"));
+}
+
+// Histogram the plane correlations of an alignment into the results file, if
+// one is given. Returns false if the file can't be opened.
+bool configureCorrelations(
+    const Options& options,
+    Mechanics::Devices& devices,
+    Loopers::Looper& looper,
+    std::unique_ptr<TFile>& results,
+    std::unique_ptr<Analyzers::Correlations>& correlations) {
+  if (!options.hasArg("results")) return true;
+
+  results.reset(new TFile(options.getValue("results").c_str(), "RECREATE"));
+  if (results->IsZombie()) {
+    std::cerr << "ERROR: can't open results file "
+        << options.getValue("results") << std::endl;
+    return false;
+  }
+
+  correlations.reset(new Analyzers::Correlations(devices.getVector()));
+  unsigned rebin = 1;
+  unsigned band = 0;
+  if (options.hasArg("align-corr-rebin"))
+    rebin = strToInt(options.getValue("align-corr-rebin"));
+  if (options.hasArg("align-corr-band"))
+    band = strToInt(options.getValue("align-corr-band"));
+  correlations->setBinning(rebin, band);
+  correlations->setOutput(results.get());
+  looper.addAnalyzer(*correlations);
+  return true;
+}
+
+// Parse a shard given as "i/N": the ith (from 0) of N shards
+bool parseShard(const std::string& value, unsigned& ishard, unsigned& nshards) {
+  const size_t split = value.find('/');
+  if (split == std::string::npos) return false;
+  const int i = strToInt(value.substr(0, split));
+  const int n = strToInt(value.substr(split+1));
+  if (i < 0 || n < 1 || i >= n) return false;
+  ishard = i;
+  nshards = n;
+  return true;
+}
+
 int main(int argc, const char** argv) {
   std::cout << "\nStarting Judith\n" << std::endl;
 
@@ -183,6 +354,9 @@ int main(int argc, const char** argv) {
   Mechanics::Devices devices;
   generateDevices(options, devices);
 
+  // Apply regions of interest and timing windows from the settings
+  setWindows(options, devices);
+
   // Remove masked planes from the devices
   maskPlanes(options, devices);
 
@@ -220,6 +394,9 @@ int main(int argc, const char** argv) {
         // Don't read hit global positions since they will be re-generated
         &inHitsOff);
 
+    // Drop hits outside the sensor windows and calibrate their values
+    configureInput(options, devices[0], input);
+
     int outTreeMask = 0;
 
     if (!options.evalBoolArg("process-clusters"))
@@ -237,6 +414,22 @@ int main(int argc, const char** argv) {
       clusterBranchesOff.insert("Timing");
     }
 
+    // Store the clusters by pattern if a dictionary is given
+    Storage::ClusterDictionary patterns;
+    if (options.hasArg("patterns")) {
+      if (!options.evalBoolArg("process-clusters")) {
+        std::cerr << "ERROR: patterns require clusters processing" << std::endl;
+        return -1;
+      }
+      TFile file(options.getValue("patterns").c_str());
+      if (!file.IsOpen() || !patterns.read(file)) {
+        std::cerr << "ERROR: no cluster patterns found in "
+            << options.getValue("patterns") << std::endl;
+        return -1;
+      }
+      file.Close();
+    }
+
     Storage::StorageO output(
         options.getValue("output"),
         input.getNumPlanes(),
@@ -244,17 +437,29 @@ int main(int argc, const char** argv) {
         &hitBranchesOff,
         &clusterBranchesOff,
         &trackBranchesOff,
-        &eventInfoBranchesOff);
+        &eventInfoBranchesOff,
+        options.hasArg("patterns") ? &patterns : 0);
 
     // Build an alignment object from the device
     Processors::Aligning aligning(devices[0]);
 
     // Build a clustering object from the options
     Processors::Clustering clustering;
-    if (options.hasArg("process-clusters-nrows"))
-      clustering.m_maxRows = strToInt(options.getValue("process-clusters-nrows"));
-    if (options.hasArg("process-clusters-ncols"))
-      clustering.m_maxRows = strToInt(options.getValue("process-clusters-ncols"));
+    configureClustering(options, clustering);
+
+    // Cluster and align the planes of each event in parallel if requested,
+    // for events too busy to wait on a single thread
+    std::unique_ptr<Utils::ThreadPool> planePool;
+    if (options.hasArg("plane-threads") &&
+        strToInt(options.getValue("plane-threads")) > 1) {
+      const unsigned nthreads = strToInt(options.getValue("plane-threads"));
+      planePool.reset(new Utils::ThreadPool(nthreads));
+      clustering.m_pool = planePool.get();
+      aligning.m_pool = planePool.get();
+      // The planes are read from one file into shared buffers, so let ROOT
+      // decompress their branches in parallel instead
+      ROOT::EnableImplicitMT(nthreads);
+    }
 
     // Build a tracking object from the options
     Processors::Tracking tracking(devices[0].getNumSensors());
@@ -264,13 +469,45 @@ int main(int argc, const char** argv) {
     if (options.hasArg("process-tracks-minclusters"))
       tracking.m_minClusters = strToInt(
           options.getValue("process-tracks-minclusters"));
+    // Compute the clusters, positions and tracks in float. Alignment keeps
+    // working in double.
+    if (options.evalBoolArg("process-single-precision")) {
+      clustering.m_singlePrecision = true;
+      aligning.m_singlePrecision = true;
+      tracking.m_singlePrecision = true;
+    }
+    // Or follow the tracks with a Kalman filter, which gates on its own
+    // covariance (with the radius in the same sigma), and so has no use for
+    // transfer scales
+    const bool kalman = options.evalBoolArg("process-tracks-kalman");
+    Processors::KalmanTracking kalmanTracking(devices[0]);
+    kalmanTracking.m_gate = tracking.m_radius;
+    kalmanTracking.m_minClusters = tracking.m_minClusters;
+    if (options.hasArg("process-tracks-momentum"))
+      kalmanTracking.m_momentum = strToFloat(
+          options.getValue("process-tracks-momentum"));
+    if (options.hasArg("process-tracks-slope-sigma"))
+      kalmanTracking.m_slopeSigma = strToFloat(
+          options.getValue("process-tracks-slope-sigma"));
+
+    // Use transfer scales measured beforehand if given
+    if (!kalman && options.hasArg("transfers")) {
+      tracking.readTransitions(options.getValue("transfers"));
+    }
     // If transfers were requested, then do a pre-run to get transfer scales
-    if (options.evalBoolArg("process-tracks-transfers")) {
+    else if (!kalman && options.evalBoolArg("process-tracks-transfers")) {
+      // Each shard would measure different scales from its own events
+      if (options.hasArg("shard")) {
+        std::cerr << "ERROR: shards need transfers from the transfers command"
+            << std::endl;
+        return -1;
+      }
       // Setup the pre-looper to measure transfers for only the reference
       Loopers::LoopTransfers preLooper(input, devices[0]);
       preLooper.addProcessor(clustering);
       preLooper.addProcessor(aligning);
       configureLooper(options, preLooper);
+      configureSampling(options, preLooper);
       // Run it
       preLooper.loop();
       preLooper.finalize();
@@ -285,16 +522,179 @@ int main(int argc, const char** argv) {
     // alignment (computes global values for the clusters), and then tracking
     // can be performed (using clusters' global values)
 
-    // If a clustering is requested, give it a clustering processor
-    if (options.evalBoolArg("process-clusters"))
-      looper.addProcessor(clustering);
+    // The full processing can instead run as a single processor, with the
+    // plane count fixed for the standard telescope
+    std::unique_ptr<Processors::Processor> chain;
+    if (options.evalBoolArg("chain")) {
+      if (!options.evalBoolArg("process-clusters") ||
+          !options.evalBoolArg("process-tracks")) {
+        std::cerr << "ERROR: chain requires clusters and tracks processing"
+            << std::endl;
+        return -1;
+      }
+      if (kalman) {
+        std::cerr << "ERROR: chain doesn't support Kalman tracking"
+            << std::endl;
+        return -1;
+      }
+      if (devices[0].getNumSensors() == 6)
+        chain.reset(new Processors::Chain<6,
+            Processors::Clustering,
+            Processors::Aligning,
+            Processors::Tracking>(clustering, aligning, tracking));
+      else
+        chain.reset(new Processors::Chain<0,
+            Processors::Clustering,
+            Processors::Aligning,
+            Processors::Tracking>(clustering, aligning, tracking));
+      looper.addProcessor(*chain);
+    }
+
+    else {
+      // If a clustering is requested, give it a clustering processor
+      if (options.evalBoolArg("process-clusters"))
+        looper.addProcessor(clustering);
+
+      // Give it the aligning object to compute and store global positions
+      looper.addProcessor(aligning);
+
+      // Likewise for tracking
+      if (options.evalBoolArg("process-tracks") && kalman)
+        looper.addProcessor(kalmanTracking);
+      else if (options.evalBoolArg("process-tracks"))
+        looper.addProcessor(tracking);
+    }
+
+    // Optionally also write the tracks to a flat ntuple in the same pass
+    Storage::TrackNtuple* ntuple = 0;
+    if (options.hasArg("ntuple")) {
+      if (!options.evalBoolArg("process-tracks")) {
+        std::cerr << "ERROR: ntuple output requires track processing"
+            << std::endl;
+        return -1;
+      }
+      ntuple = new Storage::TrackNtuple(
+          options.getValue("ntuple"), input.getNumPlanes());
+      looper.setNtuple(*ntuple);
+    }
+
+    // Apply generic looping options to the looper
+    configureLooper(options, looper);
+
+    // Process only one part of the events, to be merged with the others
+    if (options.hasArg("shard")) {
+      unsigned ishard = 0;
+      unsigned nshards = 0;
+      if (!parseShard(options.getValue("shard"), ishard, nshards)) {
+        std::cerr << "ERROR: shard must be given as i/N, with i below N"
+            << std::endl;
+        return -1;
+      }
+      looper.setShard(ishard, nshards);
+    }
+
+    // Run the looper
+    looper.loop();
+    looper.finalize();
+
+    // Writes the ntuple to its file
+    if (ntuple) delete ntuple;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Transfer scales
+
+  else if (command == "transfers") {
+    if (!options.hasArg("input") || !options.hasArg("transfers")) {
+      std::cerr << "ERROR: transfers requires an input and transfers argument"
+          << std::endl;
+      return -1;
+    }
 
-    // Give it the aligning object to compute and store global positions
+    if (devices.getNumDevices() != 1) {
+      std::cerr << "ERROR: exactly one device accepted for transfers" << std::endl;
+      return -1;
+    }
+
+    // Same input as when processing
+    std::set<std::string> inHitsOff;
+    inHitsOff.insert("PosX");
+    inHitsOff.insert("PosY");
+    inHitsOff.insert("PosZ");
+
+    Storage::StorageI input(
+        options.getValue("input"),
+        Storage::StorageIO::CLUSTERS | Storage::StorageIO::TRACKS,
+        &devices[0].getSensorMask(),
+        &inHitsOff);
+
+    configureInput(options, devices[0], input);
+
+    Processors::Aligning aligning(devices[0]);
+    Processors::Clustering clustering;
+    configureClustering(options, clustering);
+
+    // Measure the transfers once, for all the jobs processing this input
+    Loopers::LoopTransfers looper(input, devices[0]);
+    looper.addProcessor(clustering);
     looper.addProcessor(aligning);
 
-    // Likewise for tracking
-    if (options.evalBoolArg("process-tracks"))
-      looper.addProcessor(tracking);
+    // Apply generic looping options to the looper
+    configureLooper(options, looper);
+    configureSampling(options, looper);
+
+    // Run the looper
+    looper.loop();
+    looper.finalize();
+
+    // Store the scales as they would be given to the tracking
+    Processors::Tracking tracking(devices[0].getNumSensors());
+    looper.apply(tracking);
+    tracking.writeTransitions(options.getValue("transfers"));
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Cluster patterns
+
+  else if (command == "patterns") {
+    if (!options.hasArg("input") || !options.hasArg("patterns")) {
+      std::cerr << "ERROR: patterns requires an input and patterns argument"
+          << std::endl;
+      return -1;
+    }
+
+    if (devices.getNumDevices() != 1) {
+      std::cerr << "ERROR: exactly one device accepted for patterns" << std::endl;
+      return -1;
+    }
+
+    // Same input as when processing
+    std::set<std::string> inHitsOff;
+    inHitsOff.insert("PosX");
+    inHitsOff.insert("PosY");
+    inHitsOff.insert("PosZ");
+
+    Storage::StorageI input(
+        options.getValue("input"),
+        Storage::StorageIO::CLUSTERS | Storage::StorageIO::TRACKS,
+        &devices[0].getSensorMask(),
+        &inHitsOff);
+
+    configureInput(options, devices[0], input);
+
+    // The patterns hold the cluster values of this clustering
+    Processors::Clustering clustering;
+    configureClustering(options, clustering);
+
+    Analyzers::ClusterPatterns analyzer;
+    if (options.hasArg("patterns-max"))
+      analyzer.m_maxPatterns = strToInt(options.getValue("patterns-max"));
+    if (options.hasArg("patterns-min-count"))
+      analyzer.m_minCount = strToInt(options.getValue("patterns-min-count"));
+
+    Loopers::Looper looper(input, devices[0]);
+    looper.addProcessor(clustering);
+    looper.addAnalyzer(analyzer);
 
     // Apply generic looping options to the looper
     configureLooper(options, looper);
@@ -302,6 +702,37 @@ int main(int argc, const char** argv) {
     // Run the looper
     looper.loop();
     looper.finalize();
+
+    const Storage::ClusterDictionary& dictionary = analyzer.getDictionary();
+    std::cout << "Kept " << dictionary.getNumPatterns() << " of "
+        << dictionary.getNumCandidates() << " cluster shapes" << std::endl;
+
+    TFile file(options.getValue("patterns").c_str(), "RECREATE");
+    if (!file.IsOpen()) {
+      std::cerr << "ERROR: unable to open " << options.getValue("patterns")
+          << std::endl;
+      return -1;
+    }
+    dictionary.write(file);
+    file.Close();
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Merging
+
+  else if (command == "merge") {
+    const Options::Values& inputNames = options.getValues("input");
+    if (inputNames.empty() || !options.hasArg("output")) {
+      std::cerr << "ERROR: merge requires input and output arguments"
+          << std::endl;
+      return -1;
+    }
+
+    // Inputs are concatenated in the order given
+    Storage::mergeFiles(
+        inputNames,
+        options.getValue("output"),
+        options.evalBoolArg("fast"));
   }
 
   /////////////////////////////////////////////////////////////////////////////
@@ -328,6 +759,10 @@ int main(int argc, const char** argv) {
           Storage::StorageIO::TRACKS | Storage::StorageIO::CLUSTERS,
           &devices[i].getSensorMask()));
 
+    // Drop hits outside the sensor windows and calibrate their values
+    for (size_t i = 0; i < inputs.size(); i++)
+      configureInput(options, devices[i], *inputs[i]);
+
     // Prepare a processing looper with the devices which it will align
     Loopers::LoopAlignCorr looper(inputs, devices.getVector());
 
@@ -344,11 +779,21 @@ int main(int argc, const char** argv) {
 
     // Apply generic looping options to the looper
     configureLooper(options, looper);
+    configureSampling(options, looper);
+
+    // Also histogram the plane correlations into the results file, if any.
+    // The file is declared first so that it outlives the histograms it owns.
+    std::unique_ptr<TFile> results;
+    std::unique_ptr<Analyzers::Correlations> correlations;
+    if (!configureCorrelations(options, devices, looper, results, correlations))
+      return -1;
 
     // Run the looper
     looper.loop();
     looper.finalize();
 
+    if (results) results->Write();
+
     // Write out the alignment to file
     for (size_t i = 0; i < devices.getNumDevices(); i++)
       Mechanics::writeAlignment(devices[i]);
@@ -387,6 +832,10 @@ int main(int argc, const char** argv) {
           Storage::StorageIO::TRACKS | Storage::StorageIO::CLUSTERS,
           &devices[i].getSensorMask()));
 
+    // Drop hits outside the sensor windows and calibrate their values
+    for (size_t i = 0; i < inputs.size(); i++)
+      configureInput(options, devices[i], *inputs[i]);
+
     // Prepare a processing looper with the devices which it will align
     Loopers::LoopAlignTracks looper(inputs, devices.getVector());
 
@@ -419,6 +868,7 @@ int main(int argc, const char** argv) {
       preLooper.addProcessor(clustering);
       preLooper.addProcessor(aligning);
       configureLooper(options, preLooper);
+      configureSampling(options, preLooper);
       // Run it
       preLooper.loop();
       preLooper.finalize();
@@ -436,14 +886,30 @@ int main(int argc, const char** argv) {
     if (options.hasArg("align-tracks-tolerance"))
       looper.m_tolerance = strToFloat(
           options.getValue("align-tracks-tolerance"));
+    if (options.hasArg("align-tracks-gradient-threads"))
+      looper.m_gradientThreads = strToInt(
+          options.getValue("align-tracks-gradient-threads"));
+    if (options.hasArg("align-tracks-gradient-step"))
+      looper.m_gradientStep = strToFloat(
+          options.getValue("align-tracks-gradient-step"));
 
     // Apply generic looping options to the looper
     configureLooper(options, looper);
+    configureSampling(options, looper);
+
+    // Also histogram the plane correlations into the results file, if any.
+    // The file is declared first so that it outlives the histograms it owns.
+    std::unique_ptr<TFile> results;
+    std::unique_ptr<Analyzers::Correlations> correlations;
+    if (!configureCorrelations(options, devices, looper, results, correlations))
+      return -1;
 
     // Run the looper
     looper.loop();
     looper.finalize();
 
+    if (results) results->Write();
+
     // Write out the alignment to file
     for (size_t i = 0; i < devices.getNumDevices(); i++)
       Mechanics::writeAlignment(devices[i]);
@@ -454,6 +920,58 @@ int main(int argc, const char** argv) {
       delete *it;
   }
 
+  /////////////////////////////////////////////////////////////////////////////
+  // Noise scan
+
+  else if (command == "noise-scan") {
+    if (!options.hasArg("input")) {
+      std::cerr << "ERROR: noise-scan requires an input argument" << std::endl;
+      return -1;
+    }
+
+    if (devices.getNumDevices() != 1) {
+      std::cerr << "ERROR: exactly one device accepted when scanning" << std::endl;
+      return -1;
+    }
+
+    if (devices[0].m_noiseMaskFile.empty()) {
+      std::cerr << "ERROR: device has no noise mask file" << std::endl;
+      return -1;
+    }
+
+    // Only the hit pixels are used
+    std::set<std::string> inHitsOff;
+    inHitsOff.insert("PosX");
+    inHitsOff.insert("PosY");
+    inHitsOff.insert("PosZ");
+    inHitsOff.insert("Value");
+
+    Storage::StorageI input(
+        options.getValue("input"),
+        Storage::StorageIO::CLUSTERS | Storage::StorageIO::TRACKS,
+        &devices[0].getSensorMask(),
+        &inHitsOff);
+
+    // Keep the windows, but count the pixels masked by a previous scan
+    configureInput(options, devices[0], input, false);
+
+    Loopers::LoopNoiseScan looper(input, devices[0]);
+
+    if (options.hasArg("noise-scan-max-rate"))
+      looper.getAnalyzer().m_maxRate = strToFloat(
+          options.getValue("noise-scan-max-rate"));
+
+    // Apply generic looping options to the looper
+    configureLooper(options, looper);
+
+    // Run the looper
+    looper.loop();
+    looper.finalize();
+
+    // Write out the noise profiles and masks to file
+    Mechanics::writeNoiseMask(devices[0]);
+  }
+
   /////////////////////////////////////////////////////////////////////////////
   // Synchronization
 
@@ -485,7 +1003,9 @@ int main(int argc, const char** argv) {
           &inputs[i]->getHitsBranchesOff(),
           &inputs[i]->getClustersBranchesOff(),
           &inputs[i]->getTracksBranchesOff(),
-          &inputs[i]->getEventInfoBranchesOff()));
+          &inputs[i]->getEventInfoBranchesOff(),
+          inputs[i]->isClustersPatterned() ?
+              &inputs[i]->getClusterPatterns() : 0));
 
     // Prepare a processing looper with the devices which it will align
     Loopers::LoopSynchronize looper(inputs, outputs);
@@ -0,0 +1,95 @@
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+
+#include "loopers/eventqueue.h"
+
+namespace Loopers {
+
+EventQueue::EventQueue(size_t capacity) :
+    m_handles(capacity, 0),
+    m_first(0),
+    m_size(0),
+    m_closed(false) {
+  if (capacity == 0)
+    throw std::runtime_error("EventQueue::EventQueue: capacity can't be 0");
+}
+
+bool EventQueue::push(size_t handle) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_closed && m_size == m_handles.size()) m_notFull.wait(lock);
+  if (m_closed) return false;
+
+  m_handles[(m_first+m_size) % m_handles.size()] = handle;
+  m_size += 1;
+
+  lock.unlock();
+  m_notEmpty.notify_one();
+  return true;
+}
+
+bool EventQueue::pop(size_t& handle) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_closed && m_size == 0) m_notEmpty.wait(lock);
+  // Closed queues still hand out what they hold
+  if (m_size == 0) return false;
+
+  handle = m_handles[m_first];
+  m_first = (m_first+1) % m_handles.size();
+  m_size -= 1;
+
+  lock.unlock();
+  m_notFull.notify_one();
+  return true;
+}
+
+bool EventQueue::push(const std::vector<size_t>& handles) {
+  if (handles.size() > m_handles.size())
+    throw std::runtime_error("EventQueue::push: more handles than capacity");
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_closed && m_size+handles.size() > m_handles.size())
+    m_notFull.wait(lock);
+  if (m_closed) return false;
+
+  for (size_t i = 0; i < handles.size(); i++)
+    m_handles[(m_first+m_size+i) % m_handles.size()] = handles[i];
+  m_size += handles.size();
+
+  lock.unlock();
+  // Several threads can share the handles
+  m_notEmpty.notify_all();
+  return true;
+}
+
+bool EventQueue::pop(std::vector<size_t>& handles, size_t max) {
+  handles.clear();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_closed && m_size == 0) m_notEmpty.wait(lock);
+  if (m_size == 0) return false;
+
+  const size_t ntake = std::min(m_size, max);
+  for (size_t i = 0; i < ntake; i++) {
+    handles.push_back(m_handles[m_first]);
+    m_first = (m_first+1) % m_handles.size();
+  }
+  m_size -= ntake;
+
+  lock.unlock();
+  // Pushes of many handles might be waiting on any of them
+  m_notFull.notify_all();
+  return true;
+}
+
+void EventQueue::close() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+  }
+  m_notEmpty.notify_all();
+  m_notFull.notify_all();
+}
+
+}
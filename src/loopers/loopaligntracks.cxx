@@ -12,8 +12,10 @@
 #include <Math/Factory.h>
 
 #include "utils.h"
+#include "threadpool.h"
 #include "mechanics/alignment.h"
 #include "mechanics/device.h"
+#include "mechanics/geometry.h"
 #include "analyzers/analyzer.h"
 #include "analyzers/trackchi2.h"
 #include "loopers/loopaligntracks.h"
@@ -24,6 +26,7 @@ namespace Loopers {
 
 void LoopAlignTracks::Chi2Minimizer::computeTrackPars(
     const Analyzers::TrackChi2::Track& track,
+    const Mechanics::Geometry* geometry,
     LoopAlignTracks::TrackPars& pars) const {
   const size_t nclusters = track.m_nclusters;
   const size_t istart = track.m_istart;
@@ -44,12 +47,22 @@ void LoopAlignTracks::Chi2Minimizer::computeTrackPars(
   // Compute the global position of all cluster in the track
   for (size_t i = 0; i < nclusters; i++) {
     const Analyzers::TrackChi2::Cluster& cluster = m_clusters[istart+i];
-    cluster.sensor->pixelToSpace(
-        cluster.pixX, cluster.pixY, 
-        x[i], y[i], z[i]);
-    cluster.sensor->pixelErrToSpace(
-        cluster.pixErrX, cluster.pixErrY, 
-        xe[i], ye[i], dummy);
+    if (geometry) {
+      geometry->pixelToSpace(
+          cluster.isensor, cluster.pixX, cluster.pixY,
+          x[i], y[i], z[i]);
+      geometry->pixelErrToSpace(
+          cluster.isensor, cluster.pixErrX, cluster.pixErrY,
+          xe[i], ye[i], dummy);
+    }
+    else {
+      cluster.sensor->pixelToSpace(
+          cluster.pixX, cluster.pixY, 
+          x[i], y[i], z[i]);
+      cluster.sensor->pixelErrToSpace(
+          cluster.pixErrX, cluster.pixErrY, 
+          xe[i], ye[i], dummy);
+    }
   }
 
   double chi2 = 0;  // chi^2 is the sum of x and y
@@ -87,40 +100,36 @@ LoopAlignTracks::Chi2Minimizer::Chi2Minimizer(
     m_tracks(tracklets.begin(), tracklets.end()),
     m_ndim(0),
     m_minimizer(0) {
-  if (m_flags & REFERENCE) {
-    // Don't align the first plane
-    m_ndim = 3 * (m_device->getNumSensors()-1);
+  // The minimized values for each sensor
+  const size_t nsensors = m_device->getNumSensors();
+  for (size_t isensor = 0; isensor < nsensors; isensor++) {
+    // Don't align the first plane if this is a reference device
+    if ((m_flags & REFERENCE) && (isensor == 0)) continue;
+    m_parameters.push_back(Mechanics::Geometry::Parameter(
+        isensor, Mechanics::Alignment::OFFX));
+    m_parameters.push_back(Mechanics::Geometry::Parameter(
+        isensor, Mechanics::Alignment::OFFY));
+    m_parameters.push_back(Mechanics::Geometry::Parameter(
+        isensor, Mechanics::Alignment::ROTZ));
   }
+  m_ndim = m_parameters.size();
 
   // Configuration for DUT alignment
-  else {
-    // Align all sensors
-    m_ndim = 3 * m_device->getNumSensors();
+  if (!(m_flags & REFERENCE)) {
     // Pre-compute the track parameters. They won't change since the DUT
     // clusters aren't used in the tracks
     m_trackPars.assign(m_tracks.size(), LoopAlignTracks::TrackPars());
     for (size_t i = 0; i < m_tracks.size(); i++)
-      computeTrackPars(m_tracks[i], m_trackPars[i]);
+      computeTrackPars(m_tracks[i], 0, m_trackPars[i]);
   }
 }
 
-double LoopAlignTracks::Chi2Minimizer::DoEval(const double* pars) const {
+double LoopAlignTracks::Chi2Minimizer::evaluate(const double* pars) const {
   // Sum of chi^2 of tracks is computed here
   double sum = 0;
 
-  // Set the alignment for each sensor from the new parameters
-  size_t ipar = 0;  // keep track of the parameter being read
-  const size_t nsensors = m_device->getNumSensors();
-  for (size_t isensor = 0; isensor < nsensors; isensor++) {
-    // Don't align the first plane if this is a reference device
-    if ((m_flags & REFERENCE) && (isensor == 0)) continue;
-    Mechanics::Sensor& sensor = m_device->getSensor(isensor);
-    sensor.setAlignment(Mechanics::Alignment::OFFX, pars[ipar++]);
-    sensor.setAlignment(Mechanics::Alignment::OFFY, pars[ipar++]);
-    sensor.setAlignment(Mechanics::Alignment::ROTZ, pars[ipar++]);
-  }
-
-  assert(ipar == m_ndim && "Didn't assign all parameters");
+  // Place the sensors with the new parameters
+  const Mechanics::Geometry geometry(*m_device, m_parameters, pars);
 
   // Loop through all the tracks, computing their chi^2
   const size_t ntracks = m_tracks.size();
@@ -128,7 +137,7 @@ double LoopAlignTracks::Chi2Minimizer::DoEval(const double* pars) const {
     // For reference devices, re-compute the track parameters and sum chi^2
     if (m_flags & REFERENCE) {
       TrackPars pars;
-      computeTrackPars(m_tracks[itrack], pars);
+      computeTrackPars(m_tracks[itrack], &geometry, pars);
       sum += pars.chi2;
     }
 
@@ -147,11 +156,11 @@ double LoopAlignTracks::Chi2Minimizer::DoEval(const double* pars) const {
         const Analyzers::TrackChi2::Cluster& match = m_clusters[istart+i];
 
         double x, y, z, ex, ey, dummy;
-        match.sensor->pixelToSpace(
-            match.pixX, match.pixY, 
+        geometry.pixelToSpace(
+            match.isensor, match.pixX, match.pixY, 
             x, y, z);
-        match.sensor->pixelErrToSpace(
-            match.pixErrX, match.pixErrY,
+        geometry.pixelErrToSpace(
+            match.isensor, match.pixErrX, match.pixErrY,
             ex, ey, dummy);
 
         const double tx = pars.p0x + pars.p1x * z;
@@ -165,7 +174,11 @@ double LoopAlignTracks::Chi2Minimizer::DoEval(const double* pars) const {
     }
   }
 
-  const double value = sum / (double)ntracks;
+  return sum / (double)ntracks;
+}
+
+double LoopAlignTracks::Chi2Minimizer::DoEval(const double* pars) const {
+  const double value = evaluate(pars);
 
   if (m_minimizer) std::printf(
         "\rMinimization chi^2 and EDM: %.4e, %.1e",
@@ -180,6 +193,72 @@ ROOT::Math::IBaseFunctionMultiDim* LoopAlignTracks::Chi2Minimizer::Clone() const
   return new LoopAlignTracks::Chi2Minimizer(*this);
 }
 
+/** Evaluates the chi^2 at the finite difference points of a gradient. Part
+  * `2*i` is the point above parameter `i`, part `2*i+1` the one below. */
+class DifferenceTask : public Utils::ThreadPool::Task {
+private:
+  const LoopAlignTracks::Chi2Minimizer& m_function;
+  const double* const m_x;
+  const std::vector<double>& m_steps;
+  std::vector<double>& m_values;
+
+public:
+  DifferenceTask(
+      const LoopAlignTracks::Chi2Minimizer& function,
+      const double* x,
+      const std::vector<double>& steps,
+      std::vector<double>& values) :
+      m_function(function),
+      m_x(x),
+      m_steps(steps),
+      m_values(values) {}
+
+  void run(size_t i) {
+    const size_t icoord = i / 2;
+    std::vector<double> point(m_x, m_x + m_steps.size());
+    point[icoord] += (i % 2 == 0) ? m_steps[icoord] : -m_steps[icoord];
+    m_values[i] = m_function.evaluate(&point[0]);
+  }
+};
+
+LoopAlignTracks::Chi2Gradient::Chi2Gradient(
+    const Chi2Minimizer& function,
+    const std::vector<double>& steps,
+    Utils::ThreadPool& pool) :
+    m_function(function),
+    m_steps(steps),
+    m_pool(&pool) {
+  if (m_steps.size() != m_function.NDim())
+    throw std::runtime_error(
+        "LoopAlignTracks::Chi2Gradient::Chi2Gradient: need one step per "
+        "parameter");
+}
+
+double LoopAlignTracks::Chi2Gradient::DoDerivative(
+    const double* x,
+    unsigned int icoord) const {
+  std::vector<double> values(2*m_steps.size(), 0);
+  DifferenceTask task(m_function, x, m_steps, values);
+  task.run(2*icoord);
+  task.run(2*icoord+1);
+  return (values[2*icoord] - values[2*icoord+1]) / (2*m_steps[icoord]);
+}
+
+void LoopAlignTracks::Chi2Gradient::Gradient(
+    const double* x,
+    double* grad) const {
+  const size_t ndim = m_steps.size();
+  std::vector<double> values(2*ndim, 0);
+  DifferenceTask task(m_function, x, m_steps, values);
+  m_pool->run(task, 2*ndim);
+  for (size_t i = 0; i < ndim; i++)
+    grad[i] = (values[2*i] - values[2*i+1]) / (2*m_steps[i]);
+}
+
+ROOT::Math::IBaseFunctionMultiDim* LoopAlignTracks::Chi2Gradient::Clone() const {
+  return new LoopAlignTracks::Chi2Gradient(*this);
+}
+
 LoopAlignTracks::LoopAlignTracks(
     const std::vector<Storage::StorageI*>& inputs,
     const std::vector<Mechanics::Device*>& devices) :
@@ -190,11 +269,14 @@ LoopAlignTracks::LoopAlignTracks(
     m_tracking(devices[0]->getNumSensors()),
     m_translationScale(1),  // 1 pixel translation scale
     m_rotationScale(0.01),  // ~ half degree rotation scale
-    m_tolerance(1e-2) {  // good tolerance for minuit
+    m_tolerance(1e-2),  // good tolerance for minuit
+    m_gradientThreads(1),  // let the minimizer differentiate
+    m_gradientStep(1e-3) {
   if (m_devices.size() > 2)
     throw std::runtime_error(
         "LoopAlignTracks::LoopAlignTracks: supports at most two devices");
   // Let the base class deal with the analyzer
+  m_trackChi2.setOutput(0);
   addAnalyzer(m_trackChi2);
 }
 
@@ -206,22 +288,19 @@ LoopAlignTracks::LoopAlignTracks(
     m_tracking(device.getNumSensors()),
     m_translationScale(1),
     m_rotationScale(0.01),
-    m_tolerance(1e-2) { 
+    m_tolerance(1e-2),
+    m_gradientThreads(1),
+    m_gradientStep(1e-3) {
+  m_trackChi2.setOutput(0);
   addAnalyzer(m_trackChi2);
 }
 
-void LoopAlignTracks::execute() {
-  for (std::vector<Processors::Processor*>::iterator it = m_processors.begin();
-      it != m_processors.end(); ++it)
-    (*it)->execute(m_events);
-
+void LoopAlignTracks::preLoop() {
   // Tracking needs to be called after any other processors, and only on the
-  // reference device (event 0)
-  m_tracking.execute(*m_events[0]);
-
-  for (std::vector<Analyzers::Analyzer*>::iterator it = m_analyzers.begin();
-      it != m_analyzers.end(); ++it)
-    (*it)->execute(m_events);
+  // reference device (input 0). Running it as a processor lets the loop be
+  // split between threads.
+  if (m_processors.empty() || m_processors.back() != &m_tracking)
+    addProcessor(m_tracking, 0);
 }
 
 void LoopAlignTracks::finalize() {
@@ -250,13 +329,11 @@ void LoopAlignTracks::finalize() {
   // will delete it when out of scope (i.e. method ends or throws exception).
   std::unique_ptr<ROOT::Math::Minimizer> minimizer(
       ROOT::Math::Factory::CreateMinimizer("Minuit"));
-  minimizer->SetFunction(minEval);
-
   minEval.m_minimizer = minimizer.get();
 
-  size_t ipar = 0;  // keep track of the parameter index being setup
+  // Scale of each parameter (degrees of freedom for each sensor)
+  std::vector<double> scales;
 
-  // Set the minimizer parameters (degrees of freedom for each sensor)
   const size_t nsensors = device.getNumSensors();
   for (size_t isensor = 0; isensor < nsensors; isensor++) {
     if (isRef && isensor == 0) continue;  // reference doesn't align plane 1
@@ -271,9 +348,36 @@ void LoopAlignTracks::finalize() {
     const double scaleX = std::fabs(x0-x1) * m_translationScale;
     const double scaleY = std::fabs(y0-y1) * m_translationScale;
 
-    minimizer->SetVariable(ipar++, "", sensor.getOffX(), scaleX);
-    minimizer->SetVariable(ipar++, "", sensor.getOffY(), scaleY);
-    minimizer->SetVariable(ipar++, "", sensor.getRotZ(), m_rotationScale);
+    scales.push_back(scaleX);
+    scales.push_back(scaleY);
+    scales.push_back(m_rotationScale);
+  }
+
+  // The pool and gradient must outlive the minimization
+  std::unique_ptr<Utils::ThreadPool> pool;
+  std::unique_ptr<Chi2Gradient> gradient;
+  if (m_gradientThreads > 1) {
+    std::vector<double> steps(scales);
+    for (size_t i = 0; i < steps.size(); i++) steps[i] *= m_gradientStep;
+    pool.reset(new Utils::ThreadPool(m_gradientThreads));
+    gradient.reset(new Chi2Gradient(minEval, steps, *pool));
+    minimizer->SetFunction(*gradient);
+  }
+  else {
+    minimizer->SetFunction(minEval);
+  }
+
+  // Set the minimizer parameters, once it has the function
+  size_t ipar = 0;  // keep track of the parameter index being setup
+  for (size_t isensor = 0; isensor < nsensors; isensor++) {
+    if (isRef && isensor == 0) continue;
+    const Mechanics::Sensor& sensor = device[isensor];
+    minimizer->SetVariable(ipar, "", sensor.getOffX(), scales[ipar]);
+    ipar += 1;
+    minimizer->SetVariable(ipar, "", sensor.getOffY(), scales[ipar]);
+    ipar += 1;
+    minimizer->SetVariable(ipar, "", sensor.getRotZ(), scales[ipar]);
+    ipar += 1;
   }
 
   minimizer->SetTolerance(m_tolerance);
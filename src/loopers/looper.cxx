@@ -1,7 +1,17 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cmath>
 
+#include <TROOT.h>
+#include <TH1.h>
 #include <TStopwatch.h>
 
 #include "storage/storagei.h"
@@ -9,10 +19,68 @@
 #include "mechanics/device.h"
 #include "processors/processor.h"
 #include "analyzers/analyzer.h"
+#include "threadpool.h"
 #include "loopers/looper.h"
 
 namespace Loopers {
 
+class Looper::LevelTask : public Utils::ThreadPool::Task {
+private:
+  const std::vector<Analyzers::Analyzer*>& m_analyzers;
+  const std::vector<Storage::Event*>& m_events;
+
+public:
+  /** Indices of the analyzers in the level being run */
+  const std::vector<size_t>* m_level;
+
+  LevelTask(
+      const std::vector<Analyzers::Analyzer*>& analyzers,
+      const std::vector<Storage::Event*>& events) :
+      m_analyzers(analyzers),
+      m_events(events),
+      m_level(0) {}
+
+  void run(size_t i) {
+    m_analyzers[(*m_level)[i]]->execute(m_events);
+  }
+};
+
+class Looper::ReadTask : public Utils::ThreadPool::Task {
+private:
+  const std::vector<Storage::StorageI*>& m_inputs;
+  const std::vector<ULong64_t>& m_ievents;
+  std::vector<Storage::Event*>& m_events;
+  /** Fill the caller's events rather than point to the inputs' own */
+  const bool m_fill;
+
+public:
+  /** Read events `ievents` of each input. When filling, `events` holds the
+    * events of each iteration in turn, otherwise it gets the input's own
+    * event for the single entry in `ievents`. */
+  ReadTask(
+      const std::vector<Storage::StorageI*>& inputs,
+      const std::vector<ULong64_t>& ievents,
+      std::vector<Storage::Event*>& events,
+      bool fill) :
+      m_inputs(inputs),
+      m_ievents(ievents),
+      m_events(events),
+      m_fill(fill) {}
+
+  void run(size_t i) {
+    if (!m_fill) {
+      m_events[i] = &m_inputs[i]->readEvent(m_ievents[0]);
+      return;
+    }
+    const size_t ninputs = m_inputs.size();
+    for (size_t n = 0; n < m_ievents.size(); n++) {
+      Storage::Event& event = *m_events[n*ninputs + i];
+      event.reset();
+      m_inputs[i]->readEvent(m_ievents[n], event);
+    }
+  }
+};
+
 Looper::Looper(const std::vector<Storage::StorageI*>& inputs) :
     m_inputs(inputs),
     m_events(m_inputs.size()),  // reserve event vector size
@@ -22,11 +90,22 @@ Looper::Looper(const std::vector<Storage::StorageI*>& inputs) :
     m_finalized(false),
     m_ievent(0),
     m_lastTime(0),
+    m_lastEvent(0),
+    m_analyzerPool(0),
+    m_inputPool(0),
     m_start(0),
     m_nprocess(-1),  // causes iteration over entire range
     m_nstep(1),
     m_printInterval(1E4),
-    m_draw(false) {
+    m_draw(false),
+    m_nthreads(1),
+    m_analyzerThreads(1),
+    m_inputThreads(1),
+    m_chunkTime(0.01),
+    m_batchSize(1),
+    m_sampleSize(0),
+    m_sampleTolerance(0),
+    m_sampleStable(3) {
   // Keep track of the smallest and largest event indices at end of inputs
   for (size_t i = 0; i < m_inputs.size(); i++) {
     const Storage::StorageI& input = *m_inputs[i];
@@ -45,11 +124,23 @@ Looper::Looper(
     m_minEvents(-1),  // largest unsigned integer
     m_finalized(false),
     m_ievent(0),
+    m_lastTime(0),
+    m_lastEvent(0),
+    m_analyzerPool(0),
+    m_inputPool(0),
     m_start(0),
     m_nprocess(-1),  // causes iteration over entire range
     m_nstep(1),
     m_printInterval(1E4),
-    m_draw(false) {
+    m_draw(false),
+    m_nthreads(1),
+    m_analyzerThreads(1),
+    m_inputThreads(1),
+    m_chunkTime(0.01),
+    m_batchSize(1),
+    m_sampleSize(0),
+    m_sampleTolerance(0),
+    m_sampleStable(3) {
   // Keep track of the smallest and largest event indices at end of inputs
   for (size_t i = 0; i < m_inputs.size(); i++) {
     const Storage::StorageI& input = *m_inputs[i];
@@ -76,11 +167,23 @@ Looper::Looper(Storage::StorageI& input) :
     m_minEvents(-1),  // largest unsigned integer
     m_finalized(false),
     m_ievent(0),
+    m_lastTime(0),
+    m_lastEvent(0),
+    m_analyzerPool(0),
+    m_inputPool(0),
     m_start(0),
     m_nprocess(-1),  // causes iteration over entire range
     m_nstep(1),
     m_printInterval(1E4),
-    m_draw(false) {
+    m_draw(false),
+    m_nthreads(1),
+    m_analyzerThreads(1),
+    m_inputThreads(1),
+    m_chunkTime(0.01),
+    m_batchSize(1),
+    m_sampleSize(0),
+    m_sampleTolerance(0),
+    m_sampleStable(3) {
   m_minEvents = (ULong64_t)input.getNumEvents();
   m_maxEvents = (ULong64_t)input.getNumEvents();
 }
@@ -95,11 +198,23 @@ Looper::Looper(Storage::StorageI& input, Mechanics::Device& device) :
     m_minEvents(-1),  // largest unsigned integer
     m_finalized(false),
     m_ievent(0),
+    m_lastTime(0),
+    m_lastEvent(0),
+    m_analyzerPool(0),
+    m_inputPool(0),
     m_start(0),
     m_nprocess(-1),  // causes iteration over entire range
     m_nstep(1),
     m_printInterval(1E4),
-    m_draw(false) {
+    m_draw(false),
+    m_nthreads(1),
+    m_analyzerThreads(1),
+    m_inputThreads(1),
+    m_chunkTime(0.01),
+    m_batchSize(1),
+    m_sampleSize(0),
+    m_sampleTolerance(0),
+    m_sampleStable(3) {
   m_minEvents = (ULong64_t)input.getNumEvents();
   m_maxEvents = (ULong64_t)input.getNumEvents();
   if (m_devices[0]->getNumSensors() != m_inputs[0]->getNumPlanes())
@@ -112,8 +227,11 @@ void Looper::printProgress() {
   m_timer.Continue();
   const double tinst = telapsed - m_lastTime;
   m_lastTime = telapsed;
+  // Parallel loops don't update exactly at each print interval
+  const ULong64_t ninst = m_ievent - m_lastEvent;
+  m_lastEvent = m_ievent;
 
-  const double bandwidth = (tinst)*1E6 / (double)m_printInterval;
+  const double bandwidth = ninst ? tinst*1E6 / (double)ninst : 0;
   const double progress = nelapsed / (double)m_nprocess;
   
   std::printf("\r[");  // \r overwrite the last line
@@ -128,6 +246,37 @@ void Looper::printProgress() {
   std::cout << std::flush;
 }
 
+void Looper::printProgress(ULong64_t ndone, ULong64_t& lastPrinted) {
+  if (!m_printInterval || ndone < lastPrinted+m_printInterval) return;
+  m_ievent = m_start + ndone*m_nstep;
+  printProgress();
+  lastPrinted = ndone;
+}
+
+void Looper::setShard(unsigned ishard, unsigned nshards) {
+  if (nshards == 0 || ishard >= nshards)
+    throw std::out_of_range("Looper::setShard: shard out of range");
+  if (m_start >= m_minEvents)
+    throw std::runtime_error("Looper::setShard: start event out of range");
+  if (m_nstep < 1)
+    throw std::runtime_error("Looper::setShard: step size can't be smaller than 1");
+
+  // Resolve the full range as `loop` would, then keep this shard's part
+  if (m_nprocess == (ULong64_t)(-1))
+    m_nprocess = m_minEvents - m_start;
+
+  // Split whole loop iterations, so that the shards use the same events as an
+  // unsharded loop
+  const ULong64_t nsteps = (m_nprocess + m_nstep - 1) / m_nstep;
+  const ULong64_t first = nsteps*ishard / nshards;
+  const ULong64_t last = nsteps*(ishard+1) / nshards;
+  if (first == last)
+    throw std::runtime_error("Looper::setShard: shard has no events");
+
+  m_start += first*m_nstep;
+  m_nprocess = std::min(m_nprocess - first*m_nstep, (last-first)*m_nstep);
+}
+
 void Looper::loop() {
   // If no number of events is requested, default to all
   if (m_nprocess == (ULong64_t)(-1))
@@ -145,38 +294,579 @@ void Looper::loop() {
   // start, process... variables could change. Instead, if derived class needs
   // these computed and verified values, then it can overwrite preLoop.
   preLoop();
-  
-  for (m_ievent = m_start; m_ievent < m_start+m_nprocess; m_ievent += m_nstep) {
-    // If a print interval is given, and this event is on it, print progress
-    if (m_printInterval && ((m_ievent-m_start) % m_printInterval == 0))
-      printProgress();
-    bool invalid = false;
-    // Read this event from each input file
-    for (size_t i = 0; i < m_inputs.size(); i++) {
-      m_events[i] = &m_inputs[i]->readEvent(m_ievent);
-      // Don't try to do anything if any device has an invalid event (the event
-      // might have bad data)
-      invalid |= m_events[i]->getInvalid();
-      if (invalid) break;
-    }
-    if (invalid) continue;
-    // Execute this looper's event code
-    execute();
+
+  m_lastEvent = m_start;
+
+  // Run the independent analyzers of each event together if requested
+  std::unique_ptr<Utils::ThreadPool> pool;
+  if (m_analyzerThreads > 1 && m_analyzers.size() > 1) {
+    scheduleAnalyzers();
+    // Histograms are filled from many threads
+    ROOT::EnableThreadSafety();
+    pool.reset(new Utils::ThreadPool(m_analyzerThreads));
+    m_analyzerPool = pool.get();
+  }
+
+  // The inputs are separate files, so they can be read at the same time.
+  // There is no use in more threads than inputs.
+  std::unique_ptr<Utils::ThreadPool> inputPool;
+  if (m_inputThreads > 1 && m_inputs.size() > 1) {
+    ROOT::EnableThreadSafety();
+    inputPool.reset(new Utils::ThreadPool(
+        std::min((size_t)m_inputThreads, m_inputs.size())));
+    m_inputPool = inputPool.get();
+  }
+
+  try {
+    if (m_sampleSize > 0) loopSampled();
+    else loopRange();
   }
+  catch (...) {
+    m_analyzerPool = 0;
+    m_inputPool = 0;
+    throw;
+  }
+  m_analyzerPool = 0;
+  m_inputPool = 0;
+
   // Print the 100% progress and finish that line
   printProgress();
   std::cout << std::endl;
 }
 
-void Looper::execute() {
+void Looper::loopRange() {
+  // Split the events between threads if requested, and if this looper can
+  if ((m_nthreads > 1 || m_batchSize > 1) && isParallel()) {
+    loopParallel();
+  }
+
+  else {
+    for (m_ievent = m_start; m_ievent < m_start+m_nprocess; m_ievent += m_nstep) {
+      // If a print interval is given, and this event is on it, print progress
+      if (m_printInterval && ((m_ievent-m_start) % m_printInterval == 0))
+        printProgress();
+      // Read this event from each input file. Don't try to do anything if any
+      // device has an invalid event (the event might have bad data)
+      if (!readInputs(m_inputs, m_ievent, m_events)) continue;
+      // Execute this looper's event code
+      execute();
+    }
+  }
+}
+
+void Looper::loopSampled() {
+  const ULong64_t start = m_start;
+  const ULong64_t nprocess = m_nprocess;
+  const unsigned printInterval = m_printInterval;
+  const ULong64_t nsteps = (nprocess + m_nstep - 1) / m_nstep;
+  const ULong64_t nblocks = (nsteps + m_sampleSize - 1) / m_sampleSize;
+
+  // Visit the blocks in bit-reversed order of their index, so that each new
+  // block falls in the largest gap left by the previous ones (a subset of the
+  // blocks is then spread across the run)
+  ULong64_t nbits = 0;
+  while (((ULong64_t)1 << nbits) < nblocks) nbits++;
+
+  std::vector<double> means;
+  std::vector<double> sigmas;
+  unsigned nstable = 0;
+  ULong64_t ndone = 0;
+
+  try {
+    for (ULong64_t i = 0; i < ((ULong64_t)1 << nbits); i++) {
+      ULong64_t iblock = 0;
+      for (ULong64_t ibit = 0; ibit < nbits; ibit++)
+        if (i & ((ULong64_t)1 << ibit)) iblock |= (ULong64_t)1 << (nbits-1-ibit);
+      if (iblock >= nblocks) continue;
+
+      // Blocks are run as though they were the whole range, without their
+      // own progress
+      m_start = start + iblock*m_sampleSize*m_nstep;
+      m_nprocess = std::min(m_sampleSize*m_nstep, start+nprocess - m_start);
+      m_printInterval = 0;
+      loopRange();
+      ndone += (m_nprocess + m_nstep - 1) / m_nstep;
+
+      m_start = start;
+      m_nprocess = nprocess;
+      m_printInterval = printInterval;
+      m_ievent = start + ndone*m_nstep;
+      if (m_printInterval) printProgress();
+
+      if (m_sampleTolerance <= 0) continue;
+      nstable = isStable(means, sigmas) ? nstable+1 : 0;
+      if (nstable >= m_sampleStable) break;
+    }
+  }
+  catch (...) {
+    m_start = start;
+    m_nprocess = nprocess;
+    m_printInterval = printInterval;
+    throw;
+  }
+}
+
+bool Looper::isStable(
+    std::vector<double>& means,
+    std::vector<double>& sigmas) const {
+  std::vector<double> newMeans;
+  std::vector<double> newSigmas;
+  for (size_t i = 0; i < m_analyzers.size(); i++)
+    m_analyzers[i]->getMoments(newMeans, newSigmas);
+
+  // A distribution which gained its first entries isn't stable yet
+  bool stable = !newMeans.empty() && newMeans.size() == means.size();
+  for (size_t i = 0; stable && i < newMeans.size(); i++) {
+    const double tolerance = m_sampleTolerance * newSigmas[i];
+    stable &= std::fabs(newMeans[i]-means[i]) <= tolerance;
+    stable &= std::fabs(newSigmas[i]-sigmas[i]) <= tolerance;
+  }
+
+  means.swap(newMeans);
+  sigmas.swap(newSigmas);
+  return stable;
+}
+
+struct Looper::Worker {
+  /** Analyzers which ran a contiguous range of iterations starting at `first`.
+    * Ranges are merged in order, so appended results keep the event order. */
+  struct Segment {
+    ULong64_t first;
+    std::vector<Analyzers::Analyzer*> analyzers;
+    /** The first segment uses the looper's analyzers, the others own clones */
+    bool owner;
+    Segment() : first(0), owner(false) {}
+    static bool before(const Segment* seg1, const Segment* seg2) {
+      return seg1->first < seg2->first;
+    }
+    ~Segment() {
+      if (!owner) return;
+      for (size_t i = 0; i < analyzers.size(); i++) delete analyzers[i];
+    }
+  };
+
+  /** Unclaimed loop iterations in this worker's range: from `next` up to the
+    * one before `last`. Guarded by `mutex` since other workers steal. */
+  std::mutex mutex;
+  ULong64_t next;
+  ULong64_t last;
+  /** Objects used by this worker, in the same order as the looper's */
+  std::vector<Storage::StorageI*> inputs;
+  std::vector<Storage::Event*> events;
+  std::vector<Processors::Processor*> processors;
+  /** Analyzers of each range run by this worker, the last one is in use */
+  std::vector<std::unique_ptr<Segment> > segments;
+  /** Events owned by this worker, to read a block of iterations at once, and
+    * the events of the current block */
+  std::vector<std::unique_ptr<Storage::Event> > pool;
+  std::vector<Storage::Event*> batch;
+  /** The first worker uses the looper's objects, the others own copies */
+  bool owner;
+  /** Iterations done so far, read by the main thread to show progress */
+  std::atomic<ULong64_t> ndone;
+  std::atomic<bool> finished;
+  /** Message of an exception thrown in this worker's thread */
+  std::string error;
+  /** Shared by all workers, set once any of them fails so that the others
+    * stop rather than run their whole range */
+  std::atomic<bool>* stop;
+
+  Worker() :
+      next(0),
+      last(0),
+      owner(false),
+      ndone(0),
+      finished(false),
+      stop(0) {}
+  ~Worker() {
+    if (!owner) return;
+    for (size_t i = 0; i < inputs.size(); i++) delete inputs[i];
+    for (size_t i = 0; i < processors.size(); i++) delete processors[i];
+  }
+};
+
+bool Looper::stealRange(const std::vector<Worker*>& workers, size_t ithief) {
+  while (true) {
+    // The largest range is the one most likely to still be running later
+    size_t ivictim = ithief;
+    ULong64_t most = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+      if (i == ithief) continue;
+      std::lock_guard<std::mutex> lock(workers[i]->mutex);
+      if (workers[i]->last - workers[i]->next <= most) continue;
+      most = workers[i]->last - workers[i]->next;
+      ivictim = i;
+    }
+    if (most == 0) return false;
+
+    ULong64_t first = 0;
+    ULong64_t last = 0;
+    {
+      Worker& victim = *workers[ivictim];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      // Another thief might have been faster, look again
+      if (victim.last == victim.next) continue;
+      first = victim.next + (victim.last-victim.next)/2;
+      last = victim.last;
+      victim.last = first;
+    }
+
+    // The stolen range doesn't follow this worker's last range, so its
+    // analysis goes in new analyzers to be merged at its place in the order
+    Worker& thief = *workers[ithief];
+    thief.segments.push_back(
+        std::unique_ptr<Worker::Segment>(new Worker::Segment()));
+    Worker::Segment& segment = *thief.segments.back();
+    segment.first = first;
+    segment.owner = true;
+    for (size_t i = 0; i < m_analyzers.size(); i++)
+      segment.analyzers.push_back(m_analyzers[i]->clone());
+
+    std::lock_guard<std::mutex> lock(thief.mutex);
+    thief.next = first;
+    thief.last = last;
+    return true;
+  }
+}
+
+void Looper::runWorker(const std::vector<Worker*>& workers, size_t iworker) {
+  Worker& worker = *workers[iworker];
+  // Average time per iteration, weighted to the latest chunks (0 until one
+  // chunk is timed)
+  double cost = 0;
+  try {
+    // Checked before each chunk, and so also before each steal
+    while (!*worker.stop) {
+      // Claim enough iterations to last about `m_chunkTime`
+      const ULong64_t chunk = cost > 0 ?
+          std::max((ULong64_t)1, (ULong64_t)(m_chunkTime/cost)) : 1;
+      ULong64_t first = 0;
+      ULong64_t last = 0;
+      {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        first = worker.next;
+        last = std::min(worker.last, first+chunk);
+        worker.next = last;
+      }
+
+      if (first == last) {
+        if (!stealRange(workers, iworker)) break;
+        continue;
+      }
+
+      const std::vector<Analyzers::Analyzer*>& analyzers =
+          worker.segments.back()->analyzers;
+      const std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+
+      if (m_batchSize > 1) {
+        runBatches(worker, analyzers, first, last);
+      }
+
+      else {
+        for (ULong64_t istep = first; istep < last; istep++) {
+          const ULong64_t ievent = m_start + istep*m_nstep;
+          if (readInputs(worker.inputs, ievent, worker.events))
+            run(worker.processors, analyzers, worker.events);
+          worker.ndone += 1;
+        }
+      }
+
+      const double elapsed = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      const double sample = elapsed / (last-first);
+      cost = cost > 0 ? 0.75*cost + 0.25*sample : sample;
+    }
+  }
+  // Exceptions can't cross threads, so keep the message for the main thread
+  // and tell the other workers to stop
+  catch (std::exception& e) {
+    worker.error = e.what();
+    *worker.stop = true;
+  }
+  catch (...) {
+    worker.error = "unknown exception";
+    *worker.stop = true;
+  }
+  worker.finished = true;
+}
+
+void Looper::runBatches(
+    Worker& worker,
+    const std::vector<Analyzers::Analyzer*>& analyzers,
+    ULong64_t first,
+    ULong64_t last) {
+  const size_t ninputs = worker.inputs.size();
+
+  // The inputs re-use their own event at each read, so keep a block in events
+  // owned by the worker
+  if (worker.pool.empty()) {
+    for (size_t ibatch = 0; ibatch < m_batchSize; ibatch++)
+      for (size_t i = 0; i < ninputs; i++)
+        worker.pool.push_back(std::unique_ptr<Storage::Event>(
+            new Storage::Event(worker.inputs[i]->getNumPlanes())));
+  }
+
+  std::vector<Storage::Event*> window;
+  for (size_t i = 0; i < worker.pool.size(); i++)
+    window.push_back(worker.pool[i].get());
+  std::vector<ULong64_t> ievents;
+  ReadTask task(worker.inputs, ievents, window, true);
+
+  ULong64_t istep = first;
+  while (istep < last) {
+    ievents.clear();
+    for (; istep < last && ievents.size() < m_batchSize; istep++)
+      ievents.push_back(m_start + istep*m_nstep);
+    const size_t nread = ievents.size();
+
+    // Each input reads its events of the whole block, so that the block takes
+    // as long as the slowest input rather than all of them
+    if (m_inputPool) m_inputPool->run(task, ninputs);
+    else for (size_t i = 0; i < ninputs; i++) task.run(i);
+
+    worker.batch.clear();
+    for (size_t n = 0; n < nread; n++) {
+      bool invalid = false;
+      for (size_t i = 0; i < ninputs; i++)
+        invalid |= window[n*ninputs + i]->getInvalid();
+      // Leave out iterations with an invalid event
+      if (invalid) continue;
+      for (size_t i = 0; i < ninputs; i++)
+        worker.batch.push_back(window[n*ninputs + i]);
+    }
+
+    runBatch(worker.processors, analyzers, worker.batch);
+    worker.ndone += nread;
+  }
+}
+
+void Looper::loopParallel() {
+  // The threads already split the events, so each runs its analyzers in turn
+  // rather than all of them waiting on one analyzer pool
+  Utils::ThreadPool* const analyzerPool = m_analyzerPool;
+  m_analyzerPool = 0;
+
+  // Number of loop iterations to split between the threads
+  const ULong64_t nsteps = (m_nprocess + m_nstep - 1) / m_nstep;
+  const size_t nworkers = std::max(
+      (ULong64_t)1, std::min((ULong64_t)m_nthreads, nsteps));
+
+  // Likewise, the workers already read in parallel. A single worker (reading
+  // blocks of events) still reads its inputs on the input pool.
+  Utils::ThreadPool* const inputPool = m_inputPool;
+  if (nworkers > 1) m_inputPool = 0;
+
+  // ROOT files and objects are used from many threads
+  ROOT::EnableThreadSafety();
+
+  std::vector<std::unique_ptr<Worker> > owned;
+  std::vector<Worker*> workers;
+  std::atomic<bool> stop(false);
+
+  // The clones' histograms belong to their thread, don't let ROOT register
+  // them in the current directory. Threads clone analyzers when stealing, so
+  // this lasts until they are done.
+  const bool addDirectory = TH1::AddDirectoryStatus();
+  TH1::AddDirectory(false);
+
+  try {
+    for (size_t iworker = 0; iworker < nworkers; iworker++) {
+      owned.push_back(std::unique_ptr<Worker>(new Worker()));
+      Worker& worker = *owned.back();
+      workers.push_back(&worker);
+      // Start with contiguous blocks, which are enough if costs are even
+      worker.next = nsteps*iworker / nworkers;
+      worker.last = nsteps*(iworker+1) / nworkers;
+      worker.events.assign(m_inputs.size(), 0);
+      worker.stop = &stop;
+      worker.segments.push_back(
+          std::unique_ptr<Worker::Segment>(new Worker::Segment()));
+      Worker::Segment& segment = *worker.segments.back();
+      segment.first = worker.next;
+
+      // The first block runs on the looper's own objects, so that the other
+      // ranges are merged into them in order
+      if (iworker == 0) {
+        worker.inputs = m_inputs;
+        worker.processors = m_processors;
+        segment.analyzers = m_analyzers;
+        continue;
+      }
+
+      worker.owner = true;
+      segment.owner = true;
+      for (size_t i = 0; i < m_inputs.size(); i++)
+        worker.inputs.push_back(m_inputs[i]->duplicate());
+      for (size_t i = 0; i < m_processors.size(); i++)
+        worker.processors.push_back(m_processors[i]->clone());
+      for (size_t i = 0; i < m_analyzers.size(); i++)
+        segment.analyzers.push_back(m_analyzers[i]->clone());
+    }
+  }
+  catch (...) {
+    TH1::AddDirectory(addDirectory);
+    throw;
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t iworker = 0; iworker < nworkers; iworker++)
+    threads.push_back(std::thread(
+        &Looper::runWorker, this, std::cref(workers), iworker));
+
+  // Show the progress of all threads until they are done
+  ULong64_t lastPrinted = 0;
+  while (true) {
+    ULong64_t ndone = 0;
+    bool finished = true;
+    for (size_t iworker = 0; iworker < nworkers; iworker++) {
+      ndone += workers[iworker]->ndone;
+      finished &= workers[iworker]->finished;
+    }
+    if (finished) break;
+    printProgress(ndone, lastPrinted);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  for (size_t iworker = 0; iworker < nworkers; iworker++)
+    threads[iworker].join();
+
+  TH1::AddDirectory(addDirectory);
+  m_analyzerPool = analyzerPool;
+  m_inputPool = inputPool;
+
+  m_ievent = m_start + nsteps*m_nstep;
+
+  for (size_t iworker = 0; iworker < nworkers; iworker++)
+    if (!workers[iworker]->error.empty())
+      throw std::runtime_error(
+          "Looper::loopParallel: " + workers[iworker]->error);
+
+  // Merge in event order, so that the result doesn't depend on the timing of
+  // the threads. The looper's own analyzers start at the first event, and a
+  // stable sort keeps them first if a stolen range starts there too.
+  std::vector<Worker::Segment*> segments;
+  for (size_t iworker = 0; iworker < nworkers; iworker++)
+    for (size_t i = 0; i < workers[iworker]->segments.size(); i++)
+      segments.push_back(workers[iworker]->segments[i].get());
+  std::stable_sort(segments.begin(), segments.end(), Worker::Segment::before);
+
+  for (size_t iseg = 1; iseg < segments.size(); iseg++)
+    for (size_t i = 0; i < m_analyzers.size(); i++)
+      m_analyzers[i]->merge(*segments[iseg]->analyzers[i]);
+}
+
+void Looper::run(
+    const std::vector<Processors::Processor*>& processors,
+    const std::vector<Analyzers::Analyzer*>& analyzers,
+    const std::vector<Storage::Event*>& events) {
   // Execute the processors first since they can modify the event
-  for (std::vector<Processors::Processor*>::iterator it = m_processors.begin();
-      it != m_processors.end(); ++it)
-    (*it)->execute(m_events);
+  for (size_t i = 0; i < processors.size(); i++) {
+    if (m_processorInputs[i] < 0) processors[i]->execute(events);
+    else processors[i]->execute(*events[m_processorInputs[i]]);
+  }
   // Then build up analysis from the event data
-  for (std::vector<Analyzers::Analyzer*>::iterator it = m_analyzers.begin();
-      it != m_analyzers.end(); ++it)
-    (*it)->execute(m_events);
+  runAnalyzers(analyzers, events);
+}
+
+bool Looper::readInputs(
+    const std::vector<Storage::StorageI*>& inputs,
+    ULong64_t ievent,
+    std::vector<Storage::Event*>& events) {
+  if (m_inputPool && inputs.size() > 1) {
+    const std::vector<ULong64_t> ievents(1, ievent);
+    ReadTask task(inputs, ievents, events, false);
+    m_inputPool->run(task, inputs.size());
+  }
+  else {
+    // Reading in turn, stop at the first invalid event
+    for (size_t i = 0; i < inputs.size(); i++) {
+      events[i] = &inputs[i]->readEvent(ievent);
+      if (events[i]->getInvalid()) return false;
+    }
+  }
+
+  for (size_t i = 0; i < inputs.size(); i++)
+    if (events[i]->getInvalid()) return false;
+  return true;
+}
+
+void Looper::runAnalyzers(
+    const std::vector<Analyzers::Analyzer*>& analyzers,
+    const std::vector<Storage::Event*>& events) {
+  if (!m_analyzerPool) {
+    for (std::vector<Analyzers::Analyzer*>::const_iterator it =
+        analyzers.begin(); it != analyzers.end(); ++it)
+      (*it)->execute(events);
+    return;
+  }
+
+  // Each level waits on the previous one, and the event is done with once
+  // the last level returns
+  LevelTask task(analyzers, events);
+  for (size_t ilevel = 0; ilevel < m_analyzerLevels.size(); ilevel++) {
+    task.m_level = &m_analyzerLevels[ilevel];
+    m_analyzerPool->run(task, m_analyzerLevels[ilevel].size());
+  }
+}
+
+void Looper::scheduleAnalyzers() {
+  const size_t nanalyzers = m_analyzers.size();
+  std::vector<size_t> levels(nanalyzers, 0);
+  // Analyzers added after one which isn't read-only can't run before it
+  size_t barrier = 0;
+  size_t nlevels = 0;
+
+  for (size_t i = 0; i < nanalyzers; i++) {
+    const Analyzers::Analyzer& analyzer = *m_analyzers[i];
+    size_t level = analyzer.isReadOnly() ? barrier : nlevels;
+
+    const std::vector<const Analyzers::Analyzer*>& dependencies =
+        analyzer.getDependencies();
+    for (size_t idep = 0; idep < dependencies.size(); idep++) {
+      size_t j = 0;
+      while (j < i && m_analyzers[j] != dependencies[idep]) j++;
+      if (j == i)
+        throw std::runtime_error(
+            "Looper::scheduleAnalyzers: dependency must be added before");
+      level = std::max(level, levels[j]+1);
+    }
+
+    levels[i] = level;
+    nlevels = std::max(nlevels, level+1);
+    if (!analyzer.isReadOnly()) barrier = level+1;
+  }
+
+  m_analyzerLevels.assign(nlevels, std::vector<size_t>());
+  for (size_t i = 0; i < nanalyzers; i++)
+    m_analyzerLevels[levels[i]].push_back(i);
+}
+
+void Looper::runBatch(
+    const std::vector<Processors::Processor*>& processors,
+    const std::vector<Analyzers::Analyzer*>& analyzers,
+    const std::vector<Storage::Event*>& events) {
+  const size_t ninputs = m_inputs.size();
+  std::vector<Storage::Event*> inputEvents;
+  for (size_t i = 0; i < processors.size(); i++) {
+    if (m_processorInputs[i] < 0) {
+      processors[i]->executeBatch(events);
+      continue;
+    }
+    // Pick out the events of this processor's input
+    inputEvents.clear();
+    for (size_t ievent = m_processorInputs[i]; ievent < events.size();
+        ievent += ninputs)
+      inputEvents.push_back(events[ievent]);
+    processors[i]->executeBatch(inputEvents);
+  }
+  for (std::vector<Analyzers::Analyzer*>::const_iterator it = analyzers.begin();
+      it != analyzers.end(); ++it)
+    (*it)->executeBatch(events);
+}
+
+void Looper::execute() {
+  run(m_processors, m_analyzers, m_events);
 }
 
 void Looper::finalize() {
@@ -192,6 +882,14 @@ void Looper::finalize() {
 
 void Looper::addProcessor(Processors::Processor& processor) {
   m_processors.push_back(&processor);
+  m_processorInputs.push_back(-1);
+}
+
+void Looper::addProcessor(Processors::Processor& processor, size_t iinput) {
+  if (iinput >= m_inputs.size())
+    throw std::out_of_range("Looper::addProcessor: input index out of range");
+  m_processors.push_back(&processor);
+  m_processorInputs.push_back(iinput);
 }
 
 void Looper::addAnalyzer(Analyzers::Analyzer& analyzer) {
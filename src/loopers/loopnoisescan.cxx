@@ -0,0 +1,55 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "storage/storagei.h"
+#include "mechanics/device.h"
+#include "mechanics/sensor.h"
+#include "analyzers/noisescan.h"
+#include "loopers/loopnoisescan.h"
+
+namespace Loopers {
+
+LoopNoiseScan::LoopNoiseScan(
+    const std::vector<Storage::StorageI*>& inputs,
+    const std::vector<Mechanics::Device*>& devices) :
+    Looper(inputs, devices),
+    m_noiseScan(devices) {
+  m_noiseScan.setOutput(0);
+  addAnalyzer(m_noiseScan);
+}
+
+LoopNoiseScan::LoopNoiseScan(
+    Storage::StorageI& input,
+    Mechanics::Device& device) :
+    Looper(input, device),
+    m_noiseScan(device) {
+  m_noiseScan.setOutput(0);
+  addAnalyzer(m_noiseScan);
+}
+
+void LoopNoiseScan::finalize() {
+  Looper::finalize();
+
+  for (size_t idevice = 0; idevice < m_devices.size(); idevice++) {
+    Mechanics::Device& device = *m_devices[idevice];
+    for (size_t isens = 0; isens < device.getNumSensors(); isens++) {
+      Mechanics::Sensor& sensor = device.getSensor(isens);
+      m_noiseScan.getNoise(
+          idevice,
+          isens,
+          sensor.m_noiseProfile,
+          sensor.m_noiseMask);
+
+      // Report how much of the sensor is lost to the mask
+      size_t nmasked = 0;
+      for (size_t ipix = 0; ipix < sensor.m_noiseMask.size(); ipix++)
+        nmasked += sensor.m_noiseMask[ipix];
+      std::cout << device.m_name << " " << sensor.m_name << ": masked "
+          << nmasked << " of " << sensor.m_noiseMask.size() << " pixels"
+          << std::endl;
+    }
+  }
+}
+
+}
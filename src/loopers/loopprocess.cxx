@@ -1,11 +1,26 @@
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 #include <cassert>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include <TROOT.h>
 
 #include "storage/event.h"
+#include "storage/storagei.h"
 #include "storage/storageo.h"
+#include "storage/trackntuple.h"
+#include "processors/processor.h"
 #include "processors/clustering.h"
 #include "processors/aligning.h"
+#include "analyzers/analyzer.h"
+#include "loopers/eventqueue.h"
 #include "loopers/loopprocess.h"
 
 namespace Loopers {
@@ -14,14 +29,214 @@ LoopProcess::LoopProcess(
     Storage::StorageI& input,
     Storage::StorageO& output) :
     Looper(input),
-    m_output(output) {}
+    m_output(output),
+    m_ntuple(0),
+    m_poolSize(0) {}
+
+void LoopProcess::store(Storage::Event& event, ULong64_t ievent) {
+  m_output.writeEvent(event);
+  // Flat ntuple is filled in the same pass, from the same processed event
+  if (m_ntuple) m_ntuple->fill(event, ievent);
+}
 
 void LoopProcess::execute() {
   Looper::execute();  // run the processors
   // Store the processed event in the output
   assert(m_events.size() == 1 && "Can construct with 1 input only");
-  m_output.writeEvent(*m_events[0]);
+  store(*m_events[0], m_ievent);
+}
+
+struct LoopProcess::Pipeline {
+  /** Events in flight, refered to by their index (handle) in the pool */
+  std::vector<std::unique_ptr<Storage::Event> > events;
+  /** Loop iteration of the event held by each handle */
+  std::vector<ULong64_t> steps;
+  /** Queue 0 holds the free handles, queue 1+i the input of stage i, and
+    * the last queue the input of the writer */
+  std::vector<std::unique_ptr<EventQueue> > queues;
+  /** Number of replicas of each stage still running */
+  std::vector<std::unique_ptr<std::atomic<size_t> > > running;
+  /** Number of loop iterations to run */
+  ULong64_t nsteps;
+  /** Most events passed from one stage to the next at once */
+  size_t nbatch;
+  /** Iterations written so far, read by the main thread to show progress */
+  std::atomic<ULong64_t> nwritten;
+  std::atomic<bool> finished;
+  /** Message of the first exception thrown in any thread */
+  std::mutex errorMutex;
+  std::string error;
+
+  Pipeline() : nsteps(0), nbatch(1), nwritten(0), finished(false) {}
+
+  /** Keep the first error and stop all stages */
+  void fail(const std::string& what) {
+    {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      if (error.empty()) error = what;
+    }
+    for (size_t i = 0; i < queues.size(); i++) queues[i]->close();
+  }
+};
+
+void LoopProcess::readEvents(Pipeline& pipeline) {
+  EventQueue& freed = *pipeline.queues.front();
+  EventQueue& next = *pipeline.queues[1];
+  try {
+    std::vector<size_t> handles;
+    ULong64_t istep = 0;
+    while (istep < pipeline.nsteps) {
+      // Read a block of up to `nbatch` events
+      const size_t nread = std::min(
+          (ULong64_t)pipeline.nbatch, pipeline.nsteps-istep);
+      if (!freed.pop(handles, nread)) break;
+      for (size_t i = 0; i < handles.size(); i++) {
+        Storage::Event& event = *pipeline.events[handles[i]];
+        event.reset();  // drop the objects from the last use of this handle
+        m_inputs[0]->readEvent(m_start + istep*m_nstep, event);
+        pipeline.steps[handles[i]] = istep;
+        istep += 1;
+      }
+      if (!next.push(handles)) break;
+    }
+  }
+  // Exceptions can't cross threads, so keep the message for the main thread
+  catch (std::exception& e) {
+    pipeline.fail(e.what());
+  }
+  next.close();
+}
+
+void LoopProcess::processEvents(
+    Pipeline& pipeline,
+    size_t istage,
+    Processors::Processor& processor) {
+  EventQueue& queue = *pipeline.queues[1+istage];
+  EventQueue& next = *pipeline.queues[2+istage];
+  try {
+    std::vector<size_t> handles;
+    std::vector<Storage::Event*> batch;
+    while (queue.pop(handles, pipeline.nbatch)) {
+      batch.clear();
+      for (size_t i = 0; i < handles.size(); i++)
+        if (!pipeline.events[handles[i]]->getInvalid())
+          batch.push_back(pipeline.events[handles[i]].get());
+      // Invalid events are still passed on, to be freed in order
+      processor.executeBatch(batch);
+      if (!next.push(handles)) break;
+    }
+  }
+  catch (std::exception& e) {
+    pipeline.fail(e.what());
+  }
+  // The last replica of this stage to finish ends the next stage's input
+  if (--(*pipeline.running[istage]) == 0) next.close();
+}
+
+void LoopProcess::writeEvents(Pipeline& pipeline) {
+  EventQueue& queue = *pipeline.queues.back();
+  EventQueue& freed = *pipeline.queues.front();
+  const size_t npool = pipeline.events.size();
+  // Replicated stages can finish events out of order. At most `npool` are in
+  // flight, so iteration `istep` can wait at `istep % npool` for its turn.
+  std::vector<size_t> pending(npool, npool);  // npool marks an empty slot
+  std::vector<Storage::Event*> events(1, 0);
+  try {
+    ULong64_t istep = 0;
+    std::vector<size_t> handles;
+    while (istep < pipeline.nsteps && queue.pop(handles, pipeline.nbatch)) {
+      for (size_t i = 0; i < handles.size(); i++)
+        pending[pipeline.steps[handles[i]] % npool] = handles[i];
+      // Write all events which are next in order
+      while (istep < pipeline.nsteps && pending[istep % npool] < npool) {
+        const size_t ready = pending[istep % npool];
+        pending[istep % npool] = npool;
+        Storage::Event& event = *pipeline.events[ready];
+        if (!event.getInvalid()) {
+          events[0] = &event;
+          runAnalyzers(m_analyzers, events);
+          store(event, m_start + istep*m_nstep);
+        }
+        istep += 1;
+        pipeline.nwritten = istep;
+        if (!freed.push(ready)) break;
+      }
+    }
+  }
+  catch (std::exception& e) {
+    pipeline.fail(e.what());
+  }
+  pipeline.finished = true;
 }
 
+void LoopProcess::loopParallel() {
+  assert(m_inputs.size() == 1 && "Can construct with 1 input only");
+
+  Pipeline pipeline;
+  pipeline.nsteps = (m_nprocess + m_nstep - 1) / m_nstep;
+  pipeline.nbatch = std::max(1u, m_batchSize);
+
+  const size_t nstages = m_processors.size();
+  // Keep each thread busy with a few blocks of events in flight
+  const size_t npool = m_poolSize ? m_poolSize :
+      4 * pipeline.nbatch * (2 + nstages*m_nthreads);
+
+  for (size_t i = 0; i < npool; i++)
+    pipeline.events.push_back(std::unique_ptr<Storage::Event>(
+        new Storage::Event(m_inputs[0]->getNumPlanes())));
+  pipeline.steps.assign(npool, 0);
+
+  // Every queue can hold the whole pool, so only an empty queue blocks
+  for (size_t i = 0; i < nstages+2; i++)
+    pipeline.queues.push_back(
+        std::unique_ptr<EventQueue>(new EventQueue(npool)));
+  for (size_t i = 0; i < npool; i++)
+    pipeline.queues.front()->push(i);
+
+  // Processors don't store state, so each stage is replicated on many threads
+  // (the first replica is the looper's own processor)
+  std::vector<std::unique_ptr<Processors::Processor> > clones;
+  for (size_t istage = 0; istage < nstages; istage++) {
+    pipeline.running.push_back(std::unique_ptr<std::atomic<size_t> >(
+        new std::atomic<size_t>(m_nthreads)));
+    for (size_t ireplica = 1; ireplica < m_nthreads; ireplica++)
+      clones.push_back(std::unique_ptr<Processors::Processor>(
+          m_processors[istage]->clone()));
+  }
+
+  // ROOT files and objects are used from many threads
+  ROOT::EnableThreadSafety();
+
+  std::vector<std::thread> threads;
+  threads.push_back(std::thread(
+      &LoopProcess::readEvents, this, std::ref(pipeline)));
+  for (size_t istage = 0; istage < nstages; istage++) {
+    for (size_t ireplica = 0; ireplica < m_nthreads; ireplica++) {
+      Processors::Processor& processor = ireplica == 0 ?
+          *m_processors[istage] :
+          *clones[istage*(m_nthreads-1) + ireplica-1];
+      threads.push_back(std::thread(
+          &LoopProcess::processEvents, this,
+          std::ref(pipeline), istage, std::ref(processor)));
+    }
+  }
+  threads.push_back(std::thread(
+      &LoopProcess::writeEvents, this, std::ref(pipeline)));
+
+  // Show the progress of the writer, which is the slowest to advance
+  ULong64_t lastPrinted = 0;
+  while (!pipeline.finished) {
+    printProgress(pipeline.nwritten, lastPrinted);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  m_ievent = m_start + pipeline.nsteps*m_nstep;
+
+  if (!pipeline.error.empty())
+    throw std::runtime_error("LoopProcess::loopParallel: " + pipeline.error);
 }
 
+}
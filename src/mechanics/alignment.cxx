@@ -31,6 +31,8 @@ void Alignment::calculate() {
   m_matrix[2][0] = -sin(ry);
   m_matrix[2][1] = sin(rx) * cos(ry);
   m_matrix[2][2] = cos(rx) * cos(ry);
+
+  alignmentChanged();
 }
 
 void Alignment::rotate(double& x, double& y, double& z) const {
@@ -91,6 +93,29 @@ void Alignment::untransform(double& x, double& y, double& z) const {
   z = buffer[2];
 }
 
+void Alignment::fuse(const Alignment* parent, double map[3][3]) const {
+  // Global position of the local origin: through this transformation into
+  // the parent's space, then through the parent's into global space
+  double origin[3] = { 0, 0, 0 };
+  transform(origin[0], origin[1], origin[2]);
+  if (parent) parent->transform(origin[0], origin[1], origin[2]);
+
+  // Directions of the local axes only rotate
+  double axisX[3] = { 1, 0, 0 };
+  rotate(axisX[0], axisX[1], axisX[2]);
+  if (parent) parent->rotate(axisX[0], axisX[1], axisX[2]);
+
+  double axisY[3] = { 0, 1, 0 };
+  rotate(axisY[0], axisY[1], axisY[2]);
+  if (parent) parent->rotate(axisY[0], axisY[1], axisY[2]);
+
+  for (unsigned i = 0; i < 3; i++) {
+    map[i][0] = axisX[i];
+    map[i][1] = axisY[i];
+    map[i][2] = origin[i];
+  }
+}
+
 // NOTE: all these methods need to call the `calculate` method to update the
 // rotation matrix
 
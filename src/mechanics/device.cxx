@@ -23,6 +23,7 @@ Device::Device(size_t numSensors) :
     m_spaceUnit(),
     m_timeUnit(),
     m_alignmentFile(),
+    m_noiseMaskFile(),
     m_timeStart(0),
     m_timeEnd(0) {
   updateSensors();
@@ -38,6 +39,8 @@ Device::Device(const Device& copy) :
     m_readOutWindow(copy.m_readOutWindow),
     m_spaceUnit(copy.m_spaceUnit),
     m_timeUnit(copy.m_timeUnit),
+    m_alignmentFile(copy.m_alignmentFile),
+    m_noiseMaskFile(copy.m_noiseMaskFile),
     m_timeStart(copy.m_timeStart),
     m_timeEnd(copy.m_timeEnd) {
   updateSensors();
@@ -52,9 +55,15 @@ void Device::updateSensors() {
     if (!m_sensorMask[i]) m_sensors.push_back(&m_sensorsFull[i]);
     // Associate the sensors to this device (useful when copying)
     m_sensorsFull[i].m_device = this;
+    m_sensorsFull[i].fuseAlignment();
   }
 }
 
+void Device::alignmentChanged() {
+  for (size_t i = 0; i < m_sensorsFull.size(); i++)
+    m_sensorsFull[i].fuseAlignment();
+}
+
 void Device::print() const {
   std::printf(
       "\n---\nDevice: %s\n---\n"
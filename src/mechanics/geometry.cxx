@@ -0,0 +1,87 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+
+#include "mechanics/alignment.h"
+#include "mechanics/sensor.h"
+#include "mechanics/device.h"
+#include "mechanics/geometry.h"
+
+namespace Mechanics {
+
+void Geometry::setPlane(
+    const Device& device,
+    size_t isensor,
+    const Alignment& alignment) {
+  const Sensor& sensor = device.getSensorConst(isensor);
+  Plane& plane = m_planes[isensor];
+  alignment.fuse(&device, plane.toGlobal);
+  plane.colPitch = sensor.m_colPitch;
+  plane.rowPitch = sensor.m_rowPitch;
+  plane.centerX = sensor.m_ncols*sensor.m_colPitch/2.;
+  plane.centerY = sensor.m_nrows*sensor.m_rowPitch/2.;
+}
+
+Geometry::Geometry(const Device& device) :
+    m_planes(device.getNumSensors()) {
+  for (size_t i = 0; i < m_planes.size(); i++)
+    setPlane(device, i, device.getSensorConst(i));
+}
+
+Geometry::Geometry(
+    const Device& device,
+    const std::vector<Parameter>& parameters,
+    const double* values) :
+    m_planes(device.getNumSensors()) {
+  // Copies of the sensor alignments only, the sensors stay untouched
+  std::vector<Alignment> alignments;
+  alignments.reserve(m_planes.size());
+  for (size_t i = 0; i < m_planes.size(); i++)
+    alignments.push_back(device.getSensorConst(i));
+
+  for (size_t i = 0; i < parameters.size(); i++) {
+    if (parameters[i].isensor >= alignments.size())
+      throw std::runtime_error(
+          "Geometry::Geometry: parameter sensor out of range");
+    alignments[parameters[i].isensor].setAlignment(
+        parameters[i].axis, values[i]);
+  }
+
+  for (size_t i = 0; i < m_planes.size(); i++)
+    setPlane(device, i, alignments[i]);
+}
+
+void Geometry::pixelToSpace(
+    size_t isensor,
+    double col,
+    double row,
+    double& x,
+    double& y,
+    double& z) const {
+  const Plane& plane = m_planes[isensor];
+  const double localX = (col+0.5)*plane.colPitch - plane.centerX;
+  const double localY = (row+0.5)*plane.rowPitch - plane.centerY;
+  const double (*map)[3] = plane.toGlobal;
+  x = map[0][0]*localX + map[0][1]*localY + map[0][2];
+  y = map[1][0]*localX + map[1][1]*localY + map[1][2];
+  z = map[2][0]*localX + map[2][1]*localY + map[2][2];
+}
+
+void Geometry::pixelErrToSpace(
+    size_t isensor,
+    double colErr,
+    double rowErr,
+    double& xe,
+    double& ye,
+    double& ze) const {
+  const Plane& plane = m_planes[isensor];
+  const double localX = colErr * plane.colPitch;
+  const double localY = rowErr * plane.rowPitch;
+  const double (*map)[3] = plane.toGlobal;
+  xe = std::fabs(map[0][0]*localX + map[0][1]*localY);
+  ye = std::fabs(map[1][0]*localX + map[1][1]*localY);
+  ze = std::fabs(map[2][0]*localX + map[2][1]*localY);
+}
+
+}
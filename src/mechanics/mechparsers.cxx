@@ -6,6 +6,8 @@
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <climits>
+#include <stdint.h>
 
 #include "mechanics/sensor.h"
 #include "mechanics/device.h"
@@ -31,6 +33,13 @@ inline int strToInt(const std::string& str) {
   return val;
 }
 
+// Read an inclusive range given as two space separated integers
+inline void strToRange(const std::string& str, int& min, int& max) {
+  std::stringstream ss(str);
+  if (!(ss >> min >> max) || max < min)
+    throw std::runtime_error("Mechanics: strToRange: invalid range");
+}
+
 void prepareLine(std::string& line) {
   const size_t start = line.find_first_not_of(" \t\r\n");
   // Keep everything up to a # if there is one
@@ -67,6 +76,7 @@ struct DeviceBuff : public SpatialBuff {
   std::string spaceUnit;
   std::string timeUnit;
   std::string alignmentFile;
+  std::string noiseMaskFile;
   double clock;
   int window;
   DeviceBuff() : clock(0), window(0) {}
@@ -76,7 +86,19 @@ struct DeviceBuff : public SpatialBuff {
 struct SensorBuff : public SpatialBuff {
   std::string name;
   std::string chip;
-  SensorBuff() {}
+  int roiMinCol;
+  int roiMaxCol;
+  int roiMinRow;
+  int roiMaxRow;
+  int minTiming;
+  int maxTiming;
+  double xox0;
+  std::string calibrationFile;
+  SensorBuff() :
+      roiMinCol(INT_MIN), roiMaxCol(INT_MAX),
+      roiMinRow(INT_MIN), roiMaxRow(INT_MAX),
+      minTiming(INT_MIN), maxTiming(INT_MAX),
+      xox0(0) {}
 };
 
 // Collection of chip values while parsing
@@ -175,6 +197,7 @@ Device* parseDevice(const std::string& filePath) {
       else if (key == "clock") device.clock = strToFloat(value);
       else if (key == "window") device.window = strToInt(value);
       else if (key == "alignment") device.alignmentFile = value;
+      else if (key == "noise-mask") device.noiseMaskFile = value;
       else if (spatialKey(key, value, device)) continue;
       else throw std::runtime_error("Mechanics: parseDevice: unknown device key");
     }
@@ -182,6 +205,14 @@ Device* parseDevice(const std::string& filePath) {
     else if (current == SENSOR) {
       SensorBuff& sensor = sensors.back();
       if (key == "chip") sensor.chip = value;
+      else if (key == "roi-cols")
+        strToRange(value, sensor.roiMinCol, sensor.roiMaxCol);
+      else if (key == "roi-rows")
+        strToRange(value, sensor.roiMinRow, sensor.roiMaxRow);
+      else if (key == "timing-window")
+        strToRange(value, sensor.minTiming, sensor.maxTiming);
+      else if (key == "calibration") sensor.calibrationFile = value;
+      else if (key == "xox0") sensor.xox0 = strToFloat(value);
       else if (spatialKey(key, value, sensor)) continue;
       else throw std::runtime_error("Mechanics: parseDevice: unknown sensor key");
     }
@@ -247,6 +278,7 @@ Device* parseDevice(const std::string& filePath) {
   deviceObj->m_spaceUnit = device.spaceUnit;
   deviceObj->m_timeUnit = device.timeUnit;
   deviceObj->m_alignmentFile = device.alignmentFile;
+  deviceObj->m_noiseMaskFile = device.noiseMaskFile;
   // Set the spatial alignment
   setBuffAlignment(*deviceObj, device);
 
@@ -260,8 +292,18 @@ Device* parseDevice(const std::string& filePath) {
     sensorObj.m_ncols = chip.cols;
     sensorObj.m_rowPitch = chip.rowPitch;
     sensorObj.m_colPitch = chip.colPitch;
+    sensorObj.m_roiMinCol = sensor.roiMinCol;
+    sensorObj.m_roiMaxCol = sensor.roiMaxCol;
+    sensorObj.m_roiMinRow = sensor.roiMinRow;
+    sensorObj.m_roiMaxRow = sensor.roiMaxRow;
+    sensorObj.m_minTiming = sensor.minTiming;
+    sensorObj.m_maxTiming = sensor.maxTiming;
+    sensorObj.m_xox0 = sensor.xox0;
+    sensorObj.m_calibrationFile = sensor.calibrationFile;
     // Set the spatial alignment
     setBuffAlignment(sensorObj, sensor);
+    // Unlike the alignment, a calibration is only read and must exist
+    if (!sensorObj.m_calibrationFile.empty()) parseCalibration(sensorObj);
   }
 
   // If an alignment file is specified and exists, parse and apply it
@@ -272,6 +314,14 @@ Device* parseDevice(const std::string& filePath) {
     if (pass) parseAlignment(*deviceObj);
   }
 
+  // Likewise for the noise masks, which don't exist until a noise scan is run
+  if (!deviceObj->m_noiseMaskFile.empty()) {
+    std::ifstream test(deviceObj->m_noiseMaskFile.c_str());
+    const bool pass = test.is_open();
+    test.close();
+    if (pass) parseNoiseMask(*deviceObj);
+  }
+
   return deviceObj;
 }
 
@@ -362,6 +412,182 @@ void writeAlignment(const Device& device) {
   file.close();
 }
 
+// Calibration files are binary: a header followed by the coefficients of
+// each pixel, as 32-bit floats in host byte order, in the order of
+// `Sensor::m_calibration`
+struct CalibrationHeader {
+  char magic[4];  // "JCAL"
+  uint32_t ncols;
+  uint32_t nrows;
+  uint32_t nterms;  // coefficients per pixel
+};
+
+void parseCalibration(Sensor& sensor) {
+  std::ifstream file(sensor.m_calibrationFile.c_str(), std::ios::binary);
+  if (!file) throw std::runtime_error(
+        "Mechanics: parseCalibration: unable to open file");
+
+  CalibrationHeader header;
+  if (!file.read((char*)&header, sizeof(header)) ||
+      std::string(header.magic, 4) != "JCAL")
+    throw std::runtime_error(
+        "Mechanics: parseCalibration: not a calibration file");
+  if (header.ncols != sensor.m_ncols || header.nrows != sensor.m_nrows)
+    throw std::runtime_error(
+        "Mechanics: parseCalibration: table doesn't match the sensor size");
+  if (header.nterms == 0)
+    throw std::runtime_error(
+        "Mechanics: parseCalibration: table has no coefficients");
+
+  // Read the whole table in one go
+  sensor.m_calibrationTerms = header.nterms;
+  sensor.m_calibration.resize(
+      (size_t)header.ncols * header.nrows * header.nterms);
+  if (!file.read(
+      (char*)&sensor.m_calibration[0],
+      sensor.m_calibration.size()*sizeof(float)))
+    throw std::runtime_error(
+        "Mechanics: parseCalibration: table is truncated");
+  file.close();
+}
+
+void writeCalibration(const Sensor& sensor) {
+  if (sensor.m_calibration.size() !=
+      (size_t)sensor.m_ncols * sensor.m_nrows * sensor.m_calibrationTerms ||
+      sensor.m_calibration.empty())
+    throw std::runtime_error(
+        "Mechanics: writeCalibration: table doesn't match the sensor size");
+
+  std::ofstream file(sensor.m_calibrationFile.c_str(), std::ios::binary);
+  if (!file) throw std::runtime_error(
+        "Mechanics: writeCalibration: unable to open file");
+
+  CalibrationHeader header;
+  header.magic[0] = 'J';
+  header.magic[1] = 'C';
+  header.magic[2] = 'A';
+  header.magic[3] = 'L';
+  header.ncols = sensor.m_ncols;
+  header.nrows = sensor.m_nrows;
+  header.nterms = sensor.m_calibrationTerms;
+  file.write((const char*)&header, sizeof(header));
+  file.write(
+      (const char*)&sensor.m_calibration[0],
+      sensor.m_calibration.size()*sizeof(float));
+  file.close();
+}
+
+// Noise mask files are binary: a header followed by one block for each
+// sensor. A block gives the sensor name and size, then its noise profile as
+// 32-bit floats and its mask packed into 64-bit words (the bit of pixel `i`
+// is `i%64` in word `i/64`), in the order of `Sensor::getPixelIndex`.
+struct NoiseMaskHeader {
+  char magic[4];  // "JNOI"
+  uint32_t nsensors;
+};
+
+struct NoiseMaskBlock {
+  uint32_t nname;  // length of the name which follows
+  uint32_t ncols;
+  uint32_t nrows;
+};
+
+void parseNoiseMask(Device& device) {
+  std::ifstream file(device.m_noiseMaskFile.c_str(), std::ios::binary);
+  if (!file) throw std::runtime_error(
+        "Mechanics: parseNoiseMask: unable to open file");
+
+  NoiseMaskHeader header;
+  if (!file.read((char*)&header, sizeof(header)) ||
+      std::string(header.magic, 4) != "JNOI")
+    throw std::runtime_error(
+        "Mechanics: parseNoiseMask: not a noise mask file");
+
+  // Map sensor names to their objects
+  std::map<std::string, Sensor*> sensorMap;
+  for (size_t i = 0; i < device.getNumSensors(); i++)
+    sensorMap[device.getSensor(i).m_name] = &device.getSensor(i);
+
+  for (uint32_t isensor = 0; isensor < header.nsensors; isensor++) {
+    NoiseMaskBlock block;
+    if (!file.read((char*)&block, sizeof(block)))
+      throw std::runtime_error("Mechanics: parseNoiseMask: file is truncated");
+    std::string name(block.nname, ' ');
+    if (block.nname && !file.read(&name[0], block.nname))
+      throw std::runtime_error("Mechanics: parseNoiseMask: file is truncated");
+
+    if (sensorMap.find(name) == sensorMap.end())
+      throw std::runtime_error("Mechanics: parseNoiseMask: sensor not found");
+    Sensor& sensor = *sensorMap[name];
+    if (block.ncols != sensor.m_ncols || block.nrows != sensor.m_nrows)
+      throw std::runtime_error(
+          "Mechanics: parseNoiseMask: mask doesn't match the sensor size");
+
+    const size_t npixels = (size_t)block.ncols * block.nrows;
+    std::vector<float> profile(npixels);
+    std::vector<uint64_t> words((npixels+63)/64);
+    if (!file.read((char*)&profile[0], profile.size()*sizeof(float)) ||
+        !file.read((char*)&words[0], words.size()*sizeof(uint64_t)))
+      throw std::runtime_error("Mechanics: parseNoiseMask: file is truncated");
+
+    sensor.m_noiseProfile.assign(profile.begin(), profile.end());
+    sensor.m_noiseMask.assign(npixels, false);
+    for (size_t ipix = 0; ipix < npixels; ipix++)
+      sensor.m_noiseMask[ipix] = (words[ipix/64] >> (ipix%64)) & 1;
+  }
+  file.close();
+}
+
+void writeNoiseMask(const Device& device) {
+  // Only sensors with a complete profile and mask are written
+  std::vector<const Sensor*> sensors;
+  for (size_t i = 0; i < device.getNumSensors(); i++) {
+    const Sensor& sensor = device[i];
+    const size_t npixels = (size_t)sensor.m_ncols * sensor.m_nrows;
+    if (sensor.m_noiseProfile.empty() && sensor.m_noiseMask.empty()) continue;
+    if (sensor.m_noiseProfile.size() != npixels ||
+        sensor.m_noiseMask.size() != npixels || npixels == 0)
+      throw std::runtime_error(
+          "Mechanics: writeNoiseMask: mask doesn't match the sensor size");
+    sensors.push_back(&sensor);
+  }
+
+  std::ofstream file(device.m_noiseMaskFile.c_str(), std::ios::binary);
+  if (!file) throw std::runtime_error(
+        "Mechanics: writeNoiseMask: unable to open file");
+
+  NoiseMaskHeader header;
+  header.magic[0] = 'J';
+  header.magic[1] = 'N';
+  header.magic[2] = 'O';
+  header.magic[3] = 'I';
+  header.nsensors = sensors.size();
+  file.write((const char*)&header, sizeof(header));
+
+  for (std::vector<const Sensor*>::iterator it = sensors.begin();
+      it != sensors.end(); ++it) {
+    const Sensor& sensor = **it;
+    NoiseMaskBlock block;
+    block.nname = sensor.m_name.size();
+    block.ncols = sensor.m_ncols;
+    block.nrows = sensor.m_nrows;
+    file.write((const char*)&block, sizeof(block));
+    file.write(sensor.m_name.c_str(), block.nname);
+
+    const size_t npixels = sensor.m_noiseMask.size();
+    std::vector<float> profile(
+        sensor.m_noiseProfile.begin(),
+        sensor.m_noiseProfile.end());
+    std::vector<uint64_t> words((npixels+63)/64, 0);
+    for (size_t ipix = 0; ipix < npixels; ipix++)
+      if (sensor.m_noiseMask[ipix]) words[ipix/64] |= (uint64_t)1 << (ipix%64);
+
+    file.write((const char*)&profile[0], profile.size()*sizeof(float));
+    file.write((const char*)&words[0], words.size()*sizeof(uint64_t));
+  }
+  file.close();
+}
+
 Devices::~Devices() {
   for (std::vector<Mechanics::Device*>::iterator it = devices.begin();
       it != devices.end(); ++it)
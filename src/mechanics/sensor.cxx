@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <cstdio>
 #include <cmath>
+#include <climits>
 
 #include "mechanics/device.h"
 #include "mechanics/sensor.h"
@@ -16,7 +17,16 @@ Sensor::Sensor() :
     m_ncols(0),
     m_rowPitch(0),
     m_colPitch(0),
-    m_xox0(0) {}
+    m_xox0(0),
+    m_roiMinCol(INT_MIN),
+    m_roiMaxCol(INT_MAX),
+    m_roiMinRow(INT_MIN),
+    m_roiMaxRow(INT_MAX),
+    m_minTiming(INT_MIN),
+    m_maxTiming(INT_MAX),
+    m_calibrationTerms(0) {
+  fuseAlignment();
+}
 
 Sensor::Sensor(const Sensor& copy) :
     Alignment(copy),
@@ -26,7 +36,20 @@ Sensor::Sensor(const Sensor& copy) :
     m_ncols(copy.m_ncols),
     m_rowPitch(copy.m_rowPitch),
     m_colPitch(copy.m_colPitch),
-    m_xox0(copy.m_xox0) {}
+    m_xox0(copy.m_xox0),
+    m_roiMinCol(copy.m_roiMinCol),
+    m_roiMaxCol(copy.m_roiMaxCol),
+    m_roiMinRow(copy.m_roiMinRow),
+    m_roiMaxRow(copy.m_roiMaxRow),
+    m_minTiming(copy.m_minTiming),
+    m_maxTiming(copy.m_maxTiming),
+    m_noiseProfile(copy.m_noiseProfile),
+    m_noiseMask(copy.m_noiseMask),
+    m_calibration(copy.m_calibration),
+    m_calibrationTerms(copy.m_calibrationTerms),
+    m_calibrationFile(copy.m_calibrationFile) {
+  fuseAlignment();
+}
 
 void Sensor::print() const {
   std::printf(
@@ -45,6 +68,10 @@ void Sensor::print() const {
   std::cout << std::flush;
 }
 
+void Sensor::fuseAlignment() {
+  fuse(m_device, m_toGlobal);
+}
+
 void Sensor::pixelToSpace(
     double col,
     double row,
@@ -53,14 +80,99 @@ void Sensor::pixelToSpace(
     double& z) const {
   // Transform pixel space to sensor global space (in units of pitch). Location
   // of the pixel center, relative to the sensor center
-  x = (col+0.5)*m_colPitch - m_ncols*m_colPitch/2.;
-  y = (row+0.5)*m_rowPitch - m_nrows*m_rowPitch/2.;
-  z = 0;
-  // Then transform it into the device space (transformation of this plane
-  // relative to the device). If no device exists, this is just global space.
-  transform(x, y, z);
-  // Then transform it into global space, if it belongs to a device.
-  if (m_device) m_device->transform(x, y, z);
+  const double localX = (col+0.5)*m_colPitch - m_ncols*m_colPitch/2.;
+  const double localY = (row+0.5)*m_rowPitch - m_nrows*m_rowPitch/2.;
+  // Then apply the sensor and device transformations at once (the local z is
+  // always 0)
+  x = m_toGlobal[0][0]*localX + m_toGlobal[0][1]*localY + m_toGlobal[0][2];
+  y = m_toGlobal[1][0]*localX + m_toGlobal[1][1]*localY + m_toGlobal[1][2];
+  z = m_toGlobal[2][0]*localX + m_toGlobal[2][1]*localY + m_toGlobal[2][2];
+}
+
+/** Transform `n` pixel coordinates with the fused `map`, in the scalar type
+  * `T`. In double, it is the same arithmetic as for a single point, so that
+  * the results are identical. */
+template <typename T>
+static void transformPixels(
+    const double (*map)[3],
+    double colPitch,
+    double rowPitch,
+    double centerX,
+    double centerY,
+    size_t n,
+    const T* cols,
+    const T* rows,
+    T* xs,
+    T* ys,
+    T* zs) {
+  const T m00 = map[0][0], m01 = map[0][1], m02 = map[0][2];
+  const T m10 = map[1][0], m11 = map[1][1], m12 = map[1][2];
+  const T m20 = map[2][0], m21 = map[2][1], m22 = map[2][2];
+  const T pitchX = colPitch;
+  const T pitchY = rowPitch;
+  const T offsetX = centerX;
+  const T offsetY = centerY;
+
+  for (size_t k = 0; k < n; k++) {
+    const T localX = (cols[k]+T(0.5))*pitchX - offsetX;
+    const T localY = (rows[k]+T(0.5))*pitchY - offsetY;
+    xs[k] = m00*localX + m01*localY + m02;
+    ys[k] = m10*localX + m11*localY + m12;
+    zs[k] = m20*localX + m21*localY + m22;
+  }
+}
+
+/** Rotate `n` pixel errors with the fused `map`, in the scalar type `T` */
+template <typename T>
+static void transformErrors(
+    const double (*map)[3],
+    double colPitch,
+    double rowPitch,
+    size_t n,
+    const T* colErrs,
+    const T* rowErrs,
+    T* xes,
+    T* yes,
+    T* zes) {
+  const T m00 = map[0][0], m01 = map[0][1];
+  const T m10 = map[1][0], m11 = map[1][1];
+  const T m20 = map[2][0], m21 = map[2][1];
+  const T pitchX = colPitch;
+  const T pitchY = rowPitch;
+
+  for (size_t k = 0; k < n; k++) {
+    const T localX = colErrs[k] * pitchX;
+    const T localY = rowErrs[k] * pitchY;
+    xes[k] = std::fabs(m00*localX + m01*localY);
+    yes[k] = std::fabs(m10*localX + m11*localY);
+    zes[k] = std::fabs(m20*localX + m21*localY);
+  }
+}
+
+void Sensor::pixelToSpace(
+    size_t n,
+    const double* cols,
+    const double* rows,
+    double* xs,
+    double* ys,
+    double* zs) const {
+  transformPixels(
+      m_toGlobal, m_colPitch, m_rowPitch,
+      m_ncols*m_colPitch/2., m_nrows*m_rowPitch/2.,
+      n, cols, rows, xs, ys, zs);
+}
+
+void Sensor::pixelToSpace(
+    size_t n,
+    const float* cols,
+    const float* rows,
+    float* xs,
+    float* ys,
+    float* zs) const {
+  transformPixels(
+      m_toGlobal, m_colPitch, m_rowPitch,
+      m_ncols*m_colPitch/2., m_nrows*m_rowPitch/2.,
+      n, cols, rows, xs, ys, zs);
 }
 
 void Sensor::pixelErrToSpace(
@@ -69,15 +181,48 @@ void Sensor::pixelErrToSpace(
     double& xe,
     double& ye,
     double& ze) const {
-  xe = colErr * m_colPitch;
-  ye = rowErr * m_rowPitch;
-  ze = 0;
-  rotate(xe, ye, ze);
-  if (m_device) m_device->rotate(xe, ye, ze);
+  const double localX = colErr * m_colPitch;
+  const double localY = rowErr * m_rowPitch;
   // Could be rotated into negative values, keep asbolute value
-  xe = std::fabs(xe);
-  ye = std::fabs(ye);
-  ze = std::fabs(ze);
+  xe = std::fabs(m_toGlobal[0][0]*localX + m_toGlobal[0][1]*localY);
+  ye = std::fabs(m_toGlobal[1][0]*localX + m_toGlobal[1][1]*localY);
+  ze = std::fabs(m_toGlobal[2][0]*localX + m_toGlobal[2][1]*localY);
+}
+
+void Sensor::pixelErrToSpace(
+    size_t n,
+    const double* colErrs,
+    const double* rowErrs,
+    double* xes,
+    double* yes,
+    double* zes) const {
+  transformErrors(
+      m_toGlobal, m_colPitch, m_rowPitch,
+      n, colErrs, rowErrs, xes, yes, zes);
+}
+
+void Sensor::pixelErrToSpace(
+    size_t n,
+    const float* colErrs,
+    const float* rowErrs,
+    float* xes,
+    float* yes,
+    float* zes) const {
+  transformErrors(
+      m_toGlobal, m_colPitch, m_rowPitch,
+      n, colErrs, rowErrs, xes, yes, zes);
+}
+
+void Sensor::getPixelMap(double (*map)[3]) const {
+  // Fold the pitch and the pixel center offset into the global map
+  const double offsetX = 0.5*m_colPitch - m_ncols*m_colPitch/2.;
+  const double offsetY = 0.5*m_rowPitch - m_nrows*m_rowPitch/2.;
+  for (size_t i = 0; i < 3; i++) {
+    map[i][0] = m_toGlobal[i][0]*m_colPitch;
+    map[i][1] = m_toGlobal[i][1]*m_rowPitch;
+    map[i][2] = m_toGlobal[i][0]*offsetX + m_toGlobal[i][1]*offsetY +
+        m_toGlobal[i][2];
+  }
 }
 
 void Sensor::spaceToPixel(
@@ -105,9 +250,9 @@ bool Sensor::getPixelMask(unsigned row, unsigned col) const {
   return m_noiseMask[getPixelIndex(row, col)];
 }
 
-bool Sensor::getPixelNoise(unsigned row, unsigned col) const {
+double Sensor::getPixelNoise(unsigned row, unsigned col) const {
   if (m_noiseProfile.empty()) throw std::runtime_error(
-      "Sensor::getPixelMask: noise profile not set");
+      "Sensor::getPixelNoise: noise profile not set");
   return m_noiseProfile[getPixelIndex(row, col)];
 }
 
@@ -2,16 +2,112 @@
 #include <stdexcept>
 #include <cassert>
 #include <cmath>
+#include <vector>
+#include <algorithm>
 
 #include "storage/hit.h"
 #include "storage/cluster.h"
 #include "storage/plane.h"
 #include "storage/event.h"
 #include "mechanics/device.h"
+#include "mechanics/sensor.h"
+#include "threadpool.h"
 #include "processors/aligning.h"
 
 namespace Processors {
 
+class Aligning::PlaneTask : public Utils::ThreadPool::Task {
+private:
+  Aligning& m_aligning;
+  const std::vector<Storage::Event*>& m_events;
+  /** Device and plane of each part */
+  std::vector<size_t> m_devices;
+  std::vector<size_t> m_planes;
+
+public:
+  /** Parts are the sensors of all devices, each aligned in the events of its
+    * device (every `m_ndevices` in `events`) */
+  PlaneTask(Aligning& aligning, const std::vector<Storage::Event*>& events) :
+      m_aligning(aligning),
+      m_events(events) {
+    for (size_t idevice = 0; idevice < m_aligning.m_ndevices; idevice++) {
+      const size_t nsensors = m_aligning.m_devices[idevice]->getNumSensors();
+      for (size_t iplane = 0; iplane < nsensors; iplane++) {
+        m_devices.push_back(idevice);
+        m_planes.push_back(iplane);
+      }
+    }
+  }
+
+  size_t getNumParts() const { return m_planes.size(); }
+
+  void run(size_t i) {
+    const size_t idevice = m_devices[i];
+    const size_t iplane = m_planes[i];
+    const Mechanics::Sensor& sensor = (*m_aligning.m_devices[idevice])[iplane];
+    for (size_t ibatch = idevice; ibatch < m_events.size();
+        ibatch += m_aligning.m_ndevices)
+      m_aligning.processPlane(m_events[ibatch]->getPlane(iplane), sensor);
+  }
+};
+
+// Hits and clusters are transformed in blocks of this many, in arrays on the
+// stack so that planes aligned in parallel don't share them
+static const size_t s_blockSize = 64;
+
+template <typename T>
+void Aligning::transformPlane(
+    const Storage::Plane& plane,
+    const Mechanics::Sensor& sensor) {
+  T cols[s_blockSize];
+  T rows[s_blockSize];
+  T xs[s_blockSize];
+  T ys[s_blockSize];
+  T zs[s_blockSize];
+
+  // Ask the sensor to apply first local, then global transformation to the
+  // pixel coordinates of a block of hits at a time
+  const std::vector<Storage::Hit*>& hits = plane.getHits();
+  for (size_t first = 0; first < hits.size(); first += s_blockSize) {
+    const size_t n = std::min(s_blockSize, hits.size()-first);
+    for (size_t i = 0; i < n; i++) {
+      cols[i] = hits[first+i]->getPixX();
+      rows[i] = hits[first+i]->getPixY();
+    }
+    sensor.pixelToSpace(n, cols, rows, xs, ys, zs);
+    for (size_t i = 0; i < n; i++)
+      hits[first+i]->setPos(xs[i], ys[i], zs[i]);
+  }
+
+  // Likewise for the clusters, which also have errors
+  const std::vector<Storage::Cluster*>& clusters = plane.getClusters();
+  for (size_t first = 0; first < clusters.size(); first += s_blockSize) {
+    const size_t n = std::min(s_blockSize, clusters.size()-first);
+    for (size_t i = 0; i < n; i++) {
+      cols[i] = clusters[first+i]->getPixX();
+      rows[i] = clusters[first+i]->getPixY();
+    }
+    sensor.pixelToSpace(n, cols, rows, xs, ys, zs);
+    for (size_t i = 0; i < n; i++)
+      clusters[first+i]->setPos(xs[i], ys[i], zs[i]);
+
+    for (size_t i = 0; i < n; i++) {
+      cols[i] = clusters[first+i]->getPixErrX();
+      rows[i] = clusters[first+i]->getPixErrY();
+    }
+    sensor.pixelErrToSpace(n, cols, rows, xs, ys, zs);
+    for (size_t i = 0; i < n; i++)
+      clusters[first+i]->setPosErr(xs[i], ys[i], zs[i]);
+  }
+}
+
+void Aligning::processPlane(
+    const Storage::Plane& plane,
+    const Mechanics::Sensor& sensor) {
+  if (m_singlePrecision) transformPlane<float>(plane, sensor);
+  else transformPlane<double>(plane, sensor);
+}
+
 void Aligning::processEvent(
     Storage::Event& event,
     const Mechanics::Device& device) {
@@ -20,45 +116,71 @@ void Aligning::processEvent(
     throw std::runtime_error("Aligning::process: plane/sensor mismatch");
 
   // Get hits and clusters one plane at a time, and apply alignment
-  for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++) {
-    const Storage::Plane& plane = event.getPlane(iplane);
-
-    // Iterate through all hits in this place
-    const std::vector<Storage::Hit*>& hits = plane.getHits();
-    for (std::vector<Storage::Hit*>::const_iterator it = hits.begin();
-        it != hits.end(); ++it) {
-      double x, y, z;
-      Storage::Hit& hit = **it;
-      // Ask the device to apply first local, then global transformation to
-      // the hit's pixel coordinates
-      device[iplane].pixelToSpace(
-          hit.getPixX(), hit.getPixY(), x, y, z);
-      hit.setPos(x, y, z);
-    }
+  for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++)
+    processPlane(event.getPlane(iplane), device[iplane]);
+}
 
-    // Iterate through all clusters in this plane
-    const std::vector<Storage::Cluster*>& clusters = plane.getClusters();
-    for (std::vector<Storage::Cluster*>::const_iterator it = clusters.begin();
-        it != clusters.end(); ++it) {
-      Storage::Cluster& cluster = **it;
-      double x, y, z;
-      device[iplane].pixelToSpace(
-          cluster.getPixX(), cluster.getPixY(), x, y, z);
-      cluster.setPos(x, y, z);
-      double ex, ey, ez;
-      device[iplane].pixelErrToSpace(
-          cluster.getPixErrX(), cluster.getPixErrY(), ex, ey, ez);
-      cluster.setPosErr(ex, ey, ez);
-    }
+template <size_t NPLANES>
+void Aligning::processFixed(Storage::Event& event) {
+  if (m_ndevices != 1)
+    throw std::runtime_error("Aligning::processFixed: needs a single device");
+  const Mechanics::Device& device = *m_devices[0];
+
+  const size_t nplanes = NPLANES ? NPLANES : device.getNumSensors();
+  if (event.getNumPlanes() != nplanes || device.getNumSensors() != nplanes)
+    throw std::runtime_error("Aligning::process: plane/sensor mismatch");
+
+  if (m_pool) {
+    processBatch(std::vector<Storage::Event*>(1, &event));
+    return;
   }
+
+  for (size_t iplane = 0; iplane < nplanes; iplane++)
+    processPlane(event.getPlane(iplane), device[iplane]);
 }
 
+// Plane counts available to `Chain`
+template void Aligning::processFixed<0>(Storage::Event& event);
+template void Aligning::processFixed<6>(Storage::Event& event);
+
 void Aligning::process() {
   assert(!m_devices.empty() && "Can't construct with no devices");
+  // The events of one iteration are a block of one
+  if (m_pool) {
+    processBatch(m_events);
+    return;
+  }
   for (size_t i = 0; i < m_ndevices; i++) {
     processEvent(*m_events[i], *m_devices[i]);
   }
 }
 
+void Aligning::processBatch(const std::vector<Storage::Event*>& events) {
+  assert(!m_devices.empty() && "Can't construct with no devices");
+
+  // Check the whole block before changing any of it
+  for (size_t ibatch = 0; ibatch < events.size(); ibatch++)
+    if (events[ibatch]->getNumPlanes() !=
+        m_devices[ibatch % m_ndevices]->getNumSensors())
+      throw std::runtime_error("Aligning::process: plane/sensor mismatch");
+
+  // Sensors don't share any objects, so they can be aligned in parallel
+  if (m_pool) {
+    PlaneTask task(*this, events);
+    m_pool->run(task, task.getNumParts());
+    return;
+  }
+
+  for (size_t idevice = 0; idevice < m_ndevices; idevice++) {
+    const Mechanics::Device& device = *m_devices[idevice];
+    for (size_t iplane = 0; iplane < device.getNumSensors(); iplane++) {
+      const Mechanics::Sensor& sensor = device[iplane];
+      // Events of this device are every `m_ndevices` in the block
+      for (size_t ibatch = idevice; ibatch < events.size(); ibatch += m_ndevices)
+        processPlane(events[ibatch]->getPlane(iplane), sensor);
+    }
+  }
+}
+
 }
 
@@ -1,8 +1,6 @@
 #include <iostream>
 #include <vector>
 #include <stdexcept>
-#include <list>
-#include <stack>
 #include <cmath>
 #include <climits>
 #include <algorithm>
@@ -12,143 +10,307 @@
 #include "storage/cluster.h"
 #include "storage/plane.h"
 #include "storage/event.h"
+#include "arena.h"
+#include "threadpool.h"
 #include "processors/clustering.h"
 
 namespace Processors {
 
-void Clustering::clusterSeed(
-    Storage::Hit& seed,
-    std::list<Storage::Hit*>& hits,
-    std::list<Storage::Hit*>& clustered) {
-  // List of hist for which to search for neighbours
-  std::stack<Storage::Hit*> search;
-
-  clustered.push_back(&seed);  // add seed to the cluster
-  search.push(&seed);  // add seed to neighbour search
-
-  // For each clustered hit, search for its neighbours
-  while (!search.empty()) {
-    // Target hit about which to find neighbours
-    const Storage::Hit* target = search.top();
-    search.pop();
-
-    // Look through remaining unclustered hits for neighbouring ones
-    for (std::list<Storage::Hit*>::iterator it = hits.begin();
-        it != hits.end(); ++it) {
-      Storage::Hit* hit = *it;  // candidate neighbour
-      // If this hit isn't close enough to the target, move on
-      if (std::abs(hit->getPixX()-target->getPixX()) > m_maxRows ||
-          std::abs(hit->getPixY()-target->getPixY()) > m_maxCols)
+class Clustering::PlaneTask : public Utils::ThreadPool::Task {
+private:
+  Clustering& m_clustering;
+  const Storage::Event& m_event;
+  /** Output of each plane, so that the planes don't share any container */
+  Utils::ArenaVector<HitGroups>& m_groups;
+
+public:
+  PlaneTask(
+      Clustering& clustering,
+      const Storage::Event& event,
+      Utils::ArenaVector<HitGroups>& groups) :
+      m_clustering(clustering),
+      m_event(event),
+      m_groups(groups) {}
+
+  void run(size_t iplane) {
+    m_clustering.groupHits(
+        m_event.getPlane(iplane),
+        m_clustering.m_arenas[iplane],
+        m_groups[iplane]);
+  }
+};
+
+/** Grid cell of a hit, with the hit's index in its plane */
+struct Clustering::CellHit {
+  int cellX;
+  int cellY;
+  size_t index;
+  /** Order by cell, and by index within a cell */
+  static bool before(const CellHit& hit1, const CellHit& hit2) {
+    if (hit1.cellX != hit2.cellX) return hit1.cellX < hit2.cellX;
+    if (hit1.cellY != hit2.cellY) return hit1.cellY < hit2.cellY;
+    return hit1.index < hit2.index;
+  }
+};
+
+/** Index of the cell of `pix` on a grid of `size` wide cells, rounding down
+  * for negative pixels as well */
+static int cellOf(int pix, int size) {
+  return pix >= 0 ? pix / size : -((-pix + size - 1) / size);
+}
+
+/** Root of the set holding `i`, halving the path along the way */
+static size_t findRoot(Utils::ArenaVector<size_t>& parents, size_t i) {
+  while (parents[i] != i) {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+
+/** Merge the sets of `i` and `j`. The root with the larger index is kept, so
+  * a set's root is always its last hit. */
+static void joinSets(Utils::ArenaVector<size_t>& parents, size_t i, size_t j) {
+  i = findRoot(parents, i);
+  j = findRoot(parents, j);
+  if (i < j) parents[i] = j;
+  else if (j < i) parents[j] = i;
+}
+
+void Clustering::joinCells(
+    const Storage::Plane& plane,
+    const Utils::ArenaVector<CellHit>& cells,
+    size_t begin1,
+    size_t end1,
+    int cellX,
+    int cellY,
+    Utils::ArenaVector<size_t>& parents) const {
+  // Find the hits of the neighbouring cell (sorted by cell)
+  CellHit key = { cellX, cellY, 0 };
+  Utils::ArenaVector<CellHit>::const_iterator it = std::lower_bound(
+      cells.begin(), cells.end(), key, CellHit::before);
+
+  for (; it != cells.end() && it->cellX == cellX && it->cellY == cellY; ++it) {
+    const Storage::Hit& hit2 = *plane.getHits()[it->index];
+    for (size_t i = begin1; i < end1; i++) {
+      const Storage::Hit& hit1 = *plane.getHits()[cells[i].index];
+      if (std::abs(hit1.getPixX()-hit2.getPixX()) > (int)m_maxRows ||
+          std::abs(hit1.getPixY()-hit2.getPixY()) > (int)m_maxCols)
         continue;
-      clustered.push_back(hit);
-      // Erease from the list of unclustered list. This returns the next
-      // iterator. Move it back so that the loop moves forward correctly.
-      it = --(hits.erase(it));
-      // This hit must now also be included in the neighbour search
-      search.push(hit);
+      joinSets(parents, cells[i].index, it->index);
     }
   }
 }
 
-void Clustering::buildCluster(
+template <typename T>
+void Clustering::computeCluster(
     Storage::Cluster& cluster,
-    std::list<Storage::Hit*>& clustered) {
-  const size_t nhits = clustered.size();
+    Storage::Hit* const* clustered,
+    size_t nhits) {
   assert(nhits >= 1 && "Building empty cluster");
   cluster.reserveHits(nhits);
 
-  // Variables for weighted incremental variance computation
-  // http://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
-  double sumw = 0;
-  double meanX = 0;
-  double meanY = 0;
-  double m2X = 0;  // sum squared of differences to mean
-  double m2Y = 0;
+  // Weighted sums of the pixel positions and their squares, taken relative to
+  // the first hit so that the squares stay small and the variance precise
+  const int originX = clustered[0]->getPixX();
+  const int originY = clustered[0]->getPixY();
+  T sumw = 0;
+  T sumX = 0;
+  T sumY = 0;
+  T sumX2 = 0;
+  T sumY2 = 0;
 
   // Keep track of cluster range to know if using 1/sqrt(12). Don't rely on
-  // m2's since they are subject to be close to 0 if small weights occur.
+  // the variance since it is subject to be close to 0 if small weights occur.
   int minX = INT_MAX;
   int maxX = INT_MIN;
   int minY = INT_MAX;
   int maxY = INT_MIN;
 
-  for (std::list<Storage::Hit*>::iterator it = clustered.begin();
-      it != clustered.end(); ++it) {
-    // Add the hit to the cluster
-    Storage::Hit& hit = **it;
+  // Single pass without dependence between iterations, other than the sums
+  for (size_t i = 0; i < nhits; i++) {
+    Storage::Hit& hit = *clustered[i];
     cluster.addHit(hit);
 
     // Weight the hits by their value if that mode is turned on
-    const double weight = m_weighted ? hit.getValue() : 1;
-    const double tmp = weight + sumw;
+    const T weight = m_weighted ? hit.getCharge() : 1;
+    const T dx = hit.getPixX() - originX;
+    const T dy = hit.getPixY() - originY;
 
     minX = std::min(hit.getPixX(), minX);
     maxX = std::max(hit.getPixX(), maxX);
     minY = std::min(hit.getPixY(), minY);
     maxY = std::max(hit.getPixY(), maxY);
 
-    // Single pass mean and variance computation
-    const double deltaX = hit.getPixX() - meanX;
-    const double rX = deltaX * weight / tmp;
-    meanX += rX;
-    m2X += sumw * deltaX * rX;  // incremental formulation
-
-    // Again in y
-    const double deltaY = hit.getPixY() - meanY;
-    const double rY = deltaY * weight / tmp;
-    meanY += rY;
-    m2Y += sumw * deltaY * rY;
-
-    sumw = tmp;
+    sumw += weight;
+    sumX += weight * dx;
+    sumY += weight * dy;
+    sumX2 += weight * dx * dx;
+    sumY2 += weight * dy * dy;
   }
 
   // Set the cluster mean
-  cluster.setPix(meanX, meanY);
+  cluster.setPix(originX + sumX/sumw, originY + sumY/sumw);
+
+  // Sum squared of differences to the mean
+  const T m2X = std::max(T(0), sumX2 - sumX*sumX/sumw);
+  const T m2Y = std::max(T(0), sumY2 - sumY*sumY/sumw);
 
-  const double errX = 
+  const T errX = 
       (maxX - minX < 1) ?  // check if hits span more than 1 pixel
-      1./std::sqrt(12) :  // they don't, so use RMS of uniform distribution
-      std::sqrt(m2X/sumw * nhits / (double)(nhits-1));  // use RMS
+      T(1)/std::sqrt(T(12)) :  // they don't, so use RMS of uniform distribution
+      std::sqrt(m2X/sumw * T(nhits) / T(nhits-1));  // use RMS
 
-  const double errY = 
+  const T errY = 
       (maxY - minY < 1) ?
-      1./std::sqrt(12) :
-      std::sqrt(m2Y/sumw * nhits / (double)(nhits-1));
+      T(1)/std::sqrt(T(12)) :
+      std::sqrt(m2Y/sumw * T(nhits) / T(nhits-1));
 
   cluster.setPixErr(errX, errY);
 }
 
+void Clustering::buildCluster(
+    Storage::Cluster& cluster,
+    Storage::Hit* const* clustered,
+    size_t nhits) {
+  if (m_singlePrecision) computeCluster<float>(cluster, clustered, nhits);
+  else computeCluster<double>(cluster, clustered, nhits);
+}
+
+void Clustering::groupHits(
+    const Storage::Plane& plane,
+    Utils::Arena& arena,
+    HitGroups& groups) {
+  groups.hits.clear();
+  groups.starts.clear();
+  const size_t nhits = plane.getNumHits();
+  if (nhits == 0) return;
+
+  // Bucket the hits in cells spanning the clustering distance: hits in the
+  // same cell are all neighbours, and others can only be in the 8 cells
+  // around it. Sorting by cell brings each cell's hits together.
+  const int sizeX = m_maxRows + 1;
+  const int sizeY = m_maxCols + 1;
+  Utils::ArenaVector<CellHit> cells(nhits, CellHit(), arena);
+  for (size_t i = 0; i < nhits; i++) {
+    const Storage::Hit& hit = *plane.getHits()[i];
+    cells[i].cellX = cellOf(hit.getPixX(), sizeX);
+    cells[i].cellY = cellOf(hit.getPixY(), sizeY);
+    cells[i].index = i;
+  }
+  std::sort(cells.begin(), cells.end(), CellHit::before);
+
+  // Each hit starts in its own set
+  Utils::ArenaVector<size_t> parents(nhits, 0, arena);
+  for (size_t i = 0; i < nhits; i++) parents[i] = i;
+
+  for (size_t begin = 0; begin < nhits; ) {
+    const int cellX = cells[begin].cellX;
+    const int cellY = cells[begin].cellY;
+    size_t end = begin+1;
+    while (end < nhits &&
+        cells[end].cellX == cellX && cells[end].cellY == cellY) {
+      joinSets(parents, cells[begin].index, cells[end].index);
+      end++;
+    }
+
+    // Pairs of neighbouring cells are visited once, from the lower cell
+    joinCells(plane, cells, begin, end, cellX, cellY+1, parents);
+    joinCells(plane, cells, begin, end, cellX+1, cellY-1, parents);
+    joinCells(plane, cells, begin, end, cellX+1, cellY, parents);
+    joinCells(plane, cells, begin, end, cellX+1, cellY+1, parents);
+
+    begin = end;
+  }
+
+  // Make the groups in the order the hits were seeded before: starting from
+  // the last hit, each group is that of the last hit not yet grouped. Hits
+  // are listed from last to first within a group. A first pass counts the
+  // hits of each group, so that the groups can be laid out back to back.
+  Utils::ArenaVector<size_t> igroups(nhits, nhits, arena);
+  groups.starts.reserve(nhits+1);
+  for (size_t i = nhits; i-- > 0; ) {
+    const size_t root = findRoot(parents, i);
+    if (igroups[root] == nhits) {
+      igroups[root] = groups.starts.size();
+      groups.starts.push_back(0);
+    }
+    igroups[i] = igroups[root];
+    groups.starts[igroups[i]] += 1;
+  }
+
+  // Turn the counts into the start of each group, and fill in the hits
+  const size_t ngroups = groups.starts.size();
+  size_t start = 0;
+  for (size_t igroup = 0; igroup < ngroups; igroup++) {
+    const size_t count = groups.starts[igroup];
+    groups.starts[igroup] = start;
+    start += count;
+  }
+  groups.starts.push_back(nhits);
+
+  Utils::ArenaVector<size_t> next(groups.starts.begin(),
+      groups.starts.end()-1, arena);
+  groups.hits.resize(nhits);
+  for (size_t i = nhits; i-- > 0; )
+    groups.hits[next[igroups[i]]++] = plane.getHits()[i];
+}
+
 void Clustering::processEvent(Storage::Event& event) {
+  processFixed<0>(event);
+}
+
+template <size_t NPLANES>
+void Clustering::processFixed(Storage::Event& event) {
   // Don't add new clusters atop existing ones in an event
   if (event.getNumClusters())
     throw std::runtime_error("Clustering::process: event is already clustered");
+  if (NPLANES && event.getNumPlanes() != NPLANES)
+    throw std::runtime_error("Clustering::process: wrong number of planes");
+
+  const size_t nplanes = NPLANES ? NPLANES : event.getNumPlanes();
+
+  // Temporaries of the previous event are done with
+  if (m_arenas.size() < nplanes+1) m_arenas.resize(nplanes+1);
+  for (size_t i = 0; i < m_arenas.size(); i++) m_arenas[i].reset();
+  Utils::Arena& arena = m_arenas[nplanes];
 
-  // Cluster each plane's hits, plane by plane
-  const size_t nplanes = event.getNumPlanes();
+  // Each plane's groups take their memory from that plane's arena
+  Utils::ArenaVector<HitGroups> groups(arena);
+  groups.reserve(nplanes);
+  for (size_t iplane = 0; iplane < nplanes; iplane++)
+    groups.push_back(HitGroups(m_arenas[iplane]));
+
+  // Group each plane's hits into clusters, in parallel if a pool is given
+  if (m_pool && nplanes > 1) {
+    PlaneTask task(*this, event, groups);
+    m_pool->run(task, nplanes);
+  }
+  else {
+    for (size_t iplane = 0; iplane < nplanes; iplane++)
+      groupHits(event.getPlane(iplane), m_arenas[iplane], groups[iplane]);
+  }
+
+  // The event's cluster list isn't shared between threads, so make the
+  // clusters in plane order
   for (size_t iplane = 0; iplane < nplanes; iplane++) {
-    const Storage::Plane& plane = event.getPlane(iplane);
-    if (plane.getNumHits() == 0) continue;
-
-    // Store all hits in this plane in a list
-    std::list<Storage::Hit*> hits(
-        plane.getHits().cbegin(), plane.getHits().cend());
-
-    while (!hits.empty()) {
-      // Use the last hit as the seed hit, and remove from hits to cluster
-      Storage::Hit& seed = *hits.back();
-      hits.pop_back();
-      // Build the cluster, removing all clustered hits along the way
-      std::list<Storage::Hit*> clustered;
-      clusterSeed(seed, hits, clustered);
+    const HitGroups& planeGroups = groups[iplane];
+    for (size_t igroup = 0; igroup < planeGroups.getNumGroups(); igroup++) {
+      const size_t start = planeGroups.starts[igroup];
       // Compute the cluster's values and store in cluster object
       Storage::Cluster& cluster = event.newCluster(iplane);
-      buildCluster(cluster, clustered);
-      // Note that the clustered hits are no longer in the `hits` list, so the
-      // next pass will pick the next hit which wasn't clustered in this one
+      buildCluster(
+          cluster,
+          &planeGroups.hits[start],
+          planeGroups.starts[igroup+1] - start);
     }
   }
 }
 
+// Plane counts available to `Chain`
+template void Clustering::processFixed<0>(Storage::Event& event);
+template void Clustering::processFixed<6>(Storage::Event& event);
+
 void Clustering::process() {
   for (std::vector<Storage::Event*>::iterator it = m_events.begin();
       it != m_events.end(); ++it)
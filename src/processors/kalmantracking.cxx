@@ -0,0 +1,320 @@
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "arena.h"
+#include "storage/cluster.h"
+#include "storage/plane.h"
+#include "storage/track.h"
+#include "storage/event.h"
+#include "mechanics/device.h"
+#include "mechanics/sensor.h"
+#include "processors/kalmantracking.h"
+
+namespace Processors {
+
+void KalmanTracking::AxisState::propagate(double dz) {
+  // Linear map (pos, slope) -> (pos + dz*slope, slope) applied to the state
+  // and on both sides of the covariance
+  pos += dz*slope;
+  covPos += dz*(2*covPosSlope + dz*covSlope);
+  covPosSlope += dz*covSlope;
+}
+
+double KalmanTracking::AxisState::update(double meas, double var) {
+  const double residual = meas - pos;
+  const double variance = covPos + var;
+  // Gain for the position and the slope
+  const double gainPos = covPos / variance;
+  const double gainSlope = covPosSlope / variance;
+  pos += gainPos * residual;
+  slope += gainSlope * residual;
+  // The slope term uses the position-slope covariance before the update
+  covSlope -= gainSlope * covPosSlope;
+  covPosSlope -= gainPos * covPosSlope;
+  covPos -= gainPos * covPos;
+  return residual*residual / variance;
+}
+
+double KalmanTracking::highland(double xox0, double momentum) {
+  if (!(xox0 > 0)) return 0;
+  return 0.0136 / momentum * std::sqrt(xox0) * (1 + 0.038*std::log(xox0));
+}
+
+void KalmanTracking::process() {
+  // Processor initializes with only 1 device, so process runs on only 1 event
+  assert(m_events.size() == 1 && "More than 1 device being tracked");
+  processEvent(*m_events[0], *m_devices[0]);
+}
+
+// Track candidate: its clusters are in a slice of a pool shared by all the
+// candidates, as in `Tracking`
+struct KalmanTracklet {
+  // Index of last plane on which the track found a cluster
+  size_t lastPlane;
+  // Start of this track's clusters in the pool, and their number
+  size_t first;
+  size_t nclusters;
+  // State after the last cluster, at that cluster's z
+  KalmanTracking::AxisState x;
+  KalmanTracking::AxisState y;
+  double z;
+  // Sum of the chi^2 of the clusters against their predictions
+  double chi2;
+};
+
+// Cluster of a plane in the order of its x position
+struct SortedCluster {
+  double x;
+  size_t index;
+};
+
+static bool sortedBefore(const SortedCluster& a, const SortedCluster& b) {
+  return a.x < b.x;
+}
+
+// Cluster within the gate of a candidate
+struct GatedPair {
+  double chi2;
+  size_t itracklet;
+  size_t icluster;
+};
+
+// Best matches first, ties to the first candidate, then the first cluster
+static bool pairBefore(const GatedPair& a, const GatedPair& b) {
+  if (a.chi2 != b.chi2) return a.chi2 < b.chi2;
+  if (a.itracklet != b.itracklet) return a.itracklet < b.itracklet;
+  return a.icluster < b.icluster;
+}
+
+// Bring the state of `tracklet` to the last sensor before `iplane`, adding
+// the scattering of the material it crosses along the way
+static void predictTracklet(
+    const KalmanTracklet& tracklet,
+    size_t iplane,
+    const Utils::ArenaVector<double>& planesZ,
+    const Utils::ArenaVector<double>& scattering,
+    KalmanTracking::AxisState& x,
+    KalmanTracking::AxisState& y,
+    double& z) {
+  x = tracklet.x;
+  y = tracklet.y;
+  z = tracklet.z;
+  for (size_t iprev = tracklet.lastPlane; iprev < iplane; iprev++) {
+    x.propagate(planesZ[iprev] - z);
+    y.propagate(planesZ[iprev] - z);
+    z = planesZ[iprev];
+    x.covSlope += scattering[iprev];
+    y.covSlope += scattering[iprev];
+  }
+}
+
+void KalmanTracking::processEvent(
+    Storage::Event& event,
+    const Mechanics::Device& device) {
+  const size_t nplanes = device.getNumSensors();
+  if (event.getNumPlanes() != nplanes)
+    throw std::runtime_error("KalmanTracking::process: wrong number of planes");
+
+  // The candidates of the previous event are gone
+  m_arena.reset();
+
+  const size_t minClusters = (m_minClusters>3) ? m_minClusters : 3;
+  const double gate2 = m_gate*m_gate;
+
+  // Position of each sensor along the beam, and the variance of the
+  // scattering angle in the material between it and the next sensor
+  Utils::ArenaVector<double> planesZ(nplanes, 0, m_arena);
+  Utils::ArenaVector<double> scattering(nplanes, 0, m_arena);
+  for (size_t iplane = 0; iplane < nplanes; iplane++) {
+    const Mechanics::Sensor& sensor = device.getSensorConst(iplane);
+    double x = 0;
+    double y = 0;
+    sensor.pixelToSpace(
+        sensor.m_ncols/2., sensor.m_nrows/2., x, y, planesZ[iplane]);
+    if (iplane+1 == nplanes) continue;
+    const double xox0 =
+        device.getSensorConst(iplane+1).m_xox0 - sensor.m_xox0;
+    const double theta = highland(xox0, m_momentum);
+    scattering[iplane] = theta*theta;
+  }
+
+  // Each cluster can seed at most one candidate, with room for one cluster
+  // on each plane from there on
+  size_t maxTracklets = 0;
+  size_t maxSlots = 0;
+  for (size_t iplane = 0; iplane+minClusters <= nplanes; iplane++) {
+    maxTracklets += event.getPlane(iplane).getNumClusters();
+    maxSlots += event.getPlane(iplane).getNumClusters() * (nplanes-iplane);
+  }
+  Utils::ArenaVector<KalmanTracklet> tracklets(m_arena);
+  tracklets.reserve(maxTracklets);
+  Utils::ArenaVector<Storage::Cluster*> pool(maxSlots, 0, m_arena);
+  size_t nslots = 0;
+
+  for (size_t iplane = 0; iplane < nplanes; iplane++) {
+    const Storage::Plane& plane = event.getPlane(iplane);
+    const size_t nclusters = plane.getNumClusters();
+    const size_t ntracklets = tracklets.size();
+
+    // Sort the clusters along x, and find the extent of the plane in z and
+    // the largest error in x, to bound the clusters each candidate can gate
+    Utils::ArenaVector<SortedCluster> sorted(
+        nclusters, SortedCluster(), m_arena);
+    double minZ = planesZ[iplane];
+    double maxZ = planesZ[iplane];
+    double maxVarX = 0;
+    for (size_t i = 0; i < nclusters; i++) {
+      const Storage::Cluster& cluster = plane.getCluster(i);
+      sorted[i].x = cluster.getPosX();
+      sorted[i].index = i;
+      minZ = std::min(minZ, cluster.getPosZ());
+      maxZ = std::max(maxZ, cluster.getPosZ());
+      maxVarX = std::max(maxVarX, cluster.getPosErrX()*cluster.getPosErrX());
+    }
+    std::sort(sorted.begin(), sorted.end(), sortedBefore);
+
+    // Every candidate and cluster within its gate, with their chi^2
+    Utils::ArenaVector<GatedPair> pairs(m_arena);
+    // Clusters within the gate of any candidate don't seed
+    Utils::ArenaVector<char> gated(nclusters, 0, m_arena);
+
+    for (size_t itracklet = 0; itracklet < ntracklets; itracklet++) {
+      AxisState predX;
+      AxisState predY;
+      double predZ = 0;
+      predictTracklet(tracklets[itracklet], iplane, planesZ, scattering,
+          predX, predY, predZ);
+
+      // The x residual alone must be within the gate, so only the clusters
+      // within the gate of the prediction anywhere on the plane are tried
+      AxisState low = predX;
+      AxisState high = predX;
+      low.propagate(minZ - predZ);
+      high.propagate(maxZ - predZ);
+      const double window =
+          m_gate * std::sqrt(std::max(low.covPos, high.covPos) + maxVarX);
+      SortedCluster key = { std::min(low.pos, high.pos) - window, 0 };
+      const double maxX = std::max(low.pos, high.pos) + window;
+
+      for (Utils::ArenaVector<SortedCluster>::const_iterator it =
+          std::lower_bound(sorted.begin(), sorted.end(), key, sortedBefore);
+          it != sorted.end() && it->x <= maxX; ++it) {
+        const Storage::Cluster& cluster = plane.getCluster(it->index);
+        AxisState atX = predX;
+        AxisState atY = predY;
+        atX.propagate(cluster.getPosZ() - predZ);
+        atY.propagate(cluster.getPosZ() - predZ);
+        const double residualX = cluster.getPosX() - atX.pos;
+        const double residualY = cluster.getPosY() - atY.pos;
+        const double errX = cluster.getPosErrX();
+        const double errY = cluster.getPosErrY();
+        const double chi2 =
+            residualX*residualX / (atX.covPos + errX*errX) +
+            residualY*residualY / (atY.covPos + errY*errY);
+        // Written so that a NaN chi^2 isn't gated
+        if (!(chi2 <= gate2)) continue;
+
+        gated[it->index] = 1;
+        const GatedPair pair = { chi2, itracklet, it->index };
+        pairs.push_back(pair);
+      }
+    }  // tracklet loop
+
+    // Join candidates and clusters from the best match down. Pairs which are
+    // each other's best match are all joined, and a candidate whose best
+    // cluster went to a closer candidate then takes its next best.
+    std::sort(pairs.begin(), pairs.end(), pairBefore);
+    Utils::ArenaVector<char> joined(ntracklets, 0, m_arena);
+    Utils::ArenaVector<char> taken(nclusters, 0, m_arena);
+    for (size_t ipair = 0; ipair < pairs.size(); ipair++) {
+      const size_t itracklet = pairs[ipair].itracklet;
+      const size_t icluster = pairs[ipair].icluster;
+      if (joined[itracklet] || taken[icluster]) continue;
+      joined[itracklet] = 1;
+      taken[icluster] = 1;
+
+      KalmanTracklet& tracklet = tracklets[itracklet];
+      Storage::Cluster& cluster = plane.getCluster(icluster);
+      double z = 0;
+      predictTracklet(tracklet, iplane, planesZ, scattering,
+          tracklet.x, tracklet.y, z);
+      tracklet.x.propagate(cluster.getPosZ() - z);
+      tracklet.y.propagate(cluster.getPosZ() - z);
+      tracklet.z = cluster.getPosZ();
+      tracklet.chi2 += tracklet.x.update(
+          cluster.getPosX(), cluster.getPosErrX()*cluster.getPosErrX());
+      tracklet.chi2 += tracklet.y.update(
+          cluster.getPosY(), cluster.getPosErrY()*cluster.getPosErrY());
+
+      pool[tracklet.first+tracklet.nclusters] = &cluster;
+      tracklet.nclusters += 1;
+      tracklet.lastPlane = iplane;
+    }
+
+    // Clusters away from all candidates start new ones, if they can still
+    // make a full track
+    if (nplanes-iplane >= minClusters) {
+      for (size_t icluster = 0; icluster < nclusters; icluster++) {
+        if (gated[icluster]) continue;
+        Storage::Cluster& cluster = plane.getCluster(icluster);
+
+        // The position is measured, the slope only known to be small
+        KalmanTracklet tracklet;
+        tracklet.lastPlane = iplane;
+        tracklet.first = nslots;
+        tracklet.nclusters = 1;
+        tracklet.x.pos = cluster.getPosX();
+        tracklet.x.covPos = cluster.getPosErrX()*cluster.getPosErrX();
+        tracklet.x.covSlope = m_slopeSigma*m_slopeSigma;
+        tracklet.y.pos = cluster.getPosY();
+        tracklet.y.covPos = cluster.getPosErrY()*cluster.getPosErrY();
+        tracklet.y.covSlope = m_slopeSigma*m_slopeSigma;
+        tracklet.z = cluster.getPosZ();
+        tracklet.chi2 = 0;
+
+        pool[nslots] = &cluster;
+        // A track has at most one cluster per plane
+        nslots += nplanes-iplane;
+        tracklets.push_back(tracklet);
+      }
+    }
+
+    // Drop the candidates which can no longer be completed
+    const size_t nremains = nplanes - (iplane+1);
+    size_t nkept = 0;
+    for (size_t itracklet = 0; itracklet < tracklets.size(); itracklet++) {
+      const KalmanTracklet& tracklet = tracklets[itracklet];
+      if (tracklet.nclusters + nremains < minClusters) continue;
+      tracklets[nkept++] = tracklet;
+    }
+    tracklets.resize(nkept);
+  }  // plane loop
+
+  // The filtered states are the tracks, moved back to z = 0 where the track
+  // origin is given
+  for (size_t itracklet = 0; itracklet < tracklets.size(); itracklet++) {
+    const KalmanTracklet& tracklet = tracklets[itracklet];
+    Storage::Track& track = event.newTrack();
+    for (size_t i = 0; i < tracklet.nclusters; i++)
+      track.addCluster(*pool[tracklet.first+i]);
+
+    AxisState x = tracklet.x;
+    AxisState y = tracklet.y;
+    x.propagate(-tracklet.z);
+    y.propagate(-tracklet.z);
+
+    track.setSlope(x.slope, y.slope);
+    track.setSlopeErr(std::sqrt(x.covSlope), std::sqrt(y.covSlope));
+    track.setOrigin(x.pos, y.pos);
+    track.setOriginErr(std::sqrt(x.covPos), std::sqrt(y.covPos));
+    track.setCovariance(x.covPosSlope, y.covPosSlope);
+    // 2n d.o.f. - 2 fixed, as for the straight line fit
+    track.setChi2(tracklet.chi2/(2*tracklet.nclusters-2));
+  }
+}
+
+}
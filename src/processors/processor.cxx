@@ -49,5 +49,21 @@ void Processor::execute(Storage::Event& event) {
   process();
 }
 
+void Processor::executeBatch(const std::vector<Storage::Event*>& events) {
+  // Each iteration in the block has one event for each device
+  if (events.size() % m_ndevices)
+    throw std::runtime_error("Processor::executeBatch: incorrect number of events passed");
+  if (events.empty()) return;
+  processBatch(events);
+}
+
+void Processor::processBatch(const std::vector<Storage::Event*>& events) {
+  for (size_t ibatch = 0; ibatch < events.size(); ibatch += m_ndevices) {
+    for (size_t i = 0; i < m_ndevices; i++)
+      m_events[i] = events[ibatch+i];
+    process();
+  }
+}
+
 }
 
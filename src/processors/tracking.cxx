@@ -1,11 +1,15 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <vector>
 #include <stdexcept>
 #include <cassert>
-#include <list>
+#include <algorithm>
 #include <cmath>
 
 #include "utils.h"
+#include "arena.h"
 #include "storage/cluster.h"
 #include "storage/plane.h"
 #include "storage/track.h"
@@ -14,42 +18,41 @@
 
 namespace Processors {
 
+template <typename T>
 void Tracking::buildTrack(
     Storage::Track& track,
-    const std::list<Storage::Cluster*>& clusters) {
-  const size_t nclusters = clusters.size();
-  std::vector<double> x(nclusters, 0);
-  std::vector<double> xe(nclusters, 0);
-  std::vector<double> y(nclusters, 0);
-  std::vector<double> ye(nclusters, 0);
-  std::vector<double> z(nclusters, 0);
-
-  size_t icluster = 0;
-  for (std::list<Storage::Cluster*>::const_iterator it = clusters.begin();
-      it != clusters.end(); ++it) {
-    Storage::Cluster& cluster = **it;
+    Storage::Cluster* const* clusters,
+    size_t nclusters,
+    Utils::Arena& scratch) {
+  Utils::ArenaVector<T> x(nclusters, 0, scratch);
+  Utils::ArenaVector<T> xe(nclusters, 0, scratch);
+  Utils::ArenaVector<T> y(nclusters, 0, scratch);
+  Utils::ArenaVector<T> ye(nclusters, 0, scratch);
+  Utils::ArenaVector<T> z(nclusters, 0, scratch);
+
+  for (size_t icluster = 0; icluster < nclusters; icluster++) {
+    Storage::Cluster& cluster = *clusters[icluster];
     track.addCluster(cluster);
     x[icluster] = cluster.getPosX();
     xe[icluster] = cluster.getPosErrX();
     y[icluster] = cluster.getPosY();
     ye[icluster] = cluster.getPosErrY();
     z[icluster] = cluster.getPosZ();
-    icluster += 1;
   }
 
-  double xp0 = 0;  // x intercept
-  double xp1 = 0;  // x slope
-  double xp0e = 0;  // x intercept error
-  double xp1e = 0;  // x slope error
-  double xcov = 0;  // x intercept slope covariance
-  double xchi2 = 0;  // x fit chi^2
+  T xp0 = 0;  // x intercept
+  T xp1 = 0;  // x slope
+  T xp0e = 0;  // x intercept error
+  T xp1e = 0;  // x slope error
+  T xcov = 0;  // x intercept slope covariance
+  T xchi2 = 0;  // x fit chi^2
 
-  double yp0 = 0;
-  double yp1 = 0;
-  double yp0e = 0;
-  double yp1e = 0;
-  double ycov = 0;
-  double ychi2 = 0;
+  T yp0 = 0;
+  T yp1 = 0;
+  T yp0e = 0;
+  T yp1e = 0;
+  T ycov = 0;
+  T ychi2 = 0;
 
   Utils::linearFit(
     nclusters, &z[0], &x[0], &xe[0], xp0, xp1, xp0e, xp1e, xcov, xchi2);
@@ -65,125 +68,282 @@ void Tracking::buildTrack(
   track.setChi2((xchi2+ychi2)/(2*nclusters-2));
 }
 
+template void Tracking::buildTrack<double>(
+    Storage::Track&, Storage::Cluster* const*, size_t, Utils::Arena&);
+template void Tracking::buildTrack<float>(
+    Storage::Track&, Storage::Cluster* const*, size_t, Utils::Arena&);
+
 void Tracking::process() {
   // Processor initializes with only 1 device, so process runs on only 1 event
   assert(m_events.size() == 1 && "More than 1 device being tracked");
-  Storage::Event& event = *m_events[0];
+  processEvent(*m_events[0]);
+}
+
+void Tracking::processEvent(Storage::Event& event) {
+  processFixed<0>(event);
+}
+
+// Track candidates need to keep track of the last plane on which they found a
+// cluster, and the list of found clusters. They are kept back to back in one
+// array, and their clusters in slices of a shared pool, so that dropping the
+// dead ones is a compaction of plain values.
+struct Tracklet {
+  // Index of last plane on which the track found a cluster
+  size_t lastPlane;
+  // Start of this track's clusters in the pool, and their number
+  size_t first;
+  size_t nclusters;
+  // Set when the track shares a cluster with another one
+  bool killed;
+};
+
+// Grid cell of a cluster, with the cluster's index in its plane
+struct CellCluster {
+  int cellX;
+  int cellY;
+  size_t index;
+};
+
+// Order by cell, and by index within a cell
+static bool cellBefore(const CellCluster& a, const CellCluster& b) {
+  if (a.cellX != b.cellX) return a.cellX < b.cellX;
+  if (a.cellY != b.cellY) return a.cellY < b.cellY;
+  return a.index < b.index;
+}
+
+// A cluster within the search radius of a tracklet
+struct Candidate {
+  size_t icluster;
+  size_t itracklet;
+};
+
+// Order by cluster, so that each cluster's tracklets are together, and in the
+// tracklets' order within a cluster
+static bool candidateBefore(const Candidate& a, const Candidate& b) {
+  if (a.icluster != b.icluster) return a.icluster < b.icluster;
+  return a.itracklet < b.itracklet;
+}
+
+// Cells are kept well within the range of int, which also bounds those of
+// positions far outside the grid
+static const double CELL_LIMIT = 1 << 30;
+
+// Index of the cell of `pos` on a grid of `size` wide cells
+static int cellOf(double pos, double size) {
+  const double cell = std::floor(pos / size);
+  if (!(cell > -CELL_LIMIT)) return (int)-CELL_LIMIT;  // also for NaN
+  if (cell > CELL_LIMIT) return (int)CELL_LIMIT;
+  return (int)cell;
+}
+
+// Add the clusters of `cells` in [begin, end) which are within the search
+// radius of a tracklet ending at (prevx, prevy) as its candidates
+static void addCandidates(
+    const Storage::Plane& plane,
+    Utils::ArenaVector<CellCluster>::const_iterator begin,
+    Utils::ArenaVector<CellCluster>::const_iterator end,
+    double prevx,
+    double prevy,
+    double scalex,
+    double scaley,
+    double radius2,
+    size_t itracklet,
+    Utils::ArenaVector<Candidate>& candidates) {
+  for (Utils::ArenaVector<CellCluster>::const_iterator it = begin;
+      it != end; ++it) {
+    const Storage::Cluster& cluster = plane.getCluster(it->index);
+    // The distance from this cluster to the track, scaled
+    const double distx = (cluster.getPosX()-prevx)/scalex;
+    const double disty = (cluster.getPosY()-prevy)/scaley;
+    // Written so that a NaN distance doesn't match
+    if (!(distx*distx + disty*disty <= radius2)) continue;
+    Candidate candidate = { it->index, itracklet };
+    candidates.push_back(candidate);
+  }
+}
+
+template <size_t NPLANES>
+void Tracking::processFixed(Storage::Event& event) {
+  // A fixed number of planes lets the compiler fold it into the plane loops
+  // and the transfer indices
+  const size_t nplanes = NPLANES ? NPLANES : m_nplanes;
 
   // Consistency check since some allocation has been done to accomodate a
   // given number of planes
-  if (event.getNumPlanes() != m_nplanes)
+  if (event.getNumPlanes() != nplanes || m_nplanes != nplanes)
     throw std::runtime_error("Tracking::process: wrong number of planes");
 
-  // Track candidates need to keep track of the last plane on which they found
-  // a cluster, and the list of found clusters
-  struct Tracklet {
-    // Index of last plane on which the track found a cluster
-    size_t lastPlane;
-    // List of clusters in this track
-    std::list<Storage::Cluster*> clusters;
-    Tracklet() : lastPlane(0), clusters() {}
-  };
-
-  // List won't be moving Tracklet objects, which are light anyway, so no real
-  // performance issues
-  std::list<Tracklet> tracklets;
+  // The candidates of the previous event are gone
+  m_arena.reset();
 
   const size_t minClusters = (m_minClusters>3) ? m_minClusters : 3;
 
-  for (size_t iplane = 0; iplane < m_nplanes; iplane++) {
+  // Each cluster can seed at most one tracklet, with room for one cluster on
+  // each plane from there on, so the sizes are known up front and neither
+  // the tracklets nor the pool move as they are filled
+  size_t maxTracklets = 0;
+  size_t maxSlots = 0;
+  for (size_t iplane = 0; iplane+minClusters <= nplanes; iplane++) {
+    maxTracklets += event.getPlane(iplane).getNumClusters();
+    maxSlots += event.getPlane(iplane).getNumClusters() * (nplanes-iplane);
+  }
+  Utils::ArenaVector<Tracklet> tracklets(m_arena);
+  tracklets.reserve(maxTracklets);
+  Utils::ArenaVector<Storage::Cluster*> pool(maxSlots, 0, m_arena);
+  size_t nslots = 0;
+
+  // Compare squared distances, and match nothing with a negative radius
+  const double radius2 = (m_radius >= 0) ? m_radius*m_radius : -1;
+
+  for (size_t iplane = 0; iplane < nplanes; iplane++) {
     const Storage::Plane& plane = event.getPlane(iplane);
+    const size_t nclusters = plane.getNumClusters();
+
+    // Bucket the clusters in cells as wide as the largest search window of
+    // any previous plane into this one: a tracklet's matches are then in the
+    // cells its window overlaps, at most 3 in each direction
+    double sizeX = 0;
+    double sizeY = 0;
+    for (size_t iprev = 0; iprev < iplane; iprev++) {
+      const double windowX =
+          std::fabs(m_radius*m_transitionsX[iprev*nplanes+iplane]);
+      const double windowY =
+          std::fabs(m_radius*m_transitionsY[iprev*nplanes+iplane]);
+      // Windows which aren't finite are searched cluster by cluster instead
+      if (std::isfinite(windowX)) sizeX = std::max(sizeX, windowX);
+      if (std::isfinite(windowY)) sizeY = std::max(sizeY, windowY);
+    }
+    // Windows of 0 only match clusters in their own cell, of any size
+    if (!(sizeX > 0)) sizeX = 1;
+    if (!(sizeY > 0)) sizeY = 1;
+
+    Utils::ArenaVector<CellCluster> cells(nclusters, CellCluster(), m_arena);
+    for (size_t i = 0; i < nclusters; i++) {
+      const Storage::Cluster& cluster = plane.getCluster(i);
+      cells[i].cellX = cellOf(cluster.getPosX(), sizeX);
+      cells[i].cellY = cellOf(cluster.getPosY(), sizeY);
+      cells[i].index = i;
+    }
+    std::sort(cells.begin(), cells.end(), cellBefore);
 
-    // Try to add all clusters to tracks
-    for (size_t icluster = 0; icluster < plane.getNumClusters(); icluster++) {
+    // Find the clusters within the radius of each tracklet built so far
+    Utils::ArenaVector<Candidate> candidates(m_arena);
+    const size_t ntracklets = tracklets.size();
+    for (size_t itracklet = 0; itracklet < ntracklets; itracklet++) {
+      const Tracklet& tracklet = tracklets[itracklet];
+
+      // Information about the last cluster in the candidate
+      const size_t iprev = tracklet.lastPlane;
+      const Storage::Cluster& prev =
+          *pool[tracklet.first+tracklet.nclusters-1];
+      const double prevx = prev.getPosX();
+      const double prevy = prev.getPosY();
+
+      // The RMS of the distance of clusters from iprev plane to this plane
+      const double scalex = m_transitionsX[iprev*nplanes+iplane];
+      const double scaley = m_transitionsY[iprev*nplanes+iplane];
+
+      // Cells overlapped by the window. Scan all clusters if it is unbounded.
+      const double windowX = std::fabs(m_radius*scalex);
+      const double windowY = std::fabs(m_radius*scaley);
+      if (!std::isfinite(windowX) || !std::isfinite(windowY)) {
+        addCandidates(plane, cells.begin(), cells.end(), prevx, prevy,
+            scalex, scaley, radius2, itracklet, candidates);
+        continue;
+      }
+
+      const int highX = cellOf(prevx+windowX, sizeX);
+      const int lowY = cellOf(prevy-windowY, sizeY);
+      const int highY = cellOf(prevy+windowY, sizeY);
+      for (int cellX = cellOf(prevx-windowX, sizeX); cellX <= highX; cellX++) {
+        // Clusters in this column from the lowest row of the window
+        CellCluster key = { cellX, lowY, 0 };
+        Utils::ArenaVector<CellCluster>::const_iterator begin =
+            std::lower_bound(cells.begin(), cells.end(), key, cellBefore);
+        Utils::ArenaVector<CellCluster>::const_iterator end = begin;
+        while (end != cells.end() && end->cellX == cellX && end->cellY <= highY)
+          ++end;
+        addCandidates(plane, begin, end, prevx, prevy,
+            scalex, scaley, radius2, itracklet, candidates);
+      }
+    }  // tracklet loop
+
+    // Bring the tracklets matching each cluster together, in cluster order
+    std::sort(candidates.begin(), candidates.end(), candidateBefore);
+
+    Utils::ArenaVector<Candidate>::const_iterator next = candidates.begin();
+    for (size_t icluster = 0; icluster < nclusters; icluster++) {
       Storage::Cluster& cluster = plane.getCluster(icluster);
-      // Iterator to the track matching this cluster
-      std::list<Tracklet>::iterator match = tracklets.end();
-      // Boolean remembers if the cluster was matched (even if match has been
-      // erased)
-      bool matched = false;
-
-      // Try to associate this cluster to all track candidates
-      for (std::list<Tracklet>::iterator it = tracklets.begin();
-          it != tracklets.end(); ++it) {
-        Tracklet& tracklet = *it;
-
-        // Information about the last cluster in the candidate
-        const size_t iprev = tracklet.lastPlane;
-        const double prevx = tracklet.clusters.back()->getPosX();
-        const double prevy = tracklet.clusters.back()->getPosY();
-
-        // Information about this cluster
-        const size_t icurr = iplane;
-        const double currx = cluster.getPosX();
-        const double curry = cluster.getPosY();
-        
-        // The RMS of the distance of clusters from iprev plane to icurr plane.
-        const double scalex = m_transitionsX[iprev*m_nplanes+icurr];
-        const double scaley = m_transitionsY[iprev*m_nplanes+icurr];
-
-        // The distance from this cluster to the track, scaled
-        const double distx = std::fabs((currx-prevx)/scalex);
-        const double disty = std::fabs((curry-prevy)/scaley);
-        const double dist = std::sqrt(distx*distx + disty*disty);
-
-        // The tracklet matches the cluster, and the cluster is unmatched
-        if (dist <= m_radius && !matched) {
-          // Cluster is a candidate, add it to the track
-          tracklet.lastPlane = iplane;
-          tracklet.clusters.push_back(&cluster);
-          // Remember which track matched the cluster
-          match = it;
-          matched = true;
-        }
 
-        // The tracklet matches the cluster, but the cluster is already in 
-        // another track
-        else if (dist <= m_radius && matched) {
-          // If the cluster has a matched tracklet, erase it. Note: this must
-          // be done before erasing the current tracklet, since the iterator
-          // might be moved back to onto this one
-          if (match != tracklets.end()) {
-            tracklets.erase(match);
-            match = tracklets.end();
-          }
-          // Current tracket is also invalidated. Erase it. Get the iterator to
-          // the next tracklet, but decrement it so that the next for brings 
-          // the loop back to it
-          it = tracklets.erase(it); --it;
-          // Move onto the next tracklet (can't be trying to use tracklet)
-          continue;
+      // Tracklets which are still available for this cluster: a tracklet
+      // which took a cluster of this plane already, or was killed by one,
+      // doesn't take part
+      size_t nmatches = 0;
+      size_t match = 0;
+      Utils::ArenaVector<Candidate>::const_iterator first = next;
+      for (; next != candidates.end() && next->icluster == icluster; ++next) {
+        const Tracklet& tracklet = tracklets[next->itracklet];
+        if (tracklet.killed || tracklet.lastPlane == iplane) continue;
+        match = next->itracklet;
+        nmatches += 1;
+      }
+
+      if (nmatches == 1) {
+        // Cluster is a candidate, add it to the track
+        Tracklet& tracklet = tracklets[match];
+        pool[tracklet.first+tracklet.nclusters] = &cluster;
+        tracklet.nclusters += 1;
+        tracklet.lastPlane = iplane;
+      }
+
+      else if (nmatches > 1) {
+        // The cluster is shared, so none of the tracklets it matches is kept
+        for (; first != next; ++first) {
+          Tracklet& tracklet = tracklets[first->itracklet];
+          if (tracklet.lastPlane != iplane) tracklet.killed = true;
         }
-      }  // tracklet loop
+      }
 
       // Unmatched clusters that can still seed a full track should do so
-      if (!matched && m_nplanes-iplane >= minClusters) {
-        tracklets.push_back(Tracklet());
-        tracklets.back().lastPlane = iplane;
-        tracklets.back().clusters.push_back(&cluster);
+      else if (nplanes-iplane >= minClusters) {
+        // A track has at most one cluster per plane
+        Tracklet tracklet = { iplane, nslots, 1, false };
+        pool[nslots] = &cluster;
+        nslots += nplanes-iplane;
+        tracklets.push_back(tracklet);
       }
     }  // cluster loop
 
-    // Now remove tracklets which can no longer be completed
-    for (std::list<Tracklet>::iterator it = tracklets.begin();
-        it != tracklets.end(); ++it) {
-      Tracklet& tracklet = *it;
-      const size_t nremains = m_nplanes - (iplane+1);
-      if (tracklet.clusters.size() + nremains >= minClusters)
+    // Now remove tracklets which are killed or can no longer be completed,
+    // keeping the others in order
+    const size_t nremains = nplanes - (iplane+1);
+    size_t nkept = 0;
+    for (size_t itracklet = 0; itracklet < tracklets.size(); itracklet++) {
+      const Tracklet& tracklet = tracklets[itracklet];
+      if (tracklet.killed || tracklet.nclusters + nremains < minClusters)
         continue;
-      it = --(tracklets.erase(it));
+      tracklets[nkept++] = tracklet;
     }
+    tracklets.resize(nkept);
   }  // plane loop
 
   // Build tracks from the tracklets
-  for (std::list<Tracklet>::iterator it = tracklets.begin();
-      it != tracklets.end(); ++it) {
-    Tracklet& tracklet = *it;
+  for (size_t itracklet = 0; itracklet < tracklets.size(); itracklet++) {
+    const Tracklet& tracklet = tracklets[itracklet];
     Storage::Track& track = event.newTrack();
-    buildTrack(track, tracklet.clusters);
+    if (m_singlePrecision)
+      buildTrack<float>(
+          track, &pool[tracklet.first], tracklet.nclusters, m_arena);
+    else
+      buildTrack<double>(
+          track, &pool[tracklet.first], tracklet.nclusters, m_arena);
   }
 }
 
+// Plane counts available to `Chain`
+template void Tracking::processFixed<0>(Storage::Event& event);
+template void Tracking::processFixed<6>(Storage::Event& event);
+
 void Tracking::setTransitionX(size_t from, size_t to, double scale) {
   m_transitionsX[from*m_nplanes+to] = scale;
 }
@@ -192,5 +352,50 @@ void Tracking::setTransitionY(size_t from, size_t to, double scale) {
   m_transitionsY[from*m_nplanes+to] = scale;
 }
 
+void Tracking::writeTransitions(const std::string& filePath) const {
+  std::ofstream file(filePath.c_str());
+  if (!file) throw std::runtime_error(
+        "Tracking::writeTransitions: unable to open file");
+
+  file << std::scientific;
+  file.precision(6);
+
+  file << "# from to scale-x scale-y" << std::endl;
+  for (size_t from = 0; from < m_nplanes; from++)
+    for (size_t to = 0; to < m_nplanes; to++)
+      file << from << " " << to << " "
+          << m_transitionsX[from*m_nplanes+to] << " "
+          << m_transitionsY[from*m_nplanes+to] << std::endl;
+
+  file.close();
 }
 
+void Tracking::readTransitions(const std::string& filePath) {
+  std::ifstream file(filePath.c_str());
+  if (!file) throw std::runtime_error(
+        "Tracking::readTransitions: unable to open file");
+
+  std::string line;
+  while (std::getline(file, line)) {
+    // Skip comments and blank lines
+    const size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#') continue;
+
+    std::stringstream ss(line);
+    size_t from = 0;
+    size_t to = 0;
+    double scaleX = 0;
+    double scaleY = 0;
+    if (!(ss >> from >> to >> scaleX >> scaleY))
+      throw std::runtime_error("Tracking::readTransitions: invalid line");
+    if (from >= m_nplanes || to >= m_nplanes)
+      throw std::runtime_error("Tracking::readTransitions: plane out of range");
+
+    setTransitionX(from, to, scaleX);
+    setTransitionY(from, to, scaleY);
+  }
+
+  file.close();
+}
+
+}
@@ -0,0 +1,199 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <climits>
+
+#include <TDirectory.h>
+#include <TTree.h>
+
+#include "storage/hit.h"
+#include "storage/cluster.h"
+#include "storage/clusterdictionary.h"
+
+namespace Storage {
+
+// Most frequent patterns first, ties broken by shape so that the order
+// doesn't depend on how the calibration was split
+static bool morePopular(
+    const ClusterDictionary::Pattern& a,
+    const ClusterDictionary::Pattern& b) {
+  if (a.count != b.count) return a.count > b.count;
+  return a.shape < b.shape;
+}
+
+bool ClusterDictionary::encode(
+    const Cluster& cluster,
+    Int_t& anchorX,
+    Int_t& anchorY,
+    ULong64_t& shape) {
+  const size_t nhits = cluster.getNumHits();
+  if (nhits == 0) return false;
+
+  int minX = INT_MAX;
+  int maxX = INT_MIN;
+  int minY = INT_MAX;
+  int maxY = INT_MIN;
+  for (size_t i = 0; i < nhits; i++) {
+    const Hit& hit = cluster.getHit(i);
+    minX = std::min(hit.getPixX(), minX);
+    maxX = std::max(hit.getPixX(), maxX);
+    minY = std::min(hit.getPixY(), minY);
+    maxY = std::max(hit.getPixY(), maxY);
+  }
+
+  if (maxX - minX >= PATTERN_SIZE || maxY - minY >= PATTERN_SIZE)
+    return false;
+
+  // Hits sharing a pixel set the same bit
+  shape = 0;
+  for (size_t i = 0; i < nhits; i++) {
+    const Hit& hit = cluster.getHit(i);
+    const int bit = (hit.getPixY()-minY)*PATTERN_SIZE + hit.getPixX()-minX;
+    shape |= (ULong64_t)1 << bit;
+  }
+
+  anchorX = minX;
+  anchorY = minY;
+  return true;
+}
+
+void ClusterDictionary::addCluster(const Cluster& cluster) {
+  Int_t anchorX = 0;
+  Int_t anchorY = 0;
+  ULong64_t shape = 0;
+  if (!encode(cluster, anchorX, anchorY, shape)) return;
+
+  // Candidates hold sums until the patterns are built
+  Pattern& candidate = m_candidates[shape];
+  candidate.shape = shape;
+  candidate.offsetX += cluster.getPixX() - anchorX;
+  candidate.offsetY += cluster.getPixY() - anchorY;
+  candidate.errX += cluster.getPixErrX();
+  candidate.errY += cluster.getPixErrY();
+  candidate.count += 1;
+}
+
+void ClusterDictionary::add(const ClusterDictionary& other) {
+  for (std::map<ULong64_t, Pattern>::const_iterator it =
+      other.m_candidates.begin(); it != other.m_candidates.end(); ++it) {
+    Pattern& candidate = m_candidates[it->first];
+    candidate.shape = it->first;
+    candidate.offsetX += it->second.offsetX;
+    candidate.offsetY += it->second.offsetY;
+    candidate.errX += it->second.errX;
+    candidate.errY += it->second.errY;
+    candidate.count += it->second.count;
+  }
+}
+
+void ClusterDictionary::build(size_t maxPatterns, ULong64_t minCount) {
+  m_patterns.clear();
+  for (std::map<ULong64_t, Pattern>::const_iterator it =
+      m_candidates.begin(); it != m_candidates.end(); ++it) {
+    if (it->second.count < minCount || it->second.count == 0) continue;
+    // Turn the sums into averages
+    Pattern pattern = it->second;
+    pattern.offsetX /= pattern.count;
+    pattern.offsetY /= pattern.count;
+    pattern.errX /= pattern.count;
+    pattern.errY /= pattern.count;
+    m_patterns.push_back(pattern);
+  }
+
+  std::sort(m_patterns.begin(), m_patterns.end(), morePopular);
+  if (m_patterns.size() > maxPatterns) m_patterns.resize(maxPatterns);
+
+  indexPatterns();
+}
+
+void ClusterDictionary::indexPatterns() {
+  m_index.clear();
+  for (size_t i = 0; i < m_patterns.size(); i++)
+    m_index[m_patterns[i].shape] = i;
+}
+
+Int_t ClusterDictionary::findPattern(ULong64_t shape) const {
+  std::map<ULong64_t, Int_t>::const_iterator it = m_index.find(shape);
+  return it == m_index.end() ? -1 : it->second;
+}
+
+const ClusterDictionary::Pattern& ClusterDictionary::getPattern(
+    size_t n) const {
+  if (n >= m_patterns.size())
+    throw std::out_of_range(
+        "ClusterDictionary::getPattern: requested pattern out of range");
+  return m_patterns[n];
+}
+
+bool ClusterDictionary::isSame(const ClusterDictionary& other) const {
+  if (other.m_patterns.size() != m_patterns.size()) return false;
+  for (size_t i = 0; i < m_patterns.size(); i++) {
+    const Pattern& a = m_patterns[i];
+    const Pattern& b = other.m_patterns[i];
+    if (a.shape != b.shape || a.offsetX != b.offsetX ||
+        a.offsetY != b.offsetY || a.errX != b.errX || a.errY != b.errY)
+      return false;
+  }
+  return true;
+}
+
+void ClusterDictionary::write(TDirectory& dir) const {
+  dir.cd();
+
+  Pattern pattern;
+  TTree* tree = new TTree(PATTERNS_TREE_NAME, "Cluster patterns");
+  tree->Branch("Shape", &pattern.shape, "Shape/l");
+  tree->Branch("OffsetX", &pattern.offsetX, "OffsetX/D");
+  tree->Branch("OffsetY", &pattern.offsetY, "OffsetY/D");
+  tree->Branch("ErrX", &pattern.errX, "ErrX/D");
+  tree->Branch("ErrY", &pattern.errY, "ErrY/D");
+  tree->Branch("Count", &pattern.count, "Count/l");
+
+  // One entry per pattern, in the order of their indices
+  for (size_t i = 0; i < m_patterns.size(); i++) {
+    pattern = m_patterns[i];
+    tree->Fill();
+  }
+
+  // The tree is complete, so it can be written now and let go
+  tree->Write();
+  delete tree;
+}
+
+bool ClusterDictionary::read(TDirectory& dir) {
+  TTree* tree = 0;
+  dir.GetObject(PATTERNS_TREE_NAME, tree);
+  if (!tree) return false;
+
+  Pattern pattern;
+  if (tree->SetBranchAddress("Shape", &pattern.shape) < 0 ||
+      tree->SetBranchAddress("OffsetX", &pattern.offsetX) < 0 ||
+      tree->SetBranchAddress("OffsetY", &pattern.offsetY) < 0 ||
+      tree->SetBranchAddress("ErrX", &pattern.errX) < 0 ||
+      tree->SetBranchAddress("ErrY", &pattern.errY) < 0 ||
+      tree->SetBranchAddress("Count", &pattern.count) < 0) {
+    delete tree;
+    throw std::runtime_error(
+        "ClusterDictionary::read: patterns tree is missing branches");
+  }
+
+  std::vector<Pattern> patterns;
+  const Long64_t nentries = tree->GetEntries();
+  for (Long64_t n = 0; n < nentries; n++) {
+    if (tree->GetEntry(n) <= 0) {
+      delete tree;
+      throw std::runtime_error(
+          "ClusterDictionary::read: error reading patterns tree");
+    }
+    patterns.push_back(pattern);
+  }
+  delete tree;
+
+  m_patterns.swap(patterns);
+  indexPatterns();
+  return true;
+}
+
+}
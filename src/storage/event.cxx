@@ -76,6 +76,24 @@ void Event::clear() {
   m_invalid = false;
 }
 
+void Event::reset() {
+  if (m_storage)
+    throw std::runtime_error("Event::reset: event is owned by a storage object");
+
+  for (std::vector<Hit*>::iterator it = m_hits.begin();
+      it != m_hits.end(); ++it)
+    delete (*it);
+  for (std::vector<Cluster*>::iterator it = m_clusters.begin();
+      it != m_clusters.end(); ++it)
+    delete (*it);
+  for (std::vector<Track*>::iterator it = m_tracks.begin();
+      it != m_tracks.end(); ++it)
+    delete (*it);
+
+  // Objects are deleted, dropping ownership is now safe
+  clear();
+}
+
 void Event::print() {
   std::cout
       << "\nEVENT:\n"
@@ -105,6 +123,11 @@ Hit& Event::newHit(size_t nplane) {
   // Do the two way plane association
   m_planes[nplane]->m_hits.push_back(hit);
   hit->m_plane = m_planes[nplane];
+  // The new hit can break the plane's order
+  if (m_planes[nplane]->m_sorted) {
+    m_planes[nplane]->m_sorted = false;
+    m_planes[nplane]->m_rowOffsets.clear();
+  }
   // Return a reference to make ownership clear
   return *hit;
 }
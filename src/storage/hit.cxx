@@ -14,6 +14,7 @@ Hit::Hit() :
     m_posY(0),
     m_posZ(0),
     m_value(0),
+    m_charge(0),
     m_timing(0),
     m_masked(false),
     m_plane(0) {}
@@ -26,6 +27,7 @@ void Hit::clear() {
   m_posY = 0;
   m_posZ = 0;
   m_value = 0;
+  m_charge = 0;
   m_timing = 0;
   m_masked = false;
   m_plane = 0;
@@ -38,6 +40,7 @@ void Hit::print() {
       "  Pix:     (" << m_pixX << " , " << m_pixY << ")\n"
       "  Pos:     (" << m_posX << " , " << m_posY << " , " << m_posZ << ")\n"
       "  Value:   " << m_value << "\n"
+      "  Charge:  " << m_charge << "\n"
       "  Timing:  " << m_timing << "\n"
       "  Cluster: " << fetchCluster() << "\n"
       "  Plane:   "  << fetchPlane() << std::endl;
@@ -0,0 +1,215 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TTree.h>
+#include <TNamed.h>
+
+#include "storage/event.h"
+#include "storage/clusterdictionary.h"
+#include "storage/storageio.h"
+#include "storage/storagei.h"
+#include "storage/storageo.h"
+#include "storage/merge.h"
+
+namespace Storage {
+
+// List the paths of the trees found in a judith file, in the order in which
+// `StorageO` makes them
+static void listTrees(
+    const std::string& filePath,
+    std::vector<std::string>& paths) {
+  TFile file(filePath.c_str());
+  if (!file.IsOpen()) throw std::runtime_error(
+        "Storage: mergeFiles: unable to open " + filePath);
+
+  paths.clear();
+
+  for (size_t nplane = 0; ; nplane++) {
+    std::stringstream ss;
+    ss << "Plane" << nplane;
+    TDirectory* dir = 0;
+    file.GetObject(ss.str().c_str(), dir);
+    if (!dir) break;
+    TTree* tree = 0;
+    dir->GetObject("Hits", tree);
+    if (tree) paths.push_back(ss.str() + "/Hits");
+    tree = 0;
+    dir->GetObject("Clusters", tree);
+    if (tree) paths.push_back(ss.str() + "/Clusters");
+  }
+
+  TTree* tree = 0;
+  file.GetObject("Event", tree);
+  if (tree) paths.push_back("Event");
+  tree = 0;
+  file.GetObject("Tracks", tree);
+  if (tree) paths.push_back("Tracks");
+
+  file.Close();
+}
+
+// Copy the trees basket by basket, without decoding their entries, and flag
+// the output as sorted if requested
+static void mergeTrees(
+    const std::vector<std::string>& inputPaths,
+    const std::string& outputPath,
+    const std::vector<std::string>& trees,
+    bool sorted,
+    const ClusterDictionary* patterns) {
+  std::vector<std::unique_ptr<TFile> > inputs;
+  for (size_t i = 0; i < inputPaths.size(); i++) {
+    inputs.push_back(std::unique_ptr<TFile>(new TFile(inputPaths[i].c_str())));
+    if (!inputs.back()->IsOpen()) throw std::runtime_error(
+          "Storage: mergeFiles: unable to open " + inputPaths[i]);
+  }
+
+  TFile output(outputPath.c_str(), "RECREATE");
+  if (!output.IsOpen()) throw std::runtime_error(
+        "Storage: mergeFiles: unable to open " + outputPath);
+
+  // Plane directories made so far in the output
+  std::map<std::string, TDirectory*> dirs;
+
+  for (size_t itree = 0; itree < trees.size(); itree++) {
+    const std::string& path = trees[itree];
+
+    // Trees are either in a plane directory, or at the top
+    TDirectory* dir = &output;
+    const size_t split = path.find('/');
+    if (split != std::string::npos) {
+      const std::string name = path.substr(0, split);
+      if (dirs.find(name) == dirs.end())
+        dirs[name] = output.mkdir(name.c_str());
+      dir = dirs[name];
+    }
+    dir->cd();
+
+    // Make an empty tree with the same branches in the output directory
+    TTree* first = 0;
+    inputs[0]->GetObject(path.c_str(), first);
+    if (!first) throw std::runtime_error(
+          "Storage: mergeFiles: " + inputPaths[0] + " has no tree " + path);
+    TTree* merged = first->CloneTree(0);
+
+    Long64_t nentries = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      TTree* tree = 0;
+      inputs[i]->GetObject(path.c_str(), tree);
+      if (!tree) throw std::runtime_error(
+            "Storage: mergeFiles: " + inputPaths[i] + " has no tree " + path);
+      nentries += tree->GetEntries();
+      if (merged->CopyEntries(tree, -1, "fast") < 0)
+        throw std::runtime_error(
+            "Storage: mergeFiles: unable to copy " + path);
+    }
+
+    if (merged->GetEntries() != nentries)
+      throw std::runtime_error(
+          "Storage: mergeFiles: entries missing from " + path);
+  }
+
+  if (sorted) {
+    output.cd();
+    TNamed flag(HITS_SORTED_NAME, "Hits are in row-major order");
+    flag.Write();
+  }
+
+  // The patterns are the same for all inputs, and are copied once
+  if (patterns) patterns->write(output);
+
+  output.Write();
+  output.Close();
+}
+
+void mergeFiles(
+    const std::vector<std::string>& inputPaths,
+    const std::string& outputPath,
+    bool fast) {
+  if (inputPaths.empty())
+    throw std::runtime_error("Storage: mergeFiles: no inputs");
+
+  // All inputs must have the same trees to be concatenated
+  std::vector<std::string> trees;
+  listTrees(inputPaths[0], trees);
+  for (size_t i = 1; i < inputPaths.size(); i++) {
+    std::vector<std::string> other;
+    listTrees(inputPaths[i], other);
+    if (other != trees) throw std::runtime_error(
+          "Storage: mergeFiles: inputs don't have the same trees");
+  }
+
+  // Open the inputs to check their branches, even if they are copied without
+  // decoding: trees with different branches can't be concatenated
+  std::vector<std::unique_ptr<StorageI> > inputs;
+  for (size_t i = 0; i < inputPaths.size(); i++) {
+    inputs.push_back(std::unique_ptr<StorageI>(new StorageI(inputPaths[i])));
+    const StorageI& input = *inputs.back();
+    const StorageI& ref = *inputs.front();
+    if (input.getNumPlanes() != ref.getNumPlanes() ||
+        input.getHitsBranchesOff() != ref.getHitsBranchesOff() ||
+        input.getClustersBranchesOff() != ref.getClustersBranchesOff() ||
+        input.getTracksBranchesOff() != ref.getTracksBranchesOff() ||
+        input.getEventInfoBranchesOff() != ref.getEventInfoBranchesOff())
+      throw std::runtime_error(
+          "Storage: mergeFiles: inputs don't have the same branches");
+    // Pattern indices only mean the same in files with the same patterns
+    if (input.isClustersPatterned() != ref.isClustersPatterned() ||
+        !input.getClusterPatterns().isSame(ref.getClusterPatterns()))
+      throw std::runtime_error(
+          "Storage: mergeFiles: inputs don't have the same cluster patterns");
+  }
+
+  // Keep a copy of the patterns, the inputs might be closed before writing
+  const bool patterned = inputs.front()->isClustersPatterned();
+  const ClusterDictionary patterns = inputs.front()->getClusterPatterns();
+
+  // The merged hits are in order only if they are in every input
+  bool sorted = true;
+  for (size_t i = 0; i < inputs.size(); i++)
+    sorted &= inputs[i]->isFileSorted();
+
+  if (fast) {
+    inputs.clear();
+    mergeTrees(
+        inputPaths, outputPath, trees, sorted, patterned ? &patterns : 0);
+    return;
+  }
+
+  // Index the sorted inputs' planes, which lets the output keep the flag
+  for (size_t i = 0; i < inputs.size(); i++)
+    inputs[i]->setSortHits(sorted);
+
+  // Don't make the trees which are missing from the inputs
+  const StorageI& ref = *inputs.front();
+  int treeMask = StorageIO::HITS | StorageIO::CLUSTERS |
+      StorageIO::TRACKS | StorageIO::EVENTINFO;
+  for (size_t i = 0; i < trees.size(); i++) {
+    if (trees[i] == "Plane0/Hits") treeMask &= ~StorageIO::HITS;
+    if (trees[i] == "Plane0/Clusters") treeMask &= ~StorageIO::CLUSTERS;
+    if (trees[i] == "Tracks") treeMask &= ~StorageIO::TRACKS;
+    if (trees[i] == "Event") treeMask &= ~StorageIO::EVENTINFO;
+  }
+
+  StorageO output(
+      outputPath,
+      ref.getNumPlanes(),
+      treeMask,
+      &ref.getHitsBranchesOff(),
+      &ref.getClustersBranchesOff(),
+      &ref.getTracksBranchesOff(),
+      &ref.getEventInfoBranchesOff(),
+      patterned ? &patterns : 0);
+
+  for (size_t i = 0; i < inputs.size(); i++)
+    for (Long64_t n = 0; n < inputs[i]->getNumEvents(); n++)
+      output.writeEvent(inputs[i]->readEvent(n));
+}
+
+}
@@ -2,6 +2,7 @@
 #include <cassert>
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
 
 #include "storage/hit.h"
 #include "storage/cluster.h"
@@ -9,11 +10,56 @@
 
 namespace Storage {
 
-Plane::Plane(size_t nplane) : m_planeNum(nplane) {}
+Plane::Plane(size_t nplane) :
+    m_planeNum(nplane),
+    m_sorted(false),
+    m_firstRow(0) {}
 
 void Plane::clear() {
   m_hits.clear();
   m_clusters.clear();
+  m_sorted = false;
+  m_rowOffsets.clear();
+}
+
+bool Plane::indexRows() {
+  m_sorted = false;
+  m_rowOffsets.clear();
+
+  for (size_t i = 1; i < m_hits.size(); i++) {
+    const Hit& prev = *m_hits[i-1];
+    const Hit& hit = *m_hits[i];
+    if (hit.getPixY() < prev.getPixY() ||
+        (hit.getPixY() == prev.getPixY() && hit.getPixX() < prev.getPixX()))
+      return false;
+  }
+
+  m_sorted = true;
+  if (m_hits.empty()) return true;
+
+  // One offset per row spanned by the hits, and one past the last row
+  m_firstRow = m_hits.front()->getPixY();
+  const int nrows = m_hits.back()->getPixY() - m_firstRow + 1;
+  m_rowOffsets.assign(nrows+1, m_hits.size());
+  for (size_t i = m_hits.size(); i-- > 0; )
+    m_rowOffsets[m_hits[i]->getPixY() - m_firstRow] = i;
+  // Rows without hits start where the next row does
+  for (int row = nrows-1; row >= 0; row--)
+    m_rowOffsets[row] = std::min(m_rowOffsets[row], m_rowOffsets[row+1]);
+
+  return true;
+}
+
+void Plane::getRowRange(int row, size_t& first, size_t& last) const {
+  if (!m_sorted)
+    throw std::runtime_error(
+        "Plane::getRowRange: hits aren't indexed by row");
+  first = last = 0;
+  if (m_hits.empty() || row < m_firstRow ||
+      row >= m_firstRow + (int)m_rowOffsets.size() - 1)
+    return;
+  first = m_rowOffsets[row - m_firstRow];
+  last = m_rowOffsets[row - m_firstRow + 1];
 }
 
 void Plane::print() {
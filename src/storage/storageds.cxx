@@ -0,0 +1,353 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <set>
+#include <utility>
+#include <memory>
+#include <algorithm>
+#include <typeinfo>
+#include <sstream>
+
+#include <ROOT/RDataSource.hxx>
+#include <ROOT/RDataFrame.hxx>
+
+#include "storage/cluster.h"
+#include "storage/plane.h"
+#include "storage/track.h"
+#include "storage/event.h"
+#include "storage/storageio.h"
+#include "storage/storagei.h"
+#include "storage/storageds.h"
+
+namespace Storage {
+
+// Branches of the clusters tree exposed as columns, and their getters
+struct ClusterColumn {
+  const char* branch;
+  double (Cluster::*value)() const;
+};
+
+static const ClusterColumn s_clusterColumns[] = {
+  { "PixX", &Cluster::getPixX },
+  { "PixY", &Cluster::getPixY },
+  { "PixErrX", &Cluster::getPixErrX },
+  { "PixErrY", &Cluster::getPixErrY },
+  { "PosX", &Cluster::getPosX },
+  { "PosY", &Cluster::getPosY },
+  { "PosZ", &Cluster::getPosZ },
+  { "PosErrX", &Cluster::getPosErrX },
+  { "PosErrY", &Cluster::getPosErrY },
+  { "PosErrZ", &Cluster::getPosErrZ },
+  { "Value", &Cluster::getValue },
+  { "Timing", &Cluster::getTiming }
+};
+
+// Branches of the tracks tree exposed as columns, and their getters
+struct TrackColumn {
+  const char* branch;
+  double (Track::*value)() const;
+};
+
+static const TrackColumn s_trackColumns[] = {
+  { "SlopeX", &Track::getSlopeX },
+  { "SlopeY", &Track::getSlopeY },
+  { "SlopeErrX", &Track::getSlopeErrX },
+  { "SlopeErrY", &Track::getSlopeErrY },
+  { "OriginX", &Track::getOriginX },
+  { "OriginY", &Track::getOriginY },
+  { "OriginErrX", &Track::getOriginErrX },
+  { "OriginErrY", &Track::getOriginErrY },
+  { "CovarianceX", &Track::getCovarianceX },
+  { "CovarianceY", &Track::getCovarianceY },
+  { "Chi2", &Track::getChi2 }
+};
+
+StorageDS::StorageDS(const std::string& filePath) :
+    m_filePath(filePath),
+    m_numEvents(0),
+    m_rangesDone(false) {
+  // Open the file once with everything but the hits to find which trees and
+  // branches it provides
+  StorageI probe(filePath, StorageIO::HITS);
+  m_numEvents = probe.getNumEvents();
+  const int content = probe.getContent();
+
+  if (content & StorageIO::EVENTINFO) {
+    const char* branches[] = {
+        "TimeStamp", "FrameNumber", "TriggerOffset", "TriggerInfo", "Invalid" };
+    const char* typeNames[] = {
+        "ULong64_t", "ULong64_t", "Int_t", "Int_t", "bool" };
+    const std::type_info* types[] = {
+        &typeid(ULong64_t), &typeid(ULong64_t),
+        &typeid(Int_t), &typeid(Int_t), &typeid(bool) };
+    for (size_t i = 0; i < 5; i++) {
+      if (probe.isEventInfoBranchOff(branches[i])) continue;
+      Column column;
+      column.name = branches[i];
+      column.typeName = typeNames[i];
+      column.type = types[i];
+      column.tree = StorageIO::EVENTINFO;
+      column.branch = branches[i];
+      addColumn(column);
+    }
+  }
+
+  if (content & StorageIO::CLUSTERS) {
+    const size_t ncolumns = sizeof(s_clusterColumns)/sizeof(ClusterColumn);
+    for (size_t nplane = 0; nplane < probe.getNumPlanes(); nplane++) {
+      std::stringstream ss;
+      ss << "Plane" << nplane << "_Cluster";
+      for (size_t i = 0; i < ncolumns; i++) {
+        if (probe.isClustersBranchOff(s_clusterColumns[i].branch)) continue;
+        Column column;
+        column.name = ss.str() + s_clusterColumns[i].branch;
+        column.typeName = "std::vector<double>";
+        column.type = &typeid(std::vector<double>);
+        column.tree = StorageIO::CLUSTERS;
+        column.branch = s_clusterColumns[i].branch;
+        column.plane = nplane;
+        column.clusterValue = s_clusterColumns[i].value;
+        addColumn(column);
+      }
+      // The track association needs both trees
+      if ((content & StorageIO::TRACKS) &&
+          !probe.isClustersBranchOff("InTrack")) {
+        Column column;
+        column.name = ss.str() + "InTrack";
+        column.typeName = "std::vector<int>";
+        column.type = &typeid(std::vector<int>);
+        column.tree = StorageIO::CLUSTERS | StorageIO::TRACKS;
+        column.branch = "InTrack";
+        column.plane = nplane;
+        addColumn(column);
+      }
+    }
+  }
+
+  if (content & StorageIO::TRACKS) {
+    const size_t ncolumns = sizeof(s_trackColumns)/sizeof(TrackColumn);
+    for (size_t i = 0; i < ncolumns; i++) {
+      if (probe.isTracksBranchOff(s_trackColumns[i].branch)) continue;
+      Column column;
+      column.name = std::string("Track_") + s_trackColumns[i].branch;
+      column.typeName = "std::vector<double>";
+      column.type = &typeid(std::vector<double>);
+      column.tree = StorageIO::TRACKS;
+      column.branch = s_trackColumns[i].branch;
+      column.trackValue = s_trackColumns[i].value;
+      addColumn(column);
+    }
+  }
+}
+
+StorageDS::~StorageDS() {
+  closeInputs();
+}
+
+void StorageDS::addColumn(const Column& column) {
+  m_columns.push_back(column);
+  m_columnNames.push_back(column.name);
+  m_requested.push_back(false);
+}
+
+size_t StorageDS::findColumn(std::string_view name) const {
+  for (size_t i = 0; i < m_columnNames.size(); i++)
+    if (m_columnNames[i] == name) return i;
+  throw std::runtime_error("StorageDS::findColumn: no such column");
+}
+
+void StorageDS::closeInputs() {
+  for (std::vector<Slot>::iterator it = m_slots.begin();
+      it != m_slots.end(); ++it) {
+    if (it->input) delete it->input;
+    it->input = 0;
+  }
+}
+
+void StorageDS::SetNSlots(unsigned int nSlots) {
+  if (nSlots == 0)
+    throw std::runtime_error("StorageDS::SetNSlots: need at least one slot");
+  closeInputs();
+  m_slots.assign(nSlots, Slot());
+
+  // Point each column at its value in each slot. The slots aren't moved
+  // after this, so the addresses remain valid.
+  const size_t ncolumns = m_columns.size();
+  for (std::vector<Slot>::iterator it = m_slots.begin();
+      it != m_slots.end(); ++it) {
+    Slot& slot = *it;
+    slot.doubles.resize(ncolumns);
+    slot.ints.resize(ncolumns);
+    slot.values.resize(ncolumns, 0);
+    for (size_t i = 0; i < ncolumns; i++) {
+      const Column& column = m_columns[i];
+      if (column.tree == StorageIO::EVENTINFO) {
+        if (column.branch == "TimeStamp") slot.values[i] = &slot.timeStamp;
+        else if (column.branch == "FrameNumber") slot.values[i] = &slot.frameNumber;
+        else if (column.branch == "TriggerOffset") slot.values[i] = &slot.triggerOffset;
+        else if (column.branch == "TriggerInfo") slot.values[i] = &slot.triggerInfo;
+        else if (column.branch == "Invalid") slot.values[i] = &slot.invalid;
+      }
+      else if (*column.type == typeid(std::vector<int>)) {
+        slot.values[i] = &slot.ints[i];
+      }
+      else {
+        slot.values[i] = &slot.doubles[i];
+      }
+    }
+  }
+}
+
+const std::vector<std::string>& StorageDS::GetColumnNames() const {
+  return m_columnNames;
+}
+
+bool StorageDS::HasColumn(std::string_view name) const {
+  for (size_t i = 0; i < m_columnNames.size(); i++)
+    if (m_columnNames[i] == name) return true;
+  return false;
+}
+
+std::string StorageDS::GetTypeName(std::string_view name) const {
+  return m_columns[findColumn(name)].typeName;
+}
+
+StorageDS::Record_t StorageDS::GetColumnReadersImpl(
+    std::string_view name,
+    const std::type_info& type) {
+  const size_t icolumn = findColumn(name);
+  if (*m_columns[icolumn].type != type)
+    throw std::runtime_error(
+        "StorageDS::GetColumnReadersImpl: wrong type for column");
+  if (m_slots.empty())
+    throw std::runtime_error(
+        "StorageDS::GetColumnReadersImpl: number of slots not set");
+
+  m_requested[icolumn] = true;
+
+  // The readers see the address of the value in each slot
+  Record_t readers;
+  for (size_t islot = 0; islot < m_slots.size(); islot++)
+    readers.push_back(&m_slots[islot].values[icolumn]);
+  return readers;
+}
+
+std::vector<std::pair<ULong64_t, ULong64_t> > StorageDS::GetEntryRanges() {
+  std::vector<std::pair<ULong64_t, ULong64_t> > ranges;
+  // All ranges are given on the first call, an empty list ends the loop
+  if (m_rangesDone || m_slots.empty()) return ranges;
+  m_rangesDone = true;
+
+  const ULong64_t size = (m_numEvents+m_slots.size()-1) / m_slots.size();
+  for (ULong64_t start = 0; start < m_numEvents; start += size)
+    ranges.push_back(std::make_pair(start, std::min(start+size, m_numEvents)));
+  return ranges;
+}
+
+bool StorageDS::SetEntry(unsigned int islot, ULong64_t entry) {
+  Slot& slot = m_slots[islot];
+  // No input is opened if no column is read
+  if (!slot.input) return true;
+
+  const Event& event = slot.input->readEvent(entry);
+  slot.timeStamp = event.getTimeStamp();
+  slot.frameNumber = event.getFrameNumber();
+  slot.triggerOffset = event.getTriggerOffset();
+  slot.triggerInfo = event.getTriggerInfo();
+  slot.invalid = event.getInvalid();
+
+  for (size_t icolumn = 0; icolumn < m_columns.size(); icolumn++) {
+    if (!m_requested[icolumn]) continue;
+    const Column& column = m_columns[icolumn];
+
+    if (column.trackValue) {
+      std::vector<double>& values = slot.doubles[icolumn];
+      values.resize(event.getNumTracks());
+      for (size_t i = 0; i < values.size(); i++)
+        values[i] = (event.getTrack(i).*column.trackValue)();
+    }
+
+    else if (column.clusterValue) {
+      const Plane& plane = event.getPlane(column.plane);
+      std::vector<double>& values = slot.doubles[icolumn];
+      values.resize(plane.getNumClusters());
+      for (size_t i = 0; i < values.size(); i++)
+        values[i] = (plane.getCluster(i).*column.clusterValue)();
+    }
+
+    else if (column.tree & StorageIO::CLUSTERS) {
+      const Plane& plane = event.getPlane(column.plane);
+      std::vector<int>& values = slot.ints[icolumn];
+      values.resize(plane.getNumClusters());
+      for (size_t i = 0; i < values.size(); i++) {
+        const Track* track = plane.getCluster(i).fetchTrack();
+        values[i] = track ? track->getIndex() : -1;
+      }
+    }
+  }
+
+  return true;
+}
+
+void StorageDS::Initialise() {
+  closeInputs();
+  m_rangesDone = false;
+
+  // Start with all trees off, and turn on those needed by the columns
+  int treeMask =
+      StorageIO::HITS | StorageIO::CLUSTERS |
+      StorageIO::TRACKS | StorageIO::EVENTINFO;
+  // Turn off the branches of columns which aren't read
+  std::set<std::string> clustersOff;
+  std::set<std::string> tracksOff;
+  std::set<std::string> eventInfoOff;
+
+  for (size_t icolumn = 0; icolumn < m_columns.size(); icolumn++) {
+    const Column& column = m_columns[icolumn];
+    // The track association is bound only if the tracks are read, and is
+    // then needed to link the clusters to their tracks
+    if (column.branch == "InTrack") continue;
+    if (column.tree == StorageIO::CLUSTERS) clustersOff.insert(column.branch);
+    else if (column.tree == StorageIO::TRACKS) tracksOff.insert(column.branch);
+    else if (column.tree == StorageIO::EVENTINFO) eventInfoOff.insert(column.branch);
+  }
+
+  // Branches are shared by the planes, so keep any branch which is read on
+  // at least one plane
+  for (size_t icolumn = 0; icolumn < m_columns.size(); icolumn++) {
+    if (!m_requested[icolumn]) continue;
+    const Column& column = m_columns[icolumn];
+    treeMask &= ~column.tree;
+    clustersOff.erase(column.branch);
+    tracksOff.erase(column.branch);
+    eventInfoOff.erase(column.branch);
+  }
+
+  // Nothing to read (e.g. only counting entries)
+  if (std::find(m_requested.begin(), m_requested.end(), true) ==
+      m_requested.end())
+    return;
+
+  for (std::vector<Slot>::iterator it = m_slots.begin();
+      it != m_slots.end(); ++it)
+    it->input = new StorageI(
+        m_filePath,
+        treeMask,
+        0,
+        0,
+        &clustersOff,
+        &tracksOff,
+        &eventInfoOff);
+}
+
+void StorageDS::Finalise() {
+  closeInputs();
+}
+
+ROOT::RDataFrame makeDataFrame(const std::string& filePath) {
+  return ROOT::RDataFrame(
+      std::unique_ptr<ROOT::RDF::RDataSource>(new StorageDS(filePath)));
+}
+
+}
@@ -5,14 +5,19 @@
 #include <sstream>
 #include <stdexcept>
 #include <set>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 
 #include <TFile.h>
 #include <TDirectory.h>
 #include <TTree.h>
 #include <TBranch.h>
+#include <TNamed.h>
 
 #include "storage/hit.h"
 #include "storage/cluster.h"
+#include "storage/clusterdictionary.h"
 #include "storage/plane.h"
 #include "storage/track.h"
 #include "storage/event.h"
@@ -25,6 +30,18 @@
 
 namespace Storage {
 
+// Stop reading the branches of `tree` listed in `off`, except for the branch
+// `count` which gives the array sizes of the others
+void disableBranches(
+    TTree& tree,
+    const std::set<std::string>& off,
+    const std::string& count) {
+  for (std::set<std::string>::const_iterator it = off.begin();
+      it != off.end(); ++it)
+    if (*it != count && tree.GetBranch(it->c_str()))
+      tree.SetBranchStatus(it->c_str(), false);
+}
+
 StorageI::StorageI(
     const std::string& filePath,
     int treeMask,
@@ -34,7 +51,18 @@ StorageI::StorageI(
     const std::set<std::string>* tracksBranchesOff,
     const std::set<std::string>* eventInfoBranchesOff) :
     // Initialize base with 0 planes and count them as they are read in
-    StorageIO(filePath, INPUT, 0, treeMask) {
+    StorageIO(filePath, INPUT, 0, treeMask),
+    m_filePath(filePath),
+    m_planeMask(),
+    m_hitWindows(),
+    m_hitSelection(MAX_HITS, 0),
+    m_hitMasked(MAX_HITS, 0),
+    m_calibrations(),
+    m_hitCharges(MAX_HITS, 0),
+    m_sortHits(false),
+    m_fileSorted(false) {
+
+  if (planeMask) m_planeMask = *planeMask;
 
   // Invert the mask to not have to check !
   treeMask = ~treeMask;
@@ -45,6 +73,10 @@ StorageI::StorageI(
   if (tracksBranchesOff) m_tracksBranchesOff = *tracksBranchesOff;
   if (eventInfoBranchesOff) m_eventInfoBranchesOff = *eventInfoBranchesOff;
 
+  // Clusters written by pattern need the file's patterns to be read
+  const bool hasPatterns =
+      (treeMask & CLUSTERS) && m_clusterPatterns.read(m_file);
+
   // Keep track of the number of planes read from the file (not the same as the
   // number stored in `m_numPlanes` since some might be masked)
   size_t planeCount = 0;
@@ -114,6 +146,10 @@ StorageI::StorageI(
         if (!hits->GetBranch("Timing")) m_hitsBranchesOff.insert("Timing");
         else hits->SetBranchAddress("Timing", hitTiming);
       }
+      if (!isHitsBranchOff("Charge")) {
+        if (!hits->GetBranch("Charge")) m_hitsBranchesOff.insert("Charge");
+        else hits->SetBranchAddress("Charge", hitCharge);
+      }
       // Also check if cluster tree is masked before enabling association branch
       if (!isHitsBranchOff("InCluster") && (treeMask & CLUSTERS)) {
         if (!hits->GetBranch("InCluster")) m_hitsBranchesOff.insert("InCluster");
@@ -127,25 +163,68 @@ StorageI::StorageI(
     if (clusters) {
       m_clustersTrees.push_back(clusters);
       clusters->SetBranchAddress("NClusters", &numClusters);
-      if (!isClustersBranchOff("PixX")) {
-        if (!clusters->GetBranch("PixX")) m_clustersBranchesOff.insert("PixX");
-        else clusters->SetBranchAddress("PixX", clusterPixX);
-      }
-      if (!isClustersBranchOff("PixY")) {
-        if (!clusters->GetBranch("PixY")) m_clustersBranchesOff.insert("PixY");
-        else clusters->SetBranchAddress("PixY", clusterPixY);
-      }
-      if (!isClustersBranchOff("PixY")) {
-        if (!clusters->GetBranch("PixY")) m_clustersBranchesOff.insert("PixY");
-        else clusters->SetBranchAddress("PixY", clusterPixY);
-      }
-      if (!isClustersBranchOff("PixErrX")) {
-        if (!clusters->GetBranch("PixErrX")) m_clustersBranchesOff.insert("PixErrX");
-        else clusters->SetBranchAddress("PixErrX", clusterPixErrX);
+
+      // The writer stores either all planes by pattern, or none
+      const bool patterned = clusters->GetBranch("Pattern") != 0;
+      if (m_clustersTrees.size() == 1) m_clustersPatterned = patterned;
+      else if (patterned != m_clustersPatterned)
+        throw std::runtime_error(
+            "StorageI::StorageI: planes don't all store clusters by pattern");
+      if (patterned && !hasPatterns)
+        throw std::runtime_error(
+            "StorageI::StorageI: clusters stored by pattern without patterns");
+
+      // The pixel values of patterned clusters come from the pattern
+      // branches, whose values are needed to read back any cluster
+      if (patterned) {
+        if (!isClustersBranchOff("Pattern"))
+          clusters->SetBranchAddress("Pattern", clusterPattern);
+        if (!isClustersBranchOff("AnchorX")) {
+          if (!clusters->GetBranch("AnchorX")) m_clustersBranchesOff.insert("AnchorX");
+          else clusters->SetBranchAddress("AnchorX", clusterAnchorX);
+        }
+        if (!isClustersBranchOff("AnchorY")) {
+          if (!clusters->GetBranch("AnchorY")) m_clustersBranchesOff.insert("AnchorY");
+          else clusters->SetBranchAddress("AnchorY", clusterAnchorY);
+        }
+        if (!isClustersBranchOff("NOthers")) {
+          if (!clusters->GetBranch("NOthers")) m_clustersBranchesOff.insert("NOthers");
+          else clusters->SetBranchAddress("NOthers", &numOthers);
+        }
+        if (!isClustersBranchOff("OtherPixX")) {
+          if (!clusters->GetBranch("OtherPixX")) m_clustersBranchesOff.insert("OtherPixX");
+          else clusters->SetBranchAddress("OtherPixX", otherPixX);
+        }
+        if (!isClustersBranchOff("OtherPixY")) {
+          if (!clusters->GetBranch("OtherPixY")) m_clustersBranchesOff.insert("OtherPixY");
+          else clusters->SetBranchAddress("OtherPixY", otherPixY);
+        }
+        if (!isClustersBranchOff("OtherPixErrX")) {
+          if (!clusters->GetBranch("OtherPixErrX")) m_clustersBranchesOff.insert("OtherPixErrX");
+          else clusters->SetBranchAddress("OtherPixErrX", otherPixErrX);
+        }
+        if (!isClustersBranchOff("OtherPixErrY")) {
+          if (!clusters->GetBranch("OtherPixErrY")) m_clustersBranchesOff.insert("OtherPixErrY");
+          else clusters->SetBranchAddress("OtherPixErrY", otherPixErrY);
+        }
       }
-      if (!isClustersBranchOff("PixErrY")) {
-        if (!clusters->GetBranch("PixErrY")) m_clustersBranchesOff.insert("PixErrY");
-        else clusters->SetBranchAddress("PixErrY", clusterPixErrY);
+      else {
+        if (!isClustersBranchOff("PixX")) {
+          if (!clusters->GetBranch("PixX")) m_clustersBranchesOff.insert("PixX");
+          else clusters->SetBranchAddress("PixX", clusterPixX);
+        }
+        if (!isClustersBranchOff("PixY")) {
+          if (!clusters->GetBranch("PixY")) m_clustersBranchesOff.insert("PixY");
+          else clusters->SetBranchAddress("PixY", clusterPixY);
+        }
+        if (!isClustersBranchOff("PixErrX")) {
+          if (!clusters->GetBranch("PixErrX")) m_clustersBranchesOff.insert("PixErrX");
+          else clusters->SetBranchAddress("PixErrX", clusterPixErrX);
+        }
+        if (!isClustersBranchOff("PixErrY")) {
+          if (!clusters->GetBranch("PixErrY")) m_clustersBranchesOff.insert("PixErrY");
+          else clusters->SetBranchAddress("PixErrY", clusterPixErrY);
+        }
       }
       if (!isClustersBranchOff("PosX")) {
         if (!clusters->GetBranch("PosX")) m_clustersBranchesOff.insert("PosX");
@@ -190,6 +269,11 @@ StorageI::StorageI(
     throw std::runtime_error(
         "StorageI::StorageI: zero planes read from file");
 
+  // The writer flags files whose hits it stored in order
+  TNamed* sorted = 0;
+  m_file.GetObject(HITS_SORTED_NAME, sorted);
+  m_fileSorted = sorted != 0;
+
   if (!m_hitsTrees.empty() && m_hitsTrees.size() != m_numPlanes)
     throw std::runtime_error(
         "StorageI::StorageI: hits trees number does not match planes");
@@ -281,6 +365,19 @@ StorageI::StorageI(
     }
   }
 
+  // Don't read the branches which are turned off, their buffers aren't even
+  // associated to memory
+  for (std::vector<TTree*>::iterator it = m_hitsTrees.begin();
+      it != m_hitsTrees.end(); ++it)
+    disableBranches(**it, m_hitsBranchesOff, "NHits");
+  for (std::vector<TTree*>::iterator it = m_clustersTrees.begin();
+      it != m_clustersTrees.end(); ++it)
+    disableBranches(**it, m_clustersBranchesOff, "NClusters");
+  if (m_tracksTree)
+    disableBranches(*m_tracksTree, m_tracksBranchesOff, "NTracks");
+  if (m_eventInfoTree)
+    disableBranches(*m_eventInfoTree, m_eventInfoBranchesOff, "");
+
   // Check if tracks are given, clustesr are given, but clusters aren't
   // associated to tracks
   if (!m_tracksTree &&
@@ -325,6 +422,20 @@ StorageI::StorageI(
 }
 
 Event& StorageI::readEvent(Long64_t n) {
+  // This will clear the previous event and cache its objects
+  Event& event = newEvent();
+  readEvent(n, event);
+  return event;
+}
+
+void StorageI::readEvent(Long64_t n, Event& event) {
+  if (event.getNumPlanes() != m_numPlanes)
+    throw std::runtime_error(
+        "StorageI::readEvent: event doesn't match the input planes");
+  if (event.getNumHits() || event.getNumClusters() || event.getNumTracks())
+    throw std::runtime_error(
+        "StorageI::readEvent: event isn't empty");
+
   // NOTE: fill in reversed order: tracks first, hits last. This is so that
   // once a hit is produced, it can immediately recieve the address of its
   // parent cluster, likewise for clusters and track.
@@ -347,8 +458,6 @@ Event& StorageI::readEvent(Long64_t n) {
   // NOTE: masks need to be re-applied here. The array values aren't zeroed
   // so they can't be read in
 
-  // This will clear the previous event and cache its objects
-  Event& event = newEvent();
   // Fill the event info fro what was read from the event info tree
   event.setTimeStamp(timeStamp);
   event.setFrameNumber(frameNumber);
@@ -368,6 +477,13 @@ Event& StorageI::readEvent(Long64_t n) {
     track.setChi2(trackChi2[ntrack]);
   }
 
+  // Patterned clusters only get the pixel values whose branches are read,
+  // like the pixel branches of other clusters
+  const bool readPatterns = !isClustersBranchOff("Pattern");
+  const bool readAnchorX = !isClustersBranchOff("AnchorX");
+  const bool readAnchorY = !isClustersBranchOff("AnchorY");
+  const bool readOthers = !isClustersBranchOff("NOthers");
+
   for (size_t nplane = 0; nplane < m_numPlanes; nplane++) {
     // Try to read the hits tree for this plane
     if (!m_hitsTrees.empty() && m_hitsTrees[nplane]->GetEntry(n) <= 0)
@@ -379,19 +495,65 @@ Event& StorageI::readEvent(Long64_t n) {
       throw std::runtime_error(
           "StorageIO::readEvent: error reading clusters tree");
 
+    // Clusters without pattern take the next values of the others
+    Int_t nother = 0;
+
+    // Patterned files hold no cluster positions, they are placed if possible
+    const PixelMap* pixelMap =
+        m_clustersPatterned && !m_pixelMaps.empty() && m_pixelMaps[nplane].set ?
+        &m_pixelMaps[nplane] : 0;
+
     // Generate the cluster objects
     for (Int_t ncluster = 0; ncluster < numClusters; ncluster++) {
       Cluster& cluster = event.newCluster(nplane);
-      cluster.setPix(clusterPixX[ncluster], clusterPixY[ncluster]);
-      cluster.setPixErr(clusterPixErrX[ncluster], clusterPixErrY[ncluster]);
-      cluster.setPos(
-          clusterPosX[ncluster],
-          clusterPosY[ncluster],
-          clusterPosZ[ncluster]);
-      cluster.setPosErr(
-          clusterPosErrX[ncluster],
-          clusterPosErrY[ncluster],
-          clusterPosErrZ[ncluster]);
+      if (!m_clustersPatterned) {
+        cluster.setPix(clusterPixX[ncluster], clusterPixY[ncluster]);
+        cluster.setPixErr(clusterPixErrX[ncluster], clusterPixErrY[ncluster]);
+      }
+      else if (readPatterns && clusterPattern[ncluster] >= 0) {
+        if ((size_t)clusterPattern[ncluster] >= m_clusterPatterns.getNumPatterns())
+          throw std::runtime_error(
+              "StorageI::readEvent: cluster pattern out of range");
+        const ClusterDictionary::Pattern& pattern =
+            m_clusterPatterns.getPattern(clusterPattern[ncluster]);
+        cluster.setPix(
+            readAnchorX ? clusterAnchorX[ncluster] + pattern.offsetX : 0,
+            readAnchorY ? clusterAnchorY[ncluster] + pattern.offsetY : 0);
+        cluster.setPixErr(pattern.errX, pattern.errY);
+      }
+      else if (readPatterns && readOthers) {
+        if (nother >= numOthers)
+          throw std::runtime_error(
+              "StorageI::readEvent: missing values of clusters without pattern");
+        cluster.setPix(otherPixX[nother], otherPixY[nother]);
+        cluster.setPixErr(otherPixErrX[nother], otherPixErrY[nother]);
+        nother += 1;
+      }
+      if (pixelMap) {
+        const double (*map)[3] = pixelMap->map;
+        const double col = cluster.getPixX();
+        const double row = cluster.getPixY();
+        cluster.setPos(
+            map[0][0]*col + map[0][1]*row + map[0][2],
+            map[1][0]*col + map[1][1]*row + map[1][2],
+            map[2][0]*col + map[2][1]*row + map[2][2]);
+        const double colErr = cluster.getPixErrX();
+        const double rowErr = cluster.getPixErrY();
+        cluster.setPosErr(
+            std::fabs(map[0][0]*colErr + map[0][1]*rowErr),
+            std::fabs(map[1][0]*colErr + map[1][1]*rowErr),
+            std::fabs(map[2][0]*colErr + map[2][1]*rowErr));
+      }
+      else {
+        cluster.setPos(
+            clusterPosX[ncluster],
+            clusterPosY[ncluster],
+            clusterPosZ[ncluster]);
+        cluster.setPosErr(
+            clusterPosErrX[ncluster],
+            clusterPosErrY[ncluster],
+            clusterPosErrZ[ncluster]);
+      }
       cluster.setTiming(clusterTiming[ncluster]);
       cluster.setValue(clusterValue[ncluster]);
 
@@ -402,28 +564,34 @@ Event& StorageI::readEvent(Long64_t n) {
       }
     }
 
-    // Generate a list of all hit objects
-    for (Int_t nhit = 0; nhit < numHits; nhit++) {
-      const bool isMasked = 
-          !m_noiseMasks.empty() &&
-          m_noiseMasks[nplane].at(hitPixX[nhit], hitPixY[nhit]);
-
-      // Don't make a hit object for masked hits if they are to be removed.
-      // This will also prevent it being written out.
-      if (isMasked && m_maskMode == REMOVE) {
-        // If the hit was clustered, the cluster will be broken (it will try to
-        // use a non-existent hit)
-        if (hitInCluster[nhit] > 0) throw std::runtime_error(
-              "StorageIO::readEvent: masking tried to remove a clustered hit");
-        continue;
-      }
+    // Drop hits outside the plane's window, and masked hits if they are to
+    // be removed. This will also prevent them being written out.
+    const Int_t nselected = selectHits(nplane);
+
+    // Look up the charge of the selected hits if calibrated
+    const bool calibrated =
+        !m_calibrations.empty() && m_calibrations[nplane].table;
+    if (calibrated) calibrateHits(nplane, nselected);
+    const bool readCharge = !isHitsBranchOff("Charge");
+
+    // Masked hits which reach this point are kept but flagged
+    const bool flagMasked = m_maskMode == PASSIVE &&
+        !m_noiseMasks.empty() && !m_noiseMasks[nplane].words.empty();
+
+    // Generate a list of the selected hit objects
+    for (Int_t isel = 0; isel < nselected; isel++) {
+      const Int_t nhit = m_hitSelection[isel];
+      const bool isMasked = flagMasked && m_hitMasked[isel];
 
       Hit& hit = event.newHit(nplane);
       hit.setPix(hitPixX[nhit], hitPixY[nhit]);
       hit.setPos(hitPosX[nhit], hitPosY[nhit], hitPosZ[nhit]);
       hit.setValue(hitValue[nhit]);
+      // Charge from the calibration, else as stored, else the value
+      if (calibrated) hit.setCharge(m_hitCharges[isel]);
+      else if (readCharge) hit.setCharge(hitCharge[nhit]);
       hit.setTiming(hitTiming[nhit]);
-      hit.setMasked(isMasked);  // Possible the hit is masked but not to be removed
+      hit.setMasked(isMasked);
 
       // If this hit is in a cluster, mark this (and the clusters tree is active)
       if (!m_clustersTrees.empty() && hitInCluster[nhit] > 0) {
@@ -431,9 +599,296 @@ Event& StorageI::readEvent(Long64_t n) {
         cluster.addHit(hit);  // Bidirectional linking
       }
     }
+
+    // Clusters were given their hits in the new order, so the association
+    // holds. Check the order and index the rows.
+    if (m_sortHits) event.getPlane(nplane).indexRows();
   }  // Loop over planes
+}
 
-  return event;
+Int_t StorageI::selectHits(size_t nplane) {
+  Int_t nselected = 0;
+  // Non-zero if a hit belonging to a cluster was dropped
+  Int_t lostClustered = 0;
+
+  if (m_hitWindows.empty()) {
+    for (Int_t nhit = 0; nhit < numHits; nhit++)
+      m_hitSelection[nhit] = nhit;
+    nselected = numHits;
+  }
+
+  else {
+    const HitWindow& window = m_hitWindows[nplane];
+    // Test `min <= val <= max` as `val-min <= max-min` in unsigned arithmetic,
+    // so that each bound costs a single comparison
+    const UInt_t minX = window.minPixX;
+    const UInt_t minY = window.minPixY;
+    const UInt_t minT = window.minTiming;
+    const UInt_t spanX = (UInt_t)window.maxPixX - minX;
+    const UInt_t spanY = (UInt_t)window.maxPixY - minY;
+    const UInt_t spanT = (UInt_t)window.maxTiming - minT;
+
+    // Branch-free compaction: every index is written, but the output only
+    // advances past it if the hit passes
+    Int_t* selection = &m_hitSelection[0];
+    for (Int_t nhit = 0; nhit < numHits; nhit++) {
+      const Int_t pass =
+          ((UInt_t)hitPixX[nhit] - minX <= spanX) &
+          ((UInt_t)hitPixY[nhit] - minY <= spanY) &
+          ((UInt_t)hitTiming[nhit] - minT <= spanT);
+      selection[nselected] = nhit;
+      nselected += pass;
+      lostClustered |= (1-pass) & (hitInCluster[nhit] > 0);
+    }
+  }
+
+  // Order the selection before the masks and charges are computed, since
+  // those follow the selection's order
+  if (m_sortHits && !m_fileSorted) sortHits(nselected);
+
+  // Look up the selected hits in the noise mask, and further compact the
+  // selection by removing them if requested
+  if (!m_noiseMasks.empty() && !m_noiseMasks[nplane].words.empty()) {
+    maskHits(nplane, nselected);
+
+    if (m_maskMode == REMOVE) {
+      Int_t nkept = 0;
+      for (Int_t isel = 0; isel < nselected; isel++) {
+        const Int_t nhit = m_hitSelection[isel];
+        const Int_t masked = m_hitMasked[isel];
+        m_hitSelection[nkept] = nhit;
+        nkept += 1-masked;
+        lostClustered |= masked & (hitInCluster[nhit] > 0);
+      }
+      nselected = nkept;
+    }
+  }
+
+  // If the hit was clustered, the cluster will be broken (it will try to use a
+  // non-existent hit)
+  if (lostClustered) throw std::runtime_error(
+        "StorageI::selectHits: tried to remove a clustered hit");
+
+  return nselected;
+}
+
+void StorageI::sortHits(Int_t nselected) {
+  if (nselected < 2) return;
+
+  // Pack the row and column into one key. Flipping the sign bits orders
+  // negative pixels before positive ones as unsigned integers.
+  ULong64_t* keys = &m_sortKeys[0];
+  for (Int_t isel = 0; isel < nselected; isel++) {
+    const Int_t nhit = m_hitSelection[isel];
+    keys[isel] =
+        ((ULong64_t)((UInt_t)hitPixY[nhit] ^ 0x80000000u) << 32) |
+        (ULong64_t)((UInt_t)hitPixX[nhit] ^ 0x80000000u);
+  }
+
+  // Count the values of each byte of the keys in one pass
+  Int_t counts[8][256] = {{0}};
+  for (Int_t isel = 0; isel < nselected; isel++)
+    for (int ibyte = 0; ibyte < 8; ibyte++)
+      counts[ibyte][(keys[isel] >> (8*ibyte)) & 0xFF] += 1;
+
+  // Least significant byte first: each pass is stable, so the previous
+  // passes' order holds among equal bytes
+  ULong64_t* keysTemp = &m_sortKeysTemp[0];
+  Int_t* selection = &m_hitSelection[0];
+  Int_t* selectionTemp = &m_sortSelection[0];
+  for (int ibyte = 0; ibyte < 8; ibyte++) {
+    Int_t* offsets = counts[ibyte];
+    // All keys share this byte (e.g. the high bytes of small pixel indices)
+    if (offsets[(keys[0] >> (8*ibyte)) & 0xFF] == nselected) continue;
+
+    Int_t total = 0;
+    for (int ivalue = 0; ivalue < 256; ivalue++) {
+      const Int_t count = offsets[ivalue];
+      offsets[ivalue] = total;
+      total += count;
+    }
+
+    for (Int_t isel = 0; isel < nselected; isel++) {
+      const Int_t pos = offsets[(keys[isel] >> (8*ibyte)) & 0xFF]++;
+      keysTemp[pos] = keys[isel];
+      selectionTemp[pos] = selection[isel];
+    }
+
+    std::swap(keys, keysTemp);
+    std::swap(selection, selectionTemp);
+  }
+
+  // After an odd number of passes, the result is in the buffers
+  if (selection != &m_hitSelection[0])
+    std::copy(selection, selection+nselected, m_hitSelection.begin());
+}
+
+void StorageI::maskHits(size_t nplane, Int_t nselected) {
+  const NoiseMask& mask = m_noiseMasks[nplane];
+  const ULong64_t* words = &mask.words[0];
+  const Int_t* selection = &m_hitSelection[0];
+  Int_t* masked = &m_hitMasked[0];
+  const UInt_t ncols = mask.ncols;
+  const UInt_t nrows = mask.nrows;
+
+  // Test the bit of each hit in the bitmap. Hits outside of the mask look up
+  // bit 0 and are never masked (it is up to the hit window to drop them).
+  for (Int_t isel = 0; isel < nselected; isel++) {
+    const Int_t nhit = selection[isel];
+    const UInt_t col = hitPixX[nhit];
+    const UInt_t row = hitPixY[nhit];
+    const Int_t inside = (col < ncols) & (row < nrows);
+    const UInt_t bit = inside ? row*ncols+col : 0;
+    masked[isel] = inside & (Int_t)((words[bit>>6] >> (bit&63)) & 1);
+  }
+}
+
+void StorageI::calibrateHits(size_t nplane, Int_t nselected) {
+  const Calibration& calib = m_calibrations[nplane];
+  const float* table = calib.table;
+  const Int_t* selection = &m_hitSelection[0];
+  float* charges = &m_hitCharges[0];
+  const UInt_t ncols = calib.ncols;
+  const UInt_t nrows = calib.nrows;
+  const Int_t nterms = calib.nterms;
+
+  // Non-zero if a hit lies outside the table
+  Int_t outside = 0;
+
+  // Evaluate the polynomial of each hit's pixel. Indices are computed
+  // without branches (hits outside the table use pixel 0 and are reported
+  // afterwards). The index is unsigned, so that the garbage index of a hit
+  // outside the table wraps instead of overflowing.
+  for (Int_t isel = 0; isel < nselected; isel++) {
+    const Int_t nhit = selection[isel];
+    const UInt_t col = hitPixX[nhit];
+    const UInt_t row = hitPixY[nhit];
+    const Int_t inside = (col < ncols) & (row < nrows);
+    const size_t pixel = (size_t)inside * ((size_t)row*ncols + col);
+    const float* coeffs = table + pixel*nterms;
+    const float value = hitValue[nhit];
+    float charge = 0;
+    for (Int_t iterm = nterms-1; iterm >= 0; iterm--)
+      charge = charge*value + coeffs[iterm];
+    charges[isel] = charge;
+    outside |= 1-inside;
+  }
+
+  if (outside) throw std::runtime_error(
+        "StorageI::calibrateHits: hit outside of the calibration table");
+}
+
+StorageI* StorageI::duplicate() const {
+  // The branch lists now also flag branches missing from the file, which
+  // gives the same result when re-opening it
+  StorageI* input = new StorageI(
+      m_filePath,
+      m_treeMask,
+      m_planeMask.empty() ? 0 : &m_planeMask,
+      &m_hitsBranchesOff,
+      &m_clustersBranchesOff,
+      &m_tracksBranchesOff,
+      &m_eventInfoBranchesOff);
+
+  // Calibration tables aren't owned, so both inputs can point to them
+  input->m_hitWindows = m_hitWindows;
+  input->m_calibrations = m_calibrations;
+  input->m_pixelMaps = m_pixelMaps;
+  input->m_noiseMasks = m_noiseMasks;
+  input->m_maskMode = m_maskMode;
+  input->setSortHits(m_sortHits);
+
+  return input;
+}
+
+bool StorageI::HitWindow::isOpen() const {
+  return
+      minPixX == std::numeric_limits<Int_t>::min() &&
+      maxPixX == std::numeric_limits<Int_t>::max() &&
+      minPixY == std::numeric_limits<Int_t>::min() &&
+      maxPixY == std::numeric_limits<Int_t>::max() &&
+      minTiming == std::numeric_limits<Int_t>::min() &&
+      maxTiming == std::numeric_limits<Int_t>::max();
+}
+
+void StorageI::setSortHits(bool sort) {
+  m_sortHits = sort;
+  // The buffers are only needed to sort, and only once
+  if (m_sortHits && m_sortKeys.empty()) {
+    m_sortKeys.assign(MAX_HITS, 0);
+    m_sortKeysTemp.assign(MAX_HITS, 0);
+    m_sortSelection.assign(MAX_HITS, 0);
+  }
+}
+
+void StorageI::setHitWindow(size_t nplane, const HitWindow& window) {
+  if (nplane >= m_numPlanes)
+    throw std::out_of_range(
+        "StorageI::setHitWindow: plane out of range");
+  if (window.maxPixX < window.minPixX ||
+      window.maxPixY < window.minPixY ||
+      window.maxTiming < window.minTiming)
+    throw std::runtime_error(
+        "StorageI::setHitWindow: window bounds are inverted");
+
+  // The window is applied to the values in memory, which remain zero for
+  // branches that aren't read
+  const bool cutsPix =
+      window.minPixX != std::numeric_limits<Int_t>::min() ||
+      window.maxPixX != std::numeric_limits<Int_t>::max() ||
+      window.minPixY != std::numeric_limits<Int_t>::min() ||
+      window.maxPixY != std::numeric_limits<Int_t>::max();
+  const bool cutsTiming =
+      window.minTiming != std::numeric_limits<Int_t>::min() ||
+      window.maxTiming != std::numeric_limits<Int_t>::max();
+  if (cutsPix && (isHitsBranchOff("PixX") || isHitsBranchOff("PixY")))
+    throw std::runtime_error(
+        "StorageI::setHitWindow: pixel window needs the pixel branches");
+  if (cutsTiming && isHitsBranchOff("Timing"))
+    throw std::runtime_error(
+        "StorageI::setHitWindow: timing window needs the timing branch");
+
+  // Windows are only applied once at least one is set
+  if (m_hitWindows.empty()) m_hitWindows.resize(m_numPlanes);
+  m_hitWindows[nplane] = window;
+}
+
+void StorageI::setCalibration(
+    size_t nplane,
+    const float* table,
+    Int_t ncols,
+    Int_t nrows,
+    Int_t nterms) {
+  if (nplane >= m_numPlanes)
+    throw std::out_of_range(
+        "StorageI::setCalibration: plane out of range");
+  if (!table || ncols <= 0 || nrows <= 0 || nterms <= 0)
+    throw std::runtime_error(
+        "StorageI::setCalibration: empty calibration table");
+  if (isHitsBranchOff("PixX") || isHitsBranchOff("PixY") ||
+      isHitsBranchOff("Value"))
+    throw std::runtime_error(
+        "StorageI::setCalibration: needs the pixel and value branches");
+
+  if (m_calibrations.empty()) m_calibrations.resize(m_numPlanes);
+  Calibration& calib = m_calibrations[nplane];
+  calib.table = table;
+  calib.ncols = ncols;
+  calib.nrows = nrows;
+  calib.nterms = nterms;
+}
+
+void StorageI::setPixelMap(size_t nplane, const double (*map)[3]) {
+  if (nplane >= m_numPlanes)
+    throw std::out_of_range(
+        "StorageI::setPixelMap: plane out of range");
+
+  if (m_pixelMaps.empty()) m_pixelMaps.resize(m_numPlanes);
+  PixelMap& pixelMap = m_pixelMaps[nplane];
+  for (size_t i = 0; i < 3; i++)
+    for (size_t j = 0; j < 3; j++)
+      pixelMap.map[i][j] = map[i][j];
+  pixelMap.set = true;
 }
 
 }
@@ -33,6 +33,8 @@ StorageIO::StorageIO(
     m_treeMask(treeMask),
     m_maskMode(REMOVE),
     m_numEvents(0),
+    m_clusterPatterns(),
+    m_clustersPatterned(false),
     m_event(0),
     m_tracksTree(0),
     m_eventInfoTree(0) {
@@ -160,4 +162,44 @@ bool StorageIO::isEventInfoBranchOff(const std::string& name) const {
   return m_eventInfoBranchesOff.find(name) != m_eventInfoBranchesOff.end();
 }
 
+int StorageIO::getContent() const {
+  int content = NONE;
+  if (!m_hitsTrees.empty()) content |= HITS;
+  if (!m_clustersTrees.empty()) content |= CLUSTERS;
+  if (m_tracksTree) content |= TRACKS;
+  if (m_eventInfoTree) content |= EVENTINFO;
+  return content;
+}
+
+void StorageIO::setNoiseMask(
+    size_t nplane,
+    const std::vector<bool>& mask,
+    size_t ncols,
+    size_t nrows) {
+  if (nplane >= m_numPlanes)
+    throw std::runtime_error("StorageIO::setNoiseMask: plane out of range");
+  if (mask.size() != ncols*nrows || mask.empty())
+    throw std::runtime_error(
+        "StorageIO::setNoiseMask: mask doesn't match the plane size");
+
+  // Planes without a mask keep an empty bitmap
+  if (m_noiseMasks.empty()) m_noiseMasks.resize(m_numPlanes);
+
+  NoiseMask& noiseMask = m_noiseMasks[nplane];
+  noiseMask.ncols = ncols;
+  noiseMask.nrows = nrows;
+  // Pack the mask 64 pixels at a time
+  noiseMask.words.assign((mask.size()+63)/64, 0);
+  for (size_t ipix = 0; ipix < mask.size(); ipix++)
+    if (mask[ipix]) noiseMask.words[ipix>>6] |= (ULong64_t)1 << (ipix&63);
+}
+
+const StorageIO::NoiseMask& StorageIO::getNoiseMask(size_t nplane) const {
+  if (nplane >= m_numPlanes)
+    throw std::runtime_error("StorageIO::getNoiseMask: plane out of range");
+  // Shared empty mask for files without any masked plane
+  static const NoiseMask empty;
+  return m_noiseMasks.empty() ? empty : m_noiseMasks[nplane];
+}
+
 }
@@ -5,14 +5,18 @@
 #include <sstream>
 #include <stdexcept>
 #include <set>
+#include <cmath>
+#include <algorithm>
 
 #include <TFile.h>
 #include <TDirectory.h>
 #include <TTree.h>
 #include <TBranch.h>
+#include <TNamed.h>
 
 #include "storage/hit.h"
 #include "storage/cluster.h"
+#include "storage/clusterdictionary.h"
 #include "storage/plane.h"
 #include "storage/track.h"
 #include "storage/event.h"
@@ -32,8 +36,11 @@ StorageO::StorageO(
     const std::set<std::string>* hitsBranchesOff,
     const std::set<std::string>* clustersBranchesOff,
     const std::set<std::string>* tracksBranchesOff,
-    const std::set<std::string>* eventInfoBranchesOff) :
-    StorageIO(filePath, OUTPUT, numPlanes, treeMask) {
+    const std::set<std::string>* eventInfoBranchesOff,
+    const ClusterDictionary* clusterPatterns) :
+    StorageIO(filePath, OUTPUT, numPlanes, treeMask),
+    m_hitsSorted(true),
+    m_patternTolerance(1e-6) {
 
   // Copy any/all given branch masks
   if (hitsBranchesOff) m_hitsBranchesOff = *hitsBranchesOff;
@@ -44,6 +51,17 @@ StorageO::StorageO(
   // Avoid always checking !
   treeMask = ~treeMask;
 
+  // Patterns only matter if the clusters are written, and turning off the
+  // pattern branch stores them in full instead
+  if (clusterPatterns && (treeMask & CLUSTERS) &&
+      !isClustersBranchOff("Pattern")) {
+    if (clusterPatterns->getNumPatterns() == 0)
+      throw std::runtime_error(
+          "StorageO::StorageO: cluster dictionary has no patterns");
+    m_clusterPatterns = *clusterPatterns;
+    m_clustersPatterned = true;
+  }
+
   // Make hit and clusters trees for all the planes
   for (size_t nplane = 0; nplane < m_numPlanes; nplane++) {
     // Make a directory for this plane
@@ -77,6 +95,8 @@ StorageO::StorageO(
         hitsTreePl->Branch("Value", hitValue, "HitValue[NHits]/I");
       if (!isHitsBranchOff("Timing"))
         hitsTreePl->Branch("Timing", hitTiming, "HitTiming[NHits]/I");
+      if (!isHitsBranchOff("Charge"))
+        hitsTreePl->Branch("Charge", hitCharge, "HitCharge[NHits]/F");
       if (treeMask & CLUSTERS)
         hitsTreePl->Branch("InCluster", hitInCluster, "HitInCluster[NHits]/I");
     }
@@ -85,26 +105,53 @@ StorageO::StorageO(
       TTree* clustersTreePl = new TTree("Clusters", "Clusters");
       m_clustersTrees.push_back(clustersTreePl);
       clustersTreePl->Branch("NClusters", &numClusters, "NClusters/I");
-      if (!isClustersBranchOff("PixX"))
-        clustersTreePl->Branch("PixX", clusterPixX, "ClusterPixX[NClusters]/D");
-      if (!isClustersBranchOff("PixY"))
-        clustersTreePl->Branch("PixY", clusterPixY, "ClusterPixY[NClusters]/D");
-      if (!isClustersBranchOff("PixErrX"))
-        clustersTreePl->Branch("PixErrX", clusterPixErrX, "ClusterPixErrX[NClusters]/D");
-      if (!isClustersBranchOff("PixErrY"))
-        clustersTreePl->Branch("PixErrY", clusterPixErrY, "ClusterPixErrY[NClusters]/D");
-      if (!isClustersBranchOff("PosX"))
-        clustersTreePl->Branch("PosX", clusterPosX, "ClusterPosX[NClusters]/D");
-      if (!isClustersBranchOff("PosY"))
-        clustersTreePl->Branch("PosY", clusterPosY, "ClusterPosY[NClusters]/D");
-      if (!isClustersBranchOff("PosZ"))
-        clustersTreePl->Branch("PosZ", clusterPosZ, "ClusterPosZ[NClusters]/D");
-      if (!isClustersBranchOff("PosErrX"))
-        clustersTreePl->Branch("PosErrX", clusterPosErrX, "ClusterPosErrX[NClusters]/D");
-      if (!isClustersBranchOff("PosErrY"))
-        clustersTreePl->Branch("PosErrY", clusterPosErrY, "ClusterPosErrY[NClusters]/D");
-      if (!isClustersBranchOff("PosErrZ"))
-        clustersTreePl->Branch("PosErrZ", clusterPosErrZ, "ClusterPosErrZ[NClusters]/D");
+      // Patterned clusters replace the pixel branches by the pattern and
+      // anchor, and the values in full of the others
+      if (m_clustersPatterned) {
+        clustersTreePl->Branch("Pattern", clusterPattern, "ClusterPattern[NClusters]/I");
+        if (!isClustersBranchOff("AnchorX"))
+          clustersTreePl->Branch("AnchorX", clusterAnchorX, "ClusterAnchorX[NClusters]/I");
+        if (!isClustersBranchOff("AnchorY"))
+          clustersTreePl->Branch("AnchorY", clusterAnchorY, "ClusterAnchorY[NClusters]/I");
+        // The other values are sized by their count
+        if (!isClustersBranchOff("NOthers")) {
+          clustersTreePl->Branch("NOthers", &numOthers, "NOthers/I");
+          if (!isClustersBranchOff("OtherPixX"))
+            clustersTreePl->Branch("OtherPixX", otherPixX, "OtherPixX[NOthers]/D");
+          if (!isClustersBranchOff("OtherPixY"))
+            clustersTreePl->Branch("OtherPixY", otherPixY, "OtherPixY[NOthers]/D");
+          if (!isClustersBranchOff("OtherPixErrX"))
+            clustersTreePl->Branch("OtherPixErrX", otherPixErrX, "OtherPixErrX[NOthers]/D");
+          if (!isClustersBranchOff("OtherPixErrY"))
+            clustersTreePl->Branch("OtherPixErrY", otherPixErrY, "OtherPixErrY[NOthers]/D");
+        }
+      }
+      else {
+        if (!isClustersBranchOff("PixX"))
+          clustersTreePl->Branch("PixX", clusterPixX, "ClusterPixX[NClusters]/D");
+        if (!isClustersBranchOff("PixY"))
+          clustersTreePl->Branch("PixY", clusterPixY, "ClusterPixY[NClusters]/D");
+        if (!isClustersBranchOff("PixErrX"))
+          clustersTreePl->Branch("PixErrX", clusterPixErrX, "ClusterPixErrX[NClusters]/D");
+        if (!isClustersBranchOff("PixErrY"))
+          clustersTreePl->Branch("PixErrY", clusterPixErrY, "ClusterPixErrY[NClusters]/D");
+      }
+      // Positions follow from the pixel values, so patterned clusters leave
+      // them to be rebuilt by the reader from the plane alignment
+      if (!m_clustersPatterned) {
+        if (!isClustersBranchOff("PosX"))
+          clustersTreePl->Branch("PosX", clusterPosX, "ClusterPosX[NClusters]/D");
+        if (!isClustersBranchOff("PosY"))
+          clustersTreePl->Branch("PosY", clusterPosY, "ClusterPosY[NClusters]/D");
+        if (!isClustersBranchOff("PosZ"))
+          clustersTreePl->Branch("PosZ", clusterPosZ, "ClusterPosZ[NClusters]/D");
+        if (!isClustersBranchOff("PosErrX"))
+          clustersTreePl->Branch("PosErrX", clusterPosErrX, "ClusterPosErrX[NClusters]/D");
+        if (!isClustersBranchOff("PosErrY"))
+          clustersTreePl->Branch("PosErrY", clusterPosErrY, "ClusterPosErrY[NClusters]/D");
+        if (!isClustersBranchOff("PosErrZ"))
+          clustersTreePl->Branch("PosErrZ", clusterPosErrZ, "ClusterPosErrZ[NClusters]/D");
+      }
       if (!isClustersBranchOff("Value"))
         clustersTreePl->Branch("Value", clusterValue, "ClusterValue[NClusters]/D");
       if (!isClustersBranchOff("Timing"))
@@ -117,6 +164,9 @@ StorageO::StorageO(
   // Make the event and track trees in the root directory
   m_file.cd();
 
+  // The patterns are needed to read back the clusters
+  if (m_clustersPatterned) m_clusterPatterns.write(m_file);
+
   if (treeMask & EVENTINFO) {
     m_eventInfoTree = new TTree("Event", "Event information");
     if (!isEventInfoBranchOff("TimeStamp"))
@@ -160,6 +210,12 @@ StorageO::StorageO(
 }
 
 StorageO::~StorageO() {
+  // Readers asked to sort the hits can then skip it
+  if (m_hitsSorted && m_numEvents > 0 && !m_hitsTrees.empty()) {
+    m_file.cd();
+    TNamed flag(HITS_SORTED_NAME, "Hits are in row-major order");
+    flag.Write();
+  }
   m_file.Write();
 }
 
@@ -211,6 +267,8 @@ void StorageO::writeEvent(Event& event) {
       throw std::runtime_error(
           "StorageO::writeEvent: event exceeds MAX_CLUSTERS");
 
+    numOthers = 0;
+
     // Set the object cluster values into the arrays for writig into the root file
     for (Int_t ncluster = 0; ncluster < numClusters; ncluster++) {
       Cluster& cluster = plane.getCluster(ncluster);
@@ -226,9 +284,13 @@ void StorageO::writeEvent(Event& event) {
       clusterPosErrZ[ncluster] = cluster.getPosErrZ();
       clusterTiming[ncluster] = cluster.getTiming();
       clusterValue[ncluster] = cluster.getValue();
-      clusterInTrack[ncluster] = cluster.fetchTrack() ? cluster.fetchTrack()->getIndex() : 0;
+      // Associations are stored offset by one, 0 means no association
+      clusterInTrack[ncluster] = cluster.fetchTrack() ? cluster.fetchTrack()->getIndex()+1 : 0;
+      if (m_clustersPatterned) setPattern(cluster, ncluster);
     }
 
+    m_hitsSorted &= plane.isSorted() || plane.getNumHits() < 2;
+
     numHits = plane.getNumHits();
     if (numHits > MAX_HITS)
       throw std::runtime_error(
@@ -243,7 +305,8 @@ void StorageO::writeEvent(Event& event) {
       hitPosZ[nhit] = hit.getPosZ();
       hitValue[nhit] = hit.getValue();
       hitTiming[nhit] = hit.getTiming();
-      hitInCluster[nhit] = hit.fetchCluster() ? hit.fetchCluster()->getIndex(): 0;
+      hitCharge[nhit] = hit.getCharge();
+      hitInCluster[nhit] = hit.fetchCluster() ? hit.fetchCluster()->getIndex()+1 : 0;
     }
 
     if (!m_hitsTrees.empty())
@@ -260,4 +323,40 @@ void StorageO::writeEvent(Event& event) {
   m_numEvents += 1;
 }
 
+void StorageO::setPattern(const Cluster& cluster, Int_t ncluster) {
+  Int_t anchorX = 0;
+  Int_t anchorY = 0;
+  ULong64_t shape = 0;
+  Int_t npattern = -1;
+  if (ClusterDictionary::encode(cluster, anchorX, anchorY, shape))
+    npattern = m_clusterPatterns.findPattern(shape);
+
+  // The pattern must give back this cluster's values
+  if (npattern >= 0) {
+    const ClusterDictionary::Pattern& pattern =
+        m_clusterPatterns.getPattern(npattern);
+    const double diff = std::max(
+        std::max(
+            std::fabs(anchorX+pattern.offsetX - cluster.getPixX()),
+            std::fabs(anchorY+pattern.offsetY - cluster.getPixY())),
+        std::max(
+            std::fabs(pattern.errX - cluster.getPixErrX()),
+            std::fabs(pattern.errY - cluster.getPixErrY())));
+    if (!(diff <= m_patternTolerance)) npattern = -1;
+  }
+
+  clusterPattern[ncluster] = npattern;
+  clusterAnchorX[ncluster] = npattern >= 0 ? anchorX : 0;
+  clusterAnchorY[ncluster] = npattern >= 0 ? anchorY : 0;
+
+  // Others are listed in the order of their clusters
+  if (npattern < 0) {
+    otherPixX[numOthers] = cluster.getPixX();
+    otherPixY[numOthers] = cluster.getPixY();
+    otherPixErrX[numOthers] = cluster.getPixErrX();
+    otherPixErrY[numOthers] = cluster.getPixErrY();
+    numOthers += 1;
+  }
+}
+
 }
@@ -0,0 +1,153 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include "storage/cluster.h"
+#include "storage/plane.h"
+#include "storage/track.h"
+#include "storage/event.h"
+#include "storage/trackntuple.h"
+
+namespace Storage {
+
+TrackNtuple::TrackNtuple(const std::string& filePath, size_t numPlanes) :
+    m_file(filePath.c_str(), "RECREATE"),
+    m_tree(0),
+    m_numPlanes(numPlanes),
+    clusterPixX(numPlanes, 0),
+    clusterPixY(numPlanes, 0),
+    clusterPosX(numPlanes, 0),
+    clusterPosY(numPlanes, 0),
+    clusterPosZ(numPlanes, 0),
+    clusterValue(numPlanes, 0),
+    clusterSize(numPlanes, 0),
+    residualX(numPlanes, 0),
+    residualY(numPlanes, 0),
+    m_clusters(numPlanes, 0) {
+  if (!m_file.IsOpen()) throw std::runtime_error(
+        "TrackNtuple::TrackNtuple: file didn't initialize");
+  if (m_numPlanes == 0) throw std::runtime_error(
+        "TrackNtuple::TrackNtuple: need at least one plane");
+
+  m_file.cd();
+  m_tree = new TTree("TrackNtuple", "One entry per track");
+
+  m_tree->Branch("Event", &event, "Event/l");
+  m_tree->Branch("TimeStamp", &timeStamp, "TimeStamp/l");
+  m_tree->Branch("TrackIndex", &trackIndex, "TrackIndex/I");
+  m_tree->Branch("NTracks", &numTracks, "NTracks/I");
+  m_tree->Branch("OriginX", &originX, "OriginX/D");
+  m_tree->Branch("OriginY", &originY, "OriginY/D");
+  m_tree->Branch("OriginErrX", &originErrX, "OriginErrX/D");
+  m_tree->Branch("OriginErrY", &originErrY, "OriginErrY/D");
+  m_tree->Branch("SlopeX", &slopeX, "SlopeX/D");
+  m_tree->Branch("SlopeY", &slopeY, "SlopeY/D");
+  m_tree->Branch("SlopeErrX", &slopeErrX, "SlopeErrX/D");
+  m_tree->Branch("SlopeErrY", &slopeErrY, "SlopeErrY/D");
+  m_tree->Branch("CovarianceX", &covarianceX, "CovarianceX/D");
+  m_tree->Branch("CovarianceY", &covarianceY, "CovarianceY/D");
+  m_tree->Branch("Chi2", &chi2, "Chi2/D");
+  m_tree->Branch("NClusters", &numClusters, "NClusters/I");
+
+  // Per-plane arrays have a fixed size given in the leaf list
+  std::stringstream ss;
+  ss << "[" << m_numPlanes << "]";
+  const std::string dim = ss.str();
+
+  m_tree->Branch("ClusterPixX", &clusterPixX[0], ("ClusterPixX"+dim+"/D").c_str());
+  m_tree->Branch("ClusterPixY", &clusterPixY[0], ("ClusterPixY"+dim+"/D").c_str());
+  m_tree->Branch("ClusterPosX", &clusterPosX[0], ("ClusterPosX"+dim+"/D").c_str());
+  m_tree->Branch("ClusterPosY", &clusterPosY[0], ("ClusterPosY"+dim+"/D").c_str());
+  m_tree->Branch("ClusterPosZ", &clusterPosZ[0], ("ClusterPosZ"+dim+"/D").c_str());
+  m_tree->Branch("ClusterValue", &clusterValue[0], ("ClusterValue"+dim+"/D").c_str());
+  m_tree->Branch("ClusterSize", &clusterSize[0], ("ClusterSize"+dim+"/I").c_str());
+  m_tree->Branch("ResidualX", &residualX[0], ("ResidualX"+dim+"/D").c_str());
+  m_tree->Branch("ResidualY", &residualY[0], ("ResidualY"+dim+"/D").c_str());
+}
+
+TrackNtuple::~TrackNtuple() {
+  m_file.cd();
+  m_tree->Write();
+  m_file.Close();
+}
+
+void TrackNtuple::findClusters(
+    const Track& track,
+    std::vector<const Cluster*>& clusters) const {
+  clusters.assign(m_numPlanes, 0);
+  for (size_t i = 0; i < track.getNumClusters(); i++) {
+    const Cluster& cluster = track.getCluster(i);
+    const size_t nplane = cluster.fetchPlane()->getPlaneNum();
+    if (nplane < m_numPlanes) clusters[nplane] = &cluster;
+  }
+}
+
+void TrackNtuple::fill(const Event& event, ULong64_t ievent) {
+  m_file.cd();  // Ensure writing to the ntuple file
+
+  if (event.getNumPlanes() != m_numPlanes)
+    throw std::runtime_error("TrackNtuple::fill: event has the wrong planes");
+
+  this->event = ievent;
+  timeStamp = event.getTimeStamp();
+  numTracks = event.getNumTracks();
+
+  for (size_t itrack = 0; itrack < event.getNumTracks(); itrack++) {
+    const Track& track = event.getTrack(itrack);
+
+    trackIndex = itrack;
+    originX = track.getOriginX();
+    originY = track.getOriginY();
+    originErrX = track.getOriginErrX();
+    originErrY = track.getOriginErrY();
+    slopeX = track.getSlopeX();
+    slopeY = track.getSlopeY();
+    slopeErrX = track.getSlopeErrX();
+    slopeErrY = track.getSlopeErrY();
+    covarianceX = track.getCovarianceX();
+    covarianceY = track.getCovarianceY();
+    chi2 = track.getChi2();
+
+    findClusters(track, m_clusters);
+
+    numClusters = 0;
+    for (size_t nplane = 0; nplane < m_numPlanes; nplane++) {
+      const Cluster* cluster = m_clusters[nplane];
+      if (!cluster) {
+        clusterPixX[nplane] = 0;
+        clusterPixY[nplane] = 0;
+        clusterPosX[nplane] = 0;
+        clusterPosY[nplane] = 0;
+        clusterPosZ[nplane] = 0;
+        clusterValue[nplane] = 0;
+        clusterSize[nplane] = 0;
+        residualX[nplane] = 0;
+        residualY[nplane] = 0;
+        continue;
+      }
+
+      numClusters += 1;
+      clusterPixX[nplane] = cluster->getPixX();
+      clusterPixY[nplane] = cluster->getPixY();
+      clusterPosX[nplane] = cluster->getPosX();
+      clusterPosY[nplane] = cluster->getPosY();
+      clusterPosZ[nplane] = cluster->getPosZ();
+      clusterValue[nplane] = cluster->getValue();
+      clusterSize[nplane] = cluster->getNumHits();
+      // Residual of the cluster to the track at the cluster's z
+      residualX[nplane] = cluster->getPosX() -
+          (originX + slopeX*cluster->getPosZ());
+      residualY[nplane] = cluster->getPosY() -
+          (originY + slopeY*cluster->getPosZ());
+    }
+
+    m_tree->Fill();
+  }
+}
+
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "threadpool.h"
+
+namespace Utils {
+
+ThreadPool::ThreadPool(unsigned nthreads) :
+    m_generation(0),
+    m_stop(false),
+    m_task(0),
+    m_nparts(0),
+    m_next(0),
+    m_nbusy(0) {
+  if (nthreads < 1)
+    throw std::runtime_error("ThreadPool::ThreadPool: needs at least 1 thread");
+  // The caller of `run` is the remaining thread
+  for (unsigned i = 1; i < nthreads; i++)
+    m_threads.push_back(std::thread(&ThreadPool::wait, this));
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_start.notify_all();
+  for (size_t i = 0; i < m_threads.size(); i++)
+    m_threads[i].join();
+}
+
+void ThreadPool::work(Task& task, size_t nparts) {
+  while (true) {
+    const size_t i = m_next++;
+    if (i >= nparts) break;
+    try {
+      task.run(i);
+    }
+    // Exceptions can't cross threads, keep the first message for the caller
+    catch (std::exception& e) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_error.empty()) m_error = e.what();
+    }
+  }
+}
+
+void ThreadPool::wait() {
+  unsigned long generation = 0;
+  while (true) {
+    Task* task = 0;
+    size_t nparts = 0;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stop && m_generation == generation) m_start.wait(lock);
+      if (m_stop) return;
+      generation = m_generation;
+      // The job finished before this thread woke up
+      if (!m_task) continue;
+      task = m_task;
+      nparts = m_nparts;
+      m_nbusy += 1;
+    }
+
+    work(*task, nparts);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_nbusy -= 1;
+    if (m_nbusy == 0) m_done.notify_all();
+  }
+}
+
+void ThreadPool::run(Task& task, size_t nparts) {
+  if (nparts == 0) return;
+
+  std::lock_guard<std::mutex> runLock(m_runMutex);
+
+  // No need to wake the threads for a single part
+  if (nparts == 1 || m_threads.empty()) {
+    for (size_t i = 0; i < nparts; i++) task.run(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_task = &task;
+    m_nparts = nparts;
+    m_next = 0;
+    m_error.clear();
+    m_generation += 1;
+  }
+  m_start.notify_all();
+
+  work(task, nparts);
+
+  // Wait for the threads still running parts. Clearing the task tells those
+  // which didn't wake up in time to skip this job.
+  std::string error;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_nbusy > 0) m_done.wait(lock);
+    m_task = 0;
+    m_nparts = 0;
+    error.swap(m_error);
+  }
+
+  if (!error.empty())
+    throw std::runtime_error("ThreadPool::run: " + error);
+}
+
+}
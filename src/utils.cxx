@@ -97,17 +97,18 @@ void fitGausBg(
   bg /= hist.GetBinWidth(1);
 }
 
+template <typename T>
 void linearFit(
     const unsigned n,
-    const double* x,
-    const double* y,
-    const double* ye,
-    double& p0,
-    double& p1,
-    double& p0e,
-    double& p1e,
-    double& cov,
-    double& chi2) {
+    const T* x,
+    const T* y,
+    const T* ye,
+    T& p0,
+    T& p1,
+    T& p0e,
+    T& p1e,
+    T& cov,
+    T& chi2) {
   p0 = 0;
   p1 = 0;
   p0e = 0;
@@ -116,14 +117,14 @@ void linearFit(
   chi2 = 0;
 
   // Regression variables
-  double ss = 0;
-  double sx = 0;
-  double sy = 0;
-  double sxoss = 0;
-  double st2 = 0;
+  T ss = 0;
+  T sx = 0;
+  T sy = 0;
+  T sxoss = 0;
+  T st2 = 0;
 
   for (unsigned int i = 0; i < n; i++) {
-    const double wt = 1. / (ye[i]*ye[i]);
+    const T wt = T(1) / (ye[i]*ye[i]);
     if (!std::isfinite(wt))
       throw std::runtime_error("Utils: linearFit: invalid weight");
     ss += wt;
@@ -134,7 +135,7 @@ void linearFit(
   sxoss = sx / ss;
 
   for (unsigned i = 0; i < n; i++) {
-    const double t = (x[i]-sxoss) / ye[i];
+    const T t = (x[i]-sxoss) / ye[i];
     st2 += t*t;
     p1 += t*y[i]/ye[i];
   }
@@ -142,15 +143,25 @@ void linearFit(
   p1 /= st2;
   p0 = (sy - sx*p1) / ss;
 
-  p1e = std::sqrt(1./st2);
-  p0e = sqrt((1. + sx*sx / (ss*st2)) / ss);
+  p1e = std::sqrt(T(1)/st2);
+  p0e = std::sqrt((T(1) + sx*sx / (ss*st2)) / ss);
 
-  for (unsigned i = 0; i < n; i++)
-    chi2 += std::pow((y[i] - (p0 + p1*x[i])) / ye[i], 2);
+  for (unsigned i = 0; i < n; i++) {
+    const T r = (y[i] - (p0 + p1*x[i])) / ye[i];
+    chi2 += r*r;
+  }
 
   cov = -sx / (ss * st2);
 }
 
+// Single precision is used by the processing kernels when requested
+template void linearFit<double>(
+    const unsigned, const double*, const double*, const double*,
+    double&, double&, double&, double&, double&, double&);
+template void linearFit<float>(
+    const unsigned, const float*, const float*, const float*,
+    float&, float&, float&, float&, float&, float&);
+
 void linePlaneIntercept(
     double p0x,
     double p1x,
@@ -0,0 +1,185 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+
+#include <TH2D.h>
+
+#include "analyzers/correlationcounts.h"
+
+int test_countsFill() {
+  Analyzers::CorrelationCounts counts(10, 8);
+
+  counts.fill(0, 0);
+  counts.fill(3.7, 2.2);
+  counts.fill(3.1, 2.9);
+  counts.fill(9.99, 7.5);
+  if (counts.getCount(0, 0) != 1 || counts.getCount(3, 2) != 2 ||
+      counts.getCount(9, 7) != 1 || counts.getCount(2, 3) != 0) {
+    std::cerr << "CorrelationCounts: wrong bin counts" << std::endl;
+    return -1;
+  }
+
+  // Out of range on either axis, including negative, goes to the edges
+  counts.fill(-0.5, 1);
+  counts.fill(1, -3);
+  counts.fill(10, 1);
+  counts.fill(1, 8);
+  counts.fill(1e20, 1);
+  if (counts.getNumOutside() != 5) {
+    std::cerr << "CorrelationCounts: wrong outside count" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_countsRebin() {
+  // 10 pixels in groups of 3 leaves a partial bin at the end
+  Analyzers::CorrelationCounts counts(10, 6, 3);
+  if (counts.getNumBinsX() != 4 || counts.getNumBinsY() != 2) {
+    std::cerr << "CorrelationCounts: wrong rebinned size" << std::endl;
+    return -1;
+  }
+
+  counts.fill(0, 0);
+  counts.fill(2.5, 2.9);
+  counts.fill(3, 3);
+  counts.fill(9.5, 5.5);
+  if (counts.getCount(0, 0) != 2 || counts.getCount(1, 1) != 1 ||
+      counts.getCount(3, 1) != 1) {
+    std::cerr << "CorrelationCounts: wrong rebinned counts" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_countsBand() {
+  Analyzers::CorrelationCounts counts(100, 100);
+
+  // Correlation along y = x + 10, kept within 2 bins
+  std::vector<double> centers(100);
+  for (unsigned i = 0; i < centers.size(); i++)
+    centers[i] = i + 10.5;
+  counts.setBand(centers, 2);
+  if (counts.getNumStored() != 100*5) {
+    std::cerr << "CorrelationCounts: band stores the wrong size" << std::endl;
+    return -1;
+  }
+
+  counts.fill(20, 30);
+  counts.fill(20, 32);
+  counts.fill(20, 28);
+  counts.fill(20, 33);  // just outside the band
+  counts.fill(20, 27);  // just below
+  // Near the top the band slides down to stay on the axis
+  counts.fill(99, 95);
+  counts.fill(99, 94);
+  if (counts.getCount(20, 30) != 1 || counts.getCount(20, 32) != 1 ||
+      counts.getCount(20, 28) != 1 || counts.getCount(20, 33) != 0 ||
+      counts.getCount(99, 95) != 1 || counts.getNumOutside() != 3) {
+    std::cerr << "CorrelationCounts: wrong band counts" << std::endl;
+    return -1;
+  }
+
+  // Entries off the band are in the y under/overflow of their column
+  std::unique_ptr<TH2D> hist(counts.makeHistogram("band", "band"));
+  hist->SetDirectory(0);
+  if (hist->GetBinContent(21, 101) != 1 || hist->GetBinContent(21, 0) != 1 ||
+      hist->GetBinContent(100, 0) != 1 || hist->GetBinContent(21, 31) != 1 ||
+      hist->GetEntries() != 7) {
+    std::cerr << "CorrelationCounts: band edges not in the histogram"
+        << std::endl;
+    return -1;
+  }
+
+  // The band can't change once entries are in
+  try {
+    counts.setBand(centers, 3);
+  }
+  catch (std::runtime_error& e) {
+    return 0;
+  }
+
+  std::cerr << "CorrelationCounts: band changed after filling" << std::endl;
+  return -1;
+}
+
+int test_countsAdd() {
+  Analyzers::CorrelationCounts counts1(10, 10, 2);
+  Analyzers::CorrelationCounts counts2(10, 10, 2);
+  counts1.fill(1, 1);
+  counts1.fill(5, 7);
+  counts2.fill(1, 0);
+  counts2.fill(11, 0);
+  counts1.add(counts2);
+  if (counts1.getCount(0, 0) != 2 || counts1.getCount(2, 3) != 1 ||
+      counts1.getNumOutside() != 1) {
+    std::cerr << "CorrelationCounts: wrong sum" << std::endl;
+    return -1;
+  }
+
+  Analyzers::CorrelationCounts other(10, 10, 1);
+  try {
+    counts1.add(other);
+  }
+  catch (std::runtime_error& e) {
+    return 0;
+  }
+
+  std::cerr << "CorrelationCounts: added mismatched binning" << std::endl;
+  return -1;
+}
+
+int test_countsHistogram() {
+  Analyzers::CorrelationCounts counts(8, 6, 2);
+  counts.fill(0, 0);
+  counts.fill(1, 1);
+  counts.fill(7, 5);
+  counts.fill(20, 5);
+  counts.fill(-1, -1);
+  counts.fill(3, 6);
+
+  std::unique_ptr<TH2D> hist(counts.makeHistogram("corr", "corr"));
+  hist->SetDirectory(0);
+  if (hist->GetNbinsX() != 4 || hist->GetNbinsY() != 3) {
+    std::cerr << "CorrelationCounts: wrong histogram binning" << std::endl;
+    return -1;
+  }
+  // ROOT bins start at 1
+  if (hist->GetBinContent(1, 1) != 2 || hist->GetBinContent(4, 3) != 1 ||
+      hist->GetEntries() != 6) {
+    std::cerr << "CorrelationCounts: wrong histogram content" << std::endl;
+    return -1;
+  }
+  // Out of range entries are in the under/overflow bins, where `Fill` would
+  // have put them
+  if (hist->GetBinContent(5, 3) != 1 || hist->GetBinContent(0, 0) != 1 ||
+      hist->GetBinContent(2, 4) != 1) {
+    std::cerr << "CorrelationCounts: wrong histogram under/overflow"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_countsFill()) != 0) return retval;
+    if ((retval = test_countsRebin()) != 0) return retval;
+    if ((retval = test_countsBand()) != 0) return retval;
+    if ((retval = test_countsAdd()) != 0) return retval;
+    if ((retval = test_countsHistogram()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
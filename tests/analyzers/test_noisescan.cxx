@@ -0,0 +1,83 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <cmath>
+
+#include <TH2D.h>
+
+#include "storage/event.h"
+#include "storage/plane.h"
+#include "storage/hit.h"
+#include "mechanics/device.h"
+#include "mechanics/sensor.h"
+#include "analyzers/noisescan.h"
+
+bool approxEqual(double v1, double v2, double tol=1E-10) {
+  return std::fabs(v1-v2) < tol;
+}
+
+// Event with a hit in pixel (col, row) of its only plane
+void fillEvent(Storage::Event& event, int col, int row) {
+  event.newHit(0).setPix(col, row);
+}
+
+int test_noiseScanFinalize() {
+  Mechanics::Device device(1);
+  device.getSensor(0).m_ncols = 4;
+  device.getSensor(0).m_nrows = 3;
+
+  Analyzers::NoiseScan scan(device);
+  scan.setOutput(0);
+  std::unique_ptr<Analyzers::Analyzer> clone(scan.clone());
+
+  // Pixel (1, 2) fires in every event, (3, 0) in one of the 4
+  for (int n = 0; n < 2; n++) {
+    Storage::Event event(1);
+    fillEvent(event, 1, 2);
+    if (n == 0) fillEvent(event, 3, 0);
+    scan.execute(event);
+  }
+  for (int n = 0; n < 2; n++) {
+    Storage::Event event(1);
+    fillEvent(event, 1, 2);
+    clone->execute(event);
+  }
+  scan.merge(*clone);
+
+  // Histograms are only made at finalize
+  bool caught = false;
+  try { scan.getOccupancy(0, 0); }
+  catch (std::runtime_error& e) { caught = true; }
+  if (!caught) {
+    std::cerr << "NoiseScan: occupancy available before finalize" << std::endl;
+    return -1;
+  }
+
+  scan.finalize();
+  TH2D& occupancy = scan.getOccupancy(0, 0);
+  if (occupancy.GetNbinsX() != 4 || occupancy.GetNbinsY() != 3 ||
+      !approxEqual(occupancy.GetBinContent(2, 3), 1) ||
+      !approxEqual(occupancy.GetBinContent(4, 1), .25) ||
+      occupancy.GetBinContent(1, 1) != 0) {
+    std::cerr << "NoiseScan: wrong occupancy" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_noiseScanFinalize()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,594 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#include <TSystem.h>
+#include <TH1.h>
+#include <TH1D.h>
+
+#include "storage/storageo.h"
+#include "storage/storagei.h"
+#include "storage/event.h"
+#include "storage/hit.h"
+#include "processors/processor.h"
+#include "processors/clustering.h"
+#include "analyzers/analyzer.h"
+#include "loopers/looper.h"
+#include "loopers/loopprocess.h"
+
+#define NEVENTS 1000
+
+/**
+  * Histograms the number of hits of each event, and keeps the time stamps of
+  * the events in the order they were analyzed.
+  */
+class HitCounter : public Analyzers::Analyzer {
+private:
+  TH1D* m_hits;
+
+  void process() {
+    s_nanalyzed += 1;
+    if (m_events[0]->getTimeStamp() == m_throwAt) throw m_throwAt;
+    if (m_events[0]->getTimeStamp() < m_slowBelow)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    // Drifting counters fill a value which grows with each event
+    m_hits->Fill(m_drift ? m_timeStamps.size() : m_events[0]->getNumHits());
+    m_timeStamps.push_back(m_events[0]->getTimeStamp());
+  }
+
+public:
+  std::vector<ULong64_t> m_timeStamps;
+  /** Events with a time stamp below this take a millisecond to analyze */
+  ULong64_t m_slowBelow;
+  /** Histogram the number of events analyzed so far instead of the hits, so
+    * that the distribution never settles */
+  bool m_drift;
+  /** Throw the time stamp, which isn't an `std::exception`, when analyzing
+    * the event with this time stamp */
+  ULong64_t m_throwAt;
+  /** Number of clones made of all counters */
+  static size_t s_nclones;
+  /** Number of events analyzed by all counters */
+  static std::atomic<size_t> s_nanalyzed;
+
+  HitCounter() :
+      Analyzer(1),
+      m_hits(new TH1D("HitCounter", "Hits", NEVENTS, 0, NEVENTS)),
+      m_slowBelow(0),
+      m_drift(false),
+      m_throwAt(NEVENTS) {
+    m_hits->SetDirectory(0);
+    m_histograms.push_back(m_hits);
+  }
+
+  Analyzer* clone() const {
+    s_nclones += 1;
+    HitCounter* counter = new HitCounter();
+    counter->m_slowBelow = m_slowBelow;
+    counter->m_drift = m_drift;
+    counter->m_throwAt = m_throwAt;
+    return counter;
+  }
+
+  void merge(const Analyzer& other) {
+    Analyzer::merge(other);
+    const HitCounter& counter = dynamic_cast<const HitCounter&>(other);
+    m_timeStamps.insert(
+        m_timeStamps.end(),
+        counter.m_timeStamps.begin(),
+        counter.m_timeStamps.end());
+  }
+
+  const TH1D& getHits() const { return *m_hits; }
+};
+
+size_t HitCounter::s_nclones = 0;
+std::atomic<size_t> HitCounter::s_nanalyzed(0);
+
+/**
+  * Keeps the time stamp of the last event it analyzed, and counts the events
+  * on which the analyzers it was given to check hadn't reached that event
+  * yet.
+  */
+class StampChecker : public Analyzers::Analyzer {
+private:
+  const bool m_readOnly;
+
+  void process() {
+    const ULong64_t stamp = m_events[0]->getTimeStamp();
+    // Give analyzers running alongside a chance to run ahead
+    if (stamp%10 == 0)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    for (size_t i = 0; i < m_checked.size(); i++)
+      if (!m_checked[i]->m_seen || m_checked[i]->m_last != stamp)
+        m_nbehind += 1;
+    m_last = stamp;
+    m_seen = true;
+    m_nevents += 1;
+  }
+
+public:
+  /** Analyzers which must have analyzed each event before this one */
+  std::vector<const StampChecker*> m_checked;
+  ULong64_t m_last;
+  bool m_seen;
+  size_t m_nevents;
+  size_t m_nbehind;
+  /** Number of clones made of all checkers */
+  static size_t s_nclones;
+
+  StampChecker(bool readOnly) :
+      Analyzer(1),
+      m_readOnly(readOnly),
+      m_last(0),
+      m_seen(false),
+      m_nevents(0),
+      m_nbehind(0) {}
+
+  bool isReadOnly() const { return m_readOnly; }
+
+  Analyzer* clone() const {
+    s_nclones += 1;
+    return new StampChecker(m_readOnly);
+  }
+
+  /** Check `analyzer` and also run after it */
+  void check(const StampChecker& analyzer) {
+    m_checked.push_back(&analyzer);
+    addDependency(analyzer);
+  }
+};
+
+size_t StampChecker::s_nclones = 0;
+
+/**
+  * Keeps, for each iteration, the time stamp and number of hits of the event
+  * of each input in turn.
+  */
+class PairRecorder : public Analyzers::Analyzer {
+private:
+  void process() {
+    for (size_t i = 0; i < m_ndevices; i++) {
+      m_records.push_back(m_events[i]->getTimeStamp());
+      m_records.push_back(m_events[i]->getNumHits());
+    }
+  }
+
+public:
+  std::vector<ULong64_t> m_records;
+
+  PairRecorder() : Analyzer(2) {}
+};
+
+/** Keeps the largest block of events any copy was given at once */
+class BlockSizer : public Processors::Processor {
+private:
+  void process() {}
+
+  void processBatch(const std::vector<Storage::Event*>& events) {
+    size_t largest = s_largest;
+    while (events.size() > largest &&
+        !s_largest.compare_exchange_weak(largest, events.size())) {}
+    Processor::processBatch(events);
+  }
+
+public:
+  static std::atomic<size_t> s_largest;
+
+  BlockSizer() : Processor(1) {}
+  Processor* clone() const { return new BlockSizer(); }
+};
+
+std::atomic<size_t> BlockSizer::s_largest(0);
+
+/** Looper which shows how it scheduled its analyzers */
+class LevelLooper : public Loopers::Looper {
+public:
+  LevelLooper(Storage::StorageI& input) : Looper(input) {}
+  const std::vector<std::vector<size_t> >& getLevels() const {
+    return m_analyzerLevels; }
+};
+
+// Event n has time stamp n and n%5 hits, and every 50th event is invalid
+int writeInput() {
+  Storage::StorageO store("tmp_looper.root", 1);
+  for (ULong64_t n = 0; n < NEVENTS; n++) {
+    Storage::Event& event = store.newEvent();
+    event.setTimeStamp(n);
+    event.setInvalid(n%50 == 49);
+    for (ULong64_t i = 0; i < n%5; i++)
+      event.newHit(0).setPix(i, n%13);
+    store.writeEvent(event);
+  }
+  return 0;
+}
+
+// Second input of multi-input loops: event n has time stamp 10*n and n%3
+// hits, and every 70th event is invalid
+int writeSecondInput() {
+  Storage::StorageO store("tmp_looper2.root", 1);
+  for (ULong64_t n = 0; n < NEVENTS; n++) {
+    Storage::Event& event = store.newEvent();
+    event.setTimeStamp(10*n);
+    event.setInvalid(n%70 == 69);
+    for (ULong64_t i = 0; i < n%3; i++)
+      event.newHit(0).setPix(i, n%11);
+    store.writeEvent(event);
+  }
+  return 0;
+}
+
+bool isSame(const HitCounter& counter1, const HitCounter& counter2) {
+  if (counter1.m_timeStamps != counter2.m_timeStamps) return false;
+  if (counter1.getHits().GetEntries() != counter2.getHits().GetEntries())
+    return false;
+  for (Int_t i = 0; i <= counter1.getHits().GetNbinsX()+1; i++)
+    if (counter1.getHits().GetBinContent(i) !=
+        counter2.getHits().GetBinContent(i))
+      return false;
+  return true;
+}
+
+// Run a loop over the input with `nthreads` threads in blocks of `nbatch`
+void runLoop(HitCounter& counter, unsigned nthreads, unsigned nbatch) {
+  Storage::StorageI input("tmp_looper.root");
+  Loopers::Looper looper(input);
+  looper.m_printInterval = 0;
+  looper.m_nthreads = nthreads;
+  looper.m_batchSize = nbatch;
+  looper.addAnalyzer(counter);
+  looper.loop();
+}
+
+int test_looperSequential() {
+  HitCounter counter;
+  runLoop(counter, 1, 1);
+
+  // All valid events, in order. The invalid ones are those with 4 hits.
+  std::vector<ULong64_t> expected;
+  for (ULong64_t n = 0; n < NEVENTS; n++)
+    if (n%50 != 49) expected.push_back(n);
+  if (counter.m_timeStamps != expected ||
+      counter.getHits().GetEntries() != expected.size() ||
+      counter.getHits().GetBinContent(1) != NEVENTS/5 ||
+      counter.getHits().GetBinContent(5) != NEVENTS/5 - NEVENTS/50) {
+    std::cerr << "Loopers::Looper: sequential loop missed events" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_looperParallel() {
+  HitCounter sequential;
+  runLoop(sequential, 1, 1);
+
+  // The threads' analyzers are merged back in event order, so the results
+  // are the same as the sequential loop's whatever the timing of the threads
+  const unsigned nthreads[] = { 2, 4, 7 };
+  const unsigned nbatches[] = { 1, 1, 3 };
+  for (size_t i = 0; i < 3; i++) {
+    HitCounter parallel;
+    runLoop(parallel, nthreads[i], nbatches[i]);
+    if (!isSame(parallel, sequential)) {
+      std::cerr << "Loopers::Looper: parallel loop with " << nthreads[i]
+          << " threads differs" << std::endl;
+      return -1;
+    }
+  }
+
+  // Blocks of iterations on a single thread also go through the same events
+  HitCounter batched;
+  runLoop(batched, 1, 16);
+  if (!isSame(batched, sequential)) {
+    std::cerr << "Loopers::Looper: batched loop differs" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_looperStealing() {
+  HitCounter sequential;
+  runLoop(sequential, 1, 1);
+
+  // The first quarter of the events is slow, so that the first of 4 threads
+  // is left with most of the work unless the others steal it
+  const unsigned nthreads = 4;
+  HitCounter::s_nclones = 0;
+  HitCounter uneven;
+  uneven.m_slowBelow = NEVENTS/4;
+  runLoop(uneven, nthreads, 1);
+
+  // Each stolen range is analyzed by its own clone, beyond those of the
+  // threads' initial ranges
+  if (HitCounter::s_nclones <= nthreads-1) {
+    std::cerr << "Loopers::Looper: no events were stolen" << std::endl;
+    return -1;
+  }
+
+  // Stolen ranges are merged at their place in the event order
+  if (!isSame(uneven, sequential)) {
+    std::cerr << "Loopers::Looper: loop with stolen events differs" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_looperFailure() {
+  // Every event is slow, and the very first one fails with an exception of
+  // any type. It reaches the caller, and the other threads stop early
+  // instead of analyzing their whole range.
+  HitCounter failing;
+  failing.m_slowBelow = NEVENTS;
+  failing.m_throwAt = 0;
+  HitCounter::s_nanalyzed = 0;
+  bool caught = false;
+  try { runLoop(failing, 4, 1); }
+  catch (std::runtime_error& e) { caught = true; }
+  if (!caught) {
+    std::cerr << "Loopers::Looper: failure in a thread not reported"
+        << std::endl;
+    return -1;
+  }
+  if (HitCounter::s_nanalyzed >= NEVENTS/2) {
+    std::cerr << "Loopers::Looper: threads kept going after a failure"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+// Sample the input in blocks of 50 iterations, stopping once the moments
+// move by less than `tolerance` of the RMS for 3 blocks
+void runSampled(HitCounter& counter, double tolerance) {
+  Storage::StorageI input("tmp_looper.root");
+  Loopers::Looper looper(input);
+  looper.m_printInterval = 0;
+  looper.m_sampleSize = 50;
+  looper.m_sampleTolerance = tolerance;
+  looper.m_sampleStable = 3;
+  looper.addAnalyzer(counter);
+  looper.loop();
+}
+
+int test_looperSampled() {
+  HitCounter sequential;
+  runLoop(sequential, 1, 1);
+
+  // Every block of 50 events has the same hit distribution (but for its
+  // invalid event), so the loop stops after a few blocks
+  HitCounter stable;
+  runSampled(stable, 0.05);
+  if (stable.m_timeStamps.empty() ||
+      stable.m_timeStamps.size() >= sequential.m_timeStamps.size()) {
+    std::cerr << "Loopers::Looper: sampled loop didn't stop early" << std::endl;
+    return -1;
+  }
+
+  // It takes a first block and 3 stable ones. The blocks are spread out, so
+  // the second one is in the second half of the run.
+  if (stable.m_timeStamps.size() < 4*49 || stable.m_timeStamps[0] != 0 ||
+      stable.m_timeStamps[49] < NEVENTS/2) {
+    std::cerr << "Loopers::Looper: sampled blocks out of place" << std::endl;
+    return -1;
+  }
+
+  // A distribution which keeps moving reads every block
+  HitCounter drifting;
+  drifting.m_drift = true;
+  runSampled(drifting, 0.05);
+  if (drifting.m_timeStamps.size() != sequential.m_timeStamps.size()) {
+    std::cerr << "Loopers::Looper: sampled loop stopped while unstable"
+        << std::endl;
+    return -1;
+  }
+
+  // Without a tolerance all blocks are read, in sampled order
+  HitCounter all;
+  runSampled(all, 0);
+  std::vector<ULong64_t> sorted = all.m_timeStamps;
+  std::sort(sorted.begin(), sorted.end());
+  if (sorted != sequential.m_timeStamps) {
+    std::cerr << "Loopers::Looper: sampled loop missed events" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_looperLevels() {
+  Storage::StorageI input("tmp_looper.root");
+  LevelLooper looper(input);
+  looper.m_printInterval = 0;
+  looper.m_nprocess = 200;
+  looper.m_analyzerThreads = 4;
+
+  // Read-only analyzers run alongside each other unless one depends on the
+  // other. One which isn't read-only waits for all those before it, and
+  // those after it wait for it.
+  StampChecker first(true);
+  StampChecker dependent(true);
+  dependent.check(first);
+  StampChecker independent(true);
+  StampChecker writer(false);
+  writer.check(first);
+  writer.check(dependent);
+  writer.check(independent);
+  StampChecker last(true);
+  last.m_checked.push_back(&writer);
+
+  looper.addAnalyzer(first);
+  looper.addAnalyzer(dependent);
+  looper.addAnalyzer(independent);
+  looper.addAnalyzer(writer);
+  looper.addAnalyzer(last);
+
+  StampChecker::s_nclones = 0;
+  looper.loop();
+
+  // Levels: {first, independent}, {dependent}, {writer}, {last}
+  const std::vector<std::vector<size_t> >& levels = looper.getLevels();
+  if (levels.size() != 4 ||
+      levels[0].size() != 2 || levels[0][0] != 0 || levels[0][1] != 2 ||
+      levels[1].size() != 1 || levels[1][0] != 1 ||
+      levels[2].size() != 1 || levels[2][0] != 3 ||
+      levels[3].size() != 1 || levels[3][0] != 4) {
+    std::cerr << "Loopers::Looper: wrong analyzer levels" << std::endl;
+    return -1;
+  }
+
+  // 200 events of which 4 are invalid
+  const StampChecker* checkers[] =
+      { &first, &dependent, &independent, &writer, &last };
+  for (size_t i = 0; i < 5; i++) {
+    if (checkers[i]->m_nevents != 196 || checkers[i]->m_nbehind != 0) {
+      std::cerr << "Loopers::Looper: analyzer " << i
+          << " ran before those it depends on" << std::endl;
+      return -1;
+    }
+  }
+
+  // The analyzers of an event share it, they aren't copied to run together
+  if (StampChecker::s_nclones != 0) {
+    std::cerr << "Loopers::Looper: concurrent analyzers were cloned"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_looperInputPool() {
+  // What the iterations hold when reading fresh inputs one event at a time
+  std::vector<ULong64_t> expected;
+  {
+    Storage::StorageI input1("tmp_looper.root");
+    Storage::StorageI input2("tmp_looper2.root");
+    for (Long64_t n = 0; n < NEVENTS; n++) {
+      const Storage::Event& event1 = input1.readEvent(n);
+      const Storage::Event& event2 = input2.readEvent(n);
+      if (event1.getInvalid() || event2.getInvalid()) continue;
+      expected.push_back(event1.getTimeStamp());
+      expected.push_back(event1.getNumHits());
+      expected.push_back(event2.getTimeStamp());
+      expected.push_back(event2.getNumHits());
+    }
+  }
+
+  // Read the inputs on the pool, one iteration and then blocks of them at a
+  // time. Each looper runs twice over the same inputs.
+  const unsigned nbatches[] = { 1, 8 };
+  for (size_t i = 0; i < 2; i++) {
+    Storage::StorageI input1("tmp_looper.root");
+    Storage::StorageI input2("tmp_looper2.root");
+    std::vector<Storage::StorageI*> inputs;
+    inputs.push_back(&input1);
+    inputs.push_back(&input2);
+
+    Loopers::Looper looper(inputs);
+    looper.m_printInterval = 0;
+    looper.m_inputThreads = 2;
+    looper.m_batchSize = nbatches[i];
+    PairRecorder recorder;
+    looper.addAnalyzer(recorder);
+
+    for (size_t irun = 0; irun < 2; irun++) {
+      recorder.m_records.clear();
+      looper.loop();
+      if (recorder.m_records != expected) {
+        std::cerr << "Loopers::Looper: pooled inputs read wrong events "
+            "(block of " << nbatches[i] << ", run " << irun << ")" << std::endl;
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Cluster the input into `path` with a processing loop
+void runProcess(const std::string& path, unsigned nthreads, unsigned nbatch) {
+  Storage::StorageI input("tmp_looper.root");
+  Storage::StorageO output(path, input.getNumPlanes());
+  Loopers::LoopProcess looper(input, output);
+  looper.m_printInterval = 0;
+  looper.m_nthreads = nthreads;
+  looper.m_batchSize = nbatch;
+  Processors::Clustering clustering;
+  BlockSizer sizer;
+  looper.addProcessor(clustering);
+  looper.addProcessor(sizer);
+  looper.loop();
+}
+
+int test_looperProcessBatch() {
+  runProcess("tmp_process1.root", 1, 1);
+
+  // Blocks of events go through each stage of the pipeline, which writes the
+  // same events
+  const unsigned nthreads[] = { 1, 3 };
+  for (size_t i = 0; i < 2; i++) {
+    BlockSizer::s_largest = 0;
+    runProcess("tmp_process8.root", nthreads[i], 8);
+    if (BlockSizer::s_largest <= 1 || BlockSizer::s_largest > 8) {
+      std::cerr << "Loopers::LoopProcess: events not processed in blocks"
+          << std::endl;
+      return -1;
+    }
+
+    Storage::StorageI single("tmp_process1.root");
+    Storage::StorageI batched("tmp_process8.root");
+    if (single.getNumEvents() != batched.getNumEvents()) {
+      std::cerr << "Loopers::LoopProcess: blocks wrote wrong events"
+          << std::endl;
+      return -1;
+    }
+    for (Long64_t n = 0; n < single.getNumEvents(); n++) {
+      const Storage::Event& event1 = single.readEvent(n);
+      const Storage::Event& event2 = batched.readEvent(n);
+      if (event1.getTimeStamp() != event2.getTimeStamp() ||
+          event1.getNumHits() != event2.getNumHits() ||
+          event1.getNumClusters() != event2.getNumClusters()) {
+        std::cerr << "Loopers::LoopProcess: block event " << n << " differs"
+            << std::endl;
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = writeInput()) != 0) return retval;
+    if ((retval = writeSecondInput()) != 0) return retval;
+    if ((retval = test_looperSequential()) != 0) return retval;
+    if ((retval = test_looperParallel()) != 0) return retval;
+    if ((retval = test_looperStealing()) != 0) return retval;
+    if ((retval = test_looperFailure()) != 0) return retval;
+    if ((retval = test_looperSampled()) != 0) return retval;
+    if ((retval = test_looperLevels()) != 0) return retval;
+    if ((retval = test_looperInputPool()) != 0) return retval;
+    if ((retval = test_looperProcessBatch()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  gSystem->Exec("rm -f tmp_looper.root tmp_looper2.root");
+  gSystem->Exec("rm -f tmp_process1.root tmp_process8.root");
+
+  return 0;
+}
@@ -104,6 +104,8 @@ int test_pixelToSpace() {
 
 int test_copy() {
   Mechanics::Device device(2);
+  device.m_alignmentFile = "alignment.cfg";
+  device.m_noiseMaskFile = "noise.bin";
   Mechanics::Device copy(device);
 
   if (copy.getNumSensors() != 2) {
@@ -122,6 +124,12 @@ int test_copy() {
     return -1;
   }
 
+  if (copy.m_alignmentFile != device.m_alignmentFile ||
+      copy.m_noiseMaskFile != device.m_noiseMaskFile) {
+    std::cerr << "Copy file paths failed" << std::endl;
+    return -1;
+  }
+
   return 0;
 }
 
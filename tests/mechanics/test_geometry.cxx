@@ -0,0 +1,132 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+
+#include "mechanics/alignment.h"
+#include "mechanics/sensor.h"
+#include "mechanics/device.h"
+#include "mechanics/geometry.h"
+
+// Device and sensors rotated and shifted on all axes
+void setupDevice(Mechanics::Device& device) {
+  device.setOffX(1.5);
+  device.setRotY(0.02);
+  device.setRotZ(0.3);
+  for (size_t i = 0; i < device.getNumSensors(); i++) {
+    Mechanics::Sensor& sensor = device.getSensor(i);
+    sensor.m_ncols = 80;
+    sensor.m_nrows = 336;
+    sensor.m_colPitch = 250;
+    sensor.m_rowPitch = 50;
+    sensor.setOffX(10.*i);
+    sensor.setOffZ(1000.*i);
+    sensor.setRotX(0.01*i);
+    sensor.setRotZ(-0.1*i);
+  }
+}
+
+// Compare the snapshot to the sensors of the device at a few pixels
+int compare(const Mechanics::Device& device, const Mechanics::Geometry& geo) {
+  for (size_t i = 0; i < device.getNumSensors(); i++) {
+    const Mechanics::Sensor& sensor = device.getSensorConst(i);
+    for (int pix = -3; pix < 400; pix += 37) {
+      double x1, y1, z1, x2, y2, z2;
+      sensor.pixelToSpace(pix*0.5, pix+0.25, x1, y1, z1);
+      geo.pixelToSpace(i, pix*0.5, pix+0.25, x2, y2, z2);
+      if (x1 != x2 || y1 != y2 || z1 != z2) {
+        std::cerr << "Geometry: pixelToSpace differs from sensor" << std::endl;
+        return -1;
+      }
+
+      sensor.pixelErrToSpace(pix*0.1, pix*0.2, x1, y1, z1);
+      geo.pixelErrToSpace(i, pix*0.1, pix*0.2, x2, y2, z2);
+      if (x1 != x2 || y1 != y2 || z1 != z2) {
+        std::cerr << "Geometry: pixelErrToSpace differs from sensor"
+            << std::endl;
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int test_geometrySnapshot() {
+  Mechanics::Device device(3);
+  setupDevice(device);
+
+  const Mechanics::Geometry geo(device);
+  if (geo.getNumPlanes() != 3) {
+    std::cerr << "Geometry: wrong number of planes" << std::endl;
+    return -1;
+  }
+  if (compare(device, geo)) return -1;
+
+  // Later changes to the device don't reach the snapshot
+  device.getSensor(1).setOffY(5);
+  double x1, y1, z1, x2, y2, z2;
+  device.getSensor(1).pixelToSpace(3, 4, x1, y1, z1);
+  geo.pixelToSpace(1, 3, 4, x2, y2, z2);
+  if (x1 == x2 && y1 == y2) {
+    std::cerr << "Geometry: snapshot followed the device" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_geometryParameters() {
+  Mechanics::Device device(3);
+  setupDevice(device);
+
+  std::vector<Mechanics::Geometry::Parameter> parameters;
+  parameters.push_back(Mechanics::Geometry::Parameter(
+      1, Mechanics::Alignment::OFFY));
+  parameters.push_back(Mechanics::Geometry::Parameter(
+      2, Mechanics::Alignment::ROTZ));
+  const double values[2] = { -7.5, 0.25 };
+
+  const Mechanics::Geometry geo(device, parameters, values);
+
+  // The device isn't touched
+  if (device.getSensor(1).getOffY() != 0 ||
+      device.getSensor(2).getRotZ() != -0.2) {
+    std::cerr << "Geometry: parameters changed the device" << std::endl;
+    return -1;
+  }
+
+  // Same as aligning the device with the values
+  device.getSensor(1).setOffY(-7.5);
+  device.getSensor(2).setRotZ(0.25);
+  if (compare(device, geo)) return -1;
+
+  // Parameters must refer to existing sensors
+  parameters.push_back(Mechanics::Geometry::Parameter(
+      3, Mechanics::Alignment::OFFX));
+  const double more[3] = { 0, 0, 0 };
+  try {
+    Mechanics::Geometry bad(device, parameters, more);
+  }
+  catch (std::runtime_error& e) {
+    return 0;
+  }
+
+  std::cerr << "Geometry: accepted a parameter out of range" << std::endl;
+  return -1;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_geometrySnapshot()) != 0) return retval;
+    if ((retval = test_geometryParameters()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -34,6 +34,8 @@ int test_parsing() {
     "rot-x 3.14159\n"
     "rot-y 3.\n"
     "rot-z .1\n"
+    "roi-cols 10 20\n"
+    "timing-window 3 5\n"
     "\n"
     "chip: fei4\n"
     "rows 336\n"
@@ -116,6 +118,18 @@ int test_parsing() {
     return -1;
   }
 
+  if (device->getSensor(0).m_roiMinCol != 10 ||
+      device->getSensor(0).m_roiMaxCol != 20 ||
+      device->getSensor(0).m_minTiming != 3 ||
+      device->getSensor(0).m_maxTiming != 5) {
+    std::cerr << "Device sensor 0 windows incorrect" << std::endl;
+    return -1;
+  }
+  if (device->getSensor(1).m_roiMinCol != Mechanics::Sensor().m_roiMinCol) {
+    std::cerr << "Device sensor 1 window not open" << std::endl;
+    return -1;
+  }
+
   if (device->getSensor(1).m_name != "Diamond") {
     std::cerr << "Device sensor 1 name incorrect" << std::endl;
     return -1;
@@ -260,6 +274,95 @@ int test_alignment() {
   return 0;
 }
 
+int test_calibration() {
+  Mechanics::Sensor sensor;
+  sensor.m_ncols = 3;
+  sensor.m_nrows = 2;
+  sensor.m_calibrationTerms = 4;
+  sensor.m_calibrationFile = "tmp.bin";
+  for (size_t i = 0; i < 3*2*4; i++)
+    sensor.m_calibration.push_back(.5*i);
+  Mechanics::writeCalibration(sensor);
+
+  Mechanics::Sensor read;
+  read.m_ncols = 3;
+  read.m_nrows = 2;
+  read.m_calibrationFile = "tmp.bin";
+  Mechanics::parseCalibration(read);
+
+  if (read.m_calibrationTerms != 4 ||
+      read.m_calibration != sensor.m_calibration) {
+    std::cerr << "Calibration read back incorrect" << std::endl;
+    return -1;
+  }
+
+  // A table of the wrong size is rejected
+  read.m_nrows = 3;
+  try {
+    Mechanics::parseCalibration(read);
+    std::cerr << "Calibration accepted for the wrong sensor" << std::endl;
+    return -1;
+  }
+  catch (std::runtime_error& e) {}
+
+  gSystem->Exec("rm -f tmp.bin");
+  return 0;
+}
+
+int test_noiseMask() {
+  Mechanics::Device device(2);
+  device.m_noiseMaskFile = "tmp.bin";
+  for (size_t i = 0; i < 2; i++) {
+    Mechanics::Sensor& sensor = device.getSensor(i);
+    sensor.m_name = i ? "B" : "A";
+    sensor.m_ncols = 10;
+    sensor.m_nrows = 7;
+    sensor.m_noiseProfile.assign(70, 0);
+    sensor.m_noiseMask.assign(70, false);
+  }
+  // Only the second sensor is noisy, across a word boundary
+  Mechanics::Sensor& noisy = device.getSensor(1);
+  noisy.m_noiseProfile[63] = .5;
+  noisy.m_noiseProfile[64] = .25;
+  noisy.m_noiseMask[63] = true;
+  noisy.m_noiseMask[64] = true;
+  Mechanics::writeNoiseMask(device);
+
+  Mechanics::Device read(2);
+  read.m_noiseMaskFile = "tmp.bin";
+  for (size_t i = 0; i < 2; i++) {
+    read.getSensor(i).m_name = device[i].m_name;
+    read.getSensor(i).m_ncols = 10;
+    read.getSensor(i).m_nrows = 7;
+  }
+  Mechanics::parseNoiseMask(read);
+
+  for (size_t i = 0; i < 2; i++) {
+    if (read[i].m_noiseMask != device[i].m_noiseMask ||
+        read[i].m_noiseProfile != device[i].m_noiseProfile) {
+      std::cerr << "Noise mask read back incorrect" << std::endl;
+      return -1;
+    }
+  }
+
+  if (!read[1].getPixelMask(6, 3) || read[1].getPixelNoise(6, 4) != .25) {
+    std::cerr << "Noise mask pixel order incorrect" << std::endl;
+    return -1;
+  }
+
+  // A mask of the wrong size is rejected
+  read.getSensor(0).m_nrows = 8;
+  try {
+    Mechanics::parseNoiseMask(read);
+    std::cerr << "Noise mask accepted for the wrong sensor" << std::endl;
+    return -1;
+  }
+  catch (std::runtime_error& e) {}
+
+  gSystem->Exec("rm -f tmp.bin");
+  return 0;
+}
+
 int main() {
   int retval = 0;
 
@@ -267,6 +370,8 @@ int main() {
     if ((retval = test_parsing()) != 0) return retval;
     if ((retval = test_errors()) != 0) return retval;
     if ((retval = test_alignment()) != 0) return retval;
+    if ((retval = test_calibration()) != 0) return retval;
+    if ((retval = test_noiseMask()) != 0) return retval;
   }
   
   catch (std::exception& e) {
@@ -4,6 +4,7 @@
 
 #include "mechanics/alignment.h"
 #include "mechanics/sensor.h"
+#include "mechanics/device.h"
 
 bool approxEqual(double v1, double v2, double tol=1E-10) {
   return std::fabs(v1-v2) < tol;
@@ -201,6 +202,92 @@ int test_boxes() {
   return 0;
 }
 
+int test_pixelToSpaceBatch() {
+  Mechanics::Device device(1);
+  Mechanics::Sensor& sensor = device.getSensor(0);
+  sensor.m_nrows = 10;
+  sensor.m_ncols = 20;
+  sensor.m_rowPitch = .5;
+  sensor.m_colPitch = 2;
+  sensor.setOffZ(3);
+  sensor.setRotX(.2);
+  // Changing the device alignment must also move its sensor
+  device.setOffX(-1);
+  device.setRotZ(.4);
+
+  const size_t n = 5;
+  const double cols[n] = { 0, 1.5, 19, -2, 7.25 };
+  const double rows[n] = { 0, 2, 9, 3.5, -1 };
+  double xs[n], ys[n], zs[n];
+  double xes[n], yes[n], zes[n];
+  sensor.pixelToSpace(n, cols, rows, xs, ys, zs);
+  sensor.pixelErrToSpace(n, cols, rows, xes, yes, zes);
+  double map[3][3];
+  sensor.getPixelMap(map);
+
+  for (size_t i = 0; i < n; i++) {
+    // Reference: sensor then device transformation of the local point
+    double x = (cols[i]+.5)*2 - 20;
+    double y = (rows[i]+.5)*.5 - 2.5;
+    double z = 0;
+    sensor.transform(x, y, z);
+    device.transform(x, y, z);
+
+    double x1, y1, z1;
+    sensor.pixelToSpace(cols[i], rows[i], x1, y1, z1);
+    double xe, ye, ze;
+    sensor.pixelErrToSpace(cols[i], rows[i], xe, ye, ze);
+
+    if (!approxEqual(x, x1) || !approxEqual(y, y1) || !approxEqual(z, z1)) {
+      std::cerr << "pixelToSpace doesn't follow the device" << std::endl;
+      return -1;
+    }
+    if (xs[i] != x1 || ys[i] != y1 || zs[i] != z1 ||
+        xes[i] != xe || yes[i] != ye || zes[i] != ze) {
+      std::cerr << "pixelToSpace batch differs from single" << std::endl;
+      return -1;
+    }
+
+    // The pixel map places points and errors alike
+    if (!approxEqual(map[0][0]*cols[i] + map[0][1]*rows[i] + map[0][2], x1) ||
+        !approxEqual(map[1][0]*cols[i] + map[1][1]*rows[i] + map[1][2], y1) ||
+        !approxEqual(map[2][0]*cols[i] + map[2][1]*rows[i] + map[2][2], z1) ||
+        !approxEqual(std::fabs(map[0][0]*cols[i] + map[0][1]*rows[i]), xe) ||
+        !approxEqual(std::fabs(map[1][0]*cols[i] + map[1][1]*rows[i]), ye) ||
+        !approxEqual(std::fabs(map[2][0]*cols[i] + map[2][1]*rows[i]), ze)) {
+      std::cerr << "getPixelMap differs from pixelToSpace" << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int test_pixelNoise() {
+  Mechanics::Sensor sensor;
+  sensor.m_nrows = 2;
+  sensor.m_ncols = 2;
+
+  bool caught = false;
+  try { sensor.getPixelNoise(0, 0); }
+  catch (std::runtime_error& e) { caught = true; }
+  if (!caught) {
+    std::cerr << "getPixelNoise without a profile didn't throw" << std::endl;
+    return -1;
+  }
+
+  // The rate is returned as is, not converted to a flag. Pixels are in
+  // row-major order.
+  sensor.m_noiseProfile.assign(4, 0);
+  sensor.m_noiseProfile[1*2+0] = 0.25;
+  if (sensor.getPixelNoise(1, 0) != 0.25 || sensor.getPixelNoise(0, 1) != 0) {
+    std::cerr << "getPixelNoise returned the wrong rate" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
 int main() {
   int retval = 0;
 
@@ -209,6 +296,8 @@ int main() {
     if ((retval = test_spaceToPixel()) != 0) return retval;
     if ((retval = test_transformations()) != 0) return retval;
     if ((retval = test_boxes()) != 0) return retval;
+    if ((retval = test_pixelToSpaceBatch()) != 0) return retval;
+    if ((retval = test_pixelNoise()) != 0) return retval;
   }
   
   catch (std::exception& e) {
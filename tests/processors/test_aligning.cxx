@@ -1,11 +1,13 @@
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <vector>
 
 #include "storage/event.h"
 #include "storage/cluster.h"
 #include "storage/hit.h"
 #include "mechanics/device.h"
+#include "threadpool.h"
 #include "processors/clustering.h"
 #include "processors/aligning.h"
 
@@ -101,11 +103,90 @@ int test_aligning() {
   return 0;
 }
 
+int test_aligningBatch() {
+  const size_t nplanes = 2;
+  const size_t nevents = 3;
+
+  Mechanics::Device device(nplanes);
+  device.setRotZ(.3);
+  device.getSensor(0).m_colPitch = 2;
+  device.getSensor(1).setOffX(-.5);
+  device.getSensor(1).setRotX(1.1);
+
+  // The same hits in events run one by one and as a block
+  std::vector<Storage::Event*> single;
+  std::vector<Storage::Event*> batch;
+  std::vector<Storage::Event*> pooled;
+  for (size_t ievent = 0; ievent < nevents; ievent++) {
+    single.push_back(new Storage::Event(nplanes));
+    batch.push_back(new Storage::Event(nplanes));
+    pooled.push_back(new Storage::Event(nplanes));
+    for (size_t i = 0; i <= ievent; i++) {
+      single.back()->newHit(i%nplanes).setPix(i, 2*i+ievent);
+      batch.back()->newHit(i%nplanes).setPix(i, 2*i+ievent);
+      pooled.back()->newHit(i%nplanes).setPix(i, 2*i+ievent);
+    }
+  }
+
+  Processors::Clustering clustering;
+  Processors::Aligning aligning(device);
+  for (size_t ievent = 0; ievent < nevents; ievent++) {
+    clustering.execute(*single[ievent]);
+    aligning.execute(*single[ievent]);
+  }
+  clustering.executeBatch(batch);
+  aligning.executeBatch(batch);
+
+  // And again with the planes aligned in parallel
+  Utils::ThreadPool pool(2);
+  Processors::Aligning poolAligning(device);
+  poolAligning.m_pool = &pool;
+  clustering.executeBatch(pooled);
+  poolAligning.executeBatch(pooled);
+
+  int retval = 0;
+  for (size_t ievent = 0; ievent < nevents; ievent++) {
+    const Storage::Event& event1 = *single[ievent];
+    const Storage::Event& event2 = *batch[ievent];
+    const Storage::Event& event3 = *pooled[ievent];
+    if (event1.getNumClusters() != event2.getNumClusters() ||
+        event1.getNumClusters() != event3.getNumClusters()) {
+      std::cerr << "Batch clustering doesn't match" << std::endl;
+      retval = -1;
+      break;
+    }
+    for (size_t i = 0; i < event1.getNumClusters(); i++) {
+      const Storage::Cluster& cluster1 = event1.getCluster(i);
+      const Storage::Cluster& cluster2 = event2.getCluster(i);
+      const Storage::Cluster& cluster3 = event3.getCluster(i);
+      if (cluster1.getPosX() != cluster2.getPosX() ||
+          cluster1.getPosY() != cluster2.getPosY() ||
+          cluster1.getPosZ() != cluster2.getPosZ() ||
+          cluster1.getPosErrX() != cluster2.getPosErrX() ||
+          cluster1.getPosX() != cluster3.getPosX() ||
+          cluster1.getPosY() != cluster3.getPosY() ||
+          cluster1.getPosZ() != cluster3.getPosZ()) {
+        std::cerr << "Batch alignment doesn't match" << std::endl;
+        retval = -1;
+      }
+    }
+  }
+
+  for (size_t ievent = 0; ievent < nevents; ievent++) {
+    delete single[ievent];
+    delete batch[ievent];
+    delete pooled[ievent];
+  }
+
+  return retval;
+}
+
 int main() {
   int retval = 0;
 
   try {
     if ((retval = test_aligning()) != 0) return retval;
+    if ((retval = test_aligningBatch()) != 0) return retval;
   }
   
   catch (std::exception& e) {
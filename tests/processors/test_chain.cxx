@@ -0,0 +1,127 @@
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+
+#include "storage/hit.h"
+#include "storage/cluster.h"
+#include "storage/track.h"
+#include "storage/event.h"
+#include "mechanics/device.h"
+#include "processors/clustering.h"
+#include "processors/aligning.h"
+#include "processors/tracking.h"
+#include "processors/chain.h"
+
+// Straight tracks through all planes, with a second hit next to some
+void fillEvent(Storage::Event& event) {
+  for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++) {
+    for (int itrack = 0; itrack < 3; itrack++) {
+      const int col = 10 + 20*itrack + iplane;
+      const int row = 40 - 10*itrack;
+      event.newHit(iplane).setPix(col, row);
+      if (itrack == 1) event.newHit(iplane).setPix(col+1, row);
+    }
+  }
+}
+
+template <size_t NPLANES>
+int test_chainMatches(size_t nplanes) {
+  Mechanics::Device device(nplanes);
+  for (size_t isensor = 0; isensor < nplanes; isensor++) {
+    device.getSensor(isensor).m_colPitch = 1;
+    device.getSensor(isensor).m_rowPitch = 1;
+    device.getSensor(isensor).setOffZ(isensor);
+  }
+
+  Processors::Clustering clustering;
+  Processors::Aligning aligning(device);
+  Processors::Tracking tracking(nplanes);
+  tracking.m_radius = 10;
+
+  Storage::Event event1(nplanes);
+  fillEvent(event1);
+  clustering.execute(event1);
+  aligning.execute(event1);
+  tracking.execute(event1);
+
+  // The chain copies the processors as configured above
+  Processors::Chain<NPLANES,
+      Processors::Clustering,
+      Processors::Aligning,
+      Processors::Tracking> chain(clustering, aligning, tracking);
+
+  Storage::Event event2(nplanes);
+  fillEvent(event2);
+  chain.execute(event2);
+
+  if (event1.getNumClusters() != event2.getNumClusters() ||
+      event1.getNumTracks() != event2.getNumTracks() ||
+      event2.getNumTracks() != 3) {
+    std::cerr << "Processors::Chain: multiplicity failed" << std::endl;
+    return -1;
+  }
+
+  for (size_t i = 0; i < event1.getNumClusters(); i++) {
+    if (event1.getCluster(i).getPosX() != event2.getCluster(i).getPosX() ||
+        event1.getCluster(i).getPosZ() != event2.getCluster(i).getPosZ()) {
+      std::cerr << "Processors::Chain: clusters failed" << std::endl;
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < event1.getNumTracks(); i++) {
+    const Storage::Track& track1 = event1.getTrack(i);
+    const Storage::Track& track2 = event2.getTrack(i);
+    if (track1.getNumClusters() != track2.getNumClusters() ||
+        track1.getOriginX() != track2.getOriginX() ||
+        track1.getSlopeX() != track2.getSlopeX() ||
+        track1.getChi2() != track2.getChi2()) {
+      std::cerr << "Processors::Chain: tracks failed" << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int test_chainPlanes() {
+  // A fixed plane count must match the events
+  Mechanics::Device device(4);
+  Processors::Clustering clustering;
+  Processors::Aligning aligning(device);
+  Processors::Tracking tracking(4);
+  Processors::Chain<6,
+      Processors::Clustering,
+      Processors::Aligning,
+      Processors::Tracking> chain(clustering, aligning, tracking);
+
+  Storage::Event event(4);
+  fillEvent(event);
+  try {
+    chain.execute(event);
+  }
+  catch (std::runtime_error& e) {
+    return 0;
+  }
+
+  std::cerr << "Processors::Chain: accepted the wrong number of planes"
+      << std::endl;
+  return -1;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_chainMatches<6>(6)) != 0) return retval;
+    if ((retval = test_chainMatches<0>(5)) != 0) return retval;
+    if ((retval = test_chainPlanes()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -1,10 +1,15 @@
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
 
 #include "storage/event.h"
 #include "storage/cluster.h"
 #include "storage/hit.h"
+#include "storage/plane.h"
+#include "threadpool.h"
 #include "processors/clustering.h"
 
 bool approxEqual(double v1, double v2, double tol=1E-10) {
@@ -87,11 +92,165 @@ int test_clustering() {
   return 0;
 }
 
+int test_clusteringPool() {
+  const size_t nplanes = 6;
+  Storage::Event event1(nplanes);
+  Storage::Event event2(nplanes);
+
+  // Busy planes with clusters of varied shapes, the same in both events
+  for (size_t iplane = 0; iplane < nplanes; iplane++) {
+    for (int i = 0; i < 50; i++) {
+      const int col = (i*7 + iplane*3) % 40;
+      const int row = (i*i + iplane) % 25;
+      event1.newHit(iplane).setPix(col, row);
+      event2.newHit(iplane).setPix(col, row);
+    }
+  }
+
+  Processors::Clustering clustering;
+  clustering.execute(event1);
+
+  Utils::ThreadPool pool(4);
+  clustering.m_pool = &pool;
+  clustering.execute(event2);
+
+  if (event1.getNumClusters() != event2.getNumClusters()) {
+    std::cerr << "Processors::Clustering: pool multiplicity failed" << std::endl;
+    return -1;
+  }
+
+  // The clusters must come out in the same order as when run in turn
+  for (size_t i = 0; i < event1.getNumClusters(); i++) {
+    const Storage::Cluster& cluster1 = event1.getCluster(i);
+    const Storage::Cluster& cluster2 = event2.getCluster(i);
+    if (cluster1.fetchPlane()->getPlaneNum() !=
+            cluster2.fetchPlane()->getPlaneNum() ||
+        cluster1.getNumHits() != cluster2.getNumHits() ||
+        cluster1.getPixX() != cluster2.getPixX() ||
+        cluster1.getPixY() != cluster2.getPixY()) {
+      std::cerr << "Processors::Clustering: pool order failed" << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Label the hits of `plane` with the connected groups of neighbours, by
+// checking every pair of hits. Groups are numbered in the order the
+// clustering makes them: the group of the last hit first, then that of the
+// last hit not yet grouped, and so on.
+void bruteForceGroups(
+    const Storage::Plane& plane,
+    int maxRows,
+    int maxCols,
+    std::vector<int>& labels) {
+  const size_t nhits = plane.getNumHits();
+  labels.assign(nhits, -1);
+  int ngroups = 0;
+  for (size_t seed = nhits; seed-- > 0; ) {
+    if (labels[seed] >= 0) continue;
+    labels[seed] = ngroups;
+    std::vector<size_t> search(1, seed);
+    while (!search.empty()) {
+      const Storage::Hit& target = *plane.getHits()[search.back()];
+      search.pop_back();
+      for (size_t i = 0; i < nhits; i++) {
+        if (labels[i] >= 0) continue;
+        const Storage::Hit& hit = *plane.getHits()[i];
+        if (std::abs(hit.getPixX()-target.getPixX()) > maxRows ||
+            std::abs(hit.getPixY()-target.getPixY()) > maxCols)
+          continue;
+        labels[i] = ngroups;
+        search.push_back(i);
+      }
+    }
+    ngroups += 1;
+  }
+}
+
+int test_clusteringRandom() {
+  std::srand(12345);
+  const size_t nplanes = 2;
+
+  for (int trial = 0; trial < 200; trial++) {
+    const int maxRows = trial % 4;
+    const int maxCols = (trial/4) % 3;
+    // Cells are one more than the clustering distance wide
+    const int sizeX = maxRows+1;
+    const int sizeY = maxCols+1;
+
+    Storage::Event event(nplanes);
+    for (size_t iplane = 0; iplane < nplanes; iplane++) {
+      // Scattered hits about 0, so that many have negative indices
+      const int nhits = std::rand() % 80;
+      for (int i = 0; i < nhits; i++)
+        event.newHit(iplane).setPix(
+            std::rand() % 40 - 20,
+            std::rand() % 30 - 15);
+      // Pairs of hits on either side of cell borders, including negative ones
+      for (int i = 0; i < 5; i++) {
+        const int borderX = sizeX * (std::rand() % 10 - 5);
+        const int borderY = sizeY * (std::rand() % 10 - 5);
+        event.newHit(iplane).setPix(borderX-1, borderY);
+        event.newHit(iplane).setPix(borderX, borderY-1);
+        event.newHit(iplane).setPix(
+            borderX + std::rand() % (2*maxRows+1) - maxRows,
+            borderY + std::rand() % (2*maxCols+1) - maxCols);
+      }
+    }
+
+    Processors::Clustering clustering;
+    clustering.m_maxRows = maxRows;
+    clustering.m_maxCols = maxCols;
+    clustering.execute(event);
+
+    for (size_t iplane = 0; iplane < nplanes; iplane++) {
+      const Storage::Plane& plane = event.getPlane(iplane);
+      std::vector<int> labels;
+      bruteForceGroups(plane, maxRows, maxCols, labels);
+
+      int ngroups = 0;
+      for (size_t i = 0; i < labels.size(); i++)
+        ngroups = std::max(ngroups, labels[i]+1);
+      if ((int)plane.getNumClusters() != ngroups) {
+        std::cerr << "Processors::Clustering: random multiplicity failed "
+            "(trial " << trial << ")" << std::endl;
+        return -1;
+      }
+
+      // Each cluster holds exactly the hits of its group
+      for (size_t icluster = 0; icluster < plane.getNumClusters(); icluster++) {
+        const Storage::Cluster& cluster = *plane.getClusters()[icluster];
+        size_t ninGroup = 0;
+        for (size_t i = 0; i < labels.size(); i++)
+          ninGroup += labels[i] == (int)icluster;
+        bool good = cluster.getNumHits() == ninGroup;
+        for (size_t ihit = 0; good && ihit < cluster.getNumHits(); ihit++) {
+          const Storage::Hit* hit = &cluster.getHit(ihit);
+          size_t i = 0;
+          while (i < labels.size() && plane.getHits()[i] != hit) i++;
+          good = i < labels.size() && labels[i] == (int)icluster;
+        }
+        if (!good) {
+          std::cerr << "Processors::Clustering: random grouping failed "
+              "(trial " << trial << ")" << std::endl;
+          return -1;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
 int main() {
   int retval = 0;
 
   try {
     if ((retval = test_clustering()) != 0) return retval;
+    if ((retval = test_clusteringPool()) != 0) return retval;
+    if ((retval = test_clusteringRandom()) != 0) return retval;
   }
   
   catch (std::exception& e) {
@@ -0,0 +1,252 @@
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+
+#include "utils.h"
+#include "storage/cluster.h"
+#include "storage/plane.h"
+#include "storage/event.h"
+#include "storage/track.h"
+#include "mechanics/device.h"
+#include "mechanics/sensor.h"
+#include "processors/kalmantracking.h"
+
+bool approxEqual(double v1, double v2, double tol=1E-10) {
+  return std::fabs(v1-v2) < tol;
+}
+
+void newCluster(
+    Storage::Event& event,
+    size_t iplane,
+    double posx,
+    double posy,
+    double err=1) {
+  event.newCluster(iplane);
+  event.getPlane(iplane).getClusters().back()->setPos(posx, posy, iplane);
+  event.getPlane(iplane).getClusters().back()->setPosErr(err, err, 1);
+}
+
+// Device with its sensors 1 apart along z, starting at 0, as the clusters
+void placeSensors(Mechanics::Device& device) {
+  for (size_t i = 0; i < device.getNumSensors(); i++)
+    device.getSensor(i).setOffZ(i);
+}
+
+int test_highland() {
+  // 13.6 MeV * sqrt(0.01) * (1 + 0.038 ln(0.01)) at 1 GeV
+  const double expected = 0.0136 * 0.1 * (1 + 0.038*std::log(0.01));
+  if (!approxEqual(Processors::KalmanTracking::highland(0.01, 1), expected) ||
+      !approxEqual(Processors::KalmanTracking::highland(0.01, 2),
+          expected/2) ||
+      Processors::KalmanTracking::highland(0, 1) != 0 ||
+      Processors::KalmanTracking::highland(-1, 1) != 0) {
+    std::cerr << "Processors::KalmanTracking: wrong scattering angle"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_kalmanFit() {
+  const size_t nplanes = 4;
+  Mechanics::Device device(nplanes);
+  placeSensors(device);
+
+  Storage::Event event(nplanes);
+  double x[nplanes] = { -0.10, +0.05, +0.10, +0.32 };
+  double xe[nplanes] = { .1, .2, .4, .3 };
+  double y[nplanes] = { -0.20, -0.05, +0.20, +0.28 };
+  double ye[nplanes] = { .2, .3, .5, .1 };
+  double z[nplanes] = { 0, 1, 2, 3 };
+  for (size_t i = 0; i < nplanes; i++) {
+    newCluster(event, i, x[i], y[i]);
+    event.getClusters().back()->setPosErr(xe[i], ye[i], 1);
+  }
+
+  // Without material and with a loose slope prior, the filter gives the
+  // straight line fit
+  Processors::KalmanTracking tracking(device);
+  tracking.m_slopeSigma = 1e3;
+  tracking.execute(event);
+
+  if (event.getNumTracks() != 1 ||
+      event.getTrack(0).getNumClusters() != nplanes) {
+    std::cerr << "Processors::KalmanTracking: fit track not found"
+        << std::endl;
+    return -1;
+  }
+  const Storage::Track& track = event.getTrack(0);
+
+  double p0, p1, p0e, p1e, cov, chi2;
+  double sumChi2 = 0;
+
+  Utils::linearFit(nplanes, z, x, xe, p0, p1, p0e, p1e, cov, chi2);
+  sumChi2 += chi2;
+  if (!approxEqual(track.getOriginX(), p0, 1e-5) ||
+      !approxEqual(track.getOriginErrX(), p0e, 1e-5) ||
+      !approxEqual(track.getSlopeX(), p1, 1e-5) ||
+      !approxEqual(track.getSlopeErrX(), p1e, 1e-5) ||
+      !approxEqual(track.getCovarianceX(), cov, 1e-5)) {
+    std::cerr << "Processors::KalmanTracking: x doesn't match the fit"
+        << std::endl;
+    return -1;
+  }
+
+  Utils::linearFit(nplanes, z, y, ye, p0, p1, p0e, p1e, cov, chi2);
+  sumChi2 += chi2;
+  if (!approxEqual(track.getOriginY(), p0, 1e-5) ||
+      !approxEqual(track.getOriginErrY(), p0e, 1e-5) ||
+      !approxEqual(track.getSlopeY(), p1, 1e-5) ||
+      !approxEqual(track.getSlopeErrY(), p1e, 1e-5) ||
+      !approxEqual(track.getCovarianceY(), cov, 1e-5)) {
+    std::cerr << "Processors::KalmanTracking: y doesn't match the fit"
+        << std::endl;
+    return -1;
+  }
+
+  if (!approxEqual(track.getChi2(), sumChi2/(2.*nplanes-2), 1e-5)) {
+    std::cerr << "Processors::KalmanTracking: chi2 doesn't match the fit"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_kalmanGate() {
+  const size_t nplanes = 4;
+  Mechanics::Device device(nplanes);
+  placeSensors(device);
+
+  // Two tracks with slopes 0.5 and -0.5, and 1e-3 errors. The second track
+  // kinks on the last plane by 1e-2, far outside a 3 sigma gate.
+  Storage::Event event(nplanes);
+  for (size_t i = 0; i < nplanes; i++) {
+    newCluster(event, i, 0.5*i, 0, 1e-3);
+    newCluster(event, i, 100 - 0.5*i + ((i == 3) ? 1e-2 : 0), 0, 1e-3);
+  }
+
+  Processors::KalmanTracking tracking(device);
+  tracking.m_gate = 3;
+  tracking.m_minClusters = 3;
+  // Slopes of up to 1 are allowed from the first cluster
+  tracking.m_slopeSigma = 1;
+  tracking.execute(event);
+
+  if (event.getNumTracks() != 2 ||
+      event.getTrack(0).getNumClusters() != 4 ||
+      event.getTrack(1).getNumClusters() != 3 ||
+      !approxEqual(event.getTrack(0).getSlopeX(), 0.5, 1e-6) ||
+      !approxEqual(event.getTrack(1).getSlopeX(), -0.5, 1e-6)) {
+    std::cerr << "Processors::KalmanTracking: gating failed" << std::endl;
+    return -1;
+  }
+
+  // Scattering in the material before the last plane lets the kink through
+  Storage::Event event2(nplanes);
+  for (size_t i = 0; i < nplanes; i++) {
+    newCluster(event2, i, 0.5*i, 0, 1e-3);
+    newCluster(event2, i, 100 - 0.5*i + ((i == 3) ? 1e-2 : 0), 0, 1e-3);
+  }
+  // About 9 mrad of scattering at 1 GeV, lumped at the third plane
+  device.getSensor(3).m_xox0 = 0.5;
+  tracking.m_momentum = 1;
+  tracking.execute(event2);
+
+  if (event2.getNumTracks() != 2 ||
+      event2.getTrack(0).getNumClusters() != 4 ||
+      event2.getTrack(1).getNumClusters() != 4) {
+    std::cerr << "Processors::KalmanTracking: scattering not accounted"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_kalmanShared() {
+  const size_t nplanes = 4;
+  Mechanics::Device device(nplanes);
+  placeSensors(device);
+
+  // Two straight tracks 1 apart, and a cluster on the third plane between
+  // them but closer to the first: it goes to the first, and the second
+  // takes its own cluster
+  Storage::Event event(nplanes);
+  for (size_t i = 0; i < nplanes; i++) {
+    newCluster(event, i, 0, 0, 0.1);
+    newCluster(event, i, 1, 0, 0.1);
+  }
+  event.getPlane(2).getCluster(0).setPos(0.4, 0, 2);
+
+  Processors::KalmanTracking tracking(device);
+  tracking.m_gate = 10;
+  tracking.m_slopeSigma = 0.01;
+  tracking.execute(event);
+
+  if (event.getNumTracks() != 2 ||
+      event.getTrack(0).getNumClusters() != 4 ||
+      event.getTrack(1).getNumClusters() != 4 ||
+      &event.getTrack(0).getCluster(2) != &event.getPlane(2).getCluster(0) ||
+      &event.getTrack(1).getCluster(2) != &event.getPlane(2).getCluster(1)) {
+    std::cerr << "Processors::KalmanTracking: shared cluster misassigned"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_kalmanSecondChoice() {
+  const size_t nplanes = 4;
+  Mechanics::Device device(nplanes);
+  placeSensors(device);
+
+  // Two straight tracks 1 apart. On the third plane, the first track's
+  // cluster is closer to the second track than its own cluster: the second
+  // track loses it to the first, and takes its own cluster instead.
+  Storage::Event event(nplanes);
+  for (size_t i = 0; i < nplanes; i++) {
+    newCluster(event, i, 0, 0, 0.1);
+    newCluster(event, i, 1, 0, 0.1);
+  }
+  event.getPlane(2).getCluster(0).setPos(0.45, 0, 2);
+  event.getPlane(2).getCluster(1).setPos(1.7, 0, 2);
+
+  Processors::KalmanTracking tracking(device);
+  tracking.m_gate = 10;
+  tracking.m_slopeSigma = 0.01;
+  tracking.execute(event);
+
+  if (event.getNumTracks() != 2 ||
+      event.getTrack(0).getNumClusters() != 4 ||
+      event.getTrack(1).getNumClusters() != 4 ||
+      &event.getTrack(0).getCluster(2) != &event.getPlane(2).getCluster(0) ||
+      &event.getTrack(1).getCluster(2) != &event.getPlane(2).getCluster(1)) {
+    std::cerr << "Processors::KalmanTracking: second choice cluster lost"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_highland()) != 0) return retval;
+    if ((retval = test_kalmanFit()) != 0) return retval;
+    if ((retval = test_kalmanGate()) != 0) return retval;
+    if ((retval = test_kalmanShared()) != 0) return retval;
+    if ((retval = test_kalmanSecondChoice()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+
+#include "utils.h"
+#include "storage/hit.h"
+#include "storage/cluster.h"
+#include "storage/track.h"
+#include "storage/event.h"
+#include "mechanics/device.h"
+#include "processors/clustering.h"
+#include "processors/aligning.h"
+#include "processors/tracking.h"
+
+// Close within `rel` of the magnitude of the values, and `abs` near 0
+bool approxEqual(double v1, double v2, double rel, double abs) {
+  return std::fabs(v1-v2) <= rel*std::max(std::fabs(v1), std::fabs(v2)) + abs;
+}
+
+// Telescope sized planes (micron units) spread over a meter, slightly
+// rotated
+void setupDevice(Mechanics::Device& device) {
+  device.setOffX(250);
+  device.setRotZ(0.002);
+  for (size_t i = 0; i < device.getNumSensors(); i++) {
+    Mechanics::Sensor& sensor = device.getSensor(i);
+    sensor.m_ncols = 1152;
+    sensor.m_nrows = 576;
+    sensor.m_colPitch = 18.4;
+    sensor.m_rowPitch = 18.4;
+    sensor.setOffX(-35.5 + 12.25*i);
+    sensor.setOffY(14.75 - 3.5*i);
+    sensor.setOffZ(150000.*i);
+    sensor.setRotZ(0.01 - 0.003*i);
+  }
+}
+
+// Slanted tracks with clusters of a few weighted hits
+void fillEvent(Storage::Event& event) {
+  for (size_t iplane = 0; iplane < event.getNumPlanes(); iplane++) {
+    for (int itrack = 0; itrack < 8; itrack++) {
+      const int col = 100 + 110*itrack + 3*iplane;
+      const int row = 50 + 60*itrack - 2*iplane;
+      event.newHit(iplane).setPix(col, row);
+      event.getHit(event.getNumHits()-1).setValue(7 + itrack);
+      event.newHit(iplane).setPix(col+1, row);
+      event.getHit(event.getNumHits()-1).setValue(3 + iplane);
+      if (itrack % 2) {
+        event.newHit(iplane).setPix(col, row+1);
+        event.getHit(event.getNumHits()-1).setValue(5);
+      }
+    }
+  }
+}
+
+// Process an event with all stages in the requested precision
+void processEvent(
+    Mechanics::Device& device,
+    Storage::Event& event,
+    bool singlePrecision) {
+  Processors::Clustering clustering;
+  clustering.m_weighted = true;
+  clustering.m_singlePrecision = singlePrecision;
+  Processors::Aligning aligning(device);
+  aligning.m_singlePrecision = singlePrecision;
+  Processors::Tracking tracking(device.getNumSensors());
+  tracking.m_radius = 1000;
+  tracking.m_singlePrecision = singlePrecision;
+
+  fillEvent(event);
+  clustering.execute(event);
+  aligning.execute(event);
+  tracking.execute(event);
+}
+
+int test_precisionBounds() {
+  const size_t nplanes = 6;
+  Mechanics::Device device(nplanes);
+  setupDevice(device);
+
+  Storage::Event event1(nplanes);
+  processEvent(device, event1, false);
+  Storage::Event event2(nplanes);
+  processEvent(device, event2, true);
+
+  if (event1.getNumClusters() != event2.getNumClusters() ||
+      event1.getNumTracks() != event2.getNumTracks() ||
+      event1.getNumTracks() != 8) {
+    std::cerr << "Processors: single precision changed the multiplicity"
+        << std::endl;
+    return -1;
+  }
+
+  // Positions to well within a micron, and float's precision relative to
+  // their magnitude (the planes are up to 75 cm away)
+  for (size_t i = 0; i < event1.getNumClusters(); i++) {
+    const Storage::Cluster& c1 = event1.getCluster(i);
+    const Storage::Cluster& c2 = event2.getCluster(i);
+    if (!approxEqual(c1.getPixX(), c2.getPixX(), 1e-6, 1e-5) ||
+        !approxEqual(c1.getPixY(), c2.getPixY(), 1e-6, 1e-5) ||
+        !approxEqual(c1.getPixErrX(), c2.getPixErrX(), 1e-5, 1e-6) ||
+        !approxEqual(c1.getPixErrY(), c2.getPixErrY(), 1e-5, 1e-6)) {
+      std::cerr << "Processors: single precision cluster out of bounds"
+          << std::endl;
+      return -1;
+    }
+    if (!approxEqual(c1.getPosX(), c2.getPosX(), 1e-6, 1e-2) ||
+        !approxEqual(c1.getPosY(), c2.getPosY(), 1e-6, 1e-2) ||
+        !approxEqual(c1.getPosZ(), c2.getPosZ(), 1e-6, 1e-2) ||
+        !approxEqual(c1.getPosErrX(), c2.getPosErrX(), 1e-5, 1e-4) ||
+        !approxEqual(c1.getPosErrY(), c2.getPosErrY(), 1e-5, 1e-4)) {
+      std::cerr << "Processors: single precision position out of bounds"
+          << std::endl;
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < event1.getNumTracks(); i++) {
+    const Storage::Track& t1 = event1.getTrack(i);
+    const Storage::Track& t2 = event2.getTrack(i);
+    if (!approxEqual(t1.getOriginX(), t2.getOriginX(), 1e-5, 1e-1) ||
+        !approxEqual(t1.getOriginY(), t2.getOriginY(), 1e-5, 1e-1) ||
+        !approxEqual(t1.getSlopeX(), t2.getSlopeX(), 1e-4, 1e-7) ||
+        !approxEqual(t1.getSlopeY(), t2.getSlopeY(), 1e-4, 1e-7) ||
+        !approxEqual(t1.getChi2(), t2.getChi2(), 1e-2, 1e-3)) {
+      std::cerr << "Processors: single precision track out of bounds"
+          << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int test_linearFitPrecision() {
+  // A fit at telescope distances in float, against the same in double
+  const unsigned n = 6;
+  double xd[n], yd[n], yed[n];
+  float xf[n], yf[n], yef[n];
+  for (unsigned i = 0; i < n; i++) {
+    xd[i] = 150000.*i;
+    yd[i] = 1234.5 + 1e-3*xd[i] + ((i%2) ? 2.1 : -1.7);
+    yed[i] = 5.3;
+    xf[i] = xd[i];
+    yf[i] = yd[i];
+    yef[i] = yed[i];
+  }
+
+  double p0d, p1d, p0ed, p1ed, covd, chi2d;
+  Utils::linearFit(n, xd, yd, yed, p0d, p1d, p0ed, p1ed, covd, chi2d);
+  float p0f, p1f, p0ef, p1ef, covf, chi2f;
+  Utils::linearFit(n, xf, yf, yef, p0f, p1f, p0ef, p1ef, covf, chi2f);
+
+  if (!approxEqual(p0d, p0f, 1e-5, 1e-2) ||
+      !approxEqual(p1d, p1f, 1e-4, 1e-8) ||
+      !approxEqual(p0ed, p0ef, 1e-4, 0) ||
+      !approxEqual(p1ed, p1ef, 1e-4, 0) ||
+      !approxEqual(chi2d, chi2f, 1e-2, 1e-4)) {
+    std::cerr << "Utils: linearFit: single precision out of bounds"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_precisionBounds()) != 0) return retval;
+    if ((retval = test_linearFitPrecision()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <cstdio>
 
 #include "utils.h"
 #include "storage/hit.h"
@@ -216,6 +217,63 @@ int test_radius() {
   return 0;
 }
 
+int test_transitionsFile() {
+  const size_t nplanes = 4;
+  Storage::Event event(nplanes);
+
+  // Same clusters as the radius test
+  newCluster(event, 0, 0, 0);
+  newCluster(event, 1, .9, 9);
+  newCluster(event, 1, 1.1, 11);
+  newCluster(event, 2, 2.1, 21);
+  newCluster(event, 3, 2.8, 28);
+  newCluster(event, 3, 3.2, 32);
+
+  // Transitions measured once, written and shared
+  {
+    Processors::Tracking measured(nplanes);
+    measured.setTransitionX(0, 1, 1);
+    measured.setTransitionY(0, 1, 10);
+    measured.setTransitionX(1, 2, 1);
+    measured.setTransitionY(1, 2, 10);
+    measured.setTransitionX(1, 3, 2);
+    measured.setTransitionY(1, 3, 20);
+    measured.writeTransitions("tmp_transitions.txt");
+  }
+
+  Processors::Tracking tracking(nplanes);
+  tracking.m_minClusters = 3;
+  tracking.m_radius = std::sqrt(2);
+  tracking.readTransitions("tmp_transitions.txt");
+
+  tracking.execute(event);
+
+  if (event.getNumTracks() != 1 ||
+      event.getTrack(0).getNumClusters() != 3) {
+    std::cerr << "Processors::Tracking: transitions read from file failed" << std::endl;
+    return -1;
+  }
+
+  // Transitions of more planes than the tracking don't fit
+  bool thrown = false;
+  try {
+    Processors::Tracking small(nplanes-1);
+    small.readTransitions("tmp_transitions.txt");
+  }
+  catch (std::runtime_error& e) {
+    thrown = true;
+  }
+
+  if (!thrown) {
+    std::cerr << "Processors::Tracking: transitions planes not checked" << std::endl;
+    return -1;
+  }
+
+  std::remove("tmp_transitions.txt");
+
+  return 0;
+}
+
 int test_values() {
   const size_t nplanes = 3;
   Storage::Event event(nplanes);
@@ -282,6 +340,63 @@ int test_values() {
   return 0;
 }
 
+int test_multiplicity() {
+  const size_t nplanes = 6;
+  Storage::Event event(nplanes);
+
+  // A 30x30 lattice of parallel tracks, 10 apart and centered on 0, with the
+  // clusters of each plane listed column by column on even planes, and row
+  // by row on odd ones. Tracks drift by up to 0.5 per plane.
+  const int nside = 30;
+  for (size_t iplane = 0; iplane < nplanes; iplane++) {
+    for (int i = 0; i < nside; i++) {
+      for (int j = 0; j < nside; j++) {
+        const int ix = (iplane%2) ? j : i;
+        const int iy = (iplane%2) ? i : j;
+        const double drift = 0.1 * ((ix*7 + iy*3) % 6) * iplane;
+        newCluster(event, iplane,
+            10*(ix-nside/2) + drift, 10*(iy-nside/2) - drift);
+      }
+    }
+  }
+
+  Processors::Tracking tracking(nplanes);
+  tracking.m_minClusters = 6;
+  // Clusters within 1 of the previous one are matched
+  tracking.m_radius = 1;
+
+  tracking.execute(event);
+
+  if (event.getNumTracks() != (size_t)(nside*nside)) {
+    std::cerr << "Processors::Tracking: high multiplicity failed" << std::endl;
+    return -1;
+  }
+
+  // Clusters of a track are all from the same lattice point
+  for (size_t itrack = 0; itrack < event.getNumTracks(); itrack++) {
+    const Storage::Track& track = event.getTrack(itrack);
+    const double x0 = track.getCluster(0).getPosX();
+    const double y0 = track.getCluster(0).getPosY();
+    for (size_t i = 1; i < track.getNumClusters(); i++) {
+      if (std::fabs(track.getCluster(i).getPosX()-x0) > 3 ||
+          std::fabs(track.getCluster(i).getPosY()-y0) > 3) {
+        std::cerr << "Processors::Tracking: high multiplicity tracks mixed"
+            << std::endl;
+        return -1;
+      }
+    }
+  }
+
+  // Seeds come out in the order of their clusters
+  if (&event.getTrack(1).getCluster(0) != &event.getPlane(0).getCluster(1)) {
+    std::cerr << "Processors::Tracking: high multiplicity track order"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
 int main() {
   int retval = 0;
 
@@ -289,6 +404,8 @@ int main() {
     if ((retval = test_association()) != 0) return retval;
     if ((retval = test_minClusters()) != 0) return retval;
     if ((retval = test_radius()) != 0) return retval;
+    if ((retval = test_transitionsFile()) != 0) return retval;
+    if ((retval = test_multiplicity()) != 0) return retval;
     if ((retval = test_values()) != 0) return retval;
   }
   
@@ -0,0 +1,358 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <set>
+#include <cmath>
+
+#include <TSystem.h>
+#include <TFile.h>
+
+#include "storage/storageo.h"
+#include "storage/storagei.h"
+#include "storage/event.h"
+#include "storage/plane.h"
+#include "storage/cluster.h"
+#include "storage/hit.h"
+#include "storage/clusterdictionary.h"
+
+// Make a cluster on plane 0 of `event` from hits at the given offsets from
+// (x0, y0), with the unweighted center and errors of those hits
+Storage::Cluster& makeCluster(
+    Storage::Event& event,
+    int x0,
+    int y0,
+    const int* dx,
+    const int* dy,
+    size_t nhits) {
+  Storage::Cluster& cluster = event.newCluster(0);
+  double sumX = 0;
+  double sumY = 0;
+  for (size_t i = 0; i < nhits; i++) {
+    Storage::Hit& hit = event.newHit(0);
+    hit.setPix(x0+dx[i], y0+dy[i]);
+    cluster.addHit(hit);
+    sumX += x0+dx[i];
+    sumY += y0+dy[i];
+  }
+  cluster.setPix(sumX/nhits, sumY/nhits);
+  // Errors only depend on the shape, any value which does will do
+  cluster.setPixErr(0.1*nhits, 0.2*nhits);
+  return cluster;
+}
+
+const int singleX[] = { 0 };
+const int singleY[] = { 0 };
+const int pairX[] = { 1, 0 };
+const int pairY[] = { 0, 0 };
+const int cornerX[] = { 0, 1, 1 };
+const int cornerY[] = { 1, 1, 0 };
+const int longX[] = { 0, 8 };
+const int longY[] = { 0, 0 };
+
+int test_clusterEncode() {
+  Storage::Event event(1);
+
+  Int_t anchorX = 0;
+  Int_t anchorY = 0;
+  ULong64_t shape = 0;
+
+  // Anchor at the lowest column and row, even without a hit there
+  const Storage::Cluster& corner = makeCluster(event, 10, 20, cornerX, cornerY, 3);
+  if (!Storage::ClusterDictionary::encode(corner, anchorX, anchorY, shape) ||
+      anchorX != 10 || anchorY != 20 ||
+      shape != ((1 << PATTERN_SIZE) | (1 << (PATTERN_SIZE+1)) | (1 << 1))) {
+    std::cerr << "ClusterDictionary: wrong encoding" << std::endl;
+    return -1;
+  }
+
+  // Too long for a pattern
+  const Storage::Cluster& wide = makeCluster(event, 0, 0, longX, longY, 2);
+  if (Storage::ClusterDictionary::encode(wide, anchorX, anchorY, shape)) {
+    std::cerr << "ClusterDictionary: encoded an oversized cluster" << std::endl;
+    return -1;
+  }
+
+  // Nothing to encode without hits
+  const Storage::Cluster& empty = event.newCluster(0);
+  if (Storage::ClusterDictionary::encode(empty, anchorX, anchorY, shape)) {
+    std::cerr << "ClusterDictionary: encoded a cluster without hits" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+// Calibrate on 5 singles, 3 pairs and a corner
+void calibrate(Storage::ClusterDictionary& dictionary) {
+  Storage::Event event(1);
+  for (int i = 0; i < 5; i++)
+    dictionary.addCluster(makeCluster(event, i, 2*i, singleX, singleY, 1));
+  for (int i = 0; i < 3; i++)
+    dictionary.addCluster(makeCluster(event, 3*i, i, pairX, pairY, 2));
+  dictionary.addCluster(makeCluster(event, 7, 7, cornerX, cornerY, 3));
+  dictionary.addCluster(makeCluster(event, 7, 7, longX, longY, 2));
+}
+
+int test_clusterBuild() {
+  Storage::ClusterDictionary dictionary;
+  calibrate(dictionary);
+
+  if (dictionary.getNumCandidates() != 3) {
+    std::cerr << "ClusterDictionary: wrong number of shapes" << std::endl;
+    return -1;
+  }
+
+  // Only the shapes seen twice, most frequent first
+  dictionary.build(10, 2);
+  if (dictionary.getNumPatterns() != 2 ||
+      dictionary.getPattern(0).count != 5 ||
+      dictionary.getPattern(1).count != 3 ||
+      dictionary.findPattern(dictionary.getPattern(1).shape) != 1 ||
+      dictionary.findPattern(0x6) != -1) {
+    std::cerr << "ClusterDictionary: wrong patterns" << std::endl;
+    return -1;
+  }
+
+  const Storage::ClusterDictionary::Pattern& pair = dictionary.getPattern(1);
+  if (std::fabs(pair.offsetX-0.5) > 1e-12 || std::fabs(pair.offsetY) > 1e-12 ||
+      std::fabs(pair.errX-0.2) > 1e-12 || std::fabs(pair.errY-0.4) > 1e-12) {
+    std::cerr << "ClusterDictionary: wrong pattern values" << std::endl;
+    return -1;
+  }
+
+  // Limit the number kept
+  dictionary.build(1);
+  if (dictionary.getNumPatterns() != 1 || dictionary.getPattern(0).count != 5) {
+    std::cerr << "ClusterDictionary: kept too many patterns" << std::endl;
+    return -1;
+  }
+
+  // Calibrations split in parts add up to the same
+  Storage::ClusterDictionary part1;
+  Storage::ClusterDictionary part2;
+  calibrate(part1);
+  calibrate(part2);
+  part1.add(part2);
+  part1.build(10, 2);
+  Storage::ClusterDictionary twice;
+  calibrate(twice);
+  calibrate(twice);
+  twice.build(10, 2);
+  if (part1.getNumPatterns() != twice.getNumPatterns() ||
+      part1.isSame(dictionary)) {
+    std::cerr << "ClusterDictionary: added calibration differs" << std::endl;
+    return -1;
+  }
+  // Sums are added in another order, so only close to the same
+  for (size_t i = 0; i < part1.getNumPatterns(); i++) {
+    const Storage::ClusterDictionary::Pattern& a = part1.getPattern(i);
+    const Storage::ClusterDictionary::Pattern& b = twice.getPattern(i);
+    if (a.shape != b.shape || a.count != b.count ||
+        std::fabs(a.offsetX-b.offsetX) > 1e-12 ||
+        std::fabs(a.errY-b.errY) > 1e-12) {
+      std::cerr << "ClusterDictionary: added calibration differs" << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int test_clusterPatternedStorage() {
+  Storage::ClusterDictionary dictionary;
+  calibrate(dictionary);
+  dictionary.build(10);
+
+  // Write one event with clusters with and without patterns
+  std::vector<double> pixX;
+  std::vector<double> pixY;
+  std::vector<double> pixErrX;
+  std::vector<size_t> numHits;
+  {
+    Storage::StorageO store(
+        "tmp_patterns.root", 1, Storage::StorageIO::TRACKS,
+        0, 0, 0, 0, &dictionary);
+    if (!store.isClustersPatterned()) {
+      std::cerr << "StorageO: clusters not patterned" << std::endl;
+      return -1;
+    }
+
+    Storage::Event& event = store.newEvent();
+    makeCluster(event, 100, 200, pairX, pairY, 2);
+    makeCluster(event, 50, 60, longX, longY, 2);  // no pattern
+    makeCluster(event, 30, 40, cornerX, cornerY, 3);
+    // Shape in the dictionary, but values which it doesn't give back
+    makeCluster(event, 70, 80, singleX, singleY, 1).setPix(70.25, 80);
+    makeCluster(event, 1, 2, singleX, singleY, 1);
+
+    for (size_t i = 0; i < event.getNumClusters(); i++) {
+      pixX.push_back(event.getCluster(i).getPixX());
+      pixY.push_back(event.getCluster(i).getPixY());
+      pixErrX.push_back(event.getCluster(i).getPixErrX());
+      numHits.push_back(event.getCluster(i).getNumHits());
+    }
+
+    store.writeEvent(event);
+  }
+
+  Storage::StorageI store("tmp_patterns.root", Storage::StorageIO::TRACKS);
+  if (!store.isClustersPatterned() ||
+      !store.getClusterPatterns().isSame(dictionary)) {
+    std::cerr << "StorageI: patterns not read back" << std::endl;
+    return -1;
+  }
+
+  // Positions aren't stored, they come from the plane's pixel map
+  const std::set<std::string>& off = store.getClustersBranchesOff();
+  if (off.find("PosX") == off.end() || off.find("PosErrZ") == off.end()) {
+    std::cerr << "StorageO: patterned clusters stored their positions"
+        << std::endl;
+    return -1;
+  }
+  const double map[3][3] = { { 2, 0, -1 }, { 0.5, -1, 3 }, { 0, 0.25, 7 } };
+  store.setPixelMap(0, map);
+
+  const Storage::Event& event = store.readEvent(0);
+  if (event.getNumClusters() != pixX.size() || event.getNumHits() != 9) {
+    std::cerr << "StorageI: wrong patterned event content" << std::endl;
+    return -1;
+  }
+  for (size_t i = 0; i < event.getNumClusters(); i++) {
+    const Storage::Cluster& cluster = event.getCluster(i);
+    if (std::fabs(cluster.getPixX()-pixX[i]) > 1e-9 ||
+        std::fabs(cluster.getPixY()-pixY[i]) > 1e-9 ||
+        std::fabs(cluster.getPixErrX()-pixErrX[i]) > 1e-9 ||
+        cluster.getNumHits() != numHits[i]) {
+      std::cerr << "StorageI: patterned cluster " << i << " doesn't match"
+          << std::endl;
+      return -1;
+    }
+    const double errY = cluster.getPixErrY();
+    if (std::fabs(cluster.getPosX() - (2*pixX[i] - 1)) > 1e-9 ||
+        std::fabs(cluster.getPosY() - (0.5*pixX[i] - pixY[i] + 3)) > 1e-9 ||
+        std::fabs(cluster.getPosZ() - (0.25*pixY[i] + 7)) > 1e-9 ||
+        std::fabs(cluster.getPosErrX() - 2*pixErrX[i]) > 1e-9 ||
+        std::fabs(cluster.getPosErrY() - std::fabs(0.5*pixErrX[i] - errY)) > 1e-9 ||
+        std::fabs(cluster.getPosErrZ() - 0.25*errY) > 1e-9) {
+      std::cerr << "StorageI: patterned cluster " << i << " misplaced"
+          << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int test_clusterPatternedBranchesOff() {
+  Storage::ClusterDictionary dictionary;
+  calibrate(dictionary);
+  dictionary.build(10);
+
+  // Turning off the pattern branch stores the clusters in full
+  {
+    std::set<std::string> branchesOff;
+    branchesOff.insert("Pattern");
+    Storage::StorageO store(
+        "tmp_patterns.root", 1, Storage::StorageIO::TRACKS,
+        0, &branchesOff, 0, 0, &dictionary);
+    if (store.isClustersPatterned()) {
+      std::cerr << "StorageO: patterned without the pattern branch"
+          << std::endl;
+      return -1;
+    }
+    Storage::Event& event = store.newEvent();
+    makeCluster(event, 100, 200, pairX, pairY, 2);
+    store.writeEvent(event);
+  }
+  {
+    Storage::StorageI store("tmp_patterns.root", Storage::StorageIO::TRACKS);
+    const Storage::Event& event = store.readEvent(0);
+    if (store.isClustersPatterned() || event.getNumClusters() != 1 ||
+        event.getCluster(0).getPixX() != 100.5 ||
+        event.getCluster(0).getPixY() != 200) {
+      std::cerr << "StorageI: clusters not stored in full" << std::endl;
+      return -1;
+    }
+  }
+
+  // Other pattern branches which are off are neither written nor read
+  {
+    std::set<std::string> branchesOff;
+    branchesOff.insert("AnchorX");
+    branchesOff.insert("OtherPixErrX");
+    Storage::StorageO store(
+        "tmp_patterns.root", 1, Storage::StorageIO::TRACKS,
+        0, &branchesOff, 0, 0, &dictionary);
+    Storage::Event& event = store.newEvent();
+    makeCluster(event, 100, 200, pairX, pairY, 2);
+    makeCluster(event, 50, 60, longX, longY, 2);  // no pattern
+    store.writeEvent(event);
+  }
+
+  Storage::StorageI store("tmp_patterns.root", Storage::StorageIO::TRACKS);
+  const std::set<std::string>& off = store.getClustersBranchesOff();
+  if (!store.isClustersPatterned() ||
+      off.find("AnchorX") == off.end() ||
+      off.find("OtherPixErrX") == off.end() ||
+      off.find("AnchorY") != off.end() ||
+      off.find("OtherPixX") != off.end()) {
+    std::cerr << "StorageI: wrong pattern branches read" << std::endl;
+    return -1;
+  }
+  const Storage::Event& event = store.readEvent(0);
+  if (event.getNumClusters() != 2 ||
+      event.getCluster(0).getPixX() != 0 ||
+      std::fabs(event.getCluster(0).getPixY()-200) > 1e-9 ||
+      event.getCluster(1).getPixX() != 54 ||
+      event.getCluster(1).getPixErrX() != 0 ||
+      std::fabs(event.getCluster(1).getPixErrY()-0.4) > 1e-9) {
+    std::cerr << "StorageI: wrong values with pattern branches off"
+        << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_clusterDictionaryFile() {
+  Storage::ClusterDictionary dictionary;
+  calibrate(dictionary);
+  dictionary.build(10);
+
+  {
+    TFile file("tmp_dictionary.root", "RECREATE");
+    dictionary.write(file);
+    file.Close();
+  }
+
+  Storage::ClusterDictionary read;
+  TFile file("tmp_dictionary.root");
+  if (!read.read(file) || !read.isSame(dictionary)) {
+    std::cerr << "ClusterDictionary: file round trip differs" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_clusterEncode()) != 0) return retval;
+    if ((retval = test_clusterBuild()) != 0) return retval;
+    if ((retval = test_clusterPatternedStorage()) != 0) return retval;
+    if ((retval = test_clusterPatternedBranchesOff()) != 0) return retval;
+    if ((retval = test_clusterDictionaryFile()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  gSystem->Exec("rm -f tmp_patterns.root tmp_dictionary.root");
+
+  return 0;
+}
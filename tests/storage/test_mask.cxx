@@ -1,5 +1,8 @@
 #include <iostream>
 #include <stdexcept>
+#include <vector>
+
+#include <TSystem.h>
 
 #include "storage/storageo.h"
 #include "storage/storagei.h"
@@ -10,7 +13,89 @@
 #include "storage/cluster.h"
 #include "storage/hit.h"
 
+#define NCOLS 10
+#define NROWS 10
+
 int test_mask() {
+  {  // Write an event with a hit in each pixel of a 10x10 plane
+    Storage::StorageO store("tmp.root", 1, Storage::StorageIO::CLUSTERS |
+        Storage::StorageIO::TRACKS);
+    Storage::Event& event = store.newEvent();
+    for (int row = 0; row < NROWS; row++)
+      for (int col = 0; col < NCOLS; col++)
+        event.newHit(0).setPix(col, row);
+    store.writeEvent(event);
+  }
+
+  // Mask pixels on either side of a word boundary, and one with col != row
+  std::vector<bool> mask(NCOLS*NROWS, false);
+  mask[63] = true;  // (3, 6)
+  mask[64] = true;  // (4, 6)
+  mask[2*NCOLS+7] = true;  // (7, 2)
+
+  {  // Packed look up
+    Storage::StorageI store("tmp.root", Storage::StorageIO::CLUSTERS |
+        Storage::StorageIO::TRACKS);
+    store.setNoiseMask(0, mask, NCOLS, NROWS);
+    const Storage::StorageIO::NoiseMask& packed = store.getNoiseMask(0);
+    if (packed.words.size() != 2 ||
+        !packed.at(3, 6) || !packed.at(4, 6) || !packed.at(7, 2) ||
+        packed.at(2, 7) || packed.at(5, 6)) {
+      std::cerr << "Storage::StorageIO: noise mask packing failed" << std::endl;
+      return -1;
+    }
+  }
+
+  {  // Remove masked hits
+    Storage::StorageI store("tmp.root", Storage::StorageIO::CLUSTERS |
+        Storage::StorageIO::TRACKS);
+    store.setNoiseMask(0, mask, NCOLS, NROWS);
+    Storage::Event& event = store.readEvent(0);
+    if (event.getNumHits() != NCOLS*NROWS-3) {
+      std::cerr << "Storage::StorageI: masked hits not removed" << std::endl;
+      return -1;
+    }
+    for (size_t i = 0; i < event.getNumHits(); i++) {
+      const Storage::Hit& hit = event.getHit(i);
+      if (mask[hit.getPixY()*NCOLS+hit.getPixX()] || hit.getMasked()) {
+        std::cerr << "Storage::StorageI: masked hit was read" << std::endl;
+        return -1;
+      }
+    }
+  }
+
+  {  // Flag masked hits
+    Storage::StorageI store("tmp.root", Storage::StorageIO::CLUSTERS |
+        Storage::StorageIO::TRACKS);
+    store.setNoiseMask(0, mask, NCOLS, NROWS);
+    store.setMaskMode(Storage::StorageIO::PASSIVE);
+    Storage::Event& event = store.readEvent(0);
+    if (event.getNumHits() != NCOLS*NROWS) {
+      std::cerr << "Storage::StorageI: passive mask removed hits" << std::endl;
+      return -1;
+    }
+    for (size_t i = 0; i < event.getNumHits(); i++) {
+      const Storage::Hit& hit = event.getHit(i);
+      if (mask[hit.getPixY()*NCOLS+hit.getPixX()] != hit.getMasked()) {
+        std::cerr << "Storage::StorageI: masked hit not flagged" << std::endl;
+        return -1;
+      }
+    }
+  }
+
+  {  // A mask which doesn't match the plane is rejected
+    Storage::StorageI store("tmp.root", Storage::StorageIO::CLUSTERS |
+        Storage::StorageIO::TRACKS);
+    bool caught = false;
+    try { store.setNoiseMask(0, mask, NCOLS, NROWS+1); }
+    catch (std::runtime_error& e) { caught = true; }
+    if (!caught) {
+      std::cerr << "Storage::StorageIO: accepted a mismatched mask" << std::endl;
+      return -1;
+    }
+  }
+
+  gSystem->Exec("rm -f tmp.root");
   return 0;
 }
 
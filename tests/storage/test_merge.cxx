@@ -0,0 +1,167 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <TSystem.h>
+#include "storage/storageo.h"
+#include "storage/storagei.h"
+#include "storage/event.h"
+#include "storage/track.h"
+#include "storage/plane.h"
+#include "storage/cluster.h"
+#include "storage/hit.h"
+#include "storage/merge.h"
+
+#define NPLANES 2
+#define NEVENTS 10
+
+// Write events [first, last) to a file, as a processing shard would
+void writeShard(const std::string& path, size_t first, size_t last) {
+  Storage::StorageO store(path, NPLANES);
+
+  for (size_t n = first; n < last; n++) {
+    Storage::Event& event = store.newEvent();
+    event.setTimeStamp(n);
+
+    // Some events are empty, others have a few hits
+    for (size_t i = 0; i < n%3; i++) {
+      Storage::Hit& hit = event.newHit(n%NPLANES);
+      hit.setPix(n, i);
+      hit.setValue(n+i);
+      Storage::Cluster& cluster = event.newCluster(n%NPLANES);
+      cluster.setPix(n, i);
+      cluster.addHit(hit);
+    }
+
+    if (n%2) {
+      Storage::Track& track = event.newTrack();
+      track.setOrigin(.1*n, .2*n);
+      track.setChi2(n);
+    }
+
+    store.writeEvent(event);
+  }
+}
+
+// Check that the merged file has the events in order, with their content
+int checkMerged(const std::string& path) {
+  Storage::StorageI store(path);
+
+  if (store.getNumEvents() != NEVENTS || store.getNumPlanes() != NPLANES) {
+    std::cerr << "Storage::mergeFiles: wrong number of events" << std::endl;
+    return -1;
+  }
+
+  for (Long64_t n = 0; n < NEVENTS; n++) {
+    const Storage::Event& event = store.readEvent(n);
+    bool good = event.getTimeStamp() == (ULong64_t)n;
+    const Storage::Plane& plane = event.getPlane(n%NPLANES);
+    good &= plane.getNumHits() == (size_t)(n%3);
+    good &= plane.getNumClusters() == (size_t)(n%3);
+    for (size_t i = 0; i < plane.getNumHits() && good; i++) {
+      good &= plane.getHit(i).getPixX() == n;
+      good &= plane.getHit(i).getPixY() == (int)i;
+      good &= plane.getHit(i).getValue() == (int)(n+i);
+      good &= plane.getHit(i).fetchCluster() == &plane.getCluster(i);
+    }
+    good &= event.getNumTracks() == (size_t)(n%2);
+    if (event.getNumTracks())
+      good &= event.getTrack(0).getChi2() == n;
+    if (!good) {
+      std::cerr << "Storage::mergeFiles: event " << n << " doesn't match"
+          << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int test_merge() {
+  std::vector<std::string> shards;
+  shards.push_back("tmp_shard0.root");
+  shards.push_back("tmp_shard1.root");
+  shards.push_back("tmp_shard2.root");
+
+  writeShard(shards[0], 0, 3);
+  writeShard(shards[1], 3, 7);
+  writeShard(shards[2], 7, NEVENTS);
+
+  Storage::mergeFiles(shards, "tmp_merged.root");
+  return checkMerged("tmp_merged.root");
+}
+
+int test_mergeFast() {
+  std::vector<std::string> shards;
+  shards.push_back("tmp_shard0.root");
+  shards.push_back("tmp_shard1.root");
+  shards.push_back("tmp_shard2.root");
+
+  Storage::mergeFiles(shards, "tmp_merged.root", true);
+  return checkMerged("tmp_merged.root");
+}
+
+int test_mergeMismatch() {
+  // Without tracks, the trees don't match the other shards
+  {
+    Storage::StorageO store(
+        "tmp_notracks.root", NPLANES, Storage::StorageIO::TRACKS);
+    store.writeEvent(store.newEvent());
+  }
+
+  std::vector<std::string> shards;
+  shards.push_back("tmp_shard0.root");
+  shards.push_back("tmp_notracks.root");
+
+  bool thrown = false;
+  try {
+    Storage::mergeFiles(shards, "tmp_merged.root");
+  }
+  catch (std::runtime_error& e) {
+    thrown = true;
+  }
+
+  if (!thrown) {
+    std::cerr << "Storage::mergeFiles: merged different trees" << std::endl;
+    return -1;
+  }
+
+  // Likewise when the first input is the one missing a tree
+  shards[0] = "tmp_notracks.root";
+  shards[1] = "tmp_shard0.root";
+  thrown = false;
+  try {
+    Storage::mergeFiles(shards, "tmp_merged.root", true);
+  }
+  catch (std::runtime_error& e) {
+    thrown = true;
+  }
+
+  if (!thrown) {
+    std::cerr << "Storage::mergeFiles: merged into missing trees" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_merge()) != 0) return retval;
+    if ((retval = test_mergeFast()) != 0) return retval;
+    if ((retval = test_mergeMismatch()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  // Remove files on success, otherwise keep them so they can be consulted
+  gSystem->Exec("rm -f tmp_shard0.root tmp_shard1.root tmp_shard2.root");
+  gSystem->Exec("rm -f tmp_merged.root tmp_notracks.root");
+
+  return 0;
+}
@@ -47,11 +47,62 @@ int test_plane() {
   return 0;
 }
 
+int test_planeRows() {
+  Storage::Event event(1);
+  Storage::Plane& plane = event.getPlane(0);
+
+  // Rows 2 (two hits), 3 (none) and 4 (one hit)
+  event.newHit(0).setPix(1, 2);
+  event.newHit(0).setPix(5, 2);
+  event.newHit(0).setPix(0, 4);
+
+  size_t first = 0;
+  size_t last = 0;
+  if (!plane.indexRows() || !plane.isSorted()) {
+    std::cerr << "Storage::Plane: sorted hits not indexed" << std::endl;
+    return -1;
+  }
+
+  bool good = true;
+  plane.getRowRange(2, first, last);
+  good &= first == 0 && last == 2;
+  plane.getRowRange(3, first, last);
+  good &= first == last;
+  plane.getRowRange(4, first, last);
+  good &= first == 2 && last == 3;
+  plane.getRowRange(1, first, last);
+  good &= first == last;
+  plane.getRowRange(5, first, last);
+  good &= first == last;
+  if (!good) {
+    std::cerr << "Storage::Plane: row ranges failed" << std::endl;
+    return -1;
+  }
+
+  // A new hit out of order drops the index, and it can't be rebuilt
+  event.newHit(0).setPix(3, 2);
+  if (plane.isSorted() || plane.indexRows()) {
+    std::cerr << "Storage::Plane: unsorted hits indexed" << std::endl;
+    return -1;
+  }
+
+  bool thrown = false;
+  try { plane.getRowRange(2, first, last); }
+  catch (std::runtime_error& e) { thrown = true; }
+  if (!thrown) {
+    std::cerr << "Storage::Plane: row range without index" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
 int main() {
   int retval = 0;
 
   try {
     if ((retval = test_plane()) != 0) return retval;
+    if ((retval = test_planeRows()) != 0) return retval;
   }
   
   catch (std::exception& e) {
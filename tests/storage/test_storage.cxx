@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <cmath>
 #include <set>
+#include <vector>
 
 #include <TSystem.h>
 
@@ -315,6 +316,15 @@ int test_storageioRead() {
       std::cerr << "Storage::StorageI: hit read back incorrect" << std::endl;
       return -1;
     }
+
+    // The first hit, cluster and track are linked as they were written
+    if (hit.fetchCluster() != &cluster ||
+        cluster.fetchTrack() != &track ||
+        track.getNumClusters() != 1 ||
+        &track.getCluster(0) != &cluster) {
+      std::cerr << "Storage::StorageI: associations read back incorrect" << std::endl;
+      return -1;
+    }
   }
 
   return 0;
@@ -479,6 +489,288 @@ int test_storageioReadMasking() {
   return 0;
 }
 
+int test_storageioReadWindow() {
+  {  // Pixel and timing windows
+    // Clusters aren't read, so that removing their hits is allowed
+    Storage::StorageI store(
+        "tmp.root",
+        Storage::StorageIO::CLUSTERS | Storage::StorageIO::TRACKS);
+
+    // Event n has a hit at (n+1, 2n+1) with timing n+1
+    Storage::StorageI::HitWindow window;
+    window.minPixX = 1;
+    window.maxPixX = 2;
+    window.minTiming = 2;
+    store.setHitWindow(0, window);
+
+    // First event fails the timing window, second passes both
+    if (store.readEvent(0).getNumHits() != 0 ||
+        store.readEvent(1).getNumHits() != 1) {
+      std::cerr << "Storage::StorageI: hit window failed" << std::endl;
+      return -1;
+    }
+
+    window.maxPixY = 2;
+    store.setHitWindow(0, window);
+
+    if (store.readEvent(1).getNumHits() != 0) {
+      std::cerr << "Storage::StorageI: hit window failed" << std::endl;
+      return -1;
+    }
+  }
+
+  {  // Windowing a clustered hit is an error
+    Storage::StorageI store("tmp.root");
+
+    Storage::StorageI::HitWindow window;
+    window.minTiming = 2;
+    store.setHitWindow(0, window);
+
+    bool caught = false;
+    try { store.readEvent(0); }
+    catch (std::runtime_error& e) { caught = true; }
+    if (!caught) {
+      std::cerr << "Storage::StorageI: windowed out a clustered hit" << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int test_storageioReadCalibration() {
+  // Clusters aren't read, hit values are then free to be calibrated
+  Storage::StorageI store(
+      "tmp.root",
+      Storage::StorageIO::CLUSTERS | Storage::StorageIO::TRACKS);
+
+  // Quadratic calibration of 4x4 pixels, the constant term is the pixel
+  // index: charge = index + v/2 + v^2/4
+  const Int_t size = 4;
+  const Int_t nterms = 3;
+  std::vector<float> table(size*size*nterms);
+  for (Int_t i = 0; i < size*size; i++) {
+    table[i*nterms] = i;
+    table[i*nterms+1] = .5;
+    table[i*nterms+2] = .25;
+  }
+  store.setCalibration(0, &table[0], size, size, nterms);
+
+  for (Int_t n = 0; n < store.getNumEvents(); n++) {
+    Storage::Event& event = store.readEvent(n);
+    // Event n has a hit at (n+1, 2n+1) with value 2n+1
+    const Int_t pixel = (2*n+1)*size + n+1;
+    const double value = 2*n+1;
+    if (!approxEqual(event.getHit(0).getCharge(),
+            pixel + .5*value + .25*value*value) ||
+        event.getHit(0).getValue() != 2*n+1) {
+      std::cerr << "Storage::StorageI: hit calibration failed" << std::endl;
+      return -1;
+    }
+  }
+
+  {  // Writing keeps the raw value, and stores the charge apart
+    Storage::StorageO output(
+        "tmp_calibrated.root", 1,
+        Storage::StorageIO::CLUSTERS | Storage::StorageIO::TRACKS);
+    for (Int_t n = 0; n < store.getNumEvents(); n++)
+      output.writeEvent(store.readEvent(n));
+  }
+
+  Storage::StorageI calibrated("tmp_calibrated.root");
+  for (Int_t n = 0; n < calibrated.getNumEvents(); n++) {
+    const Storage::Hit& hit = calibrated.readEvent(n).getHit(0);
+    const Int_t pixel = (2*n+1)*size + n+1;
+    const double value = 2*n+1;
+    if (hit.getValue() != 2*n+1 ||
+        !approxEqual(hit.getCharge(), pixel + .5*value + .25*value*value)) {
+      std::cerr << "Storage::StorageO: calibrated charge not written" << std::endl;
+      return -1;
+    }
+  }
+
+  // Uncalibrated hits have their values as charges
+  Storage::StorageI uncalibrated("tmp.root");
+  if (uncalibrated.readEvent(1).getHit(0).getCharge() != 3) {
+    std::cerr << "Storage::StorageI: wrong uncalibrated charge" << std::endl;
+    return -1;
+  }
+
+  // Hits outside of the table are an error
+  store.setCalibration(0, &table[0], 1, 1, nterms);
+  bool caught = false;
+  try { store.readEvent(1); }
+  catch (std::runtime_error& e) { caught = true; }
+  if (!caught) {
+    std::cerr << "Storage::StorageI: calibrated a hit outside the table" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_storageioReadDuplicate() {
+  std::set<std::string> hitsOff;
+  hitsOff.insert("Value");
+
+  Storage::StorageI store(
+      "tmp.root",
+      Storage::StorageIO::CLUSTERS | Storage::StorageIO::TRACKS,
+      0,
+      &hitsOff);
+
+  // Event n has a hit at (n+1, 2n+1) with timing n+1
+  Storage::StorageI::HitWindow window;
+  window.minTiming = 2;
+  store.setHitWindow(0, window);
+
+  Storage::StorageI* copy = store.duplicate();
+
+  bool good =
+      copy->getNumEvents() == store.getNumEvents() &&
+      copy->getNumPlanes() == store.getNumPlanes() &&
+      copy->isHitsBranchOff("Value") &&
+      !copy->isHitsBranchOff("Timing");
+
+  // Reading one input doesn't change the events of the other
+  for (Int_t n = 0; n < store.getNumEvents() && good; n++) {
+    const size_t nhits = store.readEvent(n).getNumHits();
+    const Storage::Event& event = copy->readEvent(n);
+    good &= event.getNumHits() == nhits;
+    good &= event.getNumHits() == (n >= 1 ? 1 : 0);  // window applies
+    good &= event.getTimeStamp() == (ULong64_t)n;
+    good &= store.readEvent(n).getNumHits() == nhits;
+  }
+
+  delete copy;
+
+  if (!good) {
+    std::cerr << "Storage::StorageI: duplicate reads different events" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_storageioReadInto() {
+  Storage::StorageI store("tmp.root");
+
+  // Keep all events at once, each in its own event object
+  std::vector<Storage::Event*> events;
+  for (Int_t n = 0; n < store.getNumEvents(); n++) {
+    events.push_back(new Storage::Event(store.getNumPlanes()));
+    store.readEvent(n, *events.back());
+  }
+
+  bool good = true;
+  for (Int_t n = 0; n < store.getNumEvents(); n++) {
+    const Storage::Event& event = store.readEvent(n);
+    good &= events[n]->getTimeStamp() == event.getTimeStamp();
+    good &= events[n]->getNumHits() == event.getNumHits();
+    good &= events[n]->getNumClusters() == event.getNumClusters();
+    good &= events[n]->getNumTracks() == event.getNumTracks();
+  }
+
+  // A filled event must be reset before it is read into again
+  bool thrown = false;
+  try { store.readEvent(0, *events.back()); }
+  catch (std::runtime_error& e) { thrown = true; }
+  good &= thrown || events.back()->getNumHits() == 0;
+
+  events.back()->reset();
+  good &= events.back()->getNumHits() == 0;
+  store.readEvent(0, *events.back());
+  good &= events.back()->getNumHits() == store.readEvent(0).getNumHits();
+
+  // The storage's own event is re-used, and can't be reset
+  thrown = false;
+  try { store.readEvent(0).reset(); }
+  catch (std::runtime_error& e) { thrown = true; }
+  good &= thrown;
+
+  for (size_t i = 0; i < events.size(); i++) delete events[i];
+
+  if (!good) {
+    std::cerr << "Storage::StorageI: reading into events failed" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_storageioReadSorted() {
+  // Hits in reverse order, the second and fourth in a cluster
+  const Int_t pixX[] = { 2, 7, 1, 4, 3 };
+  const Int_t pixY[] = { 9, 5, 5, -1, 5 };
+  const Int_t nhits = 5;
+
+  {
+    Storage::StorageO store("tmpsort.root", 1);
+    Storage::Event& event = store.newEvent();
+    Storage::Cluster& cluster = event.newCluster(0);
+    for (Int_t i = 0; i < nhits; i++) {
+      Storage::Hit& hit = event.newHit(0);
+      hit.setPix(pixX[i], pixY[i]);
+      hit.setValue(i);
+      if (i == 1 || i == 3) cluster.addHit(hit);
+    }
+    store.writeEvent(event);
+  }
+
+  {
+    Storage::StorageI store("tmpsort.root");
+    store.setSortHits(true);
+    if (store.isFileSorted()) {
+      std::cerr << "Storage::StorageI: unsorted file flagged" << std::endl;
+      return -1;
+    }
+
+    // Values give the original index of each hit in row-major order
+    const Int_t order[] = { 3, 2, 4, 1, 0 };
+    Storage::Event& event = store.readEvent(0);
+    bool good = event.getPlane(0).isSorted() &&
+        (Int_t)event.getNumHits() == nhits;
+    for (Int_t i = 0; i < nhits && good; i++)
+      good &= event.getHit(i).getValue() == order[i];
+
+    // The cluster keeps the same hits
+    const Storage::Cluster& cluster = event.getCluster(0);
+    good &= cluster.getNumHits() == 2;
+    for (size_t i = 0; i < cluster.getNumHits() && good; i++) {
+      const double value = cluster.getHit(i).getValue();
+      good &= value == 1 || value == 3;
+    }
+
+    size_t first = 0;
+    size_t last = 0;
+    event.getPlane(0).getRowRange(5, first, last);
+    good &= first == 1 && last == 4;
+
+    if (!good) {
+      std::cerr << "Storage::StorageI: sorted hits read back incorrect" << std::endl;
+      return -1;
+    }
+
+    // Writing the sorted events flags the new file
+    Storage::StorageO output("tmpsort2.root", 1);
+    output.writeEvent(event);
+  }
+
+  {
+    Storage::StorageI store("tmpsort2.root");
+    store.setSortHits(true);
+    const Storage::Event& event = store.readEvent(0);
+    if (!store.isFileSorted() || !event.getPlane(0).isSorted() ||
+        event.getHit(0).getValue() != 3) {
+      std::cerr << "Storage::StorageO: sorted file not flagged" << std::endl;
+      return -1;
+    }
+  }
+
+  gSystem->Exec("rm -f tmpsort.root tmpsort2.root");
+  return 0;
+}
+
 // TODO test masking on write
 
 int main() {
@@ -489,6 +781,11 @@ int main() {
     if ((retval = test_storageioWrite()) != 0) return retval;
     if ((retval = test_storageioRead()) != 0) return retval;
     if ((retval = test_storageioReadMasking()) != 0) return retval;
+    if ((retval = test_storageioReadWindow()) != 0) return retval;
+    if ((retval = test_storageioReadCalibration()) != 0) return retval;
+    if ((retval = test_storageioReadDuplicate()) != 0) return retval;
+    if ((retval = test_storageioReadInto()) != 0) return retval;
+    if ((retval = test_storageioReadSorted()) != 0) return retval;
   }
   
   catch (std::exception& e) {
@@ -497,7 +794,7 @@ int main() {
   }
 
   // Remove file on success, otherwise keep it so it can be consulted
-  gSystem->Exec("rm -f tmp.root");
+  gSystem->Exec("rm -f tmp.root tmp_calibrated.root");
 
   return 0;
 }
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <vector>
+#include <utility>
+
+#include <TSystem.h>
+
+#include "storage/storageo.h"
+#include "storage/storageds.h"
+#include "storage/event.h"
+#include "storage/track.h"
+#include "storage/plane.h"
+#include "storage/cluster.h"
+#include "storage/hit.h"
+
+#define NPLANES 2
+#define NEVENTS 5
+
+bool approxEqual(double v1, double v2, double tol=1E-10) {
+  return std::fabs(v1-v2) < tol;
+}
+
+int test_storagedsWrite() {
+  Storage::StorageO store("tmp.root", NPLANES);
+
+  // Event n has n clusters on plane 1, the first in a track, and none on
+  // plane 0
+  for (size_t n = 0; n < NEVENTS; n++) {
+    Storage::Event& event = store.newEvent();
+    event.setTimeStamp(10*n);
+
+    Storage::Track& track = event.newTrack();
+    track.setOrigin(.1*n, .2*n);
+    track.setChi2(n);
+
+    for (size_t i = 0; i < n; i++) {
+      Storage::Hit& hit = event.newHit(1);
+      hit.setPix(i, n);
+      Storage::Cluster& cluster = event.newCluster(1);
+      cluster.setPix(i, n);
+      cluster.addHit(hit);
+      if (i == 0) track.addCluster(cluster);
+    }
+
+    store.writeEvent(event);
+  }
+
+  return 0;
+}
+
+int test_storagedsColumns() {
+  Storage::StorageDS source("tmp.root");
+
+  if (!source.HasColumn("TimeStamp") ||
+      !source.HasColumn("Plane0_ClusterPixX") ||
+      !source.HasColumn("Plane1_ClusterInTrack") ||
+      !source.HasColumn("Track_Chi2") ||
+      source.HasColumn("Plane2_ClusterPixX")) {
+    std::cerr << "Storage::StorageDS: columns not as expected" << std::endl;
+    return -1;
+  }
+
+  if (source.GetTypeName("Plane1_ClusterPixX") != "std::vector<double>" ||
+      source.GetTypeName("Plane1_ClusterInTrack") != "std::vector<int>" ||
+      source.GetTypeName("TimeStamp") != "ULong64_t") {
+    std::cerr << "Storage::StorageDS: column types not as expected" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_storagedsRead() {
+  Storage::StorageDS source("tmp.root");
+  const unsigned nslots = 2;
+  source.SetNSlots(nslots);
+
+  std::vector<ULong64_t**> timeStamps =
+      source.GetColumnReaders<ULong64_t>("TimeStamp");
+  std::vector<std::vector<double>**> pixX =
+      source.GetColumnReaders<std::vector<double> >("Plane1_ClusterPixX");
+  std::vector<std::vector<int>**> inTrack =
+      source.GetColumnReaders<std::vector<int> >("Plane1_ClusterInTrack");
+  std::vector<std::vector<double>**> chi2 =
+      source.GetColumnReaders<std::vector<double> >("Track_Chi2");
+
+  bool caught = false;
+  try { source.GetColumnReaders<int>("TimeStamp"); }
+  catch (std::runtime_error& e) { caught = true; }
+  if (!caught) {
+    std::cerr << "Storage::StorageDS: accepted the wrong column type" << std::endl;
+    return -1;
+  }
+
+  source.Initialise();
+
+  // Ranges must cover all events once
+  std::vector<std::pair<ULong64_t, ULong64_t> > ranges =
+      source.GetEntryRanges();
+  if (ranges.size() != nslots || !source.GetEntryRanges().empty()) {
+    std::cerr << "Storage::StorageDS: entry ranges not as expected" << std::endl;
+    return -1;
+  }
+
+  ULong64_t next = 0;
+  for (size_t irange = 0; irange < ranges.size(); irange++) {
+    if (ranges[irange].first != next) {
+      std::cerr << "Storage::StorageDS: entry ranges not contiguous" << std::endl;
+      return -1;
+    }
+    next = ranges[irange].second;
+
+    // Read the range in its own slot
+    const unsigned slot = irange;
+    for (ULong64_t n = ranges[irange].first; n < ranges[irange].second; n++) {
+      source.SetEntry(slot, n);
+      const std::vector<double>& x = **pixX[slot];
+      const std::vector<int>& tracks = **inTrack[slot];
+      const std::vector<double>& chi = **chi2[slot];
+      if (**timeStamps[slot] != 10*n ||
+          x.size() != n || tracks.size() != n ||
+          chi.size() != 1 || !approxEqual(chi[0], n)) {
+        std::cerr << "Storage::StorageDS: entry read back incorrect" << std::endl;
+        return -1;
+      }
+      for (size_t i = 0; i < n; i++) {
+        if (!approxEqual(x[i], i) || tracks[i] != (i == 0 ? 0 : -1)) {
+          std::cerr << "Storage::StorageDS: clusters read back incorrect" << std::endl;
+          return -1;
+        }
+      }
+    }
+  }
+
+  if (next != NEVENTS) {
+    std::cerr << "Storage::StorageDS: entry ranges don't cover the file" << std::endl;
+    return -1;
+  }
+
+  source.Finalise();
+
+  gSystem->Exec("rm -f tmp.root");
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_storagedsWrite()) != 0) return retval;
+    if ((retval = test_storagedsColumns()) != 0) return retval;
+    if ((retval = test_storagedsRead()) != 0) return retval;
+  }
+  
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,202 @@
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <vector>
+
+#include <TSystem.h>
+#include <TFile.h>
+#include <TTree.h>
+
+#include "storage/event.h"
+#include "storage/track.h"
+#include "storage/plane.h"
+#include "storage/cluster.h"
+#include "storage/hit.h"
+#include "storage/trackntuple.h"
+
+#define NPLANES 3
+
+bool approxEqual(double v1, double v2, double tol=1E-10) {
+  return std::fabs(v1-v2) < tol;
+}
+
+int test_trackntupleWrite() {
+  Storage::TrackNtuple ntuple("tmp.root", NPLANES);
+
+  Storage::Event event(NPLANES);
+  event.setTimeStamp(42);
+
+  // Track with slope 0.1 in x through planes 0 and 2, with a cluster of two
+  // hits on plane 0
+  Storage::Track& track = event.newTrack();
+  track.setOrigin(1, 2);
+  track.setOriginErr(.1, .2);
+  track.setSlope(.1, 0);
+  track.setSlopeErr(.01, .02);
+  track.setCovariance(.3, .4);
+  track.setChi2(3);
+
+  Storage::Cluster& cluster0 = event.newCluster(0);
+  cluster0.setPix(4, 5);
+  cluster0.setPos(1, 2.5, 0);
+  cluster0.setValue(6);
+  cluster0.addHit(event.newHit(0));
+  cluster0.addHit(event.newHit(0));
+  track.addCluster(cluster0);
+
+  Storage::Cluster& cluster2 = event.newCluster(2);
+  cluster2.setPix(7, 8);
+  cluster2.setPos(3.5, 2, 20);
+  cluster2.setValue(9);
+  cluster2.addHit(event.newHit(2));
+  track.addCluster(cluster2);
+
+  // Cluster on plane 1 which isn't in the track
+  event.newCluster(1).setPos(2, 2, 10);
+
+  // Second track without clusters
+  event.newTrack();
+
+  ntuple.fill(event, 7);
+
+  if (ntuple.getNumEntries() != 2) {
+    std::cerr << "Storage::TrackNtuple: wrong number of entries" << std::endl;
+    return -1;
+  }
+
+  // Event with the wrong number of planes is rejected
+  Storage::Event wrong(NPLANES+1);
+  bool caught = false;
+  try { ntuple.fill(wrong, 8); }
+  catch (std::runtime_error& e) { caught = true; }
+  if (!caught) {
+    std::cerr << "Storage::TrackNtuple: accepted the wrong planes" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_trackntupleRead() {
+  TFile file("tmp.root", "READ");
+  TTree* tree = 0;
+  file.GetObject("TrackNtuple", tree);
+  if (!tree) {
+    std::cerr << "Storage::TrackNtuple: tree not written" << std::endl;
+    return -1;
+  }
+
+  ULong64_t event = 0;
+  ULong64_t timeStamp = 0;
+  Int_t trackIndex = 0;
+  Int_t numTracks = 0;
+  Int_t numClusters = 0;
+  Double_t origin[2];
+  Double_t originErr[2];
+  Double_t slope[2];
+  Double_t slopeErr[2];
+  Double_t covariance[2];
+  Double_t chi2 = 0;
+  Double_t pixX[NPLANES];
+  Double_t pixY[NPLANES];
+  Double_t posX[NPLANES];
+  Double_t posY[NPLANES];
+  Double_t posZ[NPLANES];
+  Double_t value[NPLANES];
+  Int_t size[NPLANES];
+  Double_t residualX[NPLANES];
+  Double_t residualY[NPLANES];
+  tree->SetBranchAddress("Event", &event);
+  tree->SetBranchAddress("TimeStamp", &timeStamp);
+  tree->SetBranchAddress("TrackIndex", &trackIndex);
+  tree->SetBranchAddress("NTracks", &numTracks);
+  tree->SetBranchAddress("OriginX", &origin[0]);
+  tree->SetBranchAddress("OriginY", &origin[1]);
+  tree->SetBranchAddress("OriginErrX", &originErr[0]);
+  tree->SetBranchAddress("OriginErrY", &originErr[1]);
+  tree->SetBranchAddress("SlopeX", &slope[0]);
+  tree->SetBranchAddress("SlopeY", &slope[1]);
+  tree->SetBranchAddress("SlopeErrX", &slopeErr[0]);
+  tree->SetBranchAddress("SlopeErrY", &slopeErr[1]);
+  tree->SetBranchAddress("CovarianceX", &covariance[0]);
+  tree->SetBranchAddress("CovarianceY", &covariance[1]);
+  tree->SetBranchAddress("Chi2", &chi2);
+  tree->SetBranchAddress("NClusters", &numClusters);
+  tree->SetBranchAddress("ClusterPixX", pixX);
+  tree->SetBranchAddress("ClusterPixY", pixY);
+  tree->SetBranchAddress("ClusterPosX", posX);
+  tree->SetBranchAddress("ClusterPosY", posY);
+  tree->SetBranchAddress("ClusterPosZ", posZ);
+  tree->SetBranchAddress("ClusterValue", value);
+  tree->SetBranchAddress("ClusterSize", size);
+  tree->SetBranchAddress("ResidualX", residualX);
+  tree->SetBranchAddress("ResidualY", residualY);
+
+  if (tree->GetEntries() != 2) {
+    std::cerr << "Storage::TrackNtuple: wrong number of entries read" << std::endl;
+    return -1;
+  }
+
+  tree->GetEntry(0);
+  if (event != 7 || timeStamp != 42 || trackIndex != 0 || numTracks != 2 ||
+      numClusters != 2 ||
+      !approxEqual(origin[0], 1) || !approxEqual(origin[1], 2) ||
+      !approxEqual(originErr[0], .1) || !approxEqual(originErr[1], .2) ||
+      !approxEqual(slope[0], .1) || !approxEqual(slope[1], 0) ||
+      !approxEqual(slopeErr[0], .01) || !approxEqual(slopeErr[1], .02) ||
+      !approxEqual(covariance[0], .3) || !approxEqual(covariance[1], .4) ||
+      !approxEqual(chi2, 3)) {
+    std::cerr << "Storage::TrackNtuple: track read back incorrect" << std::endl;
+    return -1;
+  }
+
+  if (!approxEqual(pixX[0], 4) || !approxEqual(pixY[0], 5) ||
+      !approxEqual(posX[0], 1) || !approxEqual(posY[0], 2.5) ||
+      !approxEqual(posZ[0], 0) || !approxEqual(value[0], 6) || size[0] != 2 ||
+      !approxEqual(pixX[2], 7) || !approxEqual(pixY[2], 8) ||
+      !approxEqual(posX[2], 3.5) || !approxEqual(posY[2], 2) ||
+      !approxEqual(posZ[2], 20) || !approxEqual(value[2], 9) || size[2] != 1) {
+    std::cerr << "Storage::TrackNtuple: clusters read back incorrect" << std::endl;
+    return -1;
+  }
+
+  // Plane 1's cluster isn't in the track so the plane is empty
+  if (size[1] != 0 || !approxEqual(posX[1], 0) || !approxEqual(pixX[1], 0) ||
+      !approxEqual(residualX[1], 0)) {
+    std::cerr << "Storage::TrackNtuple: cluster not in track read back" << std::endl;
+    return -1;
+  }
+
+  // Track is at x = 1 + .1*z
+  if (!approxEqual(residualX[0], 0) || !approxEqual(residualY[0], .5) ||
+      !approxEqual(residualX[2], .5) || !approxEqual(residualY[2], 0)) {
+    std::cerr << "Storage::TrackNtuple: residuals read back incorrect" << std::endl;
+    return -1;
+  }
+
+  tree->GetEntry(1);
+  if (trackIndex != 1 || numClusters != 0 || size[0] != 0 ||
+      !approxEqual(residualX[2], 0)) {
+    std::cerr << "Storage::TrackNtuple: empty track read back incorrect" << std::endl;
+    return -1;
+  }
+
+  gSystem->Exec("rm -f tmp.root");
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_trackntupleWrite()) != 0) return retval;
+    if ((retval = test_trackntupleRead()) != 0) return retval;
+  }
+  
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
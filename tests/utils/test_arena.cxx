@@ -0,0 +1,104 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <list>
+#include <cstdint>
+
+#include "arena.h"
+
+int test_arenaAlign() {
+  Utils::Arena arena(64);
+
+  // Odd sizes in between to shift the offsets
+  for (size_t align = 1; align <= 64; align *= 2) {
+    arena.allocate(3, 1);
+    void* p = arena.allocate(10, align);
+    if (reinterpret_cast<uintptr_t>(p) % align != 0) {
+      std::cerr << "Utils: Arena: misaligned allocation" << std::endl;
+      return -1;
+    }
+  }
+
+  // Requests above the block size get a block of their own
+  char* big = static_cast<char*>(arena.allocate(1000, 8));
+  for (size_t i = 0; i < 1000; i++) big[i] = 1;
+
+  return 0;
+}
+
+int test_arenaReset() {
+  Utils::Arena arena(128);
+
+  // The first event needs many blocks
+  std::vector<char*> first;
+  for (size_t i = 0; i < 100; i++)
+    first.push_back(static_cast<char*>(arena.allocate(16, 8)));
+  if (arena.getNumBlocks() < 2) {
+    std::cerr << "Utils: Arena: didn't grow" << std::endl;
+    return -1;
+  }
+
+  // After a reset they are merged, and an event of the same size fits in
+  // the first block without any more blocks
+  arena.reset();
+  const size_t capacity = arena.getCapacity();
+  for (size_t ievent = 0; ievent < 5; ievent++) {
+    for (size_t i = 0; i < 100; i++) arena.allocate(16, 8);
+    if (arena.getNumBlocks() != 1 || arena.getCapacity() != capacity) {
+      std::cerr << "Utils: Arena: steady state allocated" << std::endl;
+      return -1;
+    }
+    arena.reset();
+  }
+
+  // Copies start empty
+  Utils::Arena copy(arena);
+  if (copy.getNumBlocks() != 0) {
+    std::cerr << "Utils: Arena: copied the scratch memory" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int test_arenaContainers() {
+  Utils::Arena arena(256);
+
+  Utils::ArenaVector<int> values(arena);
+  std::list<double, Utils::ArenaAllocator<double> > list(arena);
+  for (int i = 0; i < 1000; i++) {
+    values.push_back(i);
+    list.push_back(i*0.5);
+  }
+
+  int sum = 0;
+  for (size_t i = 0; i < values.size(); i++) sum += values[i];
+  double sumList = 0;
+  for (std::list<double, Utils::ArenaAllocator<double> >::iterator it =
+      list.begin(); it != list.end(); ++it)
+    sumList += *it;
+
+  if (sum != 999*1000/2 || sumList != 999*1000/4.) {
+    std::cerr << "Utils: Arena: containers lost values" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_arenaAlign()) != 0) return retval;
+    if ((retval = test_arenaReset()) != 0) return retval;
+    if ((retval = test_arenaContainers()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "threadpool.h"
+
+class CountTask : public Utils::ThreadPool::Task {
+public:
+  std::vector<int> counts;
+  CountTask(size_t nparts) : counts(nparts, 0) {}
+  void run(size_t i) { counts[i] += 1; }
+};
+
+class ThrowTask : public Utils::ThreadPool::Task {
+public:
+  void run(size_t i) {
+    if (i == 3) throw std::runtime_error("part 3 failed");
+  }
+};
+
+int test_runAll() {
+  Utils::ThreadPool pool(4);
+
+  // Many jobs in a row, so that threads join jobs at different times
+  for (size_t nparts = 0; nparts < 200; nparts++) {
+    CountTask task(nparts);
+    pool.run(task, nparts);
+    for (size_t i = 0; i < nparts; i++) {
+      if (task.counts[i] != 1) {
+        std::cerr << "Utils: ThreadPool: part not run exactly once" << std::endl;
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int test_error() {
+  Utils::ThreadPool pool(3);
+
+  ThrowTask task;
+  bool thrown = false;
+  try {
+    pool.run(task, 10);
+  }
+  catch (std::runtime_error& e) {
+    thrown = true;
+  }
+
+  if (!thrown) {
+    std::cerr << "Utils: ThreadPool: part exception not passed on" << std::endl;
+    return -1;
+  }
+
+  // The pool is still usable after an error
+  CountTask count(10);
+  pool.run(count, 10);
+  for (size_t i = 0; i < 10; i++) {
+    if (count.counts[i] != 1) {
+      std::cerr << "Utils: ThreadPool: failed after an error" << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int main() {
+  int retval = 0;
+
+  try {
+    if ((retval = test_runAll()) != 0) return retval;
+    if ((retval = test_error()) != 0) return retval;
+  }
+
+  catch (std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}